@@ -0,0 +1,313 @@
+/* Clustered light binning - Assign lights to view-space froxels on the CPU
+ *
+ * OVERVIEW: - The view frustum is cut into CLUSTER_X * CLUSTER_Y screen tiles
+ *   and CLUSTER_Z depth slices. Slices are spaced exponentially between the
+ *   near and far planes, so a fragment finds its slice with one log():
+ *   slice = log(depth) * depthScale + depthBias.
+ *
+ * - `clusterBuild()` bins every light of the light store into the cells its
+ *   influence sphere touches. The result is `cells`, one (offset, count) pair
+ *   per cell, pointing into the flat `indices` list of light IDs.
+ *
+ * - Slices are binned in parallel on the job system. A slice only ever writes
+ *   its own scratch list, so workers never contend.
+ *
+ * - A cell holds at most CLUSTER_MAX_CELL_LIGHTS lights, which bounds the
+ *   worst-case cost of a fragment.
+ */
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cglm/cglm.h"
+#include "common.h"
+#include "jobs.c"
+#include "lights.c"
+#include "stb_ds.h"
+
+enum : int {
+	CLUSTER_X = 16,
+	CLUSTER_Y = 9,
+	CLUSTER_Z = 24,
+	CLUSTER_TILES = CLUSTER_X * CLUSTER_Y,
+	CLUSTER_COUNT = CLUSTER_TILES * CLUSTER_Z,
+	CLUSTER_MAX_CELL_LIGHTS = 128,
+};
+
+/* View-space bounds of a light, with the range of cells they overlap. */
+typedef struct ClusterLightBounds {
+	vec3 center;
+	float radius;
+	int x0, x1;
+	int y0, y1;
+	int z0, z1;
+	bool visible;
+} ClusterLightBounds;
+
+typedef struct ClusterSlice {
+	uint32_t cells[CLUSTER_TILES][2];	/* Offset in `indices`, count */
+	uint32_t *indices;			/* stb_ds.h array */
+} ClusterSlice;
+
+struct ClusterGrid {
+	mat4 projection;	/* Projection the cell bounds were built for */
+	float near;
+	float far;
+	float depthScale;
+	float depthBias;
+
+	vec3 cellMin[CLUSTER_COUNT];
+	vec3 cellMax[CLUSTER_COUNT];
+
+	ClusterLightBounds *bounds;	/* stb_ds.h array, one per light */
+	ClusterSlice slices[CLUSTER_Z];
+
+	/* Output */
+	uint32_t cells[CLUSTER_COUNT][2];	/* Offset in `indices`, count */
+	uint32_t *indices;			/* stb_ds.h array */
+};
+
+struct ClusterGrid clusters;
+
+int clusterCellIndex(int x, int y, int z)
+{
+	return (z * CLUSTER_Y + y) * CLUSTER_X + x;
+}
+
+float clusterSliceDepth(int z)
+{
+	return clusters.near * powf(clusters.far / clusters.near,
+				    (float)z / (float)CLUSTER_Z);
+}
+
+int clusterClamp(int value, int count)
+{
+	return value < 0 ? 0 : (value >= count ? count - 1 : value);
+}
+
+int clusterSliceOf(float depth)
+{
+	int z = (int)floorf(logf(depth) * clusters.depthScale
+			    + clusters.depthBias);
+	return clusterClamp(z, CLUSTER_Z);
+}
+
+/* Tile of an NDC coordinate along an axis with `tiles` tiles. */
+int clusterTileOf(float ndc, int tiles)
+{
+	return clusterClamp((int)floorf((ndc * 0.5f + 0.5f) * (float)tiles),
+			    tiles);
+}
+
+/* Rebuild the view-space AABB of every cell. Only needed when the projection
+ * changes, e.g. when zooming. */
+void clusterBuildCells(void)
+{
+	float xScale = 1.0f / clusters.projection[0][0];
+	float yScale = 1.0f / clusters.projection[1][1];
+
+	for (int z = 0; z < CLUSTER_Z; z++) {
+		float depths[2] = {
+			clusterSliceDepth(z),
+			clusterSliceDepth(z + 1),
+		};
+		for (int y = 0; y < CLUSTER_Y; y++) {
+			for (int x = 0; x < CLUSTER_X; x++) {
+				float ndcX[2] = {
+					-1.0f + 2.0f * (float)x / CLUSTER_X,
+					-1.0f + 2.0f * (float)(x + 1) / CLUSTER_X,
+				};
+				float ndcY[2] = {
+					-1.0f + 2.0f * (float)y / CLUSTER_Y,
+					-1.0f + 2.0f * (float)(y + 1) / CLUSTER_Y,
+				};
+
+				int cell = clusterCellIndex(x, y, z);
+				glm_vec3_broadcast(INFINITY,
+						   clusters.cellMin[cell]);
+				glm_vec3_broadcast(-INFINITY,
+						   clusters.cellMax[cell]);
+
+				for (int i = 0; i < 8; i++) {
+					float d = depths[i & 1];
+					vec3 corner = {
+						ndcX[(i >> 1) & 1] * d * xScale,
+						ndcY[(i >> 2) & 1] * d * yScale,
+						-d,
+					};
+					glm_vec3_minv(clusters.cellMin[cell],
+						      corner,
+						      clusters.cellMin[cell]);
+					glm_vec3_maxv(clusters.cellMax[cell],
+						      corner,
+						      clusters.cellMax[cell]);
+				}
+			}
+		}
+	}
+}
+
+/* Conservative cell range of a light's bounding sphere. */
+void clusterBoundLight(const Light *light, mat4 view, ClusterLightBounds *b)
+{
+	glm_mat4_mulv3(view, (float *)light->position, 1.0f, b->center);
+	b->radius = light->radius;
+
+	float nearest = -b->center[2] - b->radius;
+	float farthest = -b->center[2] + b->radius;
+	b->visible = b->radius > 0.0f && farthest > clusters.near
+		&& nearest < clusters.far;
+	if (!b->visible) {
+		return;
+	}
+
+	b->z0 = clusterSliceOf(fmaxf(nearest, clusters.near));
+	b->z1 = clusterSliceOf(fminf(farthest, clusters.far));
+
+	/* Project the corners of the sphere's bounding box. Corners behind the
+	 * near plane are pulled onto it, which only widens the result. */
+	vec2 ndcMin = {INFINITY, INFINITY};
+	vec2 ndcMax = {-INFINITY, -INFINITY};
+	for (int i = 0; i < 8; i++) {
+		float x = b->center[0] + (i & 1 ? b->radius : -b->radius);
+		float y = b->center[1] + (i & 2 ? b->radius : -b->radius);
+		float z = b->center[2] + (i & 4 ? b->radius : -b->radius);
+		float depth = fmaxf(-z, clusters.near);
+
+		vec2 ndc = {
+			x * clusters.projection[0][0] / depth,
+			y * clusters.projection[1][1] / depth,
+		};
+		glm_vec2_minv(ndcMin, ndc, ndcMin);
+		glm_vec2_maxv(ndcMax, ndc, ndcMax);
+	}
+
+	if (ndcMax[0] < -1.0f || ndcMin[0] > 1.0f
+	    || ndcMax[1] < -1.0f || ndcMin[1] > 1.0f) {
+		b->visible = false;
+		return;
+	}
+
+	b->x0 = clusterTileOf(ndcMin[0], CLUSTER_X);
+	b->x1 = clusterTileOf(ndcMax[0], CLUSTER_X);
+	b->y0 = clusterTileOf(ndcMin[1], CLUSTER_Y);
+	b->y1 = clusterTileOf(ndcMax[1], CLUSTER_Y);
+}
+
+bool clusterSphereTouchesCell(const ClusterLightBounds *b, int cell)
+{
+	vec3 closest;
+	glm_vec3_maxv((float *)b->center, clusters.cellMin[cell], closest);
+	glm_vec3_minv(closest, clusters.cellMax[cell], closest);
+
+	return glm_vec3_distance2(closest, (float *)b->center)
+		<= b->radius * b->radius;
+}
+
+/* Job: bin every light overlapping slice `z` into the slice's scratch list. */
+void clusterBinSlice(int z, void *user)
+{
+	(void)user;
+	ClusterSlice *slice = &clusters.slices[z];
+	int32_t count = (int32_t)arrlen(clusters.bounds);
+
+	memset(slice->cells, 0, sizeof(slice->cells));
+	arrsetlen(slice->indices, 0);
+
+	/* Count, then fill, so each cell's lights end up contiguous. */
+	for (int32_t i = 0; i < count; i++) {
+		const ClusterLightBounds *b = &clusters.bounds[i];
+		if (!b->visible || z < b->z0 || z > b->z1) {
+			continue;
+		}
+		for (int y = b->y0; y <= b->y1; y++) {
+			for (int x = b->x0; x <= b->x1; x++) {
+				int tile = y * CLUSTER_X + x;
+				if (slice->cells[tile][1] < CLUSTER_MAX_CELL_LIGHTS
+				    && clusterSphereTouchesCell(
+					    b, clusterCellIndex(x, y, z))) {
+					slice->cells[tile][1]++;
+				}
+			}
+		}
+	}
+
+	uint32_t total = 0;
+	for (int tile = 0; tile < CLUSTER_TILES; tile++) {
+		slice->cells[tile][0] = total;
+		total += slice->cells[tile][1];
+		slice->cells[tile][1] = 0;
+	}
+	arrsetlen(slice->indices, total);
+
+	for (int32_t i = 0; i < count; i++) {
+		const ClusterLightBounds *b = &clusters.bounds[i];
+		if (!b->visible || z < b->z0 || z > b->z1) {
+			continue;
+		}
+		for (int y = b->y0; y <= b->y1; y++) {
+			for (int x = b->x0; x <= b->x1; x++) {
+				int tile = y * CLUSTER_X + x;
+				uint32_t *cell = slice->cells[tile];
+				if (cell[1] < CLUSTER_MAX_CELL_LIGHTS
+				    && clusterSphereTouchesCell(
+					    b, clusterCellIndex(x, y, z))) {
+					slice->indices[cell[0] + cell[1]] =
+						(uint32_t)i;
+					cell[1]++;
+				}
+			}
+		}
+	}
+}
+
+/* Bin the light store for this frame's camera. */
+void clusterBuild(mat4 view, mat4 projection, float near, float far)
+{
+	if (near != clusters.near || far != clusters.far
+	    || memcmp(projection, clusters.projection, sizeof(mat4)) != 0) {
+		glm_mat4_copy(projection, clusters.projection);
+		clusters.near = near;
+		clusters.far = far;
+		clusters.depthScale = (float)CLUSTER_Z / logf(far / near);
+		clusters.depthBias = -clusters.depthScale * logf(near);
+		clusterBuildCells();
+	}
+
+	int32_t count = lightCount();
+	arrsetlen(clusters.bounds, count);
+	for (int32_t i = 0; i < count; i++) {
+		clusterBoundLight(&lights[i], view, &clusters.bounds[i]);
+	}
+
+	jobsParallelFor(CLUSTER_Z, clusterBinSlice, nullptr);
+
+	/* Concatenate slices. */
+	arrsetlen(clusters.indices, 0);
+	for (int z = 0; z < CLUSTER_Z; z++) {
+		ClusterSlice *slice = &clusters.slices[z];
+		uint32_t base = (uint32_t)arrlen(clusters.indices);
+		for (int tile = 0; tile < CLUSTER_TILES; tile++) {
+			uint32_t *cell = clusters.cells[z * CLUSTER_TILES + tile];
+			cell[0] = base + slice->cells[tile][0];
+			cell[1] = slice->cells[tile][1];
+		}
+
+		ptrdiff_t sliceLength = arrlen(slice->indices);
+		if (sliceLength > 0) {
+			memcpy(arraddnptr(clusters.indices, sliceLength),
+			       slice->indices, sizeof(uint32_t) * sliceLength);
+		}
+	}
+}
+
+void clusterFree(void)
+{
+	arrfree(clusters.bounds);
+	arrfree(clusters.indices);
+	for (int z = 0; z < CLUSTER_Z; z++) {
+		arrfree(clusters.slices[z].indices);
+	}
+}
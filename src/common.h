@@ -14,6 +14,10 @@
 
 #define ALIGN(x) __attribute__((aligned(x)))
 
+#define CLAMP(X, MIN, MAX)					\
+	((X) >= (MAX) ? (MAX) : ((X) <= (MIN) ? (MIN) : (X)))
+#define ARRAY_COUNT_STATIC(array) (sizeof(array) / sizeof((array)[0]))
+
 #if defined(__builtin_expect)
 #define unlikely(expr) __builtin_expect(!!(expr), 0)
 #define likely(expr) __builtin_expect(!!(expr), 1)
@@ -28,22 +32,30 @@ typedef enum Error {
 	ERR_SHADER_CREATION_FAILED,
 	ERR_WINDOW_CREATION_FAILED,
 	ERR_TEXTURE_LOADING_FAILED,
+	ERR_MESH_LOADING_FAILED,
 	ERR_SCRIPT_LOADING_FAILED,
 	ERR_SCRIPT_INITIALIZATION_FAILED,
 	ERR_SCRIPT_UPDATE_FAILED,
 	ERR_SCRIPT_CLEANUP_FAILED,
+	ERR_OUT_OF_MEMORY,
 
 	/* OpenGL */
 	ERR_GLAD_INITIALIZATION_FAILED,
+	ERR_TRACE_LOADING_FAILED,
 
 	/* Vulkan */
+	ERR_BUFFER_CREATION_FAILED,
+	ERR_BUFFER_UPLOAD_FAILED,
 	ERR_COMMAND_BUFFER_ALLOCATION_FAILED,
 	ERR_COMMAND_BUFFER_DRAWING_FAILED,
 	ERR_COMMAND_BUFFER_RECORDING_FAILED,
 	ERR_COMMAND_POOL_CREATION_FAILED,
+	ERR_COMPUTE_PIPELINE_CREATION_FAILED,
 	ERR_DEBUG_MESSENGER_CREATION_FAILED,
+	ERR_DESCRIPTOR_SET_CREATION_FAILED,
 	ERR_FRAMEBUFFER_CREATION_FAILED,
 	ERR_GRAPHICS_PIPELINE_CREATION_FAILED,
+	ERR_IMAGE_CREATION_FAILED,
 	ERR_IMAGE_VIEW_CREATION_FAILED,
 	ERR_INSTANCE_CREATION_FAILED,
 	ERR_LOGICAL_DEVICE_CREATION_FAILED,
@@ -98,6 +110,8 @@ void printError(Error err)
 		= "window creation failed",
 		[ERR_TEXTURE_LOADING_FAILED]
 		= "texture loading failed",
+		[ERR_MESH_LOADING_FAILED]
+		= "mesh loading failed",
 		[ERR_SCRIPT_LOADING_FAILED]
 		= "script loading failed",
 		[ERR_SCRIPT_INITIALIZATION_FAILED]
@@ -106,12 +120,20 @@ void printError(Error err)
 		= "script update failed",
 		[ERR_SCRIPT_CLEANUP_FAILED]
 		= "script cleanup failed",
+		[ERR_OUT_OF_MEMORY]
+		= "out of memory",
 
 		/* OpenGL */
 		[ERR_GLAD_INITIALIZATION_FAILED]
 		= "GLAD initialization failed",
+		[ERR_TRACE_LOADING_FAILED]
+		= "trace loading failed",
 		
 		/* Vulkan */
+		[ERR_BUFFER_CREATION_FAILED]
+		= "buffer creation failed",
+		[ERR_BUFFER_UPLOAD_FAILED]
+		= "buffer upload failed",
 		[ERR_COMMAND_BUFFER_ALLOCATION_FAILED]
 		= "command buffer allocation failed",
 		[ERR_COMMAND_BUFFER_DRAWING_FAILED]
@@ -120,12 +142,18 @@ void printError(Error err)
 		= "command buffer recording failed",
 		[ERR_COMMAND_POOL_CREATION_FAILED]
 		= "command pool creation failed",
+		[ERR_COMPUTE_PIPELINE_CREATION_FAILED]
+		= "compute pipeline creation failed",
 		[ERR_DEBUG_MESSENGER_CREATION_FAILED]
 		= "debug messenger creation failed",
+		[ERR_DESCRIPTOR_SET_CREATION_FAILED]
+		= "descriptor set creation failed",
 		[ERR_FRAMEBUFFER_CREATION_FAILED]
 		= "framebuffer creation failed",
 		[ERR_GRAPHICS_PIPELINE_CREATION_FAILED]
 		= "graphics pipeline creation failed",
+		[ERR_IMAGE_CREATION_FAILED]
+		= "image creation failed",
 		[ERR_IMAGE_VIEW_CREATION_FAILED]
 		= "image view creation failed",
 		[ERR_INSTANCE_CREATION_FAILED]
@@ -0,0 +1,154 @@
+/* Dynamic resolution - Trade resolution for frame rate under load
+ *
+ * OVERVIEW: - With `--dynamic-resolution on`, the scene renders at a fraction
+ *   of the window size and is upscaled to it afterwards. Every frame,
+ *   `dynamicResolutionUpdate()` is fed the frame's measured GPU time and
+ *   steers that fraction so frames fit in `--frame-budget` milliseconds.
+ *
+ * - Times are averaged over `DYNAMIC_RESOLUTION_WINDOW` frames. Fragment cost
+ *   follows the pixel count, so the scale then moves by the square root of
+ *   the ratio between the budget, less some headroom, and the average.
+ *
+ * - The scale moves in whole `dynamicResolutionStep`s, rounded towards the
+ *   current one, so render targets are not reallocated over noise. It stays
+ *   within `--min-resolution-scale` and `--max-resolution-scale`, and starts
+ *   at the maximum. Timings arrive late, so those of the first
+ *   `DYNAMIC_RESOLUTION_LATENCY` frames after a change are dropped.
+ *
+ * USAGE:
+ * - dynamicResolutionInit();
+ * - // Every frame
+ * - int width = (int)(windowWidth * dynamicResolutionScale());
+ * - dynamicResolutionUpdate(gpuMilliseconds);
+ */
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cglm/cglm.h"
+#include "common.h"
+#include "stb_ds.h"
+
+/* Scale granularity. */
+static constexpr float dynamicResolutionStep = 0.05f;
+/* Share of the budget aimed for, leaving room for spikes. */
+static constexpr float dynamicResolutionHeadroom = 0.9f;
+
+enum : uint32_t {
+	/* Frames averaged per decision. */
+	DYNAMIC_RESOLUTION_WINDOW = 8,
+	/* Frames until timings reflect a new scale. */
+	DYNAMIC_RESOLUTION_LATENCY = 4,
+};
+
+struct DynamicResolution {
+	bool enabled;
+	float budgetMs;
+	float minScale;
+	float maxScale;
+	float scale;
+	float totalMs;		/* Over the current window */
+	uint32_t samples;	/* In the current window */
+	uint32_t skip;		/* Timings still to drop */
+};
+
+struct DynamicResolution dynamicResolution = {
+	.budgetMs = 1000.0f / 60.0f,
+	.minScale = 0.5f,
+	.maxScale = 1.0f,
+	.scale = 1.0f,
+};
+
+/* Read `--dynamic-resolution on|off`, off by default, `--frame-budget <ms>`
+ * and the scale bounds. */
+Error dynamicResolutionInit(void)
+{
+	ptrdiff_t enabled = shgeti(arguments, "dynamic-resolution");
+	if (enabled >= 0) {
+		if (strcmp(arguments[enabled].value, "on") == 0) {
+			dynamicResolution.enabled = true;
+		} else if (strcmp(arguments[enabled].value, "off") != 0) {
+			return ERR_INVALID_ARGUMENTS;
+		}
+	}
+
+	ptrdiff_t budget = shgeti(arguments, "frame-budget");
+	if (budget >= 0) {
+		dynamicResolution.budgetMs = strtof(arguments[budget].value,
+						    nullptr);
+	}
+
+	ptrdiff_t minScale = shgeti(arguments, "min-resolution-scale");
+	if (minScale >= 0) {
+		dynamicResolution.minScale = strtof(arguments[minScale].value,
+						    nullptr);
+	}
+
+	ptrdiff_t maxScale = shgeti(arguments, "max-resolution-scale");
+	if (maxScale >= 0) {
+		dynamicResolution.maxScale = strtof(arguments[maxScale].value,
+						    nullptr);
+	}
+
+	if (!(dynamicResolution.budgetMs > 0.0f)
+	    || !(dynamicResolution.minScale > 0.0f)
+	    || !(dynamicResolution.minScale <= dynamicResolution.maxScale)
+	    || !(dynamicResolution.maxScale <= 1.0f)) {
+		return ERR_INVALID_ARGUMENTS;
+	}
+
+	dynamicResolution.scale = dynamicResolution.maxScale;
+	return ERR_OK;
+}
+
+/* Fraction of the window size to render at, 1 when disabled. */
+float dynamicResolutionScale(void)
+{
+	return dynamicResolution.enabled ? dynamicResolution.scale : 1.0f;
+}
+
+/* Account for a frame that took `gpuMs` on the GPU. */
+void dynamicResolutionUpdate(float gpuMs)
+{
+	if (!dynamicResolution.enabled) {
+		return;
+	}
+	if (dynamicResolution.skip > 0) {
+		dynamicResolution.skip--;
+		return;
+	}
+
+	dynamicResolution.totalMs += gpuMs;
+	dynamicResolution.samples++;
+	if (dynamicResolution.samples < DYNAMIC_RESOLUTION_WINDOW) {
+		return;
+	}
+
+	float averageMs = dynamicResolution.totalMs
+		/ (float)dynamicResolution.samples;
+	dynamicResolution.totalMs = 0.0f;
+	dynamicResolution.samples = 0;
+	if (!(averageMs > 0.0f)) {
+		return;
+	}
+
+	float target = dynamicResolution.scale
+		* sqrtf(dynamicResolution.budgetMs
+			* dynamicResolutionHeadroom / averageMs);
+	target = glm_clamp(target, dynamicResolution.minScale,
+			   dynamicResolution.maxScale);
+	float steps = truncf((target - dynamicResolution.scale)
+			     / dynamicResolutionStep);
+	if (steps == 0.0f) {
+		return;
+	}
+
+	dynamicResolution.scale = glm_clamp(dynamicResolution.scale
+					    + steps * dynamicResolutionStep,
+					    dynamicResolution.minScale,
+					    dynamicResolution.maxScale);
+	dynamicResolution.skip = DYNAMIC_RESOLUTION_LATENCY;
+}
@@ -0,0 +1,1226 @@
+/* GL capture - Record the GL calls leading to a frame, for gl_replay
+ *
+ * OVERVIEW: - With `--capture <frame>`, every GL call the renderer makes is
+ *   recorded from startup on, in the format of gl_trace_format.h. At the end
+ *   of frame `<frame>`, counted from 0, the trace is written to
+ *   `--capture-file`, "frame.trace" by default, and recording stops.
+ *   Everything before the frame becomes the trace's setup.
+ *
+ * - Calls are recorded by swapping GLAD's function pointers, and those of
+ *   gl_ext.c, for hooks that forward to the driver then record the call and
+ *   the client memory it read. Calls returning state, such as glGet*, are
+ *   not recorded, except those returning names or uniform locations. Any
+ *   other entry point aborts when called, until it gets a hook.
+ *
+ * - Persistently mapped buffers are written without any call to record, so
+ *   capturing falls back on orphaned buffers and glBufferSubData(). Program
+ *   binaries only load on the driver that built them, so shaders are
+ *   compiled from source instead. Ranges mapped for writing are recorded
+ *   when unmapped.
+ *
+ * - `captureMarker()` names the calls that follow, for replays to report
+ *   timings per range. Frames are expected to leave the state they found, so
+ *   the captured frame can be repeated.
+ *
+ * USAGE:
+ * - captureInit(width, height);	// Once GLAD and gl_ext.c are loaded
+ * - // Every frame
+ * - captureBeginFrame();
+ * - captureMarker("shadows");
+ * - captureEndFrame();
+ * - captureFree();
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glad/glad.h"
+#include "common.h"
+#include "gl_ext.c"
+#include "gl_trace_format.h"
+#include "stb_ds.h"
+
+enum : int {
+	CAPTURE_MAX_MAPPINGS = 4,
+};
+
+static constexpr uint64_t captureHashBasis = 0xcbf29ce484222325;
+static constexpr uint64_t captureHashPrime = 0x100000001b3;
+
+typedef struct CaptureMapping {
+	GLenum target;		/* 0 if unused */
+	void *pointer;
+	GLsizeiptr length;
+	GLbitfield access;
+} CaptureMapping;
+
+typedef struct CapturePayloadEntry {
+	uint64_t key;		/* Hash */
+	uint64_t value;		/* Payload index */
+} CapturePayloadEntry;
+
+typedef struct CaptureHook {
+	const char *name;	/* Entry, "glad_" prefixed if GLAD's */
+	GLFWglproc hook;
+} CaptureHook;
+
+typedef struct CaptureSyncEntry {
+	GLsync key;
+	uint64_t value;		/* Recorded sync */
+} CaptureSyncEntry;
+
+/* GLAD entry points the renderer calls without changing state, so that
+ * capturing leaves them out. */
+static const char *const captureUnrecorded[] = {
+	"glCheckFramebufferStatus",
+	"glGetIntegerv",
+	"glGetProgramiv",
+	"glGetQueryObjectui64v",
+	"glGetQueryObjectuiv",
+	"glGetShaderInfoLog",
+	"glGetShaderiv",
+	"glGetString",
+	"glGetStringi",
+};
+
+/* Driver entry points behind the hooks. */
+struct CaptureGL {
+	PFNGLGENBUFFERSPROC genBuffers;
+	PFNGLDELETEBUFFERSPROC deleteBuffers;
+	PFNGLGENTEXTURESPROC genTextures;
+	PFNGLDELETETEXTURESPROC deleteTextures;
+	PFNGLGENVERTEXARRAYSPROC genVertexArrays;
+	PFNGLDELETEVERTEXARRAYSPROC deleteVertexArrays;
+	PFNGLGENFRAMEBUFFERSPROC genFramebuffers;
+	PFNGLDELETEFRAMEBUFFERSPROC deleteFramebuffers;
+	PFNGLGENSAMPLERSPROC genSamplers;
+	PFNGLDELETESAMPLERSPROC deleteSamplers;
+	PFNGLGENQUERIESPROC genQueries;
+	PFNGLDELETEQUERIESPROC deleteQueries;
+	PFNGLCREATESHADERPROC createShader;
+	PFNGLDELETESHADERPROC deleteShader;
+	PFNGLSHADERSOURCEPROC shaderSource;
+	PFNGLCOMPILESHADERPROC compileShader;
+	PFNGLCREATEPROGRAMPROC createProgram;
+	PFNGLDELETEPROGRAMPROC deleteProgram;
+	PFNGLATTACHSHADERPROC attachShader;
+	PFNGLLINKPROGRAMPROC linkProgram;
+	PFNGLGETUNIFORMLOCATIONPROC getUniformLocation;
+	PFNGLUSEPROGRAMPROC useProgram;
+	PFNGLUNIFORM1IPROC uniform1i;
+	PFNGLUNIFORM1FPROC uniform1f;
+	PFNGLUNIFORM2FPROC uniform2f;
+	PFNGLUNIFORM3IPROC uniform3i;
+	PFNGLUNIFORM3FVPROC uniform3fv;
+	PFNGLUNIFORM4FVPROC uniform4fv;
+	PFNGLUNIFORMMATRIX4FVPROC uniformMatrix4fv;
+	PFNGLBINDVERTEXARRAYPROC bindVertexArray;
+	PFNGLBINDBUFFERPROC bindBuffer;
+	PFNGLBUFFERDATAPROC bufferData;
+	PFNGLBUFFERSUBDATAPROC bufferSubData;
+	PFNGLMAPBUFFERRANGEPROC mapBufferRange;
+	PFNGLUNMAPBUFFERPROC unmapBuffer;
+	PFNGLENABLEVERTEXATTRIBARRAYPROC enableVertexAttribArray;
+	PFNGLVERTEXATTRIBPOINTERPROC vertexAttribPointer;
+	PFNGLVERTEXATTRIBIPOINTERPROC vertexAttribIPointer;
+	PFNGLVERTEXATTRIBDIVISORPROC vertexAttribDivisor;
+	PFNGLACTIVETEXTUREPROC activeTexture;
+	PFNGLBINDTEXTUREPROC bindTexture;
+	PFNGLTEXPARAMETERIPROC texParameteri;
+	PFNGLTEXIMAGE2DPROC texImage2D;
+	PFNGLTEXSUBIMAGE2DPROC texSubImage2D;
+	PFNGLCOMPRESSEDTEXIMAGE2DPROC compressedTexImage2D;
+	PFNGLCOMPRESSEDTEXSUBIMAGE2DPROC compressedTexSubImage2D;
+	PFNGLTEXBUFFERPROC texBuffer;
+	PFNGLTEXBUFFERRANGEPROC texBufferRange;
+	PFNGLBINDSAMPLERPROC bindSampler;
+	PFNGLSAMPLERPARAMETERIPROC samplerParameteri;
+	PFNGLBINDFRAMEBUFFERPROC bindFramebuffer;
+	PFNGLFRAMEBUFFERTEXTURE2DPROC framebufferTexture2D;
+	PFNGLDRAWBUFFERSPROC drawBuffers;
+	PFNGLREADBUFFERPROC readBuffer;
+	PFNGLBLITFRAMEBUFFERPROC blitFramebuffer;
+	PFNGLENABLEPROC enable;
+	PFNGLDISABLEPROC disable;
+	PFNGLVIEWPORTPROC viewport;
+	PFNGLCLEARCOLORPROC clearColor;
+	PFNGLCLEARPROC clear;
+	PFNGLDRAWARRAYSPROC drawArrays;
+	PFNGLDRAWELEMENTSBASEVERTEXPROC drawElementsBaseVertex;
+	PFNGLMULTIDRAWELEMENTSINDIRECTPROC multiDrawElementsIndirect;
+	PFNGLBEGINQUERYPROC beginQuery;
+	PFNGLENDQUERYPROC endQuery;
+	PFNGLFENCESYNCPROC fenceSync;
+	PFNGLCLIENTWAITSYNCPROC clientWaitSync;
+	PFNGLDELETESYNCPROC deleteSync;
+};
+
+struct Capture {
+	bool recording;
+	uint64_t frame;			/* To capture */
+	uint64_t frameIndex;		/* Being drawn */
+	const char *path;
+	uint32_t width;
+	uint32_t height;
+	uint64_t *words;		/* stb_ds.h array */
+	uint64_t frameWord;
+	TracePayload *payloads;		/* stb_ds.h array */
+	uint8_t *data;			/* stb_ds.h array */
+	CapturePayloadEntry *payloadIndex;	/* stb_ds.h hashmap */
+	CaptureSyncEntry *syncs;	/* stb_ds.h hashmap */
+	CaptureHook *hooks;		/* stb_ds.h array */
+	uint64_t syncCount;
+	GLuint unpackBuffer;
+	CaptureMapping mappings[CAPTURE_MAX_MAPPINGS];
+};
+
+struct Capture capture;
+struct CaptureGL captureGL;
+
+uint64_t captureHash(const void *data, size_t size)
+{
+	const uint8_t *bytes = data;
+	uint64_t hash = captureHashBasis;
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ bytes[i]) * captureHashPrime;
+	}
+	return hash;
+}
+
+uint64_t captureFloat(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+/* Data word of `size` bytes of client memory, stored once per content. */
+uint64_t captureData(const void *data, size_t size)
+{
+	if (data == nullptr) {
+		return TRACE_DATA_NONE;
+	}
+
+	uint64_t hash = captureHash(data, size);
+	ptrdiff_t found = hmgeti(capture.payloadIndex, hash);
+	if (found >= 0) {
+		uint64_t index = capture.payloadIndex[found].value;
+		const TracePayload *payload = &capture.payloads[index];
+		const uint8_t *stored = capture.data + payload->offset;
+		if (payload->size == size && memcmp(stored, data, size) == 0) {
+			return index + 1;
+		}
+	}
+
+	/* Colliding payloads are kept, only the first one being indexed. */
+	TracePayload payload = {
+		.hash = hash,
+		.offset = (uint64_t)arrlen(capture.data),
+		.size = size,
+	};
+	memcpy(arraddnptr(capture.data, size), data, size);
+	uint64_t index = (uint64_t)arrlen(capture.payloads);
+	arrput(capture.payloads, payload);
+	if (found < 0) {
+		hmput(capture.payloadIndex, hash, index);
+	}
+	return index + 1;
+}
+
+/* Data word of a pointer into the bound buffer. */
+uint64_t captureOffset(const void *pointer)
+{
+	return TRACE_DATA_OFFSET | (uint64_t)(uintptr_t)pointer;
+}
+
+/* Data word of pixels, read from the bound unpack buffer if any. */
+uint64_t captureImage(const void *pixels, size_t size)
+{
+	return capture.unpackBuffer != 0
+		? captureOffset(pixels)
+		: captureData(pixels, size);
+}
+
+/* Bytes glTexImage2D() reads for `width` by `height` pixels, with the default
+ * unpack alignment of 4. 0 for formats never uploaded from client memory. */
+size_t captureImageSize(GLsizei width, GLsizei height, GLenum format,
+			GLenum type)
+{
+	size_t components = 0;
+	switch (format) {
+	case GL_RED:
+	case GL_DEPTH_COMPONENT:
+	case GL_DEPTH_STENCIL:
+		components = 1;
+		break;
+	case GL_RG:
+		components = 2;
+		break;
+	case GL_RGB:
+		components = 3;
+		break;
+	case GL_RGBA:
+		components = 4;
+		break;
+	}
+
+	size_t componentSize = 0;
+	switch (type) {
+	case GL_UNSIGNED_BYTE:
+		componentSize = 1;
+		break;
+	case GL_HALF_FLOAT:
+		componentSize = 2;
+		break;
+	case GL_FLOAT:
+	case GL_UNSIGNED_INT:
+		componentSize = 4;
+		break;
+	case GL_UNSIGNED_INT_24_8:
+		/* Packed, with one component. */
+		componentSize = 4;
+		components = 1;
+		break;
+	}
+
+	size_t pixelSize = components * componentSize;
+	if (pixelSize == 0 || width <= 0 || height <= 0) {
+		return 0;
+	}
+	size_t rowSize = (size_t)width * pixelSize;
+	size_t stride = (rowSize + 3) / 4 * 4;
+	return stride * (size_t)(height - 1) + rowSize;
+}
+
+void captureCall(TraceFunction function, uint32_t argumentCount,
+		 const uint64_t *arguments)
+{
+	if (!capture.recording) {
+		return;
+	}
+	arrput(capture.words, TRACE_CALL(function, argumentCount));
+	memcpy(arraddnptr(capture.words, argumentCount), arguments,
+	       sizeof(uint64_t) * argumentCount);
+}
+
+/* Record a call taking `n` names. */
+void captureNames(TraceFunction function, GLsizei n, const GLuint *names)
+{
+	if (!capture.recording || n < 0) {
+		return;
+	}
+	arrput(capture.words, TRACE_CALL(function, (uint32_t)n + 1));
+	arrput(capture.words, (uint64_t)n);
+	for (GLsizei i = 0; i < n; i++) {
+		arrput(capture.words, names[i]);
+	}
+}
+
+#define CAPTURE(function, ...) \
+	captureCall(function, \
+		    sizeof((uint64_t[]){__VA_ARGS__}) / sizeof(uint64_t), \
+		    (uint64_t[]){__VA_ARGS__})
+
+void APIENTRY captureGenBuffers(GLsizei n, GLuint *buffers)
+{
+	captureGL.genBuffers(n, buffers);
+	captureNames(TRACE_GEN_BUFFERS, n, buffers);
+}
+
+void APIENTRY captureDeleteBuffers(GLsizei n, const GLuint *buffers)
+{
+	captureGL.deleteBuffers(n, buffers);
+	captureNames(TRACE_DELETE_BUFFERS, n, buffers);
+}
+
+void APIENTRY captureGenTextures(GLsizei n, GLuint *textures)
+{
+	captureGL.genTextures(n, textures);
+	captureNames(TRACE_GEN_TEXTURES, n, textures);
+}
+
+void APIENTRY captureDeleteTextures(GLsizei n, const GLuint *textures)
+{
+	captureGL.deleteTextures(n, textures);
+	captureNames(TRACE_DELETE_TEXTURES, n, textures);
+}
+
+void APIENTRY captureGenVertexArrays(GLsizei n, GLuint *arrays)
+{
+	captureGL.genVertexArrays(n, arrays);
+	captureNames(TRACE_GEN_VERTEX_ARRAYS, n, arrays);
+}
+
+void APIENTRY captureDeleteVertexArrays(GLsizei n, const GLuint *arrays)
+{
+	captureGL.deleteVertexArrays(n, arrays);
+	captureNames(TRACE_DELETE_VERTEX_ARRAYS, n, arrays);
+}
+
+void APIENTRY captureGenFramebuffers(GLsizei n, GLuint *framebuffers)
+{
+	captureGL.genFramebuffers(n, framebuffers);
+	captureNames(TRACE_GEN_FRAMEBUFFERS, n, framebuffers);
+}
+
+void APIENTRY captureDeleteFramebuffers(GLsizei n, const GLuint *framebuffers)
+{
+	captureGL.deleteFramebuffers(n, framebuffers);
+	captureNames(TRACE_DELETE_FRAMEBUFFERS, n, framebuffers);
+}
+
+void APIENTRY captureGenSamplers(GLsizei n, GLuint *samplers)
+{
+	captureGL.genSamplers(n, samplers);
+	captureNames(TRACE_GEN_SAMPLERS, n, samplers);
+}
+
+void APIENTRY captureDeleteSamplers(GLsizei n, const GLuint *samplers)
+{
+	captureGL.deleteSamplers(n, samplers);
+	captureNames(TRACE_DELETE_SAMPLERS, n, samplers);
+}
+
+void APIENTRY captureGenQueries(GLsizei n, GLuint *queries)
+{
+	captureGL.genQueries(n, queries);
+	captureNames(TRACE_GEN_QUERIES, n, queries);
+}
+
+void APIENTRY captureDeleteQueries(GLsizei n, const GLuint *queries)
+{
+	captureGL.deleteQueries(n, queries);
+	captureNames(TRACE_DELETE_QUERIES, n, queries);
+}
+
+GLuint APIENTRY captureCreateShader(GLenum type)
+{
+	GLuint shader = captureGL.createShader(type);
+	CAPTURE(TRACE_CREATE_SHADER, type, shader);
+	return shader;
+}
+
+void APIENTRY captureDeleteShader(GLuint shader)
+{
+	captureGL.deleteShader(shader);
+	CAPTURE(TRACE_DELETE_SHADER, shader);
+}
+
+/* Recorded as one string. */
+void APIENTRY captureShaderSource(GLuint shader, GLsizei count,
+				  const GLchar *const *string,
+				  const GLint *length)
+{
+	captureGL.shaderSource(shader, count, string, length);
+	if (!capture.recording) {
+		return;
+	}
+
+	GLchar *source = nullptr;	/* stb_ds.h array */
+	for (GLsizei i = 0; i < count; i++) {
+		size_t size = length != nullptr && length[i] >= 0
+			? (size_t)length[i]
+			: strlen(string[i]);
+		memcpy(arraddnptr(source, size), string[i], size);
+	}
+	arrput(source, '\0');
+	CAPTURE(TRACE_SHADER_SOURCE, shader,
+		captureData(source, (size_t)arrlen(source)));
+	arrfree(source);
+}
+
+void APIENTRY captureCompileShader(GLuint shader)
+{
+	captureGL.compileShader(shader);
+	CAPTURE(TRACE_COMPILE_SHADER, shader);
+}
+
+GLuint APIENTRY captureCreateProgram(void)
+{
+	GLuint program = captureGL.createProgram();
+	CAPTURE(TRACE_CREATE_PROGRAM, program);
+	return program;
+}
+
+void APIENTRY captureDeleteProgram(GLuint program)
+{
+	captureGL.deleteProgram(program);
+	CAPTURE(TRACE_DELETE_PROGRAM, program);
+}
+
+void APIENTRY captureAttachShader(GLuint program, GLuint shader)
+{
+	captureGL.attachShader(program, shader);
+	CAPTURE(TRACE_ATTACH_SHADER, program, shader);
+}
+
+void APIENTRY captureLinkProgram(GLuint program)
+{
+	captureGL.linkProgram(program);
+	CAPTURE(TRACE_LINK_PROGRAM, program);
+}
+
+GLint APIENTRY captureGetUniformLocation(GLuint program, const GLchar *name)
+{
+	GLint location = captureGL.getUniformLocation(program, name);
+	if (capture.recording) {
+		CAPTURE(TRACE_GET_UNIFORM_LOCATION, program,
+			captureData(name, strlen(name) + 1),
+			(uint64_t)(int64_t)location);
+	}
+	return location;
+}
+
+void APIENTRY captureUseProgram(GLuint program)
+{
+	captureGL.useProgram(program);
+	CAPTURE(TRACE_USE_PROGRAM, program);
+}
+
+void APIENTRY captureUniform1i(GLint location, GLint x)
+{
+	captureGL.uniform1i(location, x);
+	CAPTURE(TRACE_UNIFORM_1I, (uint64_t)(int64_t)location,
+		(uint64_t)(int64_t)x);
+}
+
+void APIENTRY captureUniform1f(GLint location, GLfloat x)
+{
+	captureGL.uniform1f(location, x);
+	CAPTURE(TRACE_UNIFORM_1F, (uint64_t)(int64_t)location,
+		captureFloat(x));
+}
+
+void APIENTRY captureUniform2f(GLint location, GLfloat x, GLfloat y)
+{
+	captureGL.uniform2f(location, x, y);
+	CAPTURE(TRACE_UNIFORM_2F, (uint64_t)(int64_t)location,
+		captureFloat(x), captureFloat(y));
+}
+
+void APIENTRY captureUniform3i(GLint location, GLint x, GLint y, GLint z)
+{
+	captureGL.uniform3i(location, x, y, z);
+	CAPTURE(TRACE_UNIFORM_3I, (uint64_t)(int64_t)location,
+		(uint64_t)(int64_t)x, (uint64_t)(int64_t)y,
+		(uint64_t)(int64_t)z);
+}
+
+void APIENTRY captureUniform3fv(GLint location, GLsizei count,
+				const GLfloat *value)
+{
+	captureGL.uniform3fv(location, count, value);
+	if (capture.recording) {
+		CAPTURE(TRACE_UNIFORM_3FV, (uint64_t)(int64_t)location,
+			(uint64_t)count,
+			captureData(value,
+				    sizeof(GLfloat) * 3 * (size_t)count));
+	}
+}
+
+void APIENTRY captureUniform4fv(GLint location, GLsizei count,
+				const GLfloat *value)
+{
+	captureGL.uniform4fv(location, count, value);
+	if (capture.recording) {
+		CAPTURE(TRACE_UNIFORM_4FV, (uint64_t)(int64_t)location,
+			(uint64_t)count,
+			captureData(value,
+				    sizeof(GLfloat) * 4 * (size_t)count));
+	}
+}
+
+void APIENTRY captureUniformMatrix4fv(GLint location, GLsizei count,
+				      GLboolean transpose,
+				      const GLfloat *value)
+{
+	captureGL.uniformMatrix4fv(location, count, transpose, value);
+	if (capture.recording) {
+		CAPTURE(TRACE_UNIFORM_MATRIX_4FV, (uint64_t)(int64_t)location,
+			(uint64_t)count, transpose,
+			captureData(value,
+				    sizeof(GLfloat) * 16 * (size_t)count));
+	}
+}
+
+void APIENTRY captureBindVertexArray(GLuint array)
+{
+	captureGL.bindVertexArray(array);
+	CAPTURE(TRACE_BIND_VERTEX_ARRAY, array);
+}
+
+void APIENTRY captureBindBuffer(GLenum target, GLuint buffer)
+{
+	captureGL.bindBuffer(target, buffer);
+	if (target == GL_PIXEL_UNPACK_BUFFER) {
+		capture.unpackBuffer = buffer;
+	}
+	CAPTURE(TRACE_BIND_BUFFER, target, buffer);
+}
+
+void APIENTRY captureBufferData(GLenum target, GLsizeiptr size,
+				const void *data, GLenum usage)
+{
+	captureGL.bufferData(target, size, data, usage);
+	if (capture.recording) {
+		CAPTURE(TRACE_BUFFER_DATA, target, (uint64_t)size,
+			captureData(data, (size_t)size), usage);
+	}
+}
+
+void APIENTRY captureBufferSubData(GLenum target, GLintptr offset,
+				   GLsizeiptr size, const void *data)
+{
+	captureGL.bufferSubData(target, offset, size, data);
+	if (capture.recording) {
+		CAPTURE(TRACE_BUFFER_SUB_DATA, target, (uint64_t)offset,
+			(uint64_t)size, captureData(data, (size_t)size));
+	}
+}
+
+void *APIENTRY captureMapBufferRange(GLenum target, GLintptr offset,
+				     GLsizeiptr length, GLbitfield access)
+{
+	void *pointer = captureGL.mapBufferRange(target, offset, length,
+						 access);
+	for (int i = 0; i < CAPTURE_MAX_MAPPINGS && pointer != nullptr; i++) {
+		if (capture.mappings[i].target == 0) {
+			capture.mappings[i] = (CaptureMapping){
+				target, pointer, length, access,
+			};
+			break;
+		}
+	}
+	CAPTURE(TRACE_MAP_BUFFER_RANGE, target, (uint64_t)offset,
+		(uint64_t)length, access);
+	return pointer;
+}
+
+/* What was written to the mapping is recorded before it goes away. */
+GLboolean APIENTRY captureUnmapBuffer(GLenum target)
+{
+	uint64_t written = TRACE_DATA_NONE;
+	for (int i = 0; i < CAPTURE_MAX_MAPPINGS; i++) {
+		CaptureMapping *mapping = &capture.mappings[i];
+		if (mapping->target != target) {
+			continue;
+		}
+		if (capture.recording && (mapping->access & GL_MAP_WRITE_BIT)) {
+			written = captureData(mapping->pointer,
+					      (size_t)mapping->length);
+		}
+		*mapping = (CaptureMapping){};
+		break;
+	}
+
+	CAPTURE(TRACE_UNMAP_BUFFER, target, written);
+	return captureGL.unmapBuffer(target);
+}
+
+void APIENTRY captureEnableVertexAttribArray(GLuint index)
+{
+	captureGL.enableVertexAttribArray(index);
+	CAPTURE(TRACE_ENABLE_VERTEX_ATTRIB_ARRAY, index);
+}
+
+void APIENTRY captureVertexAttribPointer(GLuint index, GLint size, GLenum type,
+					GLboolean normalized, GLsizei stride,
+					const void *pointer)
+{
+	captureGL.vertexAttribPointer(index, size, type, normalized, stride,
+				      pointer);
+	CAPTURE(TRACE_VERTEX_ATTRIB_POINTER, index, (uint64_t)size, type,
+		normalized, (uint64_t)stride, captureOffset(pointer));
+}
+
+void APIENTRY captureVertexAttribIPointer(GLuint index, GLint size,
+					 GLenum type, GLsizei stride,
+					 const void *pointer)
+{
+	captureGL.vertexAttribIPointer(index, size, type, stride, pointer);
+	CAPTURE(TRACE_VERTEX_ATTRIB_I_POINTER, index, (uint64_t)size, type,
+		(uint64_t)stride, captureOffset(pointer));
+}
+
+void APIENTRY captureVertexAttribDivisor(GLuint index, GLuint divisor)
+{
+	captureGL.vertexAttribDivisor(index, divisor);
+	CAPTURE(TRACE_VERTEX_ATTRIB_DIVISOR, index, divisor);
+}
+
+void APIENTRY captureActiveTexture(GLenum texture)
+{
+	captureGL.activeTexture(texture);
+	CAPTURE(TRACE_ACTIVE_TEXTURE, texture);
+}
+
+void APIENTRY captureBindTexture(GLenum target, GLuint texture)
+{
+	captureGL.bindTexture(target, texture);
+	CAPTURE(TRACE_BIND_TEXTURE, target, texture);
+}
+
+void APIENTRY captureTexParameteri(GLenum target, GLenum pname, GLint param)
+{
+	captureGL.texParameteri(target, pname, param);
+	CAPTURE(TRACE_TEX_PARAMETER_I, target, pname, (uint64_t)(int64_t)param);
+}
+
+void APIENTRY captureTexImage2D(GLenum target, GLint level,
+				GLint internalformat, GLsizei width,
+				GLsizei height, GLint border, GLenum format,
+				GLenum type, const void *pixels)
+{
+	captureGL.texImage2D(target, level, internalformat, width, height,
+			     border, format, type, pixels);
+	if (capture.recording) {
+		size_t size = captureImageSize(width, height, format, type);
+		CAPTURE(TRACE_TEX_IMAGE_2D, target, (uint64_t)level,
+			(uint64_t)internalformat, (uint64_t)width,
+			(uint64_t)height, (uint64_t)border, format, type,
+			captureImage(pixels, size));
+	}
+}
+
+void APIENTRY captureTexSubImage2D(GLenum target, GLint level, GLint xoffset,
+				   GLint yoffset, GLsizei width, GLsizei height,
+				   GLenum format, GLenum type,
+				   const void *pixels)
+{
+	captureGL.texSubImage2D(target, level, xoffset, yoffset, width, height,
+				format, type, pixels);
+	if (capture.recording) {
+		size_t size = captureImageSize(width, height, format, type);
+		CAPTURE(TRACE_TEX_SUB_IMAGE_2D, target, (uint64_t)level,
+			(uint64_t)xoffset, (uint64_t)yoffset, (uint64_t)width,
+			(uint64_t)height, format, type,
+			captureImage(pixels, size));
+	}
+}
+
+void APIENTRY captureCompressedTexImage2D(GLenum target, GLint level,
+					  GLenum internalformat, GLsizei width,
+					  GLsizei height, GLint border,
+					  GLsizei imageSize, const void *data)
+{
+	captureGL.compressedTexImage2D(target, level, internalformat, width,
+				       height, border, imageSize, data);
+	if (capture.recording) {
+		CAPTURE(TRACE_COMPRESSED_TEX_IMAGE_2D, target, (uint64_t)level,
+			internalformat, (uint64_t)width, (uint64_t)height,
+			(uint64_t)border, (uint64_t)imageSize,
+			captureImage(data, (size_t)imageSize));
+	}
+}
+
+void APIENTRY captureCompressedTexSubImage2D(GLenum target, GLint level,
+					     GLint xoffset, GLint yoffset,
+					     GLsizei width, GLsizei height,
+					     GLenum format, GLsizei imageSize,
+					     const void *data)
+{
+	captureGL.compressedTexSubImage2D(target, level, xoffset, yoffset,
+					  width, height, format, imageSize,
+					  data);
+	if (capture.recording) {
+		CAPTURE(TRACE_COMPRESSED_TEX_SUB_IMAGE_2D, target,
+			(uint64_t)level, (uint64_t)xoffset, (uint64_t)yoffset,
+			(uint64_t)width, (uint64_t)height, format,
+			(uint64_t)imageSize,
+			captureImage(data, (size_t)imageSize));
+	}
+}
+
+void APIENTRY captureTexBuffer(GLenum target, GLenum internalformat,
+			       GLuint buffer)
+{
+	captureGL.texBuffer(target, internalformat, buffer);
+	CAPTURE(TRACE_TEX_BUFFER, target, internalformat, buffer);
+}
+
+void APIENTRY captureTexBufferRange(GLenum target, GLenum internalformat,
+				    GLuint buffer, GLintptr offset,
+				    GLsizeiptr size)
+{
+	captureGL.texBufferRange(target, internalformat, buffer, offset, size);
+	CAPTURE(TRACE_TEX_BUFFER_RANGE, target, internalformat, buffer,
+		(uint64_t)offset, (uint64_t)size);
+}
+
+void APIENTRY captureBindSampler(GLuint unit, GLuint sampler)
+{
+	captureGL.bindSampler(unit, sampler);
+	CAPTURE(TRACE_BIND_SAMPLER, unit, sampler);
+}
+
+void APIENTRY captureSamplerParameteri(GLuint sampler, GLenum pname,
+				       GLint param)
+{
+	captureGL.samplerParameteri(sampler, pname, param);
+	CAPTURE(TRACE_SAMPLER_PARAMETER_I, sampler, pname,
+		(uint64_t)(int64_t)param);
+}
+
+void APIENTRY captureBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	captureGL.bindFramebuffer(target, framebuffer);
+	CAPTURE(TRACE_BIND_FRAMEBUFFER, target, framebuffer);
+}
+
+void APIENTRY captureFramebufferTexture2D(GLenum target, GLenum attachment,
+					  GLenum textarget, GLuint texture,
+					  GLint level)
+{
+	captureGL.framebufferTexture2D(target, attachment, textarget, texture,
+				       level);
+	CAPTURE(TRACE_FRAMEBUFFER_TEXTURE_2D, target, attachment, textarget,
+		texture, (uint64_t)level);
+}
+
+void APIENTRY captureDrawBuffers(GLsizei n, const GLenum *bufs)
+{
+	captureGL.drawBuffers(n, bufs);
+	captureNames(TRACE_DRAW_BUFFERS, n, bufs);
+}
+
+void APIENTRY captureReadBuffer(GLenum mode)
+{
+	captureGL.readBuffer(mode);
+	CAPTURE(TRACE_READ_BUFFER, mode);
+}
+
+void APIENTRY captureBlitFramebuffer(GLint srcX0, GLint srcY0, GLint srcX1,
+				     GLint srcY1, GLint dstX0, GLint dstY0,
+				     GLint dstX1, GLint dstY1, GLbitfield mask,
+				     GLenum filter)
+{
+	captureGL.blitFramebuffer(srcX0, srcY0, srcX1, srcY1, dstX0, dstY0,
+				  dstX1, dstY1, mask, filter);
+	CAPTURE(TRACE_BLIT_FRAMEBUFFER, (uint64_t)srcX0, (uint64_t)srcY0,
+		(uint64_t)srcX1, (uint64_t)srcY1, (uint64_t)dstX0,
+		(uint64_t)dstY0, (uint64_t)dstX1, (uint64_t)dstY1, mask,
+		filter);
+}
+
+void APIENTRY captureEnable(GLenum capability)
+{
+	captureGL.enable(capability);
+	CAPTURE(TRACE_ENABLE, capability);
+}
+
+void APIENTRY captureDisable(GLenum capability)
+{
+	captureGL.disable(capability);
+	CAPTURE(TRACE_DISABLE, capability);
+}
+
+void APIENTRY captureViewport(GLint x, GLint y, GLsizei width,
+			      GLsizei height)
+{
+	captureGL.viewport(x, y, width, height);
+	CAPTURE(TRACE_VIEWPORT, (uint64_t)x, (uint64_t)y, (uint64_t)width,
+		(uint64_t)height);
+}
+
+void APIENTRY captureClearColor(GLfloat red, GLfloat green, GLfloat blue,
+				GLfloat alpha)
+{
+	captureGL.clearColor(red, green, blue, alpha);
+	CAPTURE(TRACE_CLEAR_COLOR, captureFloat(red), captureFloat(green),
+		captureFloat(blue), captureFloat(alpha));
+}
+
+void APIENTRY captureClear(GLbitfield mask)
+{
+	captureGL.clear(mask);
+	CAPTURE(TRACE_CLEAR, mask);
+}
+
+void APIENTRY captureDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+	captureGL.drawArrays(mode, first, count);
+	CAPTURE(TRACE_DRAW_ARRAYS, mode, (uint64_t)first, (uint64_t)count);
+}
+
+void APIENTRY captureDrawElementsBaseVertex(GLenum mode, GLsizei count,
+					   GLenum type, const void *indices,
+					   GLint basevertex)
+{
+	captureGL.drawElementsBaseVertex(mode, count, type, indices,
+					 basevertex);
+	CAPTURE(TRACE_DRAW_ELEMENTS_BASE_VERTEX, mode, (uint64_t)count, type,
+		captureOffset(indices), (uint64_t)(int64_t)basevertex);
+}
+
+void APIENTRY captureMultiDrawElementsIndirect(GLenum mode, GLenum type,
+					       const void *indirect,
+					       GLsizei drawcount,
+					       GLsizei stride)
+{
+	captureGL.multiDrawElementsIndirect(mode, type, indirect, drawcount,
+					    stride);
+	CAPTURE(TRACE_MULTI_DRAW_ELEMENTS_INDIRECT, mode, type,
+		captureOffset(indirect), (uint64_t)drawcount,
+		(uint64_t)stride);
+}
+
+void APIENTRY captureBeginQuery(GLenum target, GLuint id)
+{
+	captureGL.beginQuery(target, id);
+	CAPTURE(TRACE_BEGIN_QUERY, target, id);
+}
+
+void APIENTRY captureEndQuery(GLenum target)
+{
+	captureGL.endQuery(target);
+	CAPTURE(TRACE_END_QUERY, target);
+}
+
+/* Syncs are recorded as the order they were created in, from 1. */
+GLsync APIENTRY captureFenceSync(GLenum condition, GLbitfield flags)
+{
+	GLsync sync = captureGL.fenceSync(condition, flags);
+	uint64_t id = ++capture.syncCount;
+	hmput(capture.syncs, sync, id);
+	CAPTURE(TRACE_FENCE_SYNC, condition, flags, id);
+	return sync;
+}
+
+GLenum APIENTRY captureClientWaitSync(GLsync sync, GLbitfield flags,
+				      GLuint64 timeout)
+{
+	GLenum status = captureGL.clientWaitSync(sync, flags, timeout);
+	CAPTURE(TRACE_CLIENT_WAIT_SYNC, hmget(capture.syncs, sync), flags,
+		timeout);
+	return status;
+}
+
+void APIENTRY captureDeleteSync(GLsync sync)
+{
+	uint64_t id = hmget(capture.syncs, sync);
+	(void)hmdel(capture.syncs, sync);
+	captureGL.deleteSync(sync);
+	CAPTURE(TRACE_DELETE_SYNC, id);
+}
+
+/* Swap `*entry` for `hook`, keeping the driver's in `*original`. */
+#define CAPTURE_HOOK(entry, original, hook) \
+	do { \
+		(original) = (entry); \
+		(entry) = (hook); \
+		arrput(capture.hooks, ((CaptureHook){ \
+			#entry, (GLFWglproc)(hook)})); \
+	} while (0)
+
+/* Stands in for the entry points with no hook, which the trace would
+ * otherwise miss without a word. */
+void APIENTRY captureUnhooked(void)
+{
+	(void)fprintf(stderr, "GL entry point called while capturing has no "
+		      "hook, add it to captureHook() or captureUnrecorded\n");
+	abort();
+}
+
+/* GLAD loader keeping the hooks of captureHook(), and the driver's entry
+ * points for captureUnrecorded. Any other is captureUnhooked(). */
+GLFWglproc captureLoad(const char *name)
+{
+	static constexpr size_t prefixLength = sizeof("glad_") - 1;
+	for (ptrdiff_t i = 0; i < arrlen(capture.hooks); i++) {
+		const char *hooked = capture.hooks[i].name;
+		if (strncmp(hooked, "glad_", prefixLength) == 0
+		    && strcmp(hooked + prefixLength, name) == 0) {
+			return capture.hooks[i].hook;
+		}
+	}
+
+	GLFWglproc entry = glfwGetProcAddress(name);
+	if (entry == nullptr) {
+		return nullptr;
+	}
+	for (size_t i = 0; i < ARRAY_COUNT_STATIC(captureUnrecorded); i++) {
+		if (strcmp(captureUnrecorded[i], name) == 0) {
+			return entry;
+		}
+	}
+	return (GLFWglproc)captureUnhooked;
+}
+
+void captureHook(void)
+{
+	CAPTURE_HOOK(glad_glGenBuffers, captureGL.genBuffers,
+		     captureGenBuffers);
+	CAPTURE_HOOK(glad_glDeleteBuffers, captureGL.deleteBuffers,
+		     captureDeleteBuffers);
+	CAPTURE_HOOK(glad_glGenTextures, captureGL.genTextures,
+		     captureGenTextures);
+	CAPTURE_HOOK(glad_glDeleteTextures, captureGL.deleteTextures,
+		     captureDeleteTextures);
+	CAPTURE_HOOK(glad_glGenVertexArrays, captureGL.genVertexArrays,
+		     captureGenVertexArrays);
+	CAPTURE_HOOK(glad_glDeleteVertexArrays, captureGL.deleteVertexArrays,
+		     captureDeleteVertexArrays);
+	CAPTURE_HOOK(glad_glGenFramebuffers, captureGL.genFramebuffers,
+		     captureGenFramebuffers);
+	CAPTURE_HOOK(glad_glDeleteFramebuffers, captureGL.deleteFramebuffers,
+		     captureDeleteFramebuffers);
+	CAPTURE_HOOK(glad_glGenSamplers, captureGL.genSamplers,
+		     captureGenSamplers);
+	CAPTURE_HOOK(glad_glDeleteSamplers, captureGL.deleteSamplers,
+		     captureDeleteSamplers);
+	CAPTURE_HOOK(glad_glGenQueries, captureGL.genQueries,
+		     captureGenQueries);
+	CAPTURE_HOOK(glad_glDeleteQueries, captureGL.deleteQueries,
+		     captureDeleteQueries);
+	CAPTURE_HOOK(glad_glCreateShader, captureGL.createShader,
+		     captureCreateShader);
+	CAPTURE_HOOK(glad_glDeleteShader, captureGL.deleteShader,
+		     captureDeleteShader);
+	CAPTURE_HOOK(glad_glShaderSource, captureGL.shaderSource,
+		     captureShaderSource);
+	CAPTURE_HOOK(glad_glCompileShader, captureGL.compileShader,
+		     captureCompileShader);
+	CAPTURE_HOOK(glad_glCreateProgram, captureGL.createProgram,
+		     captureCreateProgram);
+	CAPTURE_HOOK(glad_glDeleteProgram, captureGL.deleteProgram,
+		     captureDeleteProgram);
+	CAPTURE_HOOK(glad_glAttachShader, captureGL.attachShader,
+		     captureAttachShader);
+	CAPTURE_HOOK(glad_glLinkProgram, captureGL.linkProgram,
+		     captureLinkProgram);
+	CAPTURE_HOOK(glad_glGetUniformLocation, captureGL.getUniformLocation,
+		     captureGetUniformLocation);
+	CAPTURE_HOOK(glad_glUseProgram, captureGL.useProgram,
+		     captureUseProgram);
+	CAPTURE_HOOK(glad_glUniform1i, captureGL.uniform1i, captureUniform1i);
+	CAPTURE_HOOK(glad_glUniform1f, captureGL.uniform1f, captureUniform1f);
+	CAPTURE_HOOK(glad_glUniform2f, captureGL.uniform2f, captureUniform2f);
+	CAPTURE_HOOK(glad_glUniform3i, captureGL.uniform3i, captureUniform3i);
+	CAPTURE_HOOK(glad_glUniform3fv, captureGL.uniform3fv,
+		     captureUniform3fv);
+	CAPTURE_HOOK(glad_glUniform4fv, captureGL.uniform4fv,
+		     captureUniform4fv);
+	CAPTURE_HOOK(glad_glUniformMatrix4fv, captureGL.uniformMatrix4fv,
+		     captureUniformMatrix4fv);
+	CAPTURE_HOOK(glad_glBindVertexArray, captureGL.bindVertexArray,
+		     captureBindVertexArray);
+	CAPTURE_HOOK(glad_glBindBuffer, captureGL.bindBuffer,
+		     captureBindBuffer);
+	CAPTURE_HOOK(glad_glBufferData, captureGL.bufferData,
+		     captureBufferData);
+	CAPTURE_HOOK(glad_glBufferSubData, captureGL.bufferSubData,
+		     captureBufferSubData);
+	CAPTURE_HOOK(glad_glMapBufferRange, captureGL.mapBufferRange,
+		     captureMapBufferRange);
+	CAPTURE_HOOK(glad_glUnmapBuffer, captureGL.unmapBuffer,
+		     captureUnmapBuffer);
+	CAPTURE_HOOK(glad_glEnableVertexAttribArray,
+		     captureGL.enableVertexAttribArray,
+		     captureEnableVertexAttribArray);
+	CAPTURE_HOOK(glad_glVertexAttribPointer, captureGL.vertexAttribPointer,
+		     captureVertexAttribPointer);
+	CAPTURE_HOOK(glad_glVertexAttribIPointer,
+		     captureGL.vertexAttribIPointer,
+		     captureVertexAttribIPointer);
+	CAPTURE_HOOK(glad_glVertexAttribDivisor, captureGL.vertexAttribDivisor,
+		     captureVertexAttribDivisor);
+	CAPTURE_HOOK(glad_glActiveTexture, captureGL.activeTexture,
+		     captureActiveTexture);
+	CAPTURE_HOOK(glad_glBindTexture, captureGL.bindTexture,
+		     captureBindTexture);
+	CAPTURE_HOOK(glad_glTexParameteri, captureGL.texParameteri,
+		     captureTexParameteri);
+	CAPTURE_HOOK(glad_glTexImage2D, captureGL.texImage2D,
+		     captureTexImage2D);
+	CAPTURE_HOOK(glad_glTexSubImage2D, captureGL.texSubImage2D,
+		     captureTexSubImage2D);
+	CAPTURE_HOOK(glad_glCompressedTexImage2D,
+		     captureGL.compressedTexImage2D,
+		     captureCompressedTexImage2D);
+	CAPTURE_HOOK(glad_glCompressedTexSubImage2D,
+		     captureGL.compressedTexSubImage2D,
+		     captureCompressedTexSubImage2D);
+	CAPTURE_HOOK(glad_glTexBuffer, captureGL.texBuffer, captureTexBuffer);
+	CAPTURE_HOOK(glad_glBindSampler, captureGL.bindSampler,
+		     captureBindSampler);
+	CAPTURE_HOOK(glad_glSamplerParameteri, captureGL.samplerParameteri,
+		     captureSamplerParameteri);
+	CAPTURE_HOOK(glad_glBindFramebuffer, captureGL.bindFramebuffer,
+		     captureBindFramebuffer);
+	CAPTURE_HOOK(glad_glFramebufferTexture2D,
+		     captureGL.framebufferTexture2D,
+		     captureFramebufferTexture2D);
+	CAPTURE_HOOK(glad_glDrawBuffers, captureGL.drawBuffers,
+		     captureDrawBuffers);
+	CAPTURE_HOOK(glad_glReadBuffer, captureGL.readBuffer,
+		     captureReadBuffer);
+	CAPTURE_HOOK(glad_glBlitFramebuffer, captureGL.blitFramebuffer,
+		     captureBlitFramebuffer);
+	CAPTURE_HOOK(glad_glEnable, captureGL.enable, captureEnable);
+	CAPTURE_HOOK(glad_glDisable, captureGL.disable, captureDisable);
+	CAPTURE_HOOK(glad_glViewport, captureGL.viewport, captureViewport);
+	CAPTURE_HOOK(glad_glClearColor, captureGL.clearColor,
+		     captureClearColor);
+	CAPTURE_HOOK(glad_glClear, captureGL.clear, captureClear);
+	CAPTURE_HOOK(glad_glDrawArrays, captureGL.drawArrays,
+		     captureDrawArrays);
+	CAPTURE_HOOK(glad_glDrawElementsBaseVertex,
+		     captureGL.drawElementsBaseVertex,
+		     captureDrawElementsBaseVertex);
+	CAPTURE_HOOK(glad_glBeginQuery, captureGL.beginQuery,
+		     captureBeginQuery);
+	CAPTURE_HOOK(glad_glEndQuery, captureGL.endQuery, captureEndQuery);
+	CAPTURE_HOOK(glad_glFenceSync, captureGL.fenceSync, captureFenceSync);
+	CAPTURE_HOOK(glad_glClientWaitSync, captureGL.clientWaitSync,
+		     captureClientWaitSync);
+	CAPTURE_HOOK(glad_glDeleteSync, captureGL.deleteSync,
+		     captureDeleteSync);
+
+	if (glExt.multiDrawElementsIndirect != nullptr) {
+		CAPTURE_HOOK(glExt.multiDrawElementsIndirect,
+			     captureGL.multiDrawElementsIndirect,
+			     captureMultiDrawElementsIndirect);
+	}
+	if (glExt.texBufferRange != nullptr) {
+		CAPTURE_HOOK(glExt.texBufferRange, captureGL.texBufferRange,
+			     captureTexBufferRange);
+	}
+}
+
+/* Read `--capture <frame>` and `--capture-file <path>`, and start recording
+ * if a frame is to be captured. `width` and `height` are the default
+ * framebuffer's. */
+Error captureInit(int width, int height)
+{
+	ptrdiff_t frame = shgeti(arguments, "capture");
+	if (frame < 0) {
+		return ERR_OK;
+	}
+
+	char *end;
+	capture.frame = strtoull(arguments[frame].value, &end, 10);
+	if (*end != '\0' || end == arguments[frame].value) {
+		return ERR_INVALID_ARGUMENTS;
+	}
+
+	ptrdiff_t path = shgeti(arguments, "capture-file");
+	capture.path = path >= 0 ? arguments[path].value : "frame.trace";
+	capture.width = (uint32_t)width;
+	capture.height = (uint32_t)height;
+
+	glExt.hasBufferStorage = false;
+	glExt.hasProgramBinary = false;
+	captureHook();
+
+	/* Calls the hooks miss would leave a trace that replays wrong, so stop
+	 * at the first one instead. */
+	if (!gladLoadGLLoader((GLADloadproc)captureLoad)) {
+		return ERR_GLAD_INITIALIZATION_FAILED;
+	}
+	glExt.getProgramBinary = (PFNGLGETPROGRAMBINARYPROC)captureUnhooked;
+	glExt.programBinary = (PFNGLPROGRAMBINARYPROC)captureUnhooked;
+	glExt.programParameteri = (PFNGLPROGRAMPARAMETERIPROC)captureUnhooked;
+	glExt.bufferStorage = (PFNGLBUFFERSTORAGEPROC)captureUnhooked;
+	capture.recording = true;
+	return ERR_OK;
+}
+
+/* Name the calls that follow, until the next marker. */
+void captureMarker(const char *name)
+{
+	if (capture.recording) {
+		CAPTURE(TRACE_MARKER, captureData(name, strlen(name) + 1));
+	}
+}
+
+void captureBeginFrame(void)
+{
+	if (capture.recording && capture.frameIndex == capture.frame) {
+		capture.frameWord = (uint64_t)arrlen(capture.words);
+		captureMarker("frame");
+	}
+}
+
+/* Write `size` bytes, padded to TRACE_ALIGNMENT. */
+bool captureWrite(FILE *file, const void *data, size_t size)
+{
+	static const uint8_t padding[TRACE_ALIGNMENT] = {};
+	size_t padded = (size + TRACE_ALIGNMENT - 1) / TRACE_ALIGNMENT
+		* TRACE_ALIGNMENT;
+	return (size == 0 || fwrite(data, size, 1, file) == 1)
+		&& (padded == size
+		    || fwrite(padding, padded - size, 1, file) == 1);
+}
+
+uint64_t captureAlign(uint64_t size)
+{
+	return (size + TRACE_ALIGNMENT - 1) / TRACE_ALIGNMENT * TRACE_ALIGNMENT;
+}
+
+bool captureSave(void)
+{
+	TraceHeader header = {
+		.magic = TRACE_MAGIC,
+		.version = TRACE_VERSION,
+		.width = capture.width,
+		.height = capture.height,
+		.callWords = (uint64_t)arrlen(capture.words),
+		.frameWord = capture.frameWord,
+		.payloadCount = (uint64_t)arrlen(capture.payloads),
+		.dataSize = (uint64_t)arrlen(capture.data),
+	};
+	header.callOffset = captureAlign(sizeof(header));
+	header.payloadOffset = header.callOffset
+		+ captureAlign(sizeof(uint64_t) * header.callWords);
+	header.dataOffset = header.payloadOffset
+		+ captureAlign(sizeof(TracePayload) * header.payloadCount);
+
+	FILE *file = fopen(capture.path, "wb");
+	if (file == nullptr) {
+		return false;
+	}
+	bool written = captureWrite(file, &header, sizeof(header))
+		&& captureWrite(file, capture.words,
+				sizeof(uint64_t) * header.callWords)
+		&& captureWrite(file, capture.payloads,
+				sizeof(TracePayload) * header.payloadCount)
+		&& captureWrite(file, capture.data, header.dataSize);
+	return fclose(file) == 0 && written;
+}
+
+/* Write the trace once the captured frame is over. */
+void captureEndFrame(void)
+{
+	if (!capture.recording) {
+		return;
+	}
+	if (capture.frameIndex++ != capture.frame) {
+		return;
+	}
+
+	capture.recording = false;
+	if (captureSave()) {
+		printf("Captured frame %llu to %s\n",
+		       (unsigned long long)capture.frame, capture.path);
+	} else {
+		(void)fprintf(stderr, "Could not write %s\n", capture.path);
+	}
+
+	arrfree(capture.words);
+	arrfree(capture.payloads);
+	arrfree(capture.data);
+	hmfree(capture.payloadIndex);
+}
+
+void captureFree(void)
+{
+	arrfree(capture.words);
+	arrfree(capture.payloads);
+	arrfree(capture.data);
+	hmfree(capture.payloadIndex);
+	hmfree(capture.syncs);
+	arrfree(capture.hooks);
+}
@@ -0,0 +1,154 @@
+/* OpenGL extensions - Entry points past the GLAD-generated 3.3 core loader
+ *
+ * OVERVIEW: - GLAD only loads OpenGL 3.3 core. Features from newer versions or
+ *   extensions are declared here and loaded by `glExtInit()`, once a context
+ *   is current.
+ *
+ * - Every feature has a `has` flag in `glExt`. Check it before calling any
+ *   of its entry points, and keep a 3.3 fallback around.
+ */
+#pragma once
+
+#include "glad/glad.h"
+#include "GLFW/glfw3.h"
+
+/* GL 4.1, ARB_get_program_binary */
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program,
+						   GLsizei bufSize,
+						   GLsizei *length,
+						   GLenum *binaryFormat,
+						   void *binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program,
+						GLenum binaryFormat,
+						const void *binary,
+						GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program,
+						    GLenum pname,
+						    GLint value);
+
+/* GL 4.3, ARB_multi_draw_indirect, with GL 4.2, ARB_base_instance */
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode,
+							    GLenum type,
+							    const void *indirect,
+							    GLsizei drawcount,
+							    GLsizei stride);
+
+/* GL 4.3, ARB_texture_buffer_range */
+#define GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT 0x919F
+
+typedef void (APIENTRYP PFNGLTEXBUFFERRANGEPROC)(GLenum target,
+						 GLenum internalformat,
+						 GLuint buffer,
+						 GLintptr offset,
+						 GLsizeiptr size);
+
+/* GL 4.4, ARB_buffer_storage */
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target,
+						GLsizeiptr size,
+						const void *data,
+						GLbitfield flags);
+
+/* EXT_texture_compression_s3tc */
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+
+/* GL 4.2, ARB_texture_compression_bptc */
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+
+struct GLExtensions {
+	/* GL 4.1, ARB_get_program_binary */
+	bool hasProgramBinary;
+	PFNGLGETPROGRAMBINARYPROC getProgramBinary;
+	PFNGLPROGRAMBINARYPROC programBinary;
+	PFNGLPROGRAMPARAMETERIPROC programParameteri;
+
+	/* GL 4.3, ARB_multi_draw_indirect, with GL 4.2, ARB_base_instance */
+	bool hasMultiDrawIndirect;
+	PFNGLMULTIDRAWELEMENTSINDIRECTPROC multiDrawElementsIndirect;
+
+	/* GL 4.3, ARB_texture_buffer_range */
+	bool hasTexBufferRange;
+	PFNGLTEXBUFFERRANGEPROC texBufferRange;
+
+	/* GL 4.4, ARB_buffer_storage */
+	bool hasBufferStorage;
+	PFNGLBUFFERSTORAGEPROC bufferStorage;
+
+	/* EXT_texture_compression_s3tc, BC1 and BC3 */
+	bool hasS3TC;
+	/* GL 4.2, ARB_texture_compression_bptc, BC7 */
+	bool hasBPTC;
+};
+
+struct GLExtensions glExt;
+
+/* True if the current context is at least version `major`.`minor`. */
+bool glExtHasVersion(int major, int minor)
+{
+	return GLVersion.major > major
+		|| (GLVersion.major == major && GLVersion.minor >= minor);
+}
+
+/* True if either the context version or the extension provide a feature. */
+bool glExtHas(int major, int minor, const char *extension)
+{
+	return glExtHasVersion(major, minor)
+		|| glfwExtensionSupported(extension);
+}
+
+void glExtInit(void)
+{
+	if (glExtHas(4, 1, "GL_ARB_get_program_binary")) {
+		glExt.getProgramBinary = (PFNGLGETPROGRAMBINARYPROC)
+			glfwGetProcAddress("glGetProgramBinary");
+		glExt.programBinary = (PFNGLPROGRAMBINARYPROC)
+			glfwGetProcAddress("glProgramBinary");
+		glExt.programParameteri = (PFNGLPROGRAMPARAMETERIPROC)
+			glfwGetProcAddress("glProgramParameteri");
+
+		/* Drivers may support the API yet offer no binary format. */
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+		glExt.hasProgramBinary = glExt.getProgramBinary != nullptr
+			&& glExt.programBinary != nullptr
+			&& glExt.programParameteri != nullptr
+			&& formats > 0;
+	}
+
+	/* Indirect commands only honour their base instance from 4.2 on. */
+	if (glExtHasVersion(4, 3)
+	    || (glfwExtensionSupported("GL_ARB_multi_draw_indirect")
+		&& glExtHas(4, 2, "GL_ARB_base_instance"))) {
+		glExt.multiDrawElementsIndirect =
+			(PFNGLMULTIDRAWELEMENTSINDIRECTPROC)
+			glfwGetProcAddress("glMultiDrawElementsIndirect");
+		glExt.hasMultiDrawIndirect =
+			glExt.multiDrawElementsIndirect != nullptr;
+	}
+
+	if (glExtHas(4, 3, "GL_ARB_texture_buffer_range")) {
+		glExt.texBufferRange = (PFNGLTEXBUFFERRANGEPROC)
+			glfwGetProcAddress("glTexBufferRange");
+		glExt.hasTexBufferRange = glExt.texBufferRange != nullptr;
+	}
+
+	if (glExtHas(4, 4, "GL_ARB_buffer_storage")) {
+		glExt.bufferStorage = (PFNGLBUFFERSTORAGEPROC)
+			glfwGetProcAddress("glBufferStorage");
+		glExt.hasBufferStorage = glExt.bufferStorage != nullptr;
+	}
+
+	glExt.hasS3TC = glfwExtensionSupported("GL_EXT_texture_compression_s3tc");
+	glExt.hasBPTC = glExtHas(4, 2, "GL_ARB_texture_compression_bptc");
+}
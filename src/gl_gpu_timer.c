@@ -0,0 +1,96 @@
+/* GPU timer - Measure GPU time per frame without stalling
+ *
+ * OVERVIEW: - A GPUTimer brackets commands with GL_TIME_ELAPSED queries,
+ *   cycling through GPU_TIMER_FRAMES of them. Results are only read once
+ *   available, a few frames late, so the CPU never waits on the GPU.
+ *
+ * - Results are read before beginning the next query, so a query is free
+ *   again as soon as its result is. A frame begun with every query pending
+ *   is not measured.
+ *
+ * USAGE:
+ * - GPUTimer timer;
+ * - gpuTimerInit(&timer);
+ * - // Every frame
+ * - float milliseconds;
+ * - while (gpuTimerRead(&timer, &milliseconds)) adapt(milliseconds);
+ * - gpuTimerBegin(&timer);
+ * - draw();
+ * - gpuTimerEnd(&timer);
+ * - gpuTimerFree(&timer);
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "glad/glad.h"
+#include "common.h"
+
+enum : int {
+	GPU_TIMER_FRAMES = 4,
+};
+
+typedef struct GPUTimer {
+	GLuint queries[GPU_TIMER_FRAMES];
+	bool pending[GPU_TIMER_FRAMES];
+	uint32_t next;		/* Query to begin next */
+	uint32_t oldest;	/* Pending query to read first */
+	bool running;		/* Begun and not ended yet */
+} GPUTimer;
+
+void gpuTimerInit(GPUTimer *timer)
+{
+	*timer = (GPUTimer){};
+	glGenQueries(GPU_TIMER_FRAMES, timer->queries);
+}
+
+/* Start timing. Does nothing while every query is still pending. */
+void gpuTimerBegin(GPUTimer *timer)
+{
+	if (timer->pending[timer->next]) {
+		return;
+	}
+	glBeginQuery(GL_TIME_ELAPSED, timer->queries[timer->next]);
+	timer->running = true;
+}
+
+/* Stop timing, if gpuTimerBegin() started. */
+void gpuTimerEnd(GPUTimer *timer)
+{
+	if (!timer->running) {
+		return;
+	}
+	glEndQuery(GL_TIME_ELAPSED);
+	timer->running = false;
+	timer->pending[timer->next] = true;
+	timer->next = (timer->next + 1) % GPU_TIMER_FRAMES;
+}
+
+/* Oldest measurement not read yet, if the GPU got to it. */
+bool gpuTimerRead(GPUTimer *timer, float *millisecondsOut)
+{
+	if (!timer->pending[timer->oldest]) {
+		return false;
+	}
+
+	GLuint available = GL_FALSE;
+	glGetQueryObjectuiv(timer->queries[timer->oldest],
+			    GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) {
+		return false;
+	}
+
+	GLuint64 nanoseconds = 0;
+	glGetQueryObjectui64v(timer->queries[timer->oldest], GL_QUERY_RESULT,
+			      &nanoseconds);
+	timer->pending[timer->oldest] = false;
+	timer->oldest = (timer->oldest + 1) % GPU_TIMER_FRAMES;
+	*millisecondsOut = (float)nanoseconds / 1.0e6f;
+	return true;
+}
+
+void gpuTimerFree(GPUTimer *timer)
+{
+	glDeleteQueries(GPU_TIMER_FRAMES, timer->queries);
+	*timer = (GPUTimer){};
+}
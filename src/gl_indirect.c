@@ -0,0 +1,253 @@
+/* Indirect draws - Submit every pooled mesh in one multi-draw
+ *
+ * OVERVIEW: - With GL 4.3 multi-draw indirect, the whole scene is one
+ *   glMultiDrawElementsIndirect() over the geometry pool of gl_mesh.c, so the
+ *   draw call count no longer depends on the object count.
+ *
+ * - Every frame, the culling stage calls `indirectAdd()` for every object
+ *   that survived. It appends one command per submesh, and the object's model
+ *   and normal matrices to the per-draw data. `indirectFinish()` then streams
+ *   both through ring buffers, the matrices being read by the vertex shader
+ *   from a buffer texture.
+ *
+ * - Every command of an object has the object's index as its base instance.
+ *   The pool feeds the instance index to GPU_MESH_DRAW_ID_LOCATION, which
+ *   tells the vertex shader where its matrices are. This stands in for
+ *   gl_DrawID, which needs GL 4.6 or ARB_shader_draw_parameters.
+ *
+ * - Objects drawn with different state, such as materials, are queued one
+ *   group after the other, and each group drawn with `indirectDrawRange()`.
+ *
+ * - Without 4.3, `indirect.enabled` stays false, and `indirectAdd()` refuses
+ *   meshes outside the pool. Callers then draw those objects one by one.
+ *
+ * USAGE:
+ * - indirectInit(DRAW_TEXTURE_UNIT);
+ * - // Every frame, after culling
+ * - indirectBegin();
+ * - GLsizei first = indirectQueued();
+ * - if (!indirectAdd(&mesh, lod, model, normalMatrix)) drawLater();
+ * - GLsizei count = indirectQueued() - first;
+ * - indirectFinish();
+ * - indirectDraw(program); // Or indirectDrawRange(program, first, count);
+ * - indirectEnd();
+ * - indirectFree();
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "glad/glad.h"
+#include "cglm/cglm.h"
+#include "common.h"
+#include "gl_ext.c"
+#include "gl_mesh.c"
+#include "gl_ring_buffer.c"
+#include "gl_state.c"
+#include "stb_ds.h"
+
+enum : int {
+	INDIRECT_MAX_DRAWS = GPU_MESH_MAX_DRAWS,
+	INDIRECT_MAX_COMMANDS = INDIRECT_MAX_DRAWS * 4,
+};
+
+/* Layout fixed by glMultiDrawElementsIndirect(). */
+typedef struct IndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+} IndirectCommand;
+
+/* 8 texels of the per-draw buffer texture. */
+typedef struct IndirectDraw {
+	mat4 model;
+	mat4 normalMatrix;
+} IndirectDraw;
+
+struct Indirect {
+	bool enabled;
+	GLint textureUnit;
+	GLint alignment;
+	GLuint drawTexture;
+	RingBuffer commandRing;
+	RingBuffer drawRing;
+	IndirectCommand *commands;	/* stb_ds.h array */
+	IndirectDraw *draws;		/* stb_ds.h array */
+	GLintptr commandOffset;
+	GLsizei commandCount;		/* Uploaded this frame */
+};
+
+struct Indirect indirect;
+
+/* Enable indirect draws if the context supports them. Per-draw data is
+ * bound to `textureUnit`. */
+Error indirectInit(GLint textureUnit)
+{
+	if (!glExt.hasMultiDrawIndirect || !glExt.hasTexBufferRange) {
+		return ERR_OK;
+	}
+
+	indirect.textureUnit = textureUnit;
+	glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &indirect.alignment);
+	indirect.alignment = indirect.alignment > 0 ? indirect.alignment : 1;
+
+	Error e = ringBufferInit(&indirect.commandRing, GL_DRAW_INDIRECT_BUFFER,
+				 sizeof(IndirectCommand)
+				 * INDIRECT_MAX_COMMANDS);
+	if (e != ERR_OK) {
+		return e;
+	}
+	e = ringBufferInit(&indirect.drawRing, GL_TEXTURE_BUFFER,
+			   sizeof(IndirectDraw) * INDIRECT_MAX_DRAWS
+			   + (size_t)indirect.alignment);
+	if (e != ERR_OK) {
+		ringBufferFree(&indirect.commandRing);
+		return e;
+	}
+
+	glGenTextures(1, &indirect.drawTexture);
+	indirect.enabled = true;
+	return ERR_OK;
+}
+
+void indirectBegin(void)
+{
+	if (!indirect.enabled) {
+		return;
+	}
+
+	arrsetlen(indirect.commands, 0);
+	arrsetlen(indirect.draws, 0);
+	indirect.commandCount = 0;
+	ringBufferBeginFrame(&indirect.commandRing);
+	ringBufferBeginFrame(&indirect.drawRing);
+}
+
+/* Queue `mesh` at level `lod`, clamped. False if the caller must draw it
+ * itself. */
+bool indirectAdd(const GPUMesh *mesh, uint32_t lod, mat4 model,
+		 mat4 normalMatrix)
+{
+	if (!indirect.enabled || !mesh->pooled
+	    || arrlen(indirect.draws) >= INDIRECT_MAX_DRAWS
+	    || arrlen(indirect.commands) + mesh->submeshCount
+	       > INDIRECT_MAX_COMMANDS) {
+		return false;
+	}
+
+	GLuint drawID = (GLuint)arrlen(indirect.draws);
+	IndirectDraw *draw = arraddnptr(indirect.draws, 1);
+	glm_mat4_copy(model, draw->model);
+	glm_mat4_copy(normalMatrix, draw->normalMatrix);
+
+	const GPUSubmesh *submeshes = gpuMeshLodSubmeshes(mesh, lod);
+	for (uint32_t i = 0; i < mesh->submeshCount; i++) {
+		IndirectCommand command = {
+			.count = (GLuint)submeshes[i].indexCount,
+			.instanceCount = 1,
+			.firstIndex = (GLuint)(submeshes[i].indexOffset
+					       / sizeof(uint32_t)),
+			.baseVertex = mesh->baseVertex,
+			.baseInstance = drawID,
+		};
+		arrput(indirect.commands, command);
+	}
+	return true;
+}
+
+/* Upload the frame's commands and per-draw data. */
+void indirectFinish(void)
+{
+	if (!indirect.enabled || arrlen(indirect.commands) == 0) {
+		return;
+	}
+
+	size_t commandSize = sizeof(IndirectCommand) * arrlen(indirect.commands);
+	size_t drawSize = sizeof(IndirectDraw) * arrlen(indirect.draws);
+	/* Never full, the rings being sized for all indirectAdd() accepts. */
+	RingAllocation commands;
+	RingAllocation draws;
+	if (!ringBufferAlloc(&indirect.commandRing, commandSize,
+			     alignof(IndirectCommand), &commands)
+	    || !ringBufferAlloc(&indirect.drawRing, drawSize,
+				(size_t)indirect.alignment, &draws)) {
+		return;
+	}
+
+	memcpy(commands.data, indirect.commands, commandSize);
+	memcpy(draws.data, indirect.draws, drawSize);
+	ringBufferFlush(&indirect.commandRing);
+	ringBufferFlush(&indirect.drawRing);
+
+	glStateActiveTexture(GL_TEXTURE0 + (GLenum)indirect.textureUnit);
+	glStateBindTexture(GL_TEXTURE_BUFFER, indirect.drawTexture);
+	glExt.texBufferRange(GL_TEXTURE_BUFFER, GL_RGBA32F,
+			     indirect.drawRing.buffer, draws.offset,
+			     (GLsizeiptr)drawSize);
+
+	indirect.commandOffset = commands.offset;
+	indirect.commandCount = (GLsizei)arrlen(indirect.commands);
+}
+
+/* Commands queued so far this frame, where the next object's start. */
+GLsizei indirectQueued(void)
+{
+	return (GLsizei)arrlen(indirect.commands);
+}
+
+/* Draw `count` of the frame's commands from `first` with `program`, in one
+ * call. */
+void indirectDrawRange(GLuint program, GLsizei first, GLsizei count)
+{
+	if (count == 0 || first + count > indirect.commandCount) {
+		return;
+	}
+
+	glStateUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "indirectDraws"), GL_TRUE);
+	glStateActiveTexture(GL_TEXTURE0 + (GLenum)indirect.textureUnit);
+	glStateBindTexture(GL_TEXTURE_BUFFER, indirect.drawTexture);
+
+	glStateBindVertexArray(gpuMeshPool.vao);
+	glStateBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect.commandRing.buffer);
+	glExt.multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+					(void *)(indirect.commandOffset
+						 + (GLintptr)first
+						 * (GLintptr)sizeof(
+							 IndirectCommand)),
+					count, 0);
+
+	glUniform1i(glGetUniformLocation(program, "indirectDraws"), GL_FALSE);
+}
+
+/* Draw everything queued this frame with `program`, in one call. */
+void indirectDraw(GLuint program)
+{
+	indirectDrawRange(program, 0, indirect.commandCount);
+}
+
+/* Fence the frame's ring partitions, after its last indirect draw. */
+void indirectEnd(void)
+{
+	if (!indirect.enabled) {
+		return;
+	}
+
+	ringBufferEndFrame(&indirect.commandRing);
+	ringBufferEndFrame(&indirect.drawRing);
+}
+
+void indirectFree(void)
+{
+	if (indirect.enabled) {
+		ringBufferFree(&indirect.commandRing);
+		ringBufferFree(&indirect.drawRing);
+		glDeleteTextures(1, &indirect.drawTexture);
+	}
+	arrfree(indirect.commands);
+	arrfree(indirect.draws);
+	indirect = (struct Indirect){};
+}
@@ -0,0 +1,403 @@
+/* GPU meshes - Upload cooked meshes to OpenGL and draw them
+ *
+ * OVERVIEW: - `gpuMeshLoad()` maps a cooked mesh and uploads its streams and
+ *   index buffer as they are, then builds the VAO from the mesh's
+ *   VertexLayout. Nothing is parsed or converted: compressed attributes are
+ *   expanded by the vertex fetch hardware.
+ *
+ * - Quantized positions are mapped back to object space by `dequantize`, which
+ *   callers fold into the model matrix with `gpuMeshModelMatrix()`.
+ *   Octahedral normals are decoded by the vertex shader, which
+ *   `gpuMeshSetUniforms()` tells about them.
+ *
+ * - Cooked meshes are suballocated from one pool: one buffer per vertex
+ *   stream and one 32-bit index buffer, behind a single VAO. The first mesh
+ *   loaded sets the pool's vertex layout; meshes laid out differently, or
+ *   that no longer fit, get buffers of their own. Pooled meshes are drawn
+ *   with a base vertex, and their space is only reclaimed with the pool.
+ *
+ * - The pool's VAO also feeds GPU_MESH_DRAW_ID_LOCATION with the instance
+ *   index, so indirect draws can tell their draws apart through their base
+ *   instance, see gl_indirect.c.
+ *
+ * - `gpuMeshFromVertices()` wraps hard-coded, non-indexed vertices in the same
+ *   interface, for when no cooked mesh is available.
+ *
+ * - `gpuMeshDraw()` issues one draw per submesh, of the full mesh.
+ *   `gpuMeshDrawLod()` draws one of the simplified levels of detail instead,
+ *   all of which index the same vertex buffers.
+ *
+ * USAGE:
+ * - GPUMesh cube;
+ * - gpuMeshLoad(&cube, "cube");
+ * - gpuMeshDraw(&cube);
+ * - gpuMeshFree(&cube);
+ * - gpuMeshPoolFree();
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glad/glad.h"
+#include "cglm/cglm.h"
+#include "common.h"
+#include "gl_state.c"
+#include "mesh.c"
+#include "stb_ds.h"
+
+enum : int {
+	GPU_MESH_PATH_SIZE = 512,
+	GPU_MESH_POOL_VERTICES = 1 << 18,
+	GPU_MESH_POOL_INDICES = 1 << 20,
+	/* Instance index input, after the mesh attributes. */
+	GPU_MESH_DRAW_ID_LOCATION = MESH_ATTRIBUTE_COUNT,
+	GPU_MESH_MAX_DRAWS = 4096,
+};
+
+typedef struct GPUSubmesh {
+	GLsizei indexCount;
+	uintptr_t indexOffset;	/* In bytes */
+} GPUSubmesh;
+
+typedef struct GPUMesh {
+	GLuint vao;
+	GLuint buffers[MESH_MAX_STREAMS];
+	GLuint indexBuffer;
+	GLenum indexType;
+	GLsizei vertexCount;
+	GLsizei indexCount;	/* 0 if not indexed */
+	GPUSubmesh *submeshes;	/* stb_ds.h array, level after level */
+	uint32_t submeshCount;	/* Per level of detail */
+	uint32_t lodCount;
+	float lodErrors[MESH_MAX_LODS];	/* In object units */
+	vec3 boundsMin;
+	vec3 boundsMax;
+	mat4 dequantize;	/* Maps stored positions to object space */
+	bool octahedralNormals;
+	bool pooled;
+	GLint baseVertex;	/* Within the pool */
+} GPUMesh;
+
+struct GPUMeshPool {
+	GLuint vao;
+	GLuint buffers[MESH_MAX_STREAMS];
+	GLuint indexBuffer;
+	GLuint drawIDBuffer;
+	VertexLayout layout;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+};
+
+struct GPUMeshPool gpuMeshPool;
+
+GLenum gpuComponentType(VertexComponentType type)
+{
+	switch (type) {
+	case VERTEX_COMPONENT_FLOAT:
+		break;
+	case VERTEX_COMPONENT_HALF:
+		return GL_HALF_FLOAT;
+	case VERTEX_COMPONENT_UNORM16:
+		return GL_UNSIGNED_SHORT;
+	}
+	return GL_FLOAT;
+}
+
+/* Point the current VAO's attributes at `buffers`, one per stream. */
+void gpuMeshSetLayout(const VertexLayout *layout, const GLuint *buffers)
+{
+	for (uint32_t i = 0; i < layout->attributeCount; i++) {
+		const VertexAttribute *attribute = &layout->attributes[i];
+		VertexFormatInfo info = vertexFormatInfo(attribute->format);
+
+		glStateBindBuffer(GL_ARRAY_BUFFER, buffers[attribute->stream]);
+		glVertexAttribPointer(attribute->location,
+				      (GLint)info.components,
+				      gpuComponentType(info.type),
+				      info.normalized ? GL_TRUE : GL_FALSE,
+				      (GLsizei)layout->strides[attribute->stream],
+				      (void *)(uintptr_t)attribute->offset);
+		glEnableVertexAttribArray(attribute->location);
+	}
+}
+
+/* Empty pool of vertices laid out as `layout`. */
+void gpuMeshPoolInit(const VertexLayout *layout)
+{
+	gpuMeshPool.layout = *layout;
+
+	glGenVertexArrays(1, &gpuMeshPool.vao);
+	glStateBindVertexArray(gpuMeshPool.vao);
+
+	glGenBuffers((GLsizei)layout->streamCount, gpuMeshPool.buffers);
+	for (uint32_t i = 0; i < layout->streamCount; i++) {
+		glStateBindBuffer(GL_ARRAY_BUFFER, gpuMeshPool.buffers[i]);
+		glBufferData(GL_ARRAY_BUFFER,
+			     (GLsizeiptr)layout->strides[i]
+			     * GPU_MESH_POOL_VERTICES,
+			     nullptr, GL_STATIC_DRAW);
+	}
+	gpuMeshSetLayout(layout, gpuMeshPool.buffers);
+
+	uint32_t drawIDs[GPU_MESH_MAX_DRAWS];
+	for (uint32_t i = 0; i < GPU_MESH_MAX_DRAWS; i++) {
+		drawIDs[i] = i;
+	}
+	glGenBuffers(1, &gpuMeshPool.drawIDBuffer);
+	glStateBindBuffer(GL_ARRAY_BUFFER, gpuMeshPool.drawIDBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(drawIDs), drawIDs,
+		     GL_STATIC_DRAW);
+	glVertexAttribIPointer(GPU_MESH_DRAW_ID_LOCATION, 1, GL_UNSIGNED_INT,
+			       0, nullptr);
+	glVertexAttribDivisor(GPU_MESH_DRAW_ID_LOCATION, 1);
+	glEnableVertexAttribArray(GPU_MESH_DRAW_ID_LOCATION);
+
+	glGenBuffers(1, &gpuMeshPool.indexBuffer);
+	glStateBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpuMeshPool.indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+		     (GLsizeiptr)sizeof(uint32_t) * GPU_MESH_POOL_INDICES,
+		     nullptr, GL_STATIC_DRAW);
+	glStateBindVertexArray(0);
+}
+
+/* Copy `mapped` into the pool, at `*firstIndexOut` in its index buffer.
+ * False if it does not fit or is laid out differently. */
+bool gpuMeshPoolAdd(GPUMesh *mesh, const MappedMesh *mapped,
+		    const VertexLayout *layout, uint32_t *firstIndexOut)
+{
+	const MeshHeader *header = mapped->header;
+	if (gpuMeshPool.vao == 0) {
+		gpuMeshPoolInit(layout);
+	}
+	if (memcmp(layout, &gpuMeshPool.layout, sizeof(VertexLayout)) != 0
+	    || header->vertexCount
+	       > GPU_MESH_POOL_VERTICES - gpuMeshPool.vertexCount
+	    || header->indexCount
+	       > GPU_MESH_POOL_INDICES - gpuMeshPool.indexCount) {
+		return false;
+	}
+
+	/* Indices are widened, so meshes of either index type share the
+	 * buffer. */
+	uint32_t *indices = malloc(sizeof(uint32_t) * header->indexCount);
+	if (indices == nullptr) {
+		return false;
+	}
+	meshDecodeIndices(mapped, 0, header->indexCount, indices);
+
+	for (uint32_t i = 0; i < header->streamCount; i++) {
+		glStateBindBuffer(GL_ARRAY_BUFFER, gpuMeshPool.buffers[i]);
+		glBufferSubData(GL_ARRAY_BUFFER,
+				(GLintptr)layout->strides[i]
+				* gpuMeshPool.vertexCount,
+				(GLsizeiptr)header->streams[i].size,
+				meshStreamData(mapped, i));
+	}
+	/* Binding GL_ELEMENT_ARRAY_BUFFER would change whichever vertex array
+	 * is bound, so the indices go through a target no VAO keeps. */
+	glStateBindBuffer(GL_COPY_WRITE_BUFFER, gpuMeshPool.indexBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER,
+			(GLintptr)sizeof(uint32_t) * gpuMeshPool.indexCount,
+			(GLsizeiptr)sizeof(uint32_t) * header->indexCount,
+			indices);
+	free(indices);
+
+	mesh->vao = gpuMeshPool.vao;
+	mesh->indexType = GL_UNSIGNED_INT;
+	mesh->baseVertex = (GLint)gpuMeshPool.vertexCount;
+	*firstIndexOut = gpuMeshPool.indexCount;
+	gpuMeshPool.vertexCount += header->vertexCount;
+	gpuMeshPool.indexCount += header->indexCount;
+	return true;
+}
+
+void gpuMeshPoolFree(void)
+{
+	glDeleteVertexArrays(1, &gpuMeshPool.vao);
+	glDeleteBuffers(MESH_MAX_STREAMS, gpuMeshPool.buffers);
+	glDeleteBuffers(1, &gpuMeshPool.indexBuffer);
+	glDeleteBuffers(1, &gpuMeshPool.drawIDBuffer);
+	gpuMeshPool = (struct GPUMeshPool){};
+}
+
+Error gpuMeshLoad(GPUMesh *meshOut, const char *name)
+{
+	char path[GPU_MESH_PATH_SIZE];
+	(void)snprintf(path, sizeof(path), COOKED_RESOURCE_PATH "/%s.mesh",
+		       name);
+
+	MappedMesh mapped;
+	Error e = meshMap(&mapped, path);
+	if (e != ERR_OK) {
+		return e;
+	}
+	const MeshHeader *header = mapped.header;
+
+	GPUMesh mesh = {
+		.indexType = header->indexType == MESH_INDEX_U16
+			? GL_UNSIGNED_SHORT
+			: GL_UNSIGNED_INT,
+		.vertexCount = (GLsizei)header->vertexCount,
+		.indexCount = (GLsizei)header->indexCount,
+		.submeshCount = header->submeshCount,
+		.lodCount = header->lodCount,
+	};
+	for (uint32_t i = 0; i < header->lodCount; i++) {
+		mesh.lodErrors[i] = header->lods[i].error;
+	}
+	glm_vec3_copy((float *)header->boundsMin, mesh.boundsMin);
+	glm_vec3_copy((float *)header->boundsMax, mesh.boundsMax);
+	glm_translate_make(mesh.dequantize, (float *)header->positionOffset);
+	glm_scale(mesh.dequantize, (float *)header->positionScale);
+	mesh.octahedralNormals =
+		header->attributes[MESH_ATTRIBUTE_NORMAL].format
+		== VERTEX_FORMAT_OCT_UNORM16X2;
+
+	VertexLayout layout;
+	meshVertexLayout(header, &layout);
+	uint32_t firstIndex = 0;
+	mesh.pooled = gpuMeshPoolAdd(&mesh, &mapped, &layout, &firstIndex);
+	if (!mesh.pooled) {
+		glGenVertexArrays(1, &mesh.vao);
+		glStateBindVertexArray(mesh.vao);
+
+		glGenBuffers((GLsizei)header->streamCount, mesh.buffers);
+		for (uint32_t i = 0; i < header->streamCount; i++) {
+			glStateBindBuffer(GL_ARRAY_BUFFER, mesh.buffers[i]);
+			glBufferData(GL_ARRAY_BUFFER,
+				     (GLsizeiptr)header->streams[i].size,
+				     meshStreamData(&mapped, i),
+				     GL_STATIC_DRAW);
+		}
+		gpuMeshSetLayout(&layout, mesh.buffers);
+
+		/* The element buffer binding is part of the VAO. */
+		glGenBuffers(1, &mesh.indexBuffer);
+		glStateBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+			     (GLsizeiptr)header->indexSize,
+			     meshIndexData(&mapped), GL_STATIC_DRAW);
+		glStateBindVertexArray(0);
+	}
+
+	size_t indexSize = mesh.pooled ? sizeof(uint32_t) : header->indexType;
+	for (uint32_t i = 0; i < header->submeshCount * header->lodCount; i++) {
+		GPUSubmesh submesh = {
+			.indexCount = (GLsizei)mapped.submeshes[i].indexCount,
+			.indexOffset = (uintptr_t)(firstIndex
+				+ mapped.submeshes[i].indexOffset) * indexSize,
+		};
+		arrput(mesh.submeshes, submesh);
+	}
+	meshUnmap(&mapped);
+
+	*meshOut = mesh;
+
+	return ERR_OK;
+}
+
+/* Non-indexed mesh of `vertexCount` vertices, each a position, a texture
+ * coordinate and a normal, as floats. */
+void gpuMeshFromVertices(GPUMesh *meshOut, const GLfloat *vertices,
+			 GLsizei vertexCount)
+{
+	const VertexLayout layout = {
+		.streamCount = 1,
+		.strides = {8 * sizeof(GLfloat)},
+		.attributeCount = MESH_ATTRIBUTE_COUNT,
+		.attributes = {
+			{MESH_ATTRIBUTE_POSITION, VERTEX_FORMAT_FLOAT3, 0, 0},
+			{MESH_ATTRIBUTE_TEXCOORD, VERTEX_FORMAT_FLOAT2, 0,
+			 3 * sizeof(GLfloat)},
+			{MESH_ATTRIBUTE_NORMAL, VERTEX_FORMAT_FLOAT3, 0,
+			 5 * sizeof(GLfloat)},
+		},
+	};
+
+	GPUMesh mesh = {
+		.vertexCount = vertexCount,
+		.lodCount = 1,
+	};
+	glm_mat4_identity(mesh.dequantize);
+
+	glm_vec3_broadcast(INFINITY, mesh.boundsMin);
+	glm_vec3_broadcast(-INFINITY, mesh.boundsMax);
+	for (GLsizei i = 0; i < vertexCount; i++) {
+		glm_vec3_minv(mesh.boundsMin, (float *)&vertices[i * 8],
+			      mesh.boundsMin);
+		glm_vec3_maxv(mesh.boundsMax, (float *)&vertices[i * 8],
+			      mesh.boundsMax);
+	}
+
+	glGenVertexArrays(1, &mesh.vao);
+	glStateBindVertexArray(mesh.vao);
+	glGenBuffers(1, &mesh.buffers[0]);
+	glStateBindBuffer(GL_ARRAY_BUFFER, mesh.buffers[0]);
+	glBufferData(GL_ARRAY_BUFFER,
+		     (GLsizeiptr)layout.strides[0] * vertexCount, vertices,
+		     GL_STATIC_DRAW);
+	gpuMeshSetLayout(&layout, mesh.buffers);
+	glStateBindVertexArray(0);
+
+	*meshOut = mesh;
+}
+
+/* Model matrix for drawing `mesh` at `world`. */
+void gpuMeshModelMatrix(GPUMesh *mesh, mat4 world, mat4 modelOut)
+{
+	glm_mat4_mul(world, mesh->dequantize, modelOut);
+}
+
+/* Tell the current program how `mesh` encodes its attributes. */
+void gpuMeshSetUniforms(const GPUMesh *mesh, GLuint shaderID)
+{
+	glUniform1i(glGetUniformLocation(shaderID, "octahedralNormals"),
+		    mesh->octahedralNormals);
+}
+
+/* The `submeshCount` submeshes of `lod`, clamped to the coarsest level. */
+const GPUSubmesh *gpuMeshLodSubmeshes(const GPUMesh *mesh, uint32_t lod)
+{
+	if (lod >= mesh->lodCount) {
+		lod = mesh->lodCount - 1;
+	}
+	return &mesh->submeshes[lod * mesh->submeshCount];
+}
+
+/* `lod` is clamped to the coarsest level. */
+void gpuMeshDrawLod(const GPUMesh *mesh, uint32_t lod)
+{
+	glStateBindVertexArray(mesh->vao);
+
+	if (mesh->indexCount == 0) {
+		glDrawArrays(GL_TRIANGLES, 0, mesh->vertexCount);
+		return;
+	}
+
+	const GPUSubmesh *submeshes = gpuMeshLodSubmeshes(mesh, lod);
+	for (uint32_t i = 0; i < mesh->submeshCount; i++) {
+		glDrawElementsBaseVertex(GL_TRIANGLES, submeshes[i].indexCount,
+					 mesh->indexType,
+					 (void *)submeshes[i].indexOffset,
+					 mesh->baseVertex);
+	}
+}
+
+void gpuMeshDraw(const GPUMesh *mesh)
+{
+	gpuMeshDrawLod(mesh, 0);
+}
+
+/* Pooled meshes keep their space until gpuMeshPoolFree(). */
+void gpuMeshFree(GPUMesh *mesh)
+{
+	if (!mesh->pooled) {
+		glDeleteVertexArrays(1, &mesh->vao);
+		glDeleteBuffers(MESH_MAX_STREAMS, mesh->buffers);
+		glDeleteBuffers(1, &mesh->indexBuffer);
+	}
+	arrfree(mesh->submeshes);
+	*mesh = (GPUMesh){};
+}
@@ -0,0 +1,254 @@
+/* OpenGL render graph - Realize render_graph.c resources and run its passes
+ *
+ * OVERVIEW: - `glGraphExecute()` gives every slot of a compiled graph a
+ *   texture, kept across frames and only reallocated when the slot's
+ *   description changes, then runs the surviving passes in order.
+ *
+ * - Before each pass, the attachments it draws to are bound: color and depth
+ *   attachment usages and transfer destinations, whether read or written. An
+ *   imported resource's handle is the framebuffer holding it, 0 being the
+ *   default one, and a pass drawing to one draws to that framebuffer only.
+ *   Other passes get a framebuffer object of their own. Transfer sources are
+ *   bound for reading the same way, for blits. The viewport covers the first
+ *   attachment.
+ *
+ * - Passes find their textures with `glGraphTexture()`. OpenGL resolves
+ *   hazards between passes itself, so transitions are ignored.
+ *
+ * USAGE:
+ * - renderGraphCompile(&graph);
+ * - glGraphExecute(&graph);
+ * - // In a pass
+ * - glStateBindTexture(GL_TEXTURE_2D, glGraphTexture(graph, color));
+ * - glGraphFree();
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "glad/glad.h"
+#include "common.h"
+#include "gl_capture.c"
+#include "gl_state.c"
+#include "render_graph.c"
+#include "stb_ds.h"
+
+enum : int {
+	GL_GRAPH_MAX_ATTACHMENTS = 8,
+};
+
+struct GLGraph {
+	GLuint *textures;		/* stb_ds.h array, one per slot */
+	RGTextureDesc *descs;		/* stb_ds.h array, of `textures` */
+	GLuint *framebuffers;		/* stb_ds.h array, one per pass */
+	GLuint readFramebuffer;
+};
+
+struct GLGraph glGraph;
+
+typedef struct GLGraphFormat {
+	GLenum internalFormat;
+	GLenum format;
+	GLenum type;
+} GLGraphFormat;
+
+GLGraphFormat glGraphFormat(RGFormat format)
+{
+	switch (format) {
+	case RG_FORMAT_RGBA8:
+		break;
+	case RG_FORMAT_RGBA16F:
+		return (GLGraphFormat){GL_RGBA16F, GL_RGBA, GL_FLOAT};
+	case RG_FORMAT_DEPTH24_STENCIL8:
+		return (GLGraphFormat){GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL,
+				       GL_UNSIGNED_INT_24_8};
+	}
+	return (GLGraphFormat){GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE};
+}
+
+bool glGraphIsDepth(RGFormat format)
+{
+	return format == RG_FORMAT_DEPTH24_STENCIL8;
+}
+
+/* Texture of a transient resource. */
+GLuint glGraphTexture(const RenderGraph *graph, RGResource resource)
+{
+	int32_t slot = graph->resources[resource].slot;
+	return slot == RG_NONE ? 0 : glGraph.textures[slot];
+}
+
+/* Give every slot a texture of its description. */
+void glGraphRealize(const RenderGraph *graph)
+{
+	while (arrlen(glGraph.textures) < arrlen(graph->slots)) {
+		GLuint texture;
+		glGenTextures(1, &texture);
+		arrput(glGraph.textures, texture);
+		arrput(glGraph.descs, (RGTextureDesc){});
+	}
+
+	for (ptrdiff_t i = 0; i < arrlen(graph->slots); i++) {
+		RGTextureDesc desc = graph->slots[i].desc;
+		if (renderGraphSameDesc(glGraph.descs[i], desc)) {
+			continue;
+		}
+
+		GLGraphFormat format = glGraphFormat(desc.format);
+		glStateBindTexture(GL_TEXTURE_2D, glGraph.textures[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, (GLint)format.internalFormat,
+			     desc.width, desc.height, 0, format.format,
+			     format.type, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+				GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+				GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
+				GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
+				GL_CLAMP_TO_EDGE);
+		glGraph.descs[i] = desc;
+	}
+	glStateBindTexture(GL_TEXTURE_2D, 0);
+
+	while (arrlen(glGraph.framebuffers) < arrlen(graph->passes)) {
+		GLuint framebuffer;
+		glGenFramebuffers(1, &framebuffer);
+		arrput(glGraph.framebuffers, framebuffer);
+	}
+	if (glGraph.readFramebuffer == 0) {
+		glGenFramebuffers(1, &glGraph.readFramebuffer);
+	}
+}
+
+bool glGraphIsAttachment(RGUsage usage)
+{
+	return usage == RG_USAGE_COLOR_ATTACHMENT
+		|| usage == RG_USAGE_DEPTH_ATTACHMENT
+		|| usage == RG_USAGE_TRANSFER_DST;
+}
+
+/* Attach the transient resources `pass` uses as `usage`, or as any
+ * attachment when `usage` is RG_USAGE_NONE, to the framebuffer bound at
+ * `target`, and for reading too. False if there are none. If one is
+ * imported, its framebuffer is returned in `importedOut` instead. */
+bool glGraphAttach(const RenderGraph *graph, RGPass pass, GLenum target,
+		   RGUsage usage, GLuint *importedOut, RGTextureDesc *descOut)
+{
+	const RGPassNode *node = &graph->passes[pass];
+	GLenum drawBuffers[GL_GRAPH_MAX_ATTACHMENTS];
+	GLsizei colorCount = 0;
+	bool any = false;
+
+	/* Framebuffers are reused across frames, whatever the graph. */
+	glFramebufferTexture2D(target, GL_DEPTH_STENCIL_ATTACHMENT,
+			       GL_TEXTURE_2D, 0, 0);
+
+	for (ptrdiff_t i = 0; i < arrlen(node->accesses); i++) {
+		const RGAccess *access = &node->accesses[i];
+		if (usage == RG_USAGE_NONE ? !glGraphIsAttachment(access->usage)
+					   : access->usage != usage) {
+			continue;
+		}
+
+		const RGResourceNode *resource =
+			&graph->resources[access->resource];
+		if (!any) {
+			*descOut = resource->desc;
+		}
+		any = true;
+		if (resource->imported) {
+			*importedOut = (GLuint)resource->handle;
+			return true;
+		}
+
+		GLenum attachment;
+		if (glGraphIsDepth(resource->desc.format)) {
+			attachment = GL_DEPTH_STENCIL_ATTACHMENT;
+		} else if (colorCount < GL_GRAPH_MAX_ATTACHMENTS) {
+			attachment = GL_COLOR_ATTACHMENT0 + (GLenum)colorCount;
+			drawBuffers[colorCount++] = attachment;
+		} else {
+			continue;
+		}
+		glFramebufferTexture2D(target, attachment, GL_TEXTURE_2D,
+				       glGraph.textures[resource->slot], 0);
+	}
+
+	for (GLsizei i = colorCount; i < GL_GRAPH_MAX_ATTACHMENTS; i++) {
+		glFramebufferTexture2D(target, GL_COLOR_ATTACHMENT0 + (GLenum)i,
+				       GL_TEXTURE_2D, 0, 0);
+	}
+	/* A read buffer without attachment leaves the framebuffer incomplete,
+	 * even when only drawn to. */
+	glReadBuffer(colorCount > 0 ? GL_COLOR_ATTACHMENT0 : GL_NONE);
+	if (target == GL_DRAW_FRAMEBUFFER) {
+		glDrawBuffers(colorCount, drawBuffers);
+	}
+	return any;
+}
+
+/* Bind the framebuffers `pass` draws to and reads from. */
+Error glGraphBindPass(const RenderGraph *graph, RGPass pass)
+{
+	GLuint framebuffer = glGraph.framebuffers[pass];
+	RGTextureDesc desc = {};
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	if (glGraphAttach(graph, pass, GL_DRAW_FRAMEBUFFER, RG_USAGE_NONE,
+			  &framebuffer, &desc)) {
+		if (framebuffer != glGraph.framebuffers[pass]) {
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+		} else if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER)
+			   != GL_FRAMEBUFFER_COMPLETE) {
+			return ERR_FRAMEBUFFER_CREATION_FAILED;
+		}
+		glStateViewport(0, 0, desc.width, desc.height);
+	}
+
+	RGTextureDesc readDesc;
+	GLuint readFramebuffer = glGraph.readFramebuffer;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+	if (glGraphAttach(graph, pass, GL_READ_FRAMEBUFFER,
+			  RG_USAGE_TRANSFER_SRC, &readFramebuffer, &readDesc)
+	    && readFramebuffer != glGraph.readFramebuffer) {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+	}
+
+	return ERR_OK;
+}
+
+/* Run the surviving passes of the compiled `graph`. */
+Error glGraphExecute(RenderGraph *graph)
+{
+	glGraphRealize(graph);
+
+	for (ptrdiff_t i = 0; i < arrlen(graph->passes); i++) {
+		const RGPassNode *pass = &graph->passes[i];
+		if (pass->culled) {
+			continue;
+		}
+
+		captureMarker(pass->name);
+		Error e = glGraphBindPass(graph, (RGPass)i);
+		if (e != ERR_OK) {
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			return e;
+		}
+		pass->execute(graph, (RGPass)i, pass->user);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return ERR_OK;
+}
+
+void glGraphFree(void)
+{
+	glDeleteTextures((GLsizei)arrlen(glGraph.textures), glGraph.textures);
+	glDeleteFramebuffers((GLsizei)arrlen(glGraph.framebuffers),
+			     glGraph.framebuffers);
+	glDeleteFramebuffers(1, &glGraph.readFramebuffer);
+	arrfree(glGraph.textures);
+	arrfree(glGraph.descs);
+	arrfree(glGraph.framebuffers);
+	glGraph = (struct GLGraph){};
+}
@@ -0,0 +1,194 @@
+/* Streaming ring buffer - Per-frame dynamic GL data at memcpy speed
+ *
+ * OVERVIEW: - A RingBuffer hands out ranges of one GL buffer for data
+ *   rewritten every frame. `ringBufferAlloc()` returns a pointer to write
+ *   the data at and the offset to bind or draw it from. Allocations only live
+ *   until the end of the frame.
+ *
+ * - With ARB_buffer_storage, the buffer is mapped once, persistent and
+ *   coherent, and split in RING_FRAMES partitions, one per frame in flight.
+ *   A frame writes straight into its partition. Each partition is fenced at
+ *   the end of its frame and only reused once the fence signals, so the GPU
+ *   never reads data being overwritten, and the CPU rarely waits.
+ *
+ * - On plain 3.3, writes go to a staging copy instead. The buffer is orphaned
+ *   at the start of every frame and `ringBufferFlush()` uploads what was
+ *   written since the last flush, so the driver never waits on last frame's
+ *   draws either.
+ *
+ * - Call `ringBufferFlush()` before drawing with anything allocated. It does
+ *   nothing on persistent buffers.
+ *
+ * USAGE:
+ * - RingBuffer ring;
+ * - ringBufferInit(&ring, GL_ARRAY_BUFFER, 1 << 20);
+ * - // Every frame
+ * - ringBufferBeginFrame(&ring);
+ * - RingAllocation lines;
+ * - if (ringBufferAlloc(&ring, bytes, 16, &lines)) {
+ * -	memcpy(lines.data, vertices, bytes);
+ * - }
+ * - ringBufferFlush(&ring);
+ * - glDrawArrays(GL_LINES, lines.offset / stride, count);
+ * - ringBufferEndFrame(&ring);
+ * - ringBufferFree(&ring);
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "glad/glad.h"
+#include "common.h"
+#include "gl_ext.c"
+#include "gl_state.c"
+
+enum : int {
+	RING_FRAMES = 3,
+};
+
+/* Nanoseconds between checks while waiting on a partition. */
+static constexpr GLuint64 ringWaitTimeout = 1000000;
+
+typedef struct RingAllocation {
+	void *data;
+	GLintptr offset;	/* From the start of the buffer */
+} RingAllocation;
+
+typedef struct RingBuffer {
+	GLuint buffer;
+	GLenum target;
+	size_t partitionSize;
+	bool persistent;
+	uint8_t *memory;	/* Persistent mapping, or the staging copy */
+	uint32_t partition;
+	size_t head;		/* Within the partition */
+	size_t flushed;		/* Staging bytes already uploaded */
+	GLsync fences[RING_FRAMES];
+} RingBuffer;
+
+Error ringBufferInit(RingBuffer *ringOut, GLenum target, size_t partitionSize)
+{
+	RingBuffer ring = {
+		.target = target,
+		.partitionSize = partitionSize,
+		.persistent = glExt.hasBufferStorage,
+	};
+
+	glGenBuffers(1, &ring.buffer);
+	glStateBindBuffer(target, ring.buffer);
+	if (ring.persistent) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT
+			| GL_MAP_COHERENT_BIT;
+		GLsizeiptr size = (GLsizeiptr)(partitionSize * RING_FRAMES);
+		glExt.bufferStorage(target, size, nullptr, flags);
+		ring.memory = glMapBufferRange(target, 0, size, flags);
+	} else {
+		glBufferData(target, (GLsizeiptr)partitionSize, nullptr,
+			     GL_STREAM_DRAW);
+		ring.memory = malloc(partitionSize);
+	}
+
+	if (ring.memory == nullptr) {
+		glDeleteBuffers(1, &ring.buffer);
+		return ERR_OUT_OF_MEMORY;
+	}
+
+	*ringOut = ring;
+	return ERR_OK;
+}
+
+/* Start writing the next partition, once the GPU is done with it. */
+void ringBufferBeginFrame(RingBuffer *ring)
+{
+	ring->head = 0;
+	ring->flushed = 0;
+
+	if (!ring->persistent) {
+		glStateBindBuffer(ring->target, ring->buffer);
+		glBufferData(ring->target, (GLsizeiptr)ring->partitionSize,
+			     nullptr, GL_STREAM_DRAW);
+		return;
+	}
+
+	GLsync fence = ring->fences[ring->partition];
+	if (fence == nullptr) {
+		return;
+	}
+
+	GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	GLenum status = glClientWaitSync(fence, flags, ringWaitTimeout);
+	while (status == GL_TIMEOUT_EXPIRED) {
+		flags = 0;
+		status = glClientWaitSync(fence, flags, ringWaitTimeout);
+	}
+	glDeleteSync(fence);
+	ring->fences[ring->partition] = nullptr;
+}
+
+/* `size` bytes at an offset that is a multiple of `alignment`, or false when
+ * the partition is full. */
+bool ringBufferAlloc(RingBuffer *ring, size_t size, size_t alignment,
+		     RingAllocation *allocationOut)
+{
+	size_t base = ring->persistent
+		? (size_t)ring->partition * ring->partitionSize
+		: 0;
+	size_t offset = (base + ring->head + alignment - 1) / alignment
+		* alignment;
+	if (offset + size > base + ring->partitionSize) {
+		return false;
+	}
+
+	/* The staging copy holds one partition, at offset 0 like its buffer. */
+	*allocationOut = (RingAllocation){
+		.data = ring->memory + offset,
+		.offset = (GLintptr)offset,
+	};
+	ring->head = offset + size - base;
+	return true;
+}
+
+/* Make everything allocated so far visible to the GPU. */
+void ringBufferFlush(RingBuffer *ring)
+{
+	if (ring->persistent || ring->flushed == ring->head) {
+		return;
+	}
+
+	glStateBindBuffer(ring->target, ring->buffer);
+	glBufferSubData(ring->target, (GLintptr)ring->flushed,
+			(GLsizeiptr)(ring->head - ring->flushed),
+			ring->memory + ring->flushed);
+	ring->flushed = ring->head;
+}
+
+/* Fence the partition after the frame's last command using it. */
+void ringBufferEndFrame(RingBuffer *ring)
+{
+	if (!ring->persistent) {
+		return;
+	}
+
+	ring->fences[ring->partition] =
+		glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	ring->partition = (ring->partition + 1) % RING_FRAMES;
+}
+
+void ringBufferFree(RingBuffer *ring)
+{
+	for (int i = 0; i < RING_FRAMES; i++) {
+		if (ring->fences[i] != nullptr) {
+			glDeleteSync(ring->fences[i]);
+		}
+	}
+
+	if (ring->persistent) {
+		glStateBindBuffer(ring->target, ring->buffer);
+		glUnmapBuffer(ring->target);
+	} else {
+		free(ring->memory);
+	}
+	glDeleteBuffers(1, &ring->buffer);
+	*ring = (RingBuffer){};
+}
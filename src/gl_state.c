@@ -0,0 +1,250 @@
+/* GL state cache - Skip binds of state that is already current
+ *
+ * OVERVIEW: - The glState* functions stand in for the GL calls of the same
+ *   name for the program, vertex array, buffer bindings, active texture unit,
+ *   texture bindings per unit, depth test, blending, face culling and
+ *   viewport. A call is only issued when it changes what the cache last saw.
+ *   Issued and elided calls are counted per frame, `glStateEndFrame()`
+ *   keeping last frame's counts in `glState.lastFrame`.
+ *
+ * - The cache only knows state changed through it, so everything drawing
+ *   goes through it. State starts unknown, and `glStateInvalidate()` forgets
+ *   it all again, e.g. after deleting bound objects, which GL unbinds behind
+ *   the cache's back.
+ *
+ * - Element array buffers are bound to the current vertex array, not the
+ *   context, so their binds are always issued, as are those of targets,
+ *   units and capabilities not tracked here.
+ *
+ * USAGE:
+ * - glStateInvalidate();
+ * - glStateUseProgram(program);
+ * - glStateActiveTexture(GL_TEXTURE0);
+ * - glStateBindTexture(GL_TEXTURE_2D, texture);
+ * - glStateEndFrame();
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "glad/glad.h"
+#include "common.h"
+#include "gl_ext.c"
+
+enum : int {
+	GL_STATE_TEXTURE_UNITS = 16,
+};
+
+static constexpr GLuint glStateUnknown = 0xFFFFFFFFu;
+
+typedef enum GLStateBuffer : int {
+	GL_STATE_BUFFER_ARRAY = 0,
+	GL_STATE_BUFFER_TEXTURE,
+	GL_STATE_BUFFER_DRAW_INDIRECT,
+	GL_STATE_BUFFER_PIXEL_UNPACK,
+	GL_STATE_BUFFER_LAST,
+} GLStateBuffer;
+
+typedef enum GLStateTexture : int {
+	GL_STATE_TEXTURE_2D = 0,
+	GL_STATE_TEXTURE_BUFFER,
+	GL_STATE_TEXTURE_LAST,
+} GLStateTexture;
+
+typedef enum GLStateCapability : int {
+	GL_STATE_CAPABILITY_DEPTH_TEST = 0,
+	GL_STATE_CAPABILITY_BLEND,
+	GL_STATE_CAPABILITY_CULL_FACE,
+	GL_STATE_CAPABILITY_LAST,
+} GLStateCapability;
+
+typedef struct GLStateCounters {
+	uint32_t issued;
+	uint32_t elided;
+} GLStateCounters;
+
+struct GLState {
+	GLuint program;
+	GLuint vertexArray;
+	GLuint buffers[GL_STATE_BUFFER_LAST];
+	GLenum activeTexture;
+	GLuint textures[GL_STATE_TEXTURE_UNITS][GL_STATE_TEXTURE_LAST];
+	GLuint capabilities[GL_STATE_CAPABILITY_LAST];	/* GL_TRUE, GL_FALSE */
+	GLint viewport[4];
+	bool viewportKnown;
+	GLStateCounters frame;
+	GLStateCounters lastFrame;
+};
+
+struct GLState glState;
+
+void glStateInvalidate(void)
+{
+	GLStateCounters frame = glState.frame;
+	GLStateCounters lastFrame = glState.lastFrame;
+
+	glState = (struct GLState){
+		.program = glStateUnknown,
+		.vertexArray = glStateUnknown,
+		.activeTexture = glStateUnknown,
+		.frame = frame,
+		.lastFrame = lastFrame,
+	};
+	for (int i = 0; i < GL_STATE_BUFFER_LAST; i++) {
+		glState.buffers[i] = glStateUnknown;
+	}
+	for (int i = 0; i < GL_STATE_TEXTURE_UNITS; i++) {
+		for (int j = 0; j < GL_STATE_TEXTURE_LAST; j++) {
+			glState.textures[i][j] = glStateUnknown;
+		}
+	}
+	for (int i = 0; i < GL_STATE_CAPABILITY_LAST; i++) {
+		glState.capabilities[i] = glStateUnknown;
+	}
+}
+
+/* Record that `*cached` should become `value`. True if the call changing it
+ * must be issued. */
+bool glStateChange(GLuint *cached, GLuint value)
+{
+	if (*cached == value) {
+		glState.frame.elided++;
+		return false;
+	}
+
+	*cached = value;
+	glState.frame.issued++;
+	return true;
+}
+
+void glStateUseProgram(GLuint program)
+{
+	if (glStateChange(&glState.program, program)) {
+		glUseProgram(program);
+	}
+}
+
+void glStateBindVertexArray(GLuint vertexArray)
+{
+	if (glStateChange(&glState.vertexArray, vertexArray)) {
+		glBindVertexArray(vertexArray);
+	}
+}
+
+void glStateBindBuffer(GLenum target, GLuint buffer)
+{
+	GLuint *cached = nullptr;
+	switch (target) {
+	case GL_ARRAY_BUFFER:
+		cached = &glState.buffers[GL_STATE_BUFFER_ARRAY];
+		break;
+	case GL_TEXTURE_BUFFER:
+		cached = &glState.buffers[GL_STATE_BUFFER_TEXTURE];
+		break;
+	case GL_DRAW_INDIRECT_BUFFER:
+		cached = &glState.buffers[GL_STATE_BUFFER_DRAW_INDIRECT];
+		break;
+	case GL_PIXEL_UNPACK_BUFFER:
+		cached = &glState.buffers[GL_STATE_BUFFER_PIXEL_UNPACK];
+		break;
+	}
+
+	if (cached == nullptr) {
+		glState.frame.issued++;
+		glBindBuffer(target, buffer);
+	} else if (glStateChange(cached, buffer)) {
+		glBindBuffer(target, buffer);
+	}
+}
+
+void glStateActiveTexture(GLenum texture)
+{
+	if (glStateChange(&glState.activeTexture, texture)) {
+		glActiveTexture(texture);
+	}
+}
+
+/* Binds to the active unit, like glBindTexture(). */
+void glStateBindTexture(GLenum target, GLuint texture)
+{
+	GLuint unit = glState.activeTexture - GL_TEXTURE0;
+	int index = -1;
+	if (target == GL_TEXTURE_2D) {
+		index = GL_STATE_TEXTURE_2D;
+	} else if (target == GL_TEXTURE_BUFFER) {
+		index = GL_STATE_TEXTURE_BUFFER;
+	}
+
+	/* An unknown active unit is out of range too. */
+	if (index < 0 || unit >= GL_STATE_TEXTURE_UNITS) {
+		glState.frame.issued++;
+		glBindTexture(target, texture);
+	} else if (glStateChange(&glState.textures[unit][index], texture)) {
+		glBindTexture(target, texture);
+	}
+}
+
+void glStateSetCapability(GLenum capability, bool enabled)
+{
+	GLuint *cached = nullptr;
+	switch (capability) {
+	case GL_DEPTH_TEST:
+		cached = &glState.capabilities[GL_STATE_CAPABILITY_DEPTH_TEST];
+		break;
+	case GL_BLEND:
+		cached = &glState.capabilities[GL_STATE_CAPABILITY_BLEND];
+		break;
+	case GL_CULL_FACE:
+		cached = &glState.capabilities[GL_STATE_CAPABILITY_CULL_FACE];
+		break;
+	}
+
+	if (cached != nullptr
+	    && !glStateChange(cached, enabled ? GL_TRUE : GL_FALSE)) {
+		return;
+	}
+	if (cached == nullptr) {
+		glState.frame.issued++;
+	}
+
+	if (enabled) {
+		glEnable(capability);
+	} else {
+		glDisable(capability);
+	}
+}
+
+void glStateEnable(GLenum capability)
+{
+	glStateSetCapability(capability, true);
+}
+
+void glStateDisable(GLenum capability)
+{
+	glStateSetCapability(capability, false);
+}
+
+void glStateViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if (glState.viewportKnown && glState.viewport[0] == x
+	    && glState.viewport[1] == y && glState.viewport[2] == width
+	    && glState.viewport[3] == height) {
+		glState.frame.elided++;
+		return;
+	}
+
+	glState.viewport[0] = x;
+	glState.viewport[1] = y;
+	glState.viewport[2] = width;
+	glState.viewport[3] = height;
+	glState.viewportKnown = true;
+	glState.frame.issued++;
+	glViewport(x, y, width, height);
+}
+
+/* Start counting the next frame's calls. */
+void glStateEndFrame(void)
+{
+	glState.lastFrame = glState.frame;
+	glState.frame = (GLStateCounters){};
+}
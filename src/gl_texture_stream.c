@@ -0,0 +1,610 @@
+/* Texture streaming - Load textures in the background, upload them gradually
+ *
+ * OVERVIEW: - `textureStreamLoad()` only queues a texture. A loader thread maps
+ *   its cooked version, or decodes its source image and builds its mips when
+ *   there is none. Meanwhile, `textureStreamGet()` returns a 1x1 placeholder.
+ *
+ * - `textureStreamUpdate()` runs once per frame on the GL thread. It copies
+ *   loaded levels into a pool of pixel buffer objects and uploads from there,
+ *   always picking the smallest pending level first. A texture replaces the
+ *   placeholder as soon as its coarsest level is uploaded, then sharpens as
+ *   finer levels arrive, by lowering GL_TEXTURE_BASE_LEVEL.
+ *
+ * - A pixel buffer is only reused once the fence of its last upload is
+ *   signaled, so uploads never stall. Levels larger than a buffer are
+ *   uploaded in slices of rows.
+ *
+ * - About `--upload-budget <KiB>` are uploaded per frame, 4 MiB by default.
+ *
+ * - Without a loader thread, textures load on the calling thread instead.
+ *
+ * USAGE:
+ * - textureStreamInit();
+ * - StreamTextureID crate = textureStreamLoad("crate");
+ * - // Every frame
+ * - textureStreamUpdate();
+ * - glStateBindTexture(GL_TEXTURE_2D, textureStreamGet(crate));
+ * - textureStreamShutdown();
+ */
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include "glad/glad.h"
+#include "common.h"
+#include "gl_ext.c"
+#include "gl_state.c"
+#include "stb_ds.h"
+#include "stb_image.h"
+#include "texture.c"
+
+enum : int {
+	STREAM_MAX_TEXTURES = 256,
+	STREAM_NAME_SIZE = 64,
+	STREAM_PATH_SIZE = 512,
+	STREAM_BUFFER_COUNT = 4,
+	STREAM_BUFFER_SIZE = 1 << 20,
+	STREAM_DEFAULT_BUDGET = 4 << 20,
+};
+
+typedef int32_t StreamTextureID;
+
+typedef enum StreamState : int {
+	STREAM_QUEUED = 0,
+	STREAM_LOADED,		/* Levels in memory, waiting for upload */
+	STREAM_RESIDENT,
+	STREAM_FAILED,
+} StreamState;
+
+typedef struct StreamLevel {
+	const uint8_t *data;
+	uint32_t width;
+	uint32_t height;
+	uint32_t rows;		/* Rows of texels, or of blocks if compressed */
+	uint32_t rowBytes;
+} StreamLevel;
+
+typedef struct StreamTexture {
+	char name[STREAM_NAME_SIZE];
+	atomic_int state;	/* StreamState */
+
+	/* Written by the loader, before STREAM_LOADED. */
+	MappedTexture cooked;
+	uint8_t *pixels;	/* RGBA8 levels, when decoded from an image */
+	GLenum format;		/* Compressed format, or GL_RGBA8 */
+	uint32_t levelCount;
+	StreamLevel levels[TEXTURE_MAX_LEVELS];
+
+	/* Upload progress, GL thread only. */
+	GLuint id;
+	bool visible;		/* The coarsest level is uploaded */
+	int level;		/* Level being uploaded, counts down to -1 */
+	uint32_t row;		/* Next row of `level` */
+} StreamTexture;
+
+typedef struct StreamBuffer {
+	GLuint buffer;
+	GLsync fence;		/* Last upload from the buffer */
+	size_t size;
+} StreamBuffer;
+
+struct TextureStream {
+	StreamTexture textures[STREAM_MAX_TEXTURES];
+	int32_t textureCount;
+
+	thrd_t loader;
+	bool loaderRunning;
+	mtx_t mutex;
+	cnd_t wake;
+	bool quit;
+	StreamTextureID *queue;		/* stb_ds.h array, under `mutex` */
+
+	/* GL thread only */
+	StreamTextureID *pending;	/* stb_ds.h array, not loaded yet */
+	StreamTextureID *uploads;	/* stb_ds.h array, levels left */
+	StreamBuffer buffers[STREAM_BUFFER_COUNT];
+	GLuint placeholder;
+	size_t budget;
+};
+
+struct TextureStream stream;
+
+/* GL format of a cooked texture, or 0 if the driver cannot sample it. Texels
+ * are uploaded as UNORM whatever the sRGB flag, like decoded images, since
+ * lighting is not done in linear space yet. */
+GLenum streamCookedFormat(const TextureHeader *header)
+{
+	switch (header->format) {
+	case TEXTURE_FORMAT_BC1:
+		return glExt.hasS3TC ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : 0;
+	case TEXTURE_FORMAT_BC3:
+		return glExt.hasS3TC ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : 0;
+	case TEXTURE_FORMAT_BC7:
+		return glExt.hasBPTC ? GL_COMPRESSED_RGBA_BPTC_UNORM : 0;
+	}
+	return 0;
+}
+
+/* Touch every page of a mapping, so the GL thread never waits on the disk
+ * when copying from it. */
+void streamPrefault(const uint8_t *data, size_t size)
+{
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	volatile uint8_t sink = 0;
+	for (size_t i = 0; i < size; i += page) {
+		sink ^= data[i];
+	}
+	(void)sink;
+}
+
+bool streamLoadCooked(StreamTexture *texture)
+{
+	char path[STREAM_PATH_SIZE];
+	(void)snprintf(path, sizeof(path), COOKED_RESOURCE_PATH "/%s.tex",
+		       texture->name);
+	if (textureMap(&texture->cooked, path) != ERR_OK) {
+		return false;
+	}
+
+	const TextureHeader *header = texture->cooked.header;
+	texture->format = streamCookedFormat(header);
+	if (texture->format == 0) {
+		textureUnmap(&texture->cooked);
+		return false;
+	}
+
+	texture->levelCount = header->levelCount;
+	for (uint32_t i = 0; i < header->levelCount; i++) {
+		const TextureLevel *source = &header->levels[i];
+		texture->levels[i] = (StreamLevel){
+			.data = textureLevelData(&texture->cooked, i),
+			.width = source->width,
+			.height = source->height,
+			.rows = textureBlockCount(source->height),
+			.rowBytes = textureBlockCount(source->width)
+				* textureBlockBytes(header->format),
+		};
+	}
+	streamPrefault(texture->cooked.data, texture->cooked.size);
+
+	return true;
+}
+
+/* 2x2 box filter. Odd edges reuse their last row or column. */
+void streamDownsample(const StreamLevel *src, uint8_t *dst, uint32_t width,
+		      uint32_t height)
+{
+	for (uint32_t y = 0; y < height; y++) {
+		uint32_t y0 = 2 * y < src->height ? 2 * y : src->height - 1;
+		uint32_t y1 = 2 * y + 1 < src->height ? 2 * y + 1 : y0;
+		for (uint32_t x = 0; x < width; x++) {
+			uint32_t x0 = 2 * x < src->width ? 2 * x : src->width - 1;
+			uint32_t x1 = 2 * x + 1 < src->width ? 2 * x + 1 : x0;
+			const uint8_t *texels[4] = {
+				&src->data[(y0 * src->width + x0) * 4],
+				&src->data[(y0 * src->width + x1) * 4],
+				&src->data[(y1 * src->width + x0) * 4],
+				&src->data[(y1 * src->width + x1) * 4],
+			};
+			for (int c = 0; c < 4; c++) {
+				dst[(y * width + x) * 4 + c] = (uint8_t)
+					((texels[0][c] + texels[1][c]
+					  + texels[2][c] + texels[3][c] + 2) >> 2);
+			}
+		}
+	}
+}
+
+/* Fallback for textures that were not cooked. */
+bool streamLoadImage(StreamTexture *texture)
+{
+	char path[STREAM_PATH_SIZE];
+	(void)snprintf(path, sizeof(path), RESOURCE_PATH "/%s.png",
+		       texture->name);
+
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+	uint8_t *image = stbi_load(path, &width, &height, &channels, 4);
+	if (image == nullptr) {
+		return false;
+	}
+
+	/* Level sizes first, to allocate the whole chain at once. */
+	size_t total = 0;
+	uint32_t levelWidth = (uint32_t)width;
+	uint32_t levelHeight = (uint32_t)height;
+	texture->levelCount = 0;
+	for (;;) {
+		texture->levels[texture->levelCount++] = (StreamLevel){
+			.width = levelWidth,
+			.height = levelHeight,
+			.rows = levelHeight,
+			.rowBytes = levelWidth * 4,
+		};
+		total += (size_t)levelWidth * levelHeight * 4;
+		if ((levelWidth == 1 && levelHeight == 1)
+		    || texture->levelCount == TEXTURE_MAX_LEVELS) {
+			break;
+		}
+		levelWidth = levelWidth > 1 ? levelWidth / 2 : 1;
+		levelHeight = levelHeight > 1 ? levelHeight / 2 : 1;
+	}
+
+	texture->pixels = malloc(total);
+	if (texture->pixels == nullptr) {
+		stbi_image_free(image);
+		return false;
+	}
+
+	uint8_t *out = texture->pixels;
+	memcpy(out, image, (size_t)width * (size_t)height * 4);
+	stbi_image_free(image);
+	for (uint32_t i = 0; i < texture->levelCount; i++) {
+		StreamLevel *level = &texture->levels[i];
+		if (i > 0) {
+			streamDownsample(&texture->levels[i - 1], out,
+					 level->width, level->height);
+		}
+		level->data = out;
+		out += (size_t)level->rows * level->rowBytes;
+	}
+	texture->format = GL_RGBA8;
+
+	return true;
+}
+
+void streamLoad(StreamTexture *texture)
+{
+	bool loaded = streamLoadCooked(texture) || streamLoadImage(texture);
+	atomic_store(&texture->state, loaded ? STREAM_LOADED : STREAM_FAILED);
+}
+
+int streamLoader(void *arg)
+{
+	(void)arg;
+
+	mtx_lock(&stream.mutex);
+	for (;;) {
+		while (arrlen(stream.queue) == 0 && !stream.quit) {
+			cnd_wait(&stream.wake, &stream.mutex);
+		}
+		if (stream.quit) {
+			break;
+		}
+
+		StreamTextureID id = stream.queue[0];
+		arrdel(stream.queue, 0);
+		mtx_unlock(&stream.mutex);
+
+		streamLoad(&stream.textures[id]);
+
+		mtx_lock(&stream.mutex);
+	}
+	mtx_unlock(&stream.mutex);
+
+	return 0;
+}
+
+void streamSetParameters(void)
+{
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+			GL_NEAREST_MIPMAP_NEAREST);
+}
+
+Error textureStreamInit(void)
+{
+	stream.budget = STREAM_DEFAULT_BUDGET;
+	ptrdiff_t budget = shgeti(arguments, "upload-budget");
+	if (budget >= 0) {
+		int kibibytes = atoi(arguments[budget].value);
+		if (kibibytes <= 0) {
+			return ERR_INVALID_ARGUMENTS;
+		}
+		stream.budget = (size_t)kibibytes * 1024;
+	}
+
+	/* Mid-grey, so neither diffuse nor specular maps stand out. */
+	const uint8_t grey[4] = {128, 128, 128, 255};
+	glGenTextures(1, &stream.placeholder);
+	glStateActiveTexture(GL_TEXTURE0);
+	glStateBindTexture(GL_TEXTURE_2D, stream.placeholder);
+	streamSetParameters();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA,
+		     GL_UNSIGNED_BYTE, grey);
+
+	for (int i = 0; i < STREAM_BUFFER_COUNT; i++) {
+		glGenBuffers(1, &stream.buffers[i].buffer);
+	}
+
+	/* Set once, before any thread reads it. */
+	stbi_set_flip_vertically_on_load(true);
+
+	if (mtx_init(&stream.mutex, mtx_plain) == thrd_success
+	    && cnd_init(&stream.wake) == thrd_success) {
+		stream.loaderRunning = thrd_create(&stream.loader, streamLoader,
+						   nullptr) == thrd_success;
+	}
+
+	return ERR_OK;
+}
+
+/* Return the new texture's ID, or -1 if the stream is full. */
+StreamTextureID textureStreamLoad(const char *name)
+{
+	if (stream.textureCount >= STREAM_MAX_TEXTURES
+	    || strlen(name) >= STREAM_NAME_SIZE) {
+		return -1;
+	}
+
+	StreamTextureID id = stream.textureCount++;
+	StreamTexture *texture = &stream.textures[id];
+	strcpy(texture->name, name);
+	texture->level = -1;
+	atomic_store(&texture->state, STREAM_QUEUED);
+	arrput(stream.pending, id);
+
+	if (!stream.loaderRunning) {
+		streamLoad(texture);
+		return id;
+	}
+
+	mtx_lock(&stream.mutex);
+	arrput(stream.queue, id);
+	cnd_signal(&stream.wake);
+	mtx_unlock(&stream.mutex);
+
+	return id;
+}
+
+GLuint textureStreamGet(StreamTextureID id)
+{
+	if (id < 0 || id >= stream.textureCount
+	    || !stream.textures[id].visible) {
+		return stream.placeholder;
+	}
+	return stream.textures[id].id;
+}
+
+/* Allocate every level, and only show the coarsest one once uploaded. */
+void streamBeginUpload(StreamTexture *texture)
+{
+	glGenTextures(1, &texture->id);
+	glStateActiveTexture(GL_TEXTURE0);
+	glStateBindTexture(GL_TEXTURE_2D, texture->id);
+	streamSetParameters();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL,
+			(GLint)texture->levelCount - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+			(GLint)texture->levelCount - 1);
+
+	for (uint32_t i = 0; i < texture->levelCount; i++) {
+		const StreamLevel *level = &texture->levels[i];
+		if (texture->format == GL_RGBA8) {
+			glTexImage2D(GL_TEXTURE_2D, (GLint)i, GL_RGBA8,
+				     (GLsizei)level->width,
+				     (GLsizei)level->height, 0, GL_RGBA,
+				     GL_UNSIGNED_BYTE, nullptr);
+		} else {
+			glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i,
+					       texture->format,
+					       (GLsizei)level->width,
+					       (GLsizei)level->height, 0,
+					       (GLsizei)(level->rows
+							 * level->rowBytes),
+					       nullptr);
+		}
+	}
+
+	texture->level = (int)texture->levelCount - 1;
+	texture->row = 0;
+}
+
+void streamReleaseMemory(StreamTexture *texture)
+{
+	textureUnmap(&texture->cooked);
+	free(texture->pixels);
+	texture->pixels = nullptr;
+}
+
+/* Start uploading textures the loader is done with. */
+void streamCollectLoaded(void)
+{
+	for (ptrdiff_t i = 0; i < arrlen(stream.pending);) {
+		StreamTextureID id = stream.pending[i];
+		StreamTexture *texture = &stream.textures[id];
+		switch ((StreamState)atomic_load(&texture->state)) {
+		case STREAM_LOADED:
+			streamBeginUpload(texture);
+			arrput(stream.uploads, id);
+			arrdel(stream.pending, i);
+			break;
+		case STREAM_FAILED:
+			(void)fprintf(stderr, "%s: ", texture->name);
+			printError(ERR_TEXTURE_LOADING_FAILED);
+			arrdel(stream.pending, i);
+			break;
+		default:
+			i++;
+			break;
+		}
+	}
+}
+
+/* A buffer whose last upload completed, or nullptr. */
+StreamBuffer *streamAcquireBuffer(void)
+{
+	for (int i = 0; i < STREAM_BUFFER_COUNT; i++) {
+		StreamBuffer *buffer = &stream.buffers[i];
+		if (buffer->fence == nullptr) {
+			return buffer;
+		}
+
+		GLenum status = glClientWaitSync(buffer->fence, 0, 0);
+		if (status == GL_ALREADY_SIGNALED
+		    || status == GL_CONDITION_SATISFIED) {
+			glDeleteSync(buffer->fence);
+			buffer->fence = nullptr;
+			return buffer;
+		}
+	}
+	return nullptr;
+}
+
+/* Index in `uploads` of the texture with the smallest pending level, so every
+ * texture gets a coarse version before any gets a fine one. */
+ptrdiff_t streamNextUpload(void)
+{
+	ptrdiff_t next = -1;
+	size_t smallest = SIZE_MAX;
+	for (ptrdiff_t i = 0; i < arrlen(stream.uploads); i++) {
+		const StreamTexture *texture =
+			&stream.textures[stream.uploads[i]];
+		const StreamLevel *level = &texture->levels[texture->level];
+		size_t size = (size_t)level->rows * level->rowBytes;
+		if (size < smallest) {
+			smallest = size;
+			next = i;
+		}
+	}
+	return next;
+}
+
+/* Upload the next slice of rows of `texture` through `buffer`. */
+bool streamUploadSlice(StreamTexture *texture, StreamBuffer *buffer,
+		       size_t *bytesOut)
+{
+	const StreamLevel *level = &texture->levels[texture->level];
+	uint32_t rows = STREAM_BUFFER_SIZE / level->rowBytes;
+	rows = rows > 0 ? rows : 1;
+	rows = rows < level->rows - texture->row
+		? rows
+		: level->rows - texture->row;
+	size_t bytes = (size_t)rows * level->rowBytes;
+
+	glStateBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer->buffer);
+	if (bytes > buffer->size) {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)bytes, nullptr,
+			     GL_STREAM_DRAW);
+		buffer->size = bytes;
+	}
+
+	/* The fence already guarantees the GPU is done with the buffer. */
+	void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+					(GLsizeiptr)bytes,
+					GL_MAP_WRITE_BIT
+					| GL_MAP_INVALIDATE_RANGE_BIT
+					| GL_MAP_UNSYNCHRONIZED_BIT);
+	if (mapped == nullptr) {
+		return false;
+	}
+	memcpy(mapped, level->data + (size_t)texture->row * level->rowBytes,
+	       bytes);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	glStateActiveTexture(GL_TEXTURE0);
+	glStateBindTexture(GL_TEXTURE_2D, texture->id);
+	if (texture->format == GL_RGBA8) {
+		glTexSubImage2D(GL_TEXTURE_2D, texture->level, 0,
+				(GLint)texture->row, (GLsizei)level->width,
+				(GLsizei)rows, GL_RGBA, GL_UNSIGNED_BYTE,
+				nullptr);
+	} else {
+		/* Rows are rows of blocks. The last slice may end in a partial
+		 * block. */
+		uint32_t y = texture->row * TEXTURE_BLOCK_SIZE;
+		uint32_t height = rows * TEXTURE_BLOCK_SIZE;
+		height = height < level->height - y ? height : level->height - y;
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, texture->level, 0,
+					  (GLint)y, (GLsizei)level->width,
+					  (GLsizei)height, texture->format,
+					  (GLsizei)bytes, nullptr);
+	}
+	buffer->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	texture->row += rows;
+	if (texture->row == level->rows) {
+		/* Commands run in order, so draws after this one already see
+		 * the level. */
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL,
+				texture->level);
+		texture->visible = true;
+		texture->level--;
+		texture->row = 0;
+	}
+
+	*bytesOut = bytes;
+
+	return true;
+}
+
+void textureStreamUpdate(void)
+{
+	streamCollectLoaded();
+
+	size_t uploaded = 0;
+	while (uploaded < stream.budget) {
+		ptrdiff_t next = streamNextUpload();
+		if (next < 0) {
+			break;
+		}
+		StreamBuffer *buffer = streamAcquireBuffer();
+		if (buffer == nullptr) {
+			break;
+		}
+
+		StreamTexture *texture = &stream.textures[stream.uploads[next]];
+		size_t bytes = 0;
+		if (!streamUploadSlice(texture, buffer, &bytes)) {
+			break;
+		}
+		uploaded += bytes;
+
+		if (texture->level < 0) {
+			atomic_store(&texture->state, STREAM_RESIDENT);
+			streamReleaseMemory(texture);
+			arrdel(stream.uploads, next);
+		}
+	}
+	glStateBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void textureStreamShutdown(void)
+{
+	if (stream.loaderRunning) {
+		mtx_lock(&stream.mutex);
+		stream.quit = true;
+		cnd_broadcast(&stream.wake);
+		mtx_unlock(&stream.mutex);
+		thrd_join(stream.loader, nullptr);
+		stream.loaderRunning = false;
+
+		cnd_destroy(&stream.wake);
+		mtx_destroy(&stream.mutex);
+	}
+
+	for (int i = 0; i < STREAM_BUFFER_COUNT; i++) {
+		if (stream.buffers[i].fence != nullptr) {
+			glDeleteSync(stream.buffers[i].fence);
+		}
+		glDeleteBuffers(1, &stream.buffers[i].buffer);
+	}
+
+	for (int32_t i = 0; i < stream.textureCount; i++) {
+		glDeleteTextures(1, &stream.textures[i].id);
+		streamReleaseMemory(&stream.textures[i]);
+	}
+	glDeleteTextures(1, &stream.placeholder);
+
+	arrfree(stream.queue);
+	arrfree(stream.pending);
+	arrfree(stream.uploads);
+}
@@ -0,0 +1,158 @@
+/* GL traces - Capture format shared by the engine and gl_replay
+ *
+ * OVERVIEW: - A trace is a TraceHeader, then its call stream, payload table
+ *   and payload data, each on a TRACE_ALIGNMENT boundary.
+ *
+ * - The call stream is a sequence of 64-bit words. Each call is a header word,
+ *   built with TRACE_CALL(), followed by its argument words. Integers and
+ *   enums are stored widened, floats as their bits, and client memory as a
+ *   TRACE_DATA_* word: no data, a payload, or an offset into the bound buffer.
+ *
+ * - Payloads are the buffer, texture, shader and uniform data read from
+ *   client memory. Identical payloads are stored once, and the table keeps
+ *   each one's 64-bit FNV-1a hash, so traces can be compared by content.
+ *
+ * - Object names, uniform locations and syncs are recorded as the capturing
+ *   context returned them. Replayers map them to their own.
+ *
+ * - Calls before `frameWord` set up the state of the captured frame, which
+ *   follows and may be repeated. TRACE_MARKER calls name the ranges of calls
+ *   that follow them, such as render passes.
+ *
+ * - Bump TRACE_VERSION on any layout change.
+ */
+#pragma once
+
+#include <stdint.h>
+
+enum : uint32_t {
+	TRACE_MAGIC = 0x4352544c, /* "LTRC" */
+	TRACE_VERSION = 1,
+	TRACE_ALIGNMENT = 16,
+};
+
+/* Arguments are listed after each call, "data" being a TRACE_DATA_* word,
+ * "names" one word per name. */
+typedef enum TraceFunction : uint32_t {
+	TRACE_MARKER = 0,			/* name data */
+	TRACE_GEN_BUFFERS,			/* n, names */
+	TRACE_DELETE_BUFFERS,			/* n, names */
+	TRACE_GEN_TEXTURES,			/* n, names */
+	TRACE_DELETE_TEXTURES,			/* n, names */
+	TRACE_GEN_VERTEX_ARRAYS,		/* n, names */
+	TRACE_DELETE_VERTEX_ARRAYS,		/* n, names */
+	TRACE_GEN_FRAMEBUFFERS,			/* n, names */
+	TRACE_DELETE_FRAMEBUFFERS,		/* n, names */
+	TRACE_GEN_SAMPLERS,			/* n, names */
+	TRACE_DELETE_SAMPLERS,			/* n, names */
+	TRACE_GEN_QUERIES,			/* n, names */
+	TRACE_DELETE_QUERIES,			/* n, names */
+	TRACE_CREATE_SHADER,			/* type, result */
+	TRACE_DELETE_SHADER,			/* shader */
+	TRACE_SHADER_SOURCE,			/* shader, source data */
+	TRACE_COMPILE_SHADER,			/* shader */
+	TRACE_CREATE_PROGRAM,			/* result */
+	TRACE_DELETE_PROGRAM,			/* program */
+	TRACE_ATTACH_SHADER,			/* program, shader */
+	TRACE_LINK_PROGRAM,			/* program */
+	TRACE_GET_UNIFORM_LOCATION,		/* program, name data, result */
+	TRACE_USE_PROGRAM,			/* program */
+	TRACE_UNIFORM_1I,			/* location, x */
+	TRACE_UNIFORM_1F,			/* location, x */
+	TRACE_UNIFORM_2F,			/* location, x, y */
+	TRACE_UNIFORM_3I,			/* location, x, y, z */
+	TRACE_UNIFORM_3FV,			/* location, count, data */
+	TRACE_UNIFORM_4FV,			/* location, count, data */
+	TRACE_UNIFORM_MATRIX_4FV,		/* location, count, transpose,
+						 * data */
+	TRACE_BIND_VERTEX_ARRAY,		/* array */
+	TRACE_BIND_BUFFER,			/* target, buffer */
+	TRACE_BUFFER_DATA,			/* target, size, data, usage */
+	TRACE_BUFFER_SUB_DATA,			/* target, offset, size, data */
+	TRACE_MAP_BUFFER_RANGE,			/* target, offset, length,
+						 * access */
+	TRACE_UNMAP_BUFFER,			/* target, written data */
+	TRACE_ENABLE_VERTEX_ATTRIB_ARRAY,	/* index */
+	TRACE_VERTEX_ATTRIB_POINTER,		/* index, size, type,
+						 * normalized, stride, data */
+	TRACE_VERTEX_ATTRIB_I_POINTER,		/* index, size, type, stride,
+						 * data */
+	TRACE_VERTEX_ATTRIB_DIVISOR,		/* index, divisor */
+	TRACE_ACTIVE_TEXTURE,			/* texture */
+	TRACE_BIND_TEXTURE,			/* target, texture */
+	TRACE_TEX_PARAMETER_I,			/* target, pname, param */
+	TRACE_TEX_IMAGE_2D,			/* target, level,
+						 * internalformat, width,
+						 * height, border, format,
+						 * type, data */
+	TRACE_TEX_SUB_IMAGE_2D,			/* target, level, x, y, width,
+						 * height, format, type, data */
+	TRACE_COMPRESSED_TEX_IMAGE_2D,		/* target, level,
+						 * internalformat, width,
+						 * height, border, imageSize,
+						 * data */
+	TRACE_COMPRESSED_TEX_SUB_IMAGE_2D,	/* target, level, x, y, width,
+						 * height, format, imageSize,
+						 * data */
+	TRACE_TEX_BUFFER,			/* target, internalformat,
+						 * buffer */
+	TRACE_TEX_BUFFER_RANGE,			/* target, internalformat,
+						 * buffer, offset, size */
+	TRACE_BIND_SAMPLER,			/* unit, sampler */
+	TRACE_SAMPLER_PARAMETER_I,		/* sampler, pname, param */
+	TRACE_BIND_FRAMEBUFFER,			/* target, framebuffer */
+	TRACE_FRAMEBUFFER_TEXTURE_2D,		/* target, attachment,
+						 * textarget, texture, level */
+	TRACE_DRAW_BUFFERS,			/* n, buffers */
+	TRACE_READ_BUFFER,			/* mode */
+	TRACE_BLIT_FRAMEBUFFER,			/* srcX0, srcY0, srcX1, srcY1,
+						 * dstX0, dstY0, dstX1, dstY1,
+						 * mask, filter */
+	TRACE_ENABLE,				/* capability */
+	TRACE_DISABLE,				/* capability */
+	TRACE_VIEWPORT,				/* x, y, width, height */
+	TRACE_CLEAR_COLOR,			/* red, green, blue, alpha */
+	TRACE_CLEAR,				/* mask */
+	TRACE_DRAW_ARRAYS,			/* mode, first, count */
+	TRACE_DRAW_ELEMENTS_BASE_VERTEX,	/* mode, count, type, data,
+						 * basevertex */
+	TRACE_MULTI_DRAW_ELEMENTS_INDIRECT,	/* mode, type, data,
+						 * drawcount, stride */
+	TRACE_BEGIN_QUERY,			/* target, query */
+	TRACE_END_QUERY,			/* target */
+	TRACE_FENCE_SYNC,			/* condition, flags, result */
+	TRACE_CLIENT_WAIT_SYNC,			/* sync, flags, timeout */
+	TRACE_DELETE_SYNC,			/* sync */
+	TRACE_FUNCTION_LAST,
+} TraceFunction;
+
+/* Header word of a call to `function` with `argumentCount` words. */
+#define TRACE_CALL(function, argumentCount) \
+	((uint64_t)(function) | (uint64_t)(argumentCount) << 32)
+#define TRACE_CALL_FUNCTION(word) ((TraceFunction)((word) & 0xFFFFFFFF))
+#define TRACE_CALL_ARGUMENTS(word) ((uint32_t)((word) >> 32))
+
+/* Client memory arguments. Payloads are stored as their index plus one. */
+#define TRACE_DATA_NONE ((uint64_t)0)
+#define TRACE_DATA_OFFSET ((uint64_t)1 << 63)
+
+typedef struct TracePayload {
+	uint64_t hash;		/* FNV-1a */
+	uint64_t offset;	/* From the start of the payload data */
+	uint64_t size;
+} TracePayload;
+
+typedef struct TraceHeader {
+	uint32_t magic;
+	uint32_t version;
+	/* Default framebuffer size */
+	uint32_t width;
+	uint32_t height;
+	uint64_t callOffset;	/* From the start of the file */
+	uint64_t callWords;
+	uint64_t frameWord;	/* First word of the captured frame */
+	uint64_t payloadOffset;
+	uint64_t payloadCount;
+	uint64_t dataOffset;
+	uint64_t dataSize;
+} TraceHeader;
@@ -0,0 +1,187 @@
+/* Job System - A minimal fork/join worker pool
+ *
+ * OVERVIEW: - `jobsInit()` starts one worker per spare CPU core. Workers sleep
+ *   until `jobsParallelFor()` hands them a batch.
+ *
+ * - `jobsParallelFor()` runs `fn(i, user)` for every i in [0, count), on the
+ *   workers and the calling thread, and returns once every call finished.
+ *   Indices are handed out one at a time, so uneven jobs balance themselves.
+ *
+ * - Only one batch runs at a time, and only the main thread may submit one.
+ *   Jobs must not submit batches themselves.
+ *
+ * - Without `jobsInit()`, or after `jobsShutdown()`, batches run serially on
+ *   the calling thread.
+ *
+ * USAGE:
+ * - jobsInit();
+ * - jobsParallelFor(sliceCount, binSlice, &grid);
+ * - jobsShutdown();
+ */
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include "common.h"
+
+typedef void (*JobFn)(int index, void *user);
+
+enum : int {
+	JOBS_MAX_WORKERS = 15,
+};
+
+struct JobSystem {
+	thrd_t workers[JOBS_MAX_WORKERS];
+	int workerCount;
+
+	mtx_t mutex;
+	cnd_t wake;
+	cnd_t done;
+
+	/* Current batch, written by the main thread under `mutex`. */
+	JobFn fn;
+	void *user;
+	int count;
+	uint64_t generation;
+	bool quit;
+
+	atomic_int next;
+	atomic_int remaining;
+	/* Workers that picked up the current generation and did not finish. */
+	int busy;
+};
+
+struct JobSystem jobs;
+
+/* Pull indices until the batch is exhausted. */
+void jobsDrain(JobFn fn, void *user, int count)
+{
+	for (int i = atomic_fetch_add(&jobs.next, 1); i < count;
+	     i = atomic_fetch_add(&jobs.next, 1)) {
+		fn(i, user);
+		atomic_fetch_sub(&jobs.remaining, 1);
+	}
+}
+
+int jobsWorker(void *arg)
+{
+	(void)arg;
+	uint64_t seen = 0;
+
+	mtx_lock(&jobs.mutex);
+	for (;;) {
+		while (jobs.generation == seen && !jobs.quit) {
+			cnd_wait(&jobs.wake, &jobs.mutex);
+		}
+		if (jobs.quit) {
+			break;
+		}
+
+		seen = jobs.generation;
+		/* Woke up after the batch was completed by others. */
+		if (atomic_load(&jobs.remaining) == 0) {
+			continue;
+		}
+
+		JobFn fn = jobs.fn;
+		void *user = jobs.user;
+		int count = jobs.count;
+		jobs.busy++;
+		mtx_unlock(&jobs.mutex);
+
+		jobsDrain(fn, user, count);
+
+		mtx_lock(&jobs.mutex);
+		jobs.busy--;
+		cnd_signal(&jobs.done);
+	}
+	mtx_unlock(&jobs.mutex);
+
+	return 0;
+}
+
+void jobsInit(void)
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	int workerCount = cores > 1 ? (int)cores - 1 : 0;
+	if (workerCount > JOBS_MAX_WORKERS) {
+		workerCount = JOBS_MAX_WORKERS;
+	}
+
+	if (mtx_init(&jobs.mutex, mtx_plain) != thrd_success
+	    || cnd_init(&jobs.wake) != thrd_success
+	    || cnd_init(&jobs.done) != thrd_success) {
+		return;
+	}
+
+	for (int i = 0; i < workerCount; i++) {
+		if (thrd_create(&jobs.workers[i], jobsWorker, nullptr)
+		    != thrd_success) {
+			break;
+		}
+		jobs.workerCount++;
+	}
+}
+
+void jobsShutdown(void)
+{
+	if (jobs.workerCount == 0) {
+		return;
+	}
+
+	mtx_lock(&jobs.mutex);
+	jobs.quit = true;
+	cnd_broadcast(&jobs.wake);
+	mtx_unlock(&jobs.mutex);
+
+	for (int i = 0; i < jobs.workerCount; i++) {
+		thrd_join(jobs.workers[i], nullptr);
+	}
+	jobs.workerCount = 0;
+
+	cnd_destroy(&jobs.done);
+	cnd_destroy(&jobs.wake);
+	mtx_destroy(&jobs.mutex);
+}
+
+int jobsWorkerCount(void)
+{
+	return jobs.workerCount;
+}
+
+void jobsParallelFor(int count, JobFn fn, void *user)
+{
+	if (count <= 0) {
+		return;
+	}
+
+	if (jobs.workerCount == 0 || count == 1) {
+		for (int i = 0; i < count; i++) {
+			fn(i, user);
+		}
+		return;
+	}
+
+	mtx_lock(&jobs.mutex);
+	jobs.fn = fn;
+	jobs.user = user;
+	jobs.count = count;
+	atomic_store(&jobs.next, 0);
+	atomic_store(&jobs.remaining, count);
+	jobs.generation++;
+	cnd_broadcast(&jobs.wake);
+	mtx_unlock(&jobs.mutex);
+
+	jobsDrain(fn, user, count);
+
+	/* Wait for stragglers too, so none of them can grab an index from the
+	 * next batch with this batch's function. */
+	mtx_lock(&jobs.mutex);
+	while (atomic_load(&jobs.remaining) > 0 || jobs.busy > 0) {
+		cnd_wait(&jobs.done, &jobs.mutex);
+	}
+	mtx_unlock(&jobs.mutex);
+}
@@ -0,0 +1,133 @@
+/* Light store - Point and spot lights shared by every shading path
+ *
+ * OVERVIEW: - Lights live in the `lights` stb_ds.h array, in world space.
+ *   Directional light is not stored here since it touches every fragment.
+ *
+ * - Each light has an influence radius past which its contribution drops
+ *   under one 8-bit step. Binning and light volumes rely on it, so call
+ *   `lightUpdateRadius()` after changing colors or falloff.
+ *
+ * - `lightsPack()` flattens the store into LIGHT_TEXELS vec4 texels per light,
+ *   in the layout read by the shaders' `fetchLight()`.
+ */
+#pragma once
+
+#include <math.h>
+
+#include "cglm/cglm.h"
+#include "common.h"
+#include "stb_ds.h"
+
+typedef enum LightType : int {
+	LIGHT_POINT = 0,
+	LIGHT_SPOT = 1,
+} LightType;
+
+enum : int {
+	/* vec4 texels per packed light */
+	LIGHT_TEXELS = 6,
+	/* Hard cap on the store, so packed buffers can be sized once. */
+	LIGHT_MAX = 1024,
+};
+
+typedef struct Light {
+	vec3 position;
+	vec3 dir;	/* Spot only */
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+	float constant;
+	float linear;
+	float quad;
+	float cutoff;		/* Spot only, cosine of the inner cone */
+	float outerCutoff;	/* Spot only, cosine of the outer cone */
+	float radius;
+	LightType type;
+} Light;
+
+typedef int32_t LightID;
+
+Light *lights; /* stb_ds.h array */
+
+/* Distance at which the brightest channel falls under 1/256. */
+void lightUpdateRadius(Light *light)
+{
+	float brightest = 0.0f;
+	for (int i = 0; i < 3; i++) {
+		brightest = fmaxf(brightest, light->ambient[i]);
+		brightest = fmaxf(brightest, light->diffuse[i]);
+		brightest = fmaxf(brightest, light->specular[i]);
+	}
+
+	/* Solve quad * d^2 + linear * d + constant = 256 * brightest. */
+	float c = light->constant - 256.0f * brightest;
+	if (c >= 0.0f) {
+		light->radius = 0.0f;
+		return;
+	}
+
+	if (light->quad <= 0.0f) {
+		light->radius = light->linear > 0.0f
+			? -c / light->linear
+			: INFINITY;
+		return;
+	}
+
+	float discriminant = light->linear * light->linear
+		- 4.0f * light->quad * c;
+	light->radius = (-light->linear + sqrtf(discriminant))
+		/ (2.0f * light->quad);
+}
+
+/* Return the new light's ID, or -1 if the store is full. */
+LightID lightAdd(const Light *light)
+{
+	if (arrlen(lights) >= LIGHT_MAX) {
+		return -1;
+	}
+
+	arrput(lights, *light);
+	lightUpdateRadius(&arrlast(lights));
+
+	return (LightID)(arrlen(lights) - 1);
+}
+
+int32_t lightCount(void)
+{
+	return (int32_t)arrlen(lights);
+}
+
+void lightsFree(void)
+{
+	arrfree(lights);
+}
+
+/* Write LIGHT_TEXELS * 4 floats per light into `out`:
+ * 0: position, radius
+ * 1: ambient, type
+ * 2: diffuse, cutoff
+ * 3: specular, outer cutoff
+ * 4: direction, unused
+ * 5: constant, linear, quadratic falloff, unused */
+void lightsPack(float *out)
+{
+	for (int32_t i = 0; i < lightCount(); i++) {
+		const Light *l = &lights[i];
+		float *t = &out[(ptrdiff_t)i * LIGHT_TEXELS * 4];
+
+		glm_vec3_copy((float *)l->position, &t[0]);
+		t[3] = l->radius;
+		glm_vec3_copy((float *)l->ambient, &t[4]);
+		t[7] = (float)l->type;
+		glm_vec3_copy((float *)l->diffuse, &t[8]);
+		t[11] = l->cutoff;
+		glm_vec3_copy((float *)l->specular, &t[12]);
+		t[15] = l->outerCutoff;
+		glm_vec3_copy((float *)l->dir, &t[16]);
+		t[19] = 0.0f;
+		t[20] = l->constant;
+		t[21] = l->linear;
+		t[22] = l->quad;
+		t[23] = 0.0f;
+	}
+}
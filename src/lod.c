@@ -0,0 +1,125 @@
+/* Level of detail selection - Pick mesh levels by projected screen-space error
+ *
+ * OVERVIEW: - Every level of a cooked mesh records its largest object-space
+ *   error. `lodProject()` gives the pixels one object unit covers at the
+ *   nearest point of the object's bounding sphere, from the vertical field of
+ *   view and the viewport height. Erring close keeps detail when unsure.
+ *
+ * - `lodSelect()` picks the coarsest level whose projected error stays under
+ *   `--lod-threshold` pixels, 1 by default. Switching levels must clear the
+ *   threshold by `lodHysteresis` either way, so an object sitting on a
+ *   boundary does not pop back and forth every frame.
+ *
+ * - The global bias scales the threshold by 2^bias, so positive values trade
+ *   detail for speed. It starts at `--lod-bias`, 0 by default, and
+ *   `lodSetBias()` moves it at runtime for dynamic quality scaling.
+ *
+ * USAGE:
+ * - lodInit();
+ * - float pixelsPerUnit = lodProject(world, mesh.boundsMin, mesh.boundsMax,
+ * -				  cameraPosition, cameraFOV, height, near);
+ * - lod = lodSelect(mesh.lodErrors, mesh.lodCount, pixelsPerUnit, lod);
+ */
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "cglm/cglm.h"
+#include "common.h"
+#include "stb_ds.h"
+
+/* Fraction of the threshold a level must clear to be switched to. */
+static constexpr float lodHysteresis = 0.25f;
+
+struct LodSettings {
+	float threshold;	/* In pixels */
+	float bias;		/* In powers of two of the threshold */
+};
+
+struct LodSettings lodSettings = {
+	.threshold = 1.0f,
+	.bias = 0.0f,
+};
+
+Error lodInit(void)
+{
+	ptrdiff_t threshold = shgeti(arguments, "lod-threshold");
+	if (threshold >= 0) {
+		lodSettings.threshold = strtof(arguments[threshold].value,
+					       nullptr);
+		if (!(lodSettings.threshold > 0.0f)) {
+			return ERR_INVALID_ARGUMENTS;
+		}
+	}
+
+	ptrdiff_t bias = shgeti(arguments, "lod-bias");
+	if (bias >= 0) {
+		lodSettings.bias = strtof(arguments[bias].value, nullptr);
+	}
+
+	return ERR_OK;
+}
+
+void lodSetBias(float bias)
+{
+	lodSettings.bias = bias;
+}
+
+float lodGetBias(void)
+{
+	return lodSettings.bias;
+}
+
+/* Pixels per object unit for an object drawn with `world`. */
+float lodProject(mat4 world, vec3 boundsMin, vec3 boundsMax, vec3 eye,
+		 float fovY, int viewportHeight, float near)
+{
+	vec3 center;
+	glm_vec3_center(boundsMin, boundsMax, center);
+	float radius = glm_vec3_distance(boundsMin, boundsMax) * 0.5f;
+
+	/* Non-uniform scales project by their largest axis. */
+	vec3 worldCenter;
+	glm_mat4_mulv3(world, center, 1.0f, worldCenter);
+	float scale = fmaxf(glm_vec3_norm(world[0]),
+			    fmaxf(glm_vec3_norm(world[1]),
+				  glm_vec3_norm(world[2])));
+
+	float distance = glm_vec3_distance(worldCenter, eye) - radius * scale;
+	distance = fmaxf(distance, near);
+
+	return scale * (float)viewportHeight
+		/ (2.0f * tanf(fovY * 0.5f) * distance);
+}
+
+/* Coarsest level within `limit` pixels. Errors grow with the level. */
+uint32_t lodCoarsestWithin(const float *errors, uint32_t lodCount,
+			   float pixelsPerUnit, float limit)
+{
+	uint32_t lod = 0;
+	while (lod + 1 < lodCount && errors[lod + 1] * pixelsPerUnit <= limit) {
+		lod++;
+	}
+	return lod;
+}
+
+/* The level to draw, given the one drawn last frame. */
+uint32_t lodSelect(const float *errors, uint32_t lodCount, float pixelsPerUnit,
+		   uint32_t current)
+{
+	float threshold = lodSettings.threshold * exp2f(lodSettings.bias);
+	uint32_t coarsest = lodCoarsestWithin(errors, lodCount, pixelsPerUnit,
+					      threshold * (1.0f - lodHysteresis));
+	uint32_t finest = lodCoarsestWithin(errors, lodCount, pixelsPerUnit,
+					    threshold * (1.0f + lodHysteresis));
+
+	if (current < coarsest) {
+		return coarsest;
+	}
+	if (current > finest) {
+		return finest;
+	}
+	return current;
+}
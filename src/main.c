@@ -4,17 +4,40 @@
 
 #include "arena_string.h"
 #include "common.h"
+#include "jobs.c"
 #include "stb_ds.h"
 
 #ifdef VULKAN_ENABLED
-#include "vulkan.c"
-#else /* !VULKAN_ENABLED */
+/* GLFW only declares its Vulkan functions if asked before it is first
+ * included, which opengl.c does after glad. */
+#define GLFW_INCLUDE_VULKAN
+#endif /* VULKAN_ENABLED */
 #include "opengl.c"
+#ifdef VULKAN_ENABLED
+#include "vulkan.c"
 #endif /* VULKAN_ENABLED */
+#include "renderer.h"
+#include "scene.c"
 #include "script.c"
 
 Arguments arguments; /* stb_ds.h string hashmap */
 
+GLFWwindow *window;
+uint64_t frameCount;
+float lastFrameTimeSec;
+float currentFrameTimeSec;
+float deltaTimeSec;
+
+const Renderer *const renderers[] = {
+	&openglRenderer,
+#ifdef VULKAN_ENABLED
+	&vulkanRenderer,
+#endif /* VULKAN_ENABLED */
+};
+
+/* Set by --renderer. */
+const Renderer *renderer = &openglRenderer;
+
 /* The program expects each pair of arguments to be under the format: --option
  * value. Those key-pairs are recorded into the global `arguments` variable,
  * which is an stb_ds.h array. Return the error into input pointer `error`, and
@@ -69,6 +92,26 @@ void freeArguments(void)
 	shfree(arguments);
 }
 
+/* Pick the renderer named by --renderer, OpenGL by default. */
+Error rendererSelect(void)
+{
+	ptrdiff_t index = shgeti(arguments, "renderer");
+	if (index < 0) {
+		return ERR_OK;
+	}
+
+	for (size_t i = 0; i < ARRAY_COUNT_STATIC(renderers); i++) {
+		if (strcmp(arguments[index].value, renderers[i]->name) == 0) {
+			renderer = renderers[i];
+			return ERR_OK;
+		}
+	}
+
+	(void)fprintf(stderr, "unknown renderer: %s\n",
+		      arguments[index].value);
+	return ERR_INVALID_ARGUMENTS;
+}
+
 void recordTime(void)
 {
 	lastFrameTimeSec = currentFrameTimeSec;
@@ -99,12 +142,29 @@ Error init(void)
 {
 	Error e = ERR_OK;
 
-	e = windowInit();
+	jobsInit();
+
+	e = rendererSelect();
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	e = sceneInit();
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	e = renderer->windowInit();
 	if (e != ERR_OK) {
 		return e;
 	}
 	
-	e = graphicsInit();
+	e = renderer->init();
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	e = sceneSubmit(renderer);
 	if (e != ERR_OK) {
 		return e;
 	}
@@ -119,8 +179,10 @@ Error init(void)
 
 void cleanup(void)
 {
-	cleanupGraphics();
-	cleanupWindow();
+	renderer->cleanup();
+	renderer->cleanupWindow();
+	sceneFree();
+	jobsShutdown();
 	arenaFree();
 
 	Error e = scriptUnload();
@@ -129,6 +191,23 @@ void cleanup(void)
 	}
 }
 
+/* Draw the scene, unless the renderer skips the frame. */
+Error drawFrame(void)
+{
+	bool drawing = true;
+	Error e = renderer->beginFrame(&drawing);
+	if (e != ERR_OK || !drawing) {
+		return e;
+	}
+
+	e = renderer->drawScene();
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	return renderer->endFrame();
+}
+
 void mainLoop()
 {
 	Error e = ERR_OK;
@@ -136,7 +215,7 @@ void mainLoop()
 	do {
 		recordTime();
 
-		processInput(window);
+		renderer->processInput(window);
 
 		e = scriptUpdate();
 		if (e != ERR_OK) {
@@ -144,6 +223,8 @@ void mainLoop()
 			return;
 		}
 
+		sceneUpdate();
+
 		e = drawFrame();
 		if (e != ERR_OK) {
 			printError(e);
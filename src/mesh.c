@@ -0,0 +1,252 @@
+/* Cooked mesh loading - Map mesh_format.h containers into memory
+ *
+ * OVERVIEW: - `meshMap()` maps a cooked mesh read-only and validates its
+ *   header, streams, submeshes, levels of detail and index buffer, so
+ *   callers can hand the blocks straight to the graphics API without parsing
+ *   anything.
+ *
+ * USAGE:
+ * - MappedMesh mesh;
+ * - if (meshMap(&mesh, COOKED_RESOURCE_PATH "/cube.mesh") == ERR_OK) {
+ * -	upload(meshIndexData(&mesh), mesh.header->indexSize);
+ * -	meshUnmap(&mesh);
+ * - }
+ */
+#pragma once
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "mesh_format.h"
+
+typedef struct MappedMesh {
+	const MeshHeader *header;
+	const MeshSubmesh *submeshes;
+	const uint8_t *data;
+	size_t size;
+} MappedMesh;
+
+bool meshBlockValid(uint64_t offset, uint64_t size, size_t fileSize)
+{
+	return offset % MESH_ALIGNMENT == 0 && offset <= fileSize
+		&& size <= fileSize - offset;
+}
+
+bool meshHeaderValid(const MeshHeader *header, size_t size)
+{
+	if (header->magic != MESH_MAGIC || header->version != MESH_VERSION
+	    || header->streamCount == 0
+	    || header->streamCount > MESH_MAX_STREAMS
+	    || header->lodCount == 0 || header->lodCount > MESH_MAX_LODS
+	    || (header->indexType != MESH_INDEX_U16
+		&& header->indexType != MESH_INDEX_U32)) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < header->streamCount; i++) {
+		const MeshStream *stream = &header->streams[i];
+		if (stream->stride == 0
+		    || stream->size != (uint64_t)stream->stride
+		       * header->vertexCount
+		    || !meshBlockValid(stream->offset, stream->size, size)) {
+			return false;
+		}
+	}
+
+	for (uint32_t i = 0; i < MESH_ATTRIBUTE_COUNT; i++) {
+		const MeshVertexAttribute *attribute = &header->attributes[i];
+		if (attribute->format == VERTEX_FORMAT_NONE) {
+			continue;
+		}
+		uint32_t size = vertexFormatInfo(attribute->format).size;
+		if (size == 0 || attribute->stream >= header->streamCount
+		    || attribute->offset + size
+		       > header->streams[attribute->stream].stride) {
+			return false;
+		}
+	}
+
+	if (header->indexSize != (uint64_t)header->indexCount
+	    * header->indexType
+	    || !meshBlockValid(header->indexOffset, header->indexSize, size)
+	    || !meshBlockValid(header->submeshOffset,
+			       (uint64_t)header->submeshCount
+			       * header->lodCount * sizeof(MeshSubmesh),
+			       size)) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < header->lodCount; i++) {
+		const MeshLod *lod = &header->lods[i];
+		if (lod->indexOffset > header->indexCount
+		    || lod->indexCount > header->indexCount - lod->indexOffset) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool meshSubmeshesValid(const MeshHeader *header, const MeshSubmesh *submeshes)
+{
+	for (uint32_t i = 0; i < header->submeshCount * header->lodCount; i++) {
+		if (submeshes[i].indexOffset > header->indexCount
+		    || submeshes[i].indexCount
+		       > header->indexCount - submeshes[i].indexOffset) {
+			return false;
+		}
+	}
+	return true;
+}
+
+Error meshMap(MappedMesh *meshOut, const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return ERR_MESH_LOADING_FAILED;
+	}
+
+	struct stat status;
+	if (fstat(fd, &status) != 0
+	    || (size_t)status.st_size < sizeof(MeshHeader)) {
+		(void)close(fd);
+		return ERR_MESH_LOADING_FAILED;
+	}
+
+	size_t size = (size_t)status.st_size;
+	void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	/* The mapping stays valid after closing. */
+	(void)close(fd);
+	if (data == MAP_FAILED) {
+		return ERR_MESH_LOADING_FAILED;
+	}
+
+	const MeshHeader *header = data;
+	if (!meshHeaderValid(header, size)
+	    || !meshSubmeshesValid(header, (const MeshSubmesh *)
+				   ((const uint8_t *)data
+				    + header->submeshOffset))) {
+		(void)munmap(data, size);
+		return ERR_MESH_LOADING_FAILED;
+	}
+
+	*meshOut = (MappedMesh){
+		.header = header,
+		.submeshes = (const MeshSubmesh *)((const uint8_t *)data
+						   + header->submeshOffset),
+		.data = data,
+		.size = size,
+	};
+
+	return ERR_OK;
+}
+
+/* The mesh's vertex layout, with attribute locations being MeshAttribute. */
+void meshVertexLayout(const MeshHeader *header, VertexLayout *layoutOut)
+{
+	VertexLayout layout = {
+		.streamCount = header->streamCount,
+	};
+	for (uint32_t i = 0; i < header->streamCount; i++) {
+		layout.strides[i] = header->streams[i].stride;
+	}
+	for (uint32_t i = 0; i < MESH_ATTRIBUTE_COUNT; i++) {
+		const MeshVertexAttribute *attribute = &header->attributes[i];
+		if (attribute->format != VERTEX_FORMAT_NONE) {
+			layout.attributes[layout.attributeCount++] =
+				(VertexAttribute){
+					.location = i,
+					.format = attribute->format,
+					.stream = attribute->stream,
+					.offset = attribute->offset,
+				};
+		}
+	}
+
+	*layoutOut = layout;
+}
+
+const MeshSubmesh *meshSubmesh(const MappedMesh *mesh, uint32_t lod,
+			       uint32_t submesh)
+{
+	return &mesh->submeshes[lod * mesh->header->submeshCount + submesh];
+}
+
+const void *meshStreamData(const MappedMesh *mesh, uint32_t stream)
+{
+	return mesh->data + mesh->header->streams[stream].offset;
+}
+
+const void *meshIndexData(const MappedMesh *mesh)
+{
+	return mesh->data + mesh->header->indexOffset;
+}
+
+/* Object-space positions of every vertex, for CPU-side use. False when the
+ * position format cannot be decoded. */
+bool meshDecodePositions(const MappedMesh *mesh, float (*positionsOut)[3])
+{
+	const MeshHeader *header = mesh->header;
+	const MeshVertexAttribute *attribute =
+		&header->attributes[MESH_ATTRIBUTE_POSITION];
+	if (attribute->format != VERTEX_FORMAT_FLOAT3
+	    && attribute->format != VERTEX_FORMAT_UNORM16X4) {
+		return false;
+	}
+
+	uint32_t stride = header->streams[attribute->stream].stride;
+	const uint8_t *data = (const uint8_t *)meshStreamData(mesh,
+							       attribute->stream)
+		+ attribute->offset;
+	for (uint32_t i = 0; i < header->vertexCount; i++) {
+		const uint8_t *element = data + (size_t)stride * i;
+		for (int axis = 0; axis < 3; axis++) {
+			float value;
+			if (attribute->format == VERTEX_FORMAT_FLOAT3) {
+				memcpy(&value, element + sizeof(float) * axis,
+				       sizeof(float));
+			} else {
+				uint16_t quantized;
+				memcpy(&quantized,
+				       element + sizeof(uint16_t) * axis,
+				       sizeof(uint16_t));
+				value = (float)quantized / 65535.0f;
+			}
+			positionsOut[i][axis] = header->positionOffset[axis]
+				+ value * header->positionScale[axis];
+		}
+	}
+	return true;
+}
+
+/* `count` indices from `first` on, widened to 32 bits. */
+void meshDecodeIndices(const MappedMesh *mesh, uint32_t first, uint32_t count,
+		       uint32_t *indicesOut)
+{
+	const MeshHeader *header = mesh->header;
+	const uint8_t *data = meshIndexData(mesh);
+	for (uint32_t i = 0; i < count; i++) {
+		size_t offset = (size_t)(first + i) * header->indexType;
+		if (header->indexType == MESH_INDEX_U16) {
+			uint16_t index;
+			memcpy(&index, data + offset, sizeof(index));
+			indicesOut[i] = index;
+		} else {
+			memcpy(&indicesOut[i], data + offset,
+			       sizeof(uint32_t));
+		}
+	}
+}
+
+void meshUnmap(MappedMesh *mesh)
+{
+	if (mesh->data != nullptr) {
+		(void)munmap((void *)mesh->data, mesh->size);
+	}
+	*mesh = (MappedMesh){};
+}
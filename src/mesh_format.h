@@ -0,0 +1,104 @@
+/* Cooked meshes - Container format shared by the cooker and the runtime
+ *
+ * OVERVIEW: - A cooked mesh is a MeshHeader, followed by its submesh table,
+ *   its vertex streams and its index buffer. Every block starts on a
+ *   MESH_ALIGNMENT boundary, so blocks can be handed to the graphics API
+ *   straight from a mapping of the file.
+ *
+ * - Vertices are split in up to MESH_MAX_STREAMS streams. Each attribute
+ *   names its stream and its offset within a stream element, so one stream
+ *   holding every attribute is the interleaved layout.
+ *
+ * - Attribute formats are the VertexFormat values of vertex_layout.h. Quantized
+ *   positions map back to object space with `positionOffset` and
+ *   `positionScale`. Both are the identity for float positions.
+ *
+ * - Indices are 16-bit when every vertex fits, 32-bit otherwise. Submeshes
+ *   are ranges of the index buffer, drawn as triangle lists.
+ *
+ * - Levels of detail share the vertex streams and differ only in their
+ *   indices. The submesh table holds `submeshCount` entries per level, level
+ *   after level, and every level keeps the same submeshes in the same order.
+ *   Each MeshLod records the largest object-space error of its
+ *   simplification, LOD 0 being the full mesh.
+ *
+ * - Bump MESH_VERSION on any layout change. Readers must reject versions they
+ *   do not know, and recook.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "vertex_layout.h"
+
+enum : uint32_t {
+	MESH_MAGIC = 0x48534d4c, /* "LMSH" */
+	MESH_VERSION = 3,
+	MESH_MAX_STREAMS = VERTEX_MAX_STREAMS,
+	MESH_ALIGNMENT = 16,
+	MESH_NAME_SIZE = 32,
+	MESH_MAX_LODS = 8,
+};
+
+/* Also the vertex shader input locations. */
+typedef enum MeshAttribute : uint32_t {
+	MESH_ATTRIBUTE_POSITION = 0,
+	MESH_ATTRIBUTE_TEXCOORD = 1,
+	MESH_ATTRIBUTE_NORMAL = 2,
+	MESH_ATTRIBUTE_COUNT,
+} MeshAttribute;
+
+typedef enum MeshIndexType : uint32_t {
+	MESH_INDEX_U16 = 2,
+	MESH_INDEX_U32 = 4,
+} MeshIndexType;
+
+typedef struct MeshStream {
+	uint64_t offset;	/* From the start of the file */
+	uint64_t size;
+	uint32_t stride;
+	uint32_t reserved;
+} MeshStream;
+
+typedef struct MeshVertexAttribute {
+	VertexFormat format;
+	uint32_t stream;
+	uint32_t offset;	/* Within a stream element */
+	uint32_t reserved;
+} MeshVertexAttribute;
+
+typedef struct MeshSubmesh {
+	char name[MESH_NAME_SIZE];
+	uint32_t indexOffset;	/* In indices, not bytes */
+	uint32_t indexCount;
+	float boundsMin[3];
+	float boundsMax[3];
+} MeshSubmesh;
+
+typedef struct MeshLod {
+	uint32_t indexOffset;	/* In indices, not bytes */
+	uint32_t indexCount;
+	float error;		/* In object units */
+	uint32_t reserved;
+} MeshLod;
+
+typedef struct MeshHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	MeshIndexType indexType;
+	uint32_t streamCount;
+	uint32_t submeshCount;	/* Per level of detail */
+	uint32_t lodCount;
+	float boundsMin[3];
+	float boundsMax[3];
+	float positionOffset[3];
+	float positionScale[3];
+	MeshStream streams[MESH_MAX_STREAMS];
+	MeshVertexAttribute attributes[MESH_ATTRIBUTE_COUNT];
+	MeshLod lods[MESH_MAX_LODS];
+	uint64_t submeshOffset;
+	uint64_t indexOffset;
+	uint64_t indexSize;
+} MeshHeader;
@@ -0,0 +1,492 @@
+/* Software occlusion culling - Rasterize occluders into a CPU depth buffer
+ *
+ * OVERVIEW: - Occluder meshes are rasterized every frame into a small
+ *   OCCLUSION_WIDTH x OCCLUSION_HEIGHT buffer holding 1/w, so larger is
+ *   nearer and the clear value 0 is infinitely far. 1/w is affine in screen
+ *   space, so it interpolates exactly without perspective correction.
+ *
+ * - The buffer is stored tile after tile. `occlusionSubmit()` transforms an
+ *   occluder, sets its triangles up and bins them to the tiles their bounds
+ *   touch. `occlusionRasterize()` then fills every tile in parallel on the job
+ *   system. A tile is only ever written by its own job, so nothing is locked.
+ *
+ * - Tile rows are rasterized 8 pixels at a time with AVX2 when the CPU has
+ *   it, chosen once at init, and one pixel at a time otherwise.
+ *
+ * - `occlusionTestBox()` projects a box and finds its screen rectangle and
+ *   nearest depth. The box is hidden only when every pixel of the rectangle
+ *   holds a nearer occluder, or when the rectangle is off screen. Tiles keep
+ *   their farthest depth, so wholly covered tiles are accepted at once.
+ *
+ * - Both sides err towards visibility. Occluder triangles crossing the near
+ *   plane are dropped rather than clipped, and boxes crossing it are visible.
+ *   Occluders themselves must not reach outside what they stand for.
+ *
+ * - Nothing here touches the graphics API, so it runs and can be checked on
+ *   machines without a GPU.
+ *
+ * USAGE:
+ * - occlusionInit();
+ * - OccluderID wall = occlusionAddMesh(positions, sizeof(float[3]),
+ * -				     vertexCount, indices, indexCount);
+ * - occlusionBegin(viewProjection, nearPlane);
+ * - occlusionSubmit(wall, world);
+ * - occlusionRasterize();
+ * - if (!occlusionTestBox(boundsMin, boundsMax, world)) draw();
+ */
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "cglm/cglm.h"
+#include "common.h"
+#include "jobs.c"
+#include "stb_ds.h"
+
+enum : int {
+	OCCLUSION_WIDTH = 320,
+	OCCLUSION_HEIGHT = 192,
+	OCCLUSION_TILE_WIDTH = 32,	/* A multiple of 8, for AVX2 */
+	OCCLUSION_TILE_HEIGHT = 16,
+	OCCLUSION_TILES_X = OCCLUSION_WIDTH / OCCLUSION_TILE_WIDTH,
+	OCCLUSION_TILES_Y = OCCLUSION_HEIGHT / OCCLUSION_TILE_HEIGHT,
+	OCCLUSION_TILE_COUNT = OCCLUSION_TILES_X * OCCLUSION_TILES_Y,
+	OCCLUSION_TILE_PIXELS = OCCLUSION_TILE_WIDTH * OCCLUSION_TILE_HEIGHT,
+};
+
+typedef int32_t OccluderID;
+#define OCCLUDER_NONE (-1)
+
+typedef struct OccluderMesh {
+	float (*positions)[3];	/* stb_ds.h array */
+	uint32_t *indices;	/* stb_ds.h array */
+} OccluderMesh;
+
+/* Edge functions are A*x + B*y + C, non-negative inside. Depth is the plane
+ * depth[0]*x + depth[1]*y + depth[2]. All in pixels, at pixel centres. */
+typedef struct OcclusionTriangle {
+	float edges[3][3];
+	float depth[3];
+	int minX;
+	int minY;
+	int maxX;		/* Inclusive */
+	int maxY;
+} OcclusionTriangle;
+
+typedef void (*OcclusionRowsFn)(const OcclusionTriangle *triangle,
+				float *tile, int tileX, int tileY, int minX,
+				int minY, int maxX, int maxY);
+
+struct Occlusion {
+	alignas(32) float depth[OCCLUSION_TILE_COUNT * OCCLUSION_TILE_PIXELS];
+	/* Smallest 1/w of every tile, i.e. its farthest occluder. */
+	float tileFarthest[OCCLUSION_TILE_COUNT];
+	uint32_t *bins[OCCLUSION_TILE_COUNT];	/* stb_ds.h arrays */
+	OcclusionTriangle *triangles;		/* stb_ds.h array */
+	OccluderMesh *meshes;			/* stb_ds.h array */
+	mat4 viewProjection;
+	float nearPlane;	/* Clip w of the near plane */
+	OcclusionRowsFn rasterizeRows;
+	bool enabled;
+};
+
+struct Occlusion occlusion = {
+	.enabled = true,
+};
+
+/* Fill the covered pixels of `triangle` within one tile, one at a time.
+ * Bounds are relative to the tile. */
+void occlusionRasterizeRowsScalar(const OcclusionTriangle *triangle,
+				  float *tile, int tileX, int tileY, int minX,
+				  int minY, int maxX, int maxY)
+{
+	const float (*e)[3] = triangle->edges;
+	const float *d = triangle->depth;
+	for (int y = minY; y <= maxY; y++) {
+		float py = (float)(tileY + y) + 0.5f;
+		float *row = &tile[y * OCCLUSION_TILE_WIDTH];
+		for (int x = minX; x <= maxX; x++) {
+			float px = (float)(tileX + x) + 0.5f;
+			if (e[0][0] * px + e[0][1] * py + e[0][2] >= 0.0f
+			    && e[1][0] * px + e[1][1] * py + e[1][2] >= 0.0f
+			    && e[2][0] * px + e[2][1] * py + e[2][2] >= 0.0f) {
+				row[x] = fmaxf(row[x],
+					       d[0] * px + d[1] * py + d[2]);
+			}
+		}
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* Same, 8 pixels at a time. Spans start 8-aligned within the tile, and
+ * extra pixels are masked by the edge tests, never by the bounds. */
+__attribute__((target("avx2")))
+void occlusionRasterizeRowsAVX2(const OcclusionTriangle *triangle, float *tile,
+				int tileX, int tileY, int minX, int minY,
+				int maxX, int maxY)
+{
+	const float (*e)[3] = triangle->edges;
+	const float *d = triangle->depth;
+	const __m256 offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f,
+					      5.5f, 6.5f, 7.5f);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 a0 = _mm256_set1_ps(e[0][0]);
+	const __m256 a1 = _mm256_set1_ps(e[1][0]);
+	const __m256 a2 = _mm256_set1_ps(e[2][0]);
+	const __m256 depthX = _mm256_set1_ps(d[0]);
+	int startX = minX & ~7;
+
+	for (int y = minY; y <= maxY; y++) {
+		float py = (float)(tileY + y) + 0.5f;
+		__m256 c0 = _mm256_set1_ps(e[0][1] * py + e[0][2]);
+		__m256 c1 = _mm256_set1_ps(e[1][1] * py + e[1][2]);
+		__m256 c2 = _mm256_set1_ps(e[2][1] * py + e[2][2]);
+		__m256 depthC = _mm256_set1_ps(d[1] * py + d[2]);
+		float *row = &tile[y * OCCLUSION_TILE_WIDTH];
+
+		for (int x = startX; x <= maxX; x += 8) {
+			__m256 px = _mm256_add_ps(
+				_mm256_set1_ps((float)(tileX + x)), offsets);
+			__m256 inside = _mm256_and_ps(
+				_mm256_and_ps(
+					_mm256_cmp_ps(
+						_mm256_add_ps(
+							_mm256_mul_ps(a0, px),
+							c0),
+						zero, _CMP_GE_OQ),
+					_mm256_cmp_ps(
+						_mm256_add_ps(
+							_mm256_mul_ps(a1, px),
+							c1),
+						zero, _CMP_GE_OQ)),
+				_mm256_cmp_ps(
+					_mm256_add_ps(
+						_mm256_mul_ps(a2, px), c2),
+					zero, _CMP_GE_OQ));
+			if (_mm256_testz_ps(inside, inside)) {
+				continue;
+			}
+
+			__m256 depth = _mm256_add_ps(
+				_mm256_mul_ps(depthX, px), depthC);
+			__m256 old = _mm256_load_ps(&row[x]);
+			_mm256_store_ps(&row[x],
+					_mm256_blendv_ps(
+						old, _mm256_max_ps(old, depth),
+						inside));
+		}
+	}
+}
+#endif
+
+/* Pick the rasterizer, and read `--occlusion on|off`, on by default. */
+Error occlusionInit(void)
+{
+	ptrdiff_t enabled = shgeti(arguments, "occlusion");
+	if (enabled >= 0) {
+		if (strcmp(arguments[enabled].value, "off") == 0) {
+			occlusion.enabled = false;
+		} else if (strcmp(arguments[enabled].value, "on") != 0) {
+			return ERR_INVALID_ARGUMENTS;
+		}
+	}
+
+	occlusion.rasterizeRows = occlusionRasterizeRowsScalar;
+#if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("avx2")) {
+		occlusion.rasterizeRows = occlusionRasterizeRowsAVX2;
+	}
+#endif
+
+	return ERR_OK;
+}
+
+/* Copies the occluder's positions and triangles. */
+OccluderID occlusionAddMesh(const float *positions, size_t positionStride,
+			    uint32_t vertexCount, const uint32_t *indices,
+			    size_t indexCount)
+{
+	OccluderMesh mesh = {};
+	for (uint32_t i = 0; i < vertexCount; i++) {
+		const uint8_t *bytes = (const uint8_t *)positions
+			+ positionStride * i;
+		const float *position = (const float *)bytes;
+		float *copy = arraddnptr(mesh.positions, 1)[0];
+		copy[0] = position[0];
+		copy[1] = position[1];
+		copy[2] = position[2];
+	}
+	for (size_t i = 0; i < indexCount; i++) {
+		if (indices[i] >= vertexCount) {
+			arrfree(mesh.positions);
+			arrfree(mesh.indices);
+			return OCCLUDER_NONE;
+		}
+	}
+	if (indexCount > 0) {
+		memcpy(arraddnptr(mesh.indices, indexCount), indices,
+		       sizeof(uint32_t) * indexCount);
+	}
+
+	arrput(occlusion.meshes, mesh);
+	return (OccluderID)arrlen(occlusion.meshes) - 1;
+}
+
+/* Clear the buffer for a frame seen through `viewProjection`, a
+ * perspective projection whose near plane is `nearPlane` away from the eye. */
+void occlusionBegin(mat4 viewProjection, float nearPlane)
+{
+	glm_mat4_copy(viewProjection, occlusion.viewProjection);
+	occlusion.nearPlane = nearPlane;
+	arrsetlen(occlusion.triangles, 0);
+	for (int i = 0; i < OCCLUSION_TILE_COUNT; i++) {
+		arrsetlen(occlusion.bins[i], 0);
+	}
+}
+
+/* Screen position in buffer pixels, y down, and 1/w. */
+void occlusionProject(vec4 clip, float *screen)
+{
+	float inverseW = 1.0f / clip[3];
+	screen[0] = (clip[0] * inverseW * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+	screen[1] = (0.5f - clip[1] * inverseW * 0.5f) * OCCLUSION_HEIGHT;
+	screen[2] = inverseW;
+}
+
+void occlusionSetupTriangle(const float *a, const float *b, const float *c)
+{
+	/* Either winding: occluders may be seen from inside or be open. */
+	float area = (b[0] - a[0]) * (c[1] - a[1])
+		- (b[1] - a[1]) * (c[0] - a[0]);
+	if (area == 0.0f) {
+		return;
+	}
+	if (area < 0.0f) {
+		const float *swap = b;
+		b = c;
+		c = swap;
+		area = -area;
+	}
+
+	float minX = fminf(a[0], fminf(b[0], c[0]));
+	float minY = fminf(a[1], fminf(b[1], c[1]));
+	float maxX = fmaxf(a[0], fmaxf(b[0], c[0]));
+	float maxY = fmaxf(a[1], fmaxf(b[1], c[1]));
+	/* Pixels whose centre may be inside. */
+	OcclusionTriangle triangle = {
+		.minX = (int)fmaxf(ceilf(minX - 0.5f), 0.0f),
+		.minY = (int)fmaxf(ceilf(minY - 0.5f), 0.0f),
+		.maxX = (int)fminf(floorf(maxX - 0.5f), OCCLUSION_WIDTH - 1),
+		.maxY = (int)fminf(floorf(maxY - 0.5f), OCCLUSION_HEIGHT - 1),
+	};
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+		return;
+	}
+
+	/* Edge i is opposite vertex i, positive on its side. */
+	const float *vertices[3] = {a, b, c};
+	for (int i = 0; i < 3; i++) {
+		const float *from = vertices[(i + 1) % 3];
+		const float *to = vertices[(i + 2) % 3];
+		triangle.edges[i][0] = from[1] - to[1];
+		triangle.edges[i][1] = to[0] - from[0];
+		triangle.edges[i][2] = from[0] * to[1] - from[1] * to[0];
+	}
+
+	/* Depth plane through the three vertices, by barycentrics. */
+	for (int i = 0; i < 3; i++) {
+		triangle.depth[0] += triangle.edges[i][0] * vertices[i][2];
+		triangle.depth[1] += triangle.edges[i][1] * vertices[i][2];
+		triangle.depth[2] += triangle.edges[i][2] * vertices[i][2];
+	}
+	for (int i = 0; i < 3; i++) {
+		triangle.depth[i] /= area;
+	}
+
+	uint32_t index = (uint32_t)arrlen(occlusion.triangles);
+	arrput(occlusion.triangles, triangle);
+	for (int y = triangle.minY / OCCLUSION_TILE_HEIGHT;
+	     y <= triangle.maxY / OCCLUSION_TILE_HEIGHT; y++) {
+		for (int x = triangle.minX / OCCLUSION_TILE_WIDTH;
+		     x <= triangle.maxX / OCCLUSION_TILE_WIDTH; x++) {
+			int tile = y * OCCLUSION_TILES_X + x;
+			arrput(occlusion.bins[tile], index);
+		}
+	}
+}
+
+/* Transform, set up and bin the occluder's triangles. */
+void occlusionSubmit(OccluderID id, mat4 world)
+{
+	if (id < 0 || id >= arrlen(occlusion.meshes)) {
+		return;
+	}
+	const OccluderMesh *mesh = &occlusion.meshes[id];
+
+	mat4 transform;
+	glm_mat4_mul(occlusion.viewProjection, world, transform);
+
+	float (*screen)[3] = nullptr;	/* stb_ds.h array */
+	bool *behind = nullptr;		/* stb_ds.h array */
+	arrsetlen(screen, arrlen(mesh->positions));
+	arrsetlen(behind, arrlen(mesh->positions));
+	for (ptrdiff_t i = 0; i < arrlen(mesh->positions); i++) {
+		vec4 clip;
+		glm_mat4_mulv(transform,
+			      (vec4){mesh->positions[i][0],
+				     mesh->positions[i][1],
+				     mesh->positions[i][2], 1.0f},
+			      clip);
+		behind[i] = clip[3] < occlusion.nearPlane;
+		if (!behind[i]) {
+			occlusionProject(clip, screen[i]);
+		}
+	}
+
+	for (ptrdiff_t i = 0; i + 2 < arrlen(mesh->indices); i += 3) {
+		const uint32_t *triangle = &mesh->indices[i];
+		if (!behind[triangle[0]] && !behind[triangle[1]]
+		    && !behind[triangle[2]]) {
+			occlusionSetupTriangle(screen[triangle[0]],
+					       screen[triangle[1]],
+					       screen[triangle[2]]);
+		}
+	}
+
+	arrfree(screen);
+	arrfree(behind);
+}
+
+void occlusionRasterizeTile(int index, void *)
+{
+	int tileX = index % OCCLUSION_TILES_X * OCCLUSION_TILE_WIDTH;
+	int tileY = index / OCCLUSION_TILES_X * OCCLUSION_TILE_HEIGHT;
+	float *tile = &occlusion.depth[index * OCCLUSION_TILE_PIXELS];
+	memset(tile, 0, sizeof(float) * OCCLUSION_TILE_PIXELS);
+
+	const uint32_t *bin = occlusion.bins[index];
+	for (ptrdiff_t i = 0; i < arrlen(bin); i++) {
+		const OcclusionTriangle *triangle =
+			&occlusion.triangles[bin[i]];
+		int minX = triangle->minX - tileX;
+		int minY = triangle->minY - tileY;
+		int maxX = triangle->maxX - tileX;
+		int maxY = triangle->maxY - tileY;
+		occlusion.rasterizeRows(
+			triangle, tile, tileX, tileY, minX > 0 ? minX : 0,
+			minY > 0 ? minY : 0,
+			maxX < OCCLUSION_TILE_WIDTH - 1
+				? maxX
+				: OCCLUSION_TILE_WIDTH - 1,
+			maxY < OCCLUSION_TILE_HEIGHT - 1
+				? maxY
+				: OCCLUSION_TILE_HEIGHT - 1);
+	}
+
+	float farthest = tile[0];
+	for (int i = 1; i < OCCLUSION_TILE_PIXELS; i++) {
+		farthest = fminf(farthest, tile[i]);
+	}
+	occlusion.tileFarthest[index] = farthest;
+}
+
+void occlusionRasterize(void)
+{
+	jobsParallelFor(OCCLUSION_TILE_COUNT, occlusionRasterizeTile, nullptr);
+}
+
+/* Whether any part of the box drawn with `world` may be visible. */
+bool occlusionTestBox(vec3 boundsMin, vec3 boundsMax, mat4 world)
+{
+	mat4 transform;
+	glm_mat4_mul(occlusion.viewProjection, world, transform);
+
+	float minX = INFINITY;
+	float minY = INFINITY;
+	float maxX = -INFINITY;
+	float maxY = -INFINITY;
+	float nearest = 0.0f;
+	for (int i = 0; i < 8; i++) {
+		vec4 corner = {
+			(i & 1) ? boundsMax[0] : boundsMin[0],
+			(i & 2) ? boundsMax[1] : boundsMin[1],
+			(i & 4) ? boundsMax[2] : boundsMin[2],
+			1.0f,
+		};
+		vec4 clip;
+		glm_mat4_mulv(transform, corner, clip);
+		if (clip[3] < occlusion.nearPlane) {
+			return true;
+		}
+
+		float screen[3];
+		occlusionProject(clip, screen);
+		minX = fminf(minX, screen[0]);
+		minY = fminf(minY, screen[1]);
+		maxX = fmaxf(maxX, screen[0]);
+		maxY = fmaxf(maxY, screen[1]);
+		nearest = fmaxf(nearest, screen[2]);
+	}
+
+	/* Every pixel the rectangle touches. */
+	int x0 = (int)fmaxf(floorf(minX), 0.0f);
+	int y0 = (int)fmaxf(floorf(minY), 0.0f);
+	int x1 = (int)fminf(ceilf(maxX), OCCLUSION_WIDTH) - 1;
+	int y1 = (int)fminf(ceilf(maxY), OCCLUSION_HEIGHT) - 1;
+	if (x0 > x1 || y0 > y1) {
+		return false;
+	}
+
+	for (int tileY = y0 / OCCLUSION_TILE_HEIGHT;
+	     tileY <= y1 / OCCLUSION_TILE_HEIGHT; tileY++) {
+		for (int tileX = x0 / OCCLUSION_TILE_WIDTH;
+		     tileX <= x1 / OCCLUSION_TILE_WIDTH; tileX++) {
+			int index = tileY * OCCLUSION_TILES_X + tileX;
+			if (occlusion.tileFarthest[index] > nearest) {
+				continue;
+			}
+
+			const float *tile =
+				&occlusion.depth[index * OCCLUSION_TILE_PIXELS];
+			int left = tileX * OCCLUSION_TILE_WIDTH;
+			int top = tileY * OCCLUSION_TILE_HEIGHT;
+			int fromX = x0 > left ? x0 - left : 0;
+			int fromY = y0 > top ? y0 - top : 0;
+			int toX = x1 - left < OCCLUSION_TILE_WIDTH - 1
+				? x1 - left
+				: OCCLUSION_TILE_WIDTH - 1;
+			int toY = y1 - top < OCCLUSION_TILE_HEIGHT - 1
+				? y1 - top
+				: OCCLUSION_TILE_HEIGHT - 1;
+			for (int y = fromY; y <= toY; y++) {
+				for (int x = fromX; x <= toX; x++) {
+					if (tile[y * OCCLUSION_TILE_WIDTH + x]
+					    <= nearest) {
+						return true;
+					}
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+void occlusionFree(void)
+{
+	for (ptrdiff_t i = 0; i < arrlen(occlusion.meshes); i++) {
+		arrfree(occlusion.meshes[i].positions);
+		arrfree(occlusion.meshes[i].indices);
+	}
+	arrfree(occlusion.meshes);
+	arrfree(occlusion.triangles);
+	for (int i = 0; i < OCCLUSION_TILE_COUNT; i++) {
+		arrfree(occlusion.bins[i]);
+	}
+}
@@ -1,41 +1,134 @@
 #include "glad/glad.h"
 #include "GLFW/glfw3.h"
 #include "cglm/cglm.h"
+#include "cluster.c"
 #include "common.h"
+#include "dynamic_resolution.c"
+#include "gl_capture.c"
+#include "gl_ext.c"
+#include "gl_gpu_timer.c"
+#include "gl_indirect.c"
+#include "gl_mesh.c"
+#include "gl_render_graph.c"
+#include "gl_ring_buffer.c"
+#include "gl_state.c"
+#include "gl_texture_stream.c"
+#include "lights.c"
+#include "lod.c"
+#include "mesh.c"
+#include "occlusion.c"
+#include "renderer.h"
+#include "scene.c"
+#include "shader_cache.c"
+#include "transform.c"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-#define CLAMP(X, MIN, MAX)					\
-	((X) >= (MAX) ? (MAX) : ((X) <= (MIN) ? (MIN) : (X)))
-
 enum {
 	INFO_LOG_SIZE = 512,
 };
 
-GLchar infoLog[INFO_LOG_SIZE];
-GLFWwindow *window;
-GLuint VBO;
-GLuint cubeVAO;
-GLuint lightVAO;
-GLuint shaderProgram;
-GLuint lightShaderProgram;
-GLuint texture0;
-GLuint texture1;
-vec3 lightPosition = {0.0f, 0.0f, -10.0f};
+enum : uint32_t {
+	PROGRAM_CACHE_MAGIC = 0x4c50424e, /* "LPBN" */
+};
+
+/* Header of a cached program binary, followed by the binary itself. */
+typedef struct ProgramCacheHeader {
+	uint32_t magic;
+	GLenum format;
+	uint64_t key;
+} ProgramCacheHeader;
+
+/* Texture units of the clustered lighting buffer textures. The material uses
+ * units 0 and 1. */
+enum ClusterTexture : int {
+	CLUSTER_TEXTURE_LIGHTS = 0,
+	CLUSTER_TEXTURE_CELLS = 1,
+	CLUSTER_TEXTURE_INDICES = 2,
+	CLUSTER_TEXTURE_LAST,
+	CLUSTER_TEXTURE_UNIT = 2,
+};
 
-uint32_t frameCount;
-float lastFrameTimeSec;
-float currentFrameTimeSec;
-float deltaTimeSec;
-float cameraSpeed = 10.0f;
+/* G-buffer attachments of the deferred path, sampled from texture units
+ * following the cluster buffer textures. */
+enum GBufferTexture : int {
+	GBUFFER_ALBEDO = 0,
+	GBUFFER_SPECULAR = 1,
+	GBUFFER_NORMAL = 2,
+	GBUFFER_COLOR_LAST,
+	GBUFFER_DEPTH = GBUFFER_COLOR_LAST,
+	GBUFFER_LAST,
+	GBUFFER_TEXTURE_UNIT = CLUSTER_TEXTURE_UNIT + CLUSTER_TEXTURE_LAST,
+};
 
-static constexpr float cameraFOVMin = 0.26f;
-static constexpr float cameraFOVMax = 1.75f;
+/* Texture units of the per-draw matrices of indirect draws and of the
+ * upscaled scene, following the G-buffer. */
+enum : int {
+	DRAW_TEXTURE_UNIT = GBUFFER_TEXTURE_UNIT + GBUFFER_LAST,
+	UPSCALE_TEXTURE_UNIT = DRAW_TEXTURE_UNIT + 1,
+};
 
-float cameraFOV = GLM_PI / 2.0f;
-vec3 cameraEuler;
-vec3 cameraPosition = {0.0f, 0.0f, 3.0f};
+typedef enum ShadingPath : int {
+	SHADING_FORWARD = 0,
+	SHADING_DEFERRED = 1,
+} ShadingPath;
+
+/* Emissive materials are drawn unlit after the scene, the others by the
+ * geometry pass. */
+typedef struct GLMaterial {
+	StreamTextureID diffuse;
+	StreamTextureID specular;
+	vec4 color;
+	bool emissive;
+	/* This frame's indirect commands */
+	GLsizei firstCommand;
+	GLsizei commandCount;
+} GLMaterial;
+
+/* A submitted draw, and what the frame decided for it. */
+typedef struct GLDraw {
+	MeshID mesh;
+	MaterialID material;
+	TransformID transform;
+	uint32_t lod;		/* Last frame's, or this one's */
+	bool visible;
+	bool indirect;
+} GLDraw;
+
+GLchar infoLog[INFO_LOG_SIZE];
+GPUMesh *gpuMeshes;		/* stb_ds.h array */
+OccluderID *meshOccluders;	/* stb_ds.h array, of each mesh */
+GLMaterial *glMaterials;	/* stb_ds.h array */
+GLDraw *glDraws;		/* stb_ds.h array, sorted by material */
+GLuint shaderProgram;
+GLuint lightShaderProgram;
+GLuint gbufferProgram;
+GLuint deferredProgram;
+GLuint upscaleProgram;
+GLuint upscaleSampler;
+GPUTimer frameTimer;
+GLuint emptyVAO;
+ShadingPath shadingPath = SHADING_FORWARD;
+LightID pointLight;
+LightID spotlight;
+LightID firstExtraLight;
+GLuint clusterBuffers[CLUSTER_TEXTURE_LAST];
+GLuint clusterTextures[CLUSTER_TEXTURE_LAST];
+RenderGraph renderGraph;
+RGResource gbufferTargets[GBUFFER_LAST];
+RGResource sceneTarget;
+RingBuffer clusterRing;
+GLint clusterRingAlignment = 1;
+float *packedLights;
+int framebufferWidth = WIDTH;
+int framebufferHeight = HEIGHT;
+/* Size the scene renders at, below the framebuffer's with dynamic
+ * resolution. */
+int renderWidth = WIDTH;
+int renderHeight = HEIGHT;
+
+static constexpr float upscaleSharpness = 0.5f;
 
 void setUniformBool(GLuint shaderID, const GLchar *name, GLboolean value)
 {
@@ -63,46 +156,21 @@ void setUniformMatrix(GLuint shaderID, const GLchar *name, mat4 value)
 			   (GLfloat*)value);
 }
 
-void getCameraFront(vec3 out)
+void getCameraProjection(mat4 out)
 {
-	out[0] = 0.0f;
-	out[1] = 0.0f;
-	out[2] = 1.0f;
-
-	glm_vec3_rotate(out, cameraEuler[0], GLM_XUP);
-	glm_vec3_rotate(out, cameraEuler[1], GLM_YUP);
-	glm_vec3_rotate(out, cameraEuler[2], GLM_ZUP);
-
-	out[2] = -out[2];
-
-	glm_normalize(out);
+	glm_perspective(cameraFOV, (float)WIDTH / (float)HEIGHT, cameraNear,
+			cameraFar, out);
 }
 
-void processCamera(GLFWwindow *window)
-{
-	vec3 velocity = {};
-
-	velocity[0] -= (float)(glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS);
-	velocity[0] += (float)(glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS);
-	velocity[1] += (float)(glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS);
-	velocity[1] -= (float)(glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS);
-	velocity[2] += (float)(glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS);
-	velocity[2] -= (float)(glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS);
-
-	glm_vec3_rotate(velocity, -cameraEuler[1], GLM_YUP);
-	glm_vec3_scale(velocity, cameraSpeed * deltaTimeSec, velocity);
-	glm_vec3_add(velocity, cameraPosition, cameraPosition);
-}
-
-void processInput(GLFWwindow *window)
+void openglProcessInput(GLFWwindow *window)
 {
 	(void)window;
 	glfwPollEvents();
 	processCamera(window);
 }
 
-void keyCallback(GLFWwindow *window, int key, int scancode, int action,
-		 int mods)
+void openglKeyCallback(GLFWwindow *window, int key, int scancode,
+		       int action, int mods)
 {
 	(void)scancode;
 	(void)mods;
@@ -110,52 +178,32 @@ void keyCallback(GLFWwindow *window, int key, int scancode, int action,
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
 		glfwSetWindowShouldClose(window, GLFW_TRUE);
 	}
-}
 
-void mouseCallback(GLFWwindow* window, double xpos, double ypos)
-{
-	(void)window;
-
-	static float lastX = NAN;
-	static float lastY = NAN;
-
-	if (isnan(lastX) || isnan(lastY)) {
-		lastX = (float)xpos;
-		lastY = (float)ypos;
+	if (key == GLFW_KEY_F2 && action == GLFW_PRESS) {
+		shadingPath = shadingPath == SHADING_FORWARD
+			? SHADING_DEFERRED
+			: SHADING_FORWARD;
+		printf("Shading: %s\n", shadingPath == SHADING_FORWARD
+		       ? "forward"
+		       : "deferred");
 	}
 
-	float xoffset = (float)xpos - lastX;
-	float yoffset = -lastY + (float)ypos;
-	lastX = (float)xpos;
-	lastY = (float)ypos;
-
-	constexpr float sensitivity = 0.01f;
-	xoffset *= sensitivity;
-	yoffset *= sensitivity;
-
-	cameraEuler[0] += yoffset;
-	cameraEuler[1] += xoffset;
-
-	cameraEuler[0] =
-		CLAMP(cameraEuler[0], -(float)GLM_PI / 3.0f, (float)GLM_PI / 3.0f);
-}
-
-void scrollCallback(GLFWwindow* window, double xoffset, double yoffset)
-{
-	(void)window;
-	(void)xoffset;
-
-	cameraFOV -= (float)yoffset * 0.25f;
-	cameraFOV = CLAMP(cameraFOV, cameraFOVMin, cameraFOVMax);
+	if (key == GLFW_KEY_F3 && action == GLFW_PRESS) {
+		printf("GL state calls last frame: %u issued, %u elided\n",
+		       glState.lastFrame.issued, glState.lastFrame.elided);
+	}
 }
 
-void framebufferResizeCallback(GLFWwindow *window, int width, int height)
+void openglFramebufferResizeCallback(GLFWwindow *window, int width,
+				     int height)
 {
 	(void)window;
-	glViewport(0, 0, width, height);
+	framebufferWidth = width;
+	framebufferHeight = height;
+	glStateViewport(0, 0, width, height);
 }
 
-Error windowInit(void)
+Error openglWindowInit(void)
 {
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -173,12 +221,22 @@ Error windowInit(void)
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
 		return ERR_GLAD_INITIALIZATION_FAILED;
 	}
+	glExtInit();
+
+	/* Before any call worth recording. */
+	int width, height;
+	glfwGetFramebufferSize(window, &width, &height);
+	Error e = captureInit(width, height);
+	if (e != ERR_OK) {
+		return e;
+	}
+	glStateInvalidate();
 
-	glViewport(0, 0, WIDTH, HEIGHT);
-	glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+	glStateViewport(0, 0, WIDTH, HEIGHT);
+	glfwSetFramebufferSizeCallback(window, openglFramebufferResizeCallback);
 	glfwSwapInterval(0);
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-	glfwSetKeyCallback(window, keyCallback);
+	glfwSetKeyCallback(window, openglKeyCallback);
 	glfwSetCursorPosCallback(window, mouseCallback);  
 	glfwSetScrollCallback(window, scrollCallback);
 
@@ -206,10 +264,13 @@ Error compileVertexShader(GLuint *vertexShaderOut, const GLchar *code)
 	return ERR_OK;
 }
 
-Error compileFragmentShader(GLuint *fragmentShaderOut, const GLchar *code)
+/* Compile the concatenation of `count` sources. Only the first may hold the
+ * #version directive. */
+Error compileFragmentShaderSources(GLuint *fragmentShaderOut,
+				   const GLchar *const *sources, GLsizei count)
 {
 	GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragmentShader, 1, &code, nullptr);
+	glShaderSource(fragmentShader, count, sources, nullptr);
 	glCompileShader(fragmentShader);
 
 	/* Shader compilation results. */
@@ -227,12 +288,22 @@ Error compileFragmentShader(GLuint *fragmentShaderOut, const GLchar *code)
 	return ERR_OK;
 }
 
+Error compileFragmentShader(GLuint *fragmentShaderOut, const GLchar *code)
+{
+	return compileFragmentShaderSources(fragmentShaderOut, &code, 1);
+}
+
 Error linkShaderProgram(GLuint *shaderProgramOut, GLuint vertexShader,
 			    GLuint fragmentShader)
 {
 	GLuint shaderProgram = glCreateProgram();
 	glAttachShader(shaderProgram, vertexShader);
 	glAttachShader(shaderProgram, fragmentShader);
+	if (glExt.hasProgramBinary) {
+		glExt.programParameteri(shaderProgram,
+					GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+					GL_TRUE);
+	}
 	glLinkProgram(shaderProgram);
 
 	/* Shader program linking results. */
@@ -252,10 +323,102 @@ Error linkShaderProgram(GLuint *shaderProgramOut, GLuint vertexShader,
 	return ERR_OK;
 }
 
-Error compileShaderProgram(GLuint *shaderIDOut,
-			   const GLchar *vertexShaderSource,
-			   const GLchar *fragmentShaderSource)
+/* Binaries are only valid for the driver that produced them, so the driver
+ * strings are part of the key. */
+uint64_t programCacheKey(const GLchar *vertexShaderSource,
+			 const GLchar *const *fragmentShaderSources,
+			 GLsizei fragmentShaderSourcesCount)
+{
+	uint64_t key = CACHE_HASH_SEED;
+	key = cacheHashString(key, (const char *)glGetString(GL_VENDOR));
+	key = cacheHashString(key, (const char *)glGetString(GL_RENDERER));
+	key = cacheHashString(key, (const char *)glGetString(GL_VERSION));
+	key = cacheHashString(key, vertexShaderSource);
+	for (GLsizei i = 0; i < fragmentShaderSourcesCount; i++) {
+		key = cacheHashString(key, fragmentShaderSources[i]);
+	}
+	return key;
+}
+
+/* Returns false if the binary is missing or the driver rejects it. */
+bool loadProgramBinary(GLuint *shaderProgramOut, uint64_t key)
 {
+	size_t size = 0;
+	unsigned char *blob = cacheLoad("gl", key, &size);
+	if (blob == nullptr) {
+		return false;
+	}
+
+	ProgramCacheHeader header;
+	if (size <= sizeof(header)) {
+		free(blob);
+		return false;
+	}
+	memcpy(&header, blob, sizeof(header));
+	if (header.magic != PROGRAM_CACHE_MAGIC || header.key != key) {
+		free(blob);
+		return false;
+	}
+
+	GLuint shaderProgram = glCreateProgram();
+	glExt.programBinary(shaderProgram, header.format, blob + sizeof(header),
+			    (GLsizei)(size - sizeof(header)));
+	free(blob);
+
+	GLint success = 0;
+	glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+	if (!success) {
+		glDeleteProgram(shaderProgram);
+		return false;
+	}
+
+	*shaderProgramOut = shaderProgram;
+
+	return true;
+}
+
+void storeProgramBinary(GLuint shaderProgram, uint64_t key)
+{
+	GLint length = 0;
+	glGetProgramiv(shaderProgram, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+
+	ProgramCacheHeader header = {
+		.magic = PROGRAM_CACHE_MAGIC,
+		.key = key,
+	};
+	size_t size = sizeof(header) + (size_t)length;
+	unsigned char *blob = malloc(size);
+	if (blob == nullptr) {
+		return;
+	}
+
+	GLsizei written = 0;
+	glExt.getProgramBinary(shaderProgram, length, &written, &header.format,
+			       blob + sizeof(header));
+	memcpy(blob, &header, sizeof(header));
+	if (written == length) {
+		cacheStore("gl", key, blob, size);
+	}
+	free(blob);
+}
+
+Error compileShaderProgramSources(GLuint *shaderIDOut,
+				 const GLchar *vertexShaderSource,
+				 const GLchar *const *fragmentShaderSources,
+				 GLsizei fragmentShaderSourcesCount)
+{
+	uint64_t key = 0;
+	if (glExt.hasProgramBinary) {
+		key = programCacheKey(vertexShaderSource, fragmentShaderSources,
+				      fragmentShaderSourcesCount);
+		if (loadProgramBinary(shaderIDOut, key)) {
+			return ERR_OK;
+		}
+	}
+
 	/* Create vertex shader. */
 	GLuint vertexShader = 0;
 	Error e = compileVertexShader(&vertexShader, vertexShaderSource);
@@ -265,7 +428,9 @@ Error compileShaderProgram(GLuint *shaderIDOut,
 
 	/* Create fragment shader. */
 	GLuint fragmentShader = 0;
-	e = compileFragmentShader(&fragmentShader, fragmentShaderSource);
+	e = compileFragmentShaderSources(&fragmentShader,
+					 fragmentShaderSources,
+					 fragmentShaderSourcesCount);
 	if (e != ERR_OK) {
 		return e;
 	}
@@ -276,169 +441,398 @@ Error compileShaderProgram(GLuint *shaderIDOut,
 		return e;
 	}
 
+	if (glExt.hasProgramBinary) {
+		storeProgramBinary(shaderProgram, key);
+	}
+
 	*shaderIDOut = shaderProgram;
 
 	return ERR_OK;
 }
 
-/* Buffers data to VBO global. */
-void bufferMeshData(const GLfloat *vertices, GLsizeiptr length)
-{
-	glGenBuffers(1, &VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, length * (GLsizeiptr)sizeof(GLfloat),
-		     vertices, GL_STATIC_DRAW);
-}
-
-void cubeVertexBufferInit(GLuint pVBO)
-{
-	glGenVertexArrays(1, &cubeVAO);
-	glBindVertexArray(cubeVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, pVBO);
-
-	/* Set position attribute. */
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-			      nullptr);
-	glEnableVertexAttribArray(0);
-
-	/* Set texture attribute. */
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-			      (void*)(3 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(1);
-
-	/* Set normals. */
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-			      (void*)(5 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(2);
-}
-
-void lightVertexBufferInit(GLuint pVBO)
-{
-	glGenVertexArrays(1, &lightVAO);
-	glBindVertexArray(lightVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, pVBO);
-
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-			      nullptr);
-	glEnableVertexAttribArray(0);
-}
-
-void vertexBuffersInit(void)
-{
-	const GLfloat vertices[] = {
-		-0.5f, -0.5f, -0.5f,	0.0f, 0.0f,	0.0f, 0.0f, -1.0f,
-		0.5f, -0.5f, -0.5f,	1.0f, 0.0f,	0.0f, 0.0f, -1.0f,
-		0.5f,  0.5f, -0.5f,	1.0f, 1.0f,	0.0f, 0.0f, -1.0f,
-		0.5f,  0.5f, -0.5f,	1.0f, 1.0f,	0.0f, 0.0f, -1.0f,
-		-0.5f,  0.5f, -0.5f,	0.0f, 1.0f,	0.0f, 0.0f, -1.0f,
-		-0.5f, -0.5f, -0.5f,	0.0f, 0.0f,	0.0f, 0.0f, -1.0f,
-	
-		-0.5f, -0.5f,  0.5f,	0.0f, 0.0f,	0.0f, 0.0f, 1.0f,
-		0.5f, -0.5f,  0.5f,	1.0f, 0.0f,	0.0f, 0.0f, 1.0f,
-		0.5f,  0.5f,  0.5f,	1.0f, 1.0f,	0.0f, 0.0f, 1.0f,
-		0.5f,  0.5f,  0.5f,	1.0f, 1.0f,	0.0f, 0.0f, 1.0f,
-		-0.5f,  0.5f,  0.5f,	0.0f, 1.0f,	0.0f, 0.0f, 1.0f,
-		-0.5f, -0.5f,  0.5f,	0.0f, 0.0f,	0.0f, 0.0f, 1.0f,
-	
-		-0.5f,  0.5f,  0.5f,	1.0f, 0.0f,	-1.0f, 0.0f, 0.0f,
-		-0.5f,  0.5f, -0.5f,	1.0f, 1.0f,	-1.0f, 0.0f, 0.0f,
-		-0.5f, -0.5f, -0.5f,	0.0f, 1.0f,	-1.0f, 0.0f, 0.0f,
-		-0.5f, -0.5f, -0.5f,	0.0f, 1.0f,	-1.0f, 0.0f, 0.0f,
-		-0.5f, -0.5f,  0.5f,	0.0f, 0.0f,	-1.0f, 0.0f, 0.0f,
-		-0.5f,  0.5f,  0.5f,	1.0f, 0.0f,	-1.0f, 0.0f, 0.0f,
-	
-		0.5f,  0.5f,  0.5f,	1.0f, 0.0f,	1.0f, 0.0f, 0.0f,
-		0.5f,  0.5f, -0.5f,	1.0f, 1.0f,	1.0f, 0.0f, 0.0f,
-		0.5f, -0.5f, -0.5f,	0.0f, 1.0f,	1.0f, 0.0f, 0.0f,
-		0.5f, -0.5f, -0.5f,	0.0f, 1.0f,	1.0f, 0.0f, 0.0f,
-		0.5f, -0.5f,  0.5f,	0.0f, 0.0f,	1.0f, 0.0f, 0.0f,
-		0.5f,  0.5f,  0.5f,	1.0f, 0.0f,	1.0f, 0.0f, 0.0f,
-	
-		-0.5f, -0.5f, -0.5f,	0.0f, 1.0f,	0.0f, -1.0f, 0.0f,
-		0.5f, -0.5f, -0.5f,	1.0f, 1.0f,	0.0f, -1.0f, 0.0f,
-		0.5f, -0.5f,  0.5f,	1.0f, 0.0f,	0.0f, -1.0f, 0.0f,
-		0.5f, -0.5f,  0.5f,	1.0f, 0.0f,	0.0f, -1.0f, 0.0f,
-		-0.5f, -0.5f,  0.5f,	0.0f, 0.0f,	0.0f, -1.0f, 0.0f,
-		-0.5f, -0.5f, -0.5f,	0.0f, 1.0f,	0.0f, -1.0f, 0.0f,
-	
-		-0.5f,  0.5f, -0.5f,	0.0f, 1.0f,	0.0f, 1.0f, 0.0f,
-		0.5f,  0.5f, -0.5f,	1.0f, 1.0f,	0.0f, 1.0f, 0.0f,
-		0.5f,  0.5f,  0.5f,	1.0f, 0.0f,	0.0f, 1.0f, 0.0f,
-		0.5f,  0.5f,  0.5f,	1.0f, 0.0f,	0.0f, 1.0f, 0.0f,
-		-0.5f,  0.5f,  0.5f,	0.0f, 0.0f,	0.0f, 1.0f, 0.0f,
-		-0.5f,  0.5f, -0.5f,	0.0f, 1.0f,	0.0f, 1.0f, 0.0f,
-	};
-
-	bufferMeshData(vertices, sizeof(vertices));
-	cubeVertexBufferInit(VBO);
-	lightVertexBufferInit(VBO);
+Error compileShaderProgram(GLuint *shaderIDOut,
+			   const GLchar *vertexShaderSource,
+			   const GLchar *fragmentShaderSource)
+{
+	return compileShaderProgramSources(shaderIDOut, vertexShaderSource,
+					   &fragmentShaderSource, 1);
 }
 
-Error bindTexture(GLuint *idOut, const char *path)
+/* Occluder of a cooked mesh's finest level, or OCCLUDER_NONE. */
+OccluderID occluderLoad(const char *name)
 {
-	int width = 0;
-	int height = 0;
-	int nrChannels = 0;
-	unsigned char *data = stbi_load(path, &width,
-					&height, &nrChannels, 0);
-	if (data == nullptr) {
-		return ERR_TEXTURE_LOADING_FAILED;
+	char path[GPU_MESH_PATH_SIZE];
+	(void)snprintf(path, sizeof(path), COOKED_RESOURCE_PATH "/%s.mesh",
+		       name);
+
+	MappedMesh mapped;
+	if (meshMap(&mapped, path) != ERR_OK) {
+		return OCCLUDER_NONE;
 	}
 
-	GLuint id = 0;
+	uint32_t vertexCount = mapped.header->vertexCount;
+	uint32_t indexCount = mapped.header->lods[0].indexCount;
+	float (*positions)[3] = malloc(sizeof(float[3]) * vertexCount);
+	uint32_t *indices = malloc(sizeof(uint32_t) * indexCount);
+	OccluderID id = OCCLUDER_NONE;
+	if (positions != nullptr && indices != nullptr
+	    && meshDecodePositions(&mapped, positions)) {
+		meshDecodeIndices(&mapped, mapped.header->lods[0].indexOffset,
+				  indexCount, indices);
+		id = occlusionAddMesh(&positions[0][0], sizeof(float[3]),
+				      vertexCount, indices, indexCount);
+	}
 
-	glGenTextures(1, &id);
-	glBindTexture(GL_TEXTURE_2D, id);
+	free(positions);
+	free(indices);
+	meshUnmap(&mapped);
+	return id;
+}
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-			GL_NEAREST_MIPMAP_NEAREST);
+/* Position, texture coordinates and normal of the cube drawn without a
+ * cooked one. */
+const GLfloat cubeVertices[] = {
+	-0.5f, -0.5f, -0.5f,	0.0f, 0.0f,	0.0f, 0.0f, -1.0f,
+	0.5f, -0.5f, -0.5f,	1.0f, 0.0f,	0.0f, 0.0f, -1.0f,
+	0.5f,  0.5f, -0.5f,	1.0f, 1.0f,	0.0f, 0.0f, -1.0f,
+	0.5f,  0.5f, -0.5f,	1.0f, 1.0f,	0.0f, 0.0f, -1.0f,
+	-0.5f,  0.5f, -0.5f,	0.0f, 1.0f,	0.0f, 0.0f, -1.0f,
+	-0.5f, -0.5f, -0.5f,	0.0f, 0.0f,	0.0f, 0.0f, -1.0f,
+
+	-0.5f, -0.5f,  0.5f,	0.0f, 0.0f,	0.0f, 0.0f, 1.0f,
+	0.5f, -0.5f,  0.5f,	1.0f, 0.0f,	0.0f, 0.0f, 1.0f,
+	0.5f,  0.5f,  0.5f,	1.0f, 1.0f,	0.0f, 0.0f, 1.0f,
+	0.5f,  0.5f,  0.5f,	1.0f, 1.0f,	0.0f, 0.0f, 1.0f,
+	-0.5f,  0.5f,  0.5f,	0.0f, 1.0f,	0.0f, 0.0f, 1.0f,
+	-0.5f, -0.5f,  0.5f,	0.0f, 0.0f,	0.0f, 0.0f, 1.0f,
+
+	-0.5f,  0.5f,  0.5f,	1.0f, 0.0f,	-1.0f, 0.0f, 0.0f,
+	-0.5f,  0.5f, -0.5f,	1.0f, 1.0f,	-1.0f, 0.0f, 0.0f,
+	-0.5f, -0.5f, -0.5f,	0.0f, 1.0f,	-1.0f, 0.0f, 0.0f,
+	-0.5f, -0.5f, -0.5f,	0.0f, 1.0f,	-1.0f, 0.0f, 0.0f,
+	-0.5f, -0.5f,  0.5f,	0.0f, 0.0f,	-1.0f, 0.0f, 0.0f,
+	-0.5f,  0.5f,  0.5f,	1.0f, 0.0f,	-1.0f, 0.0f, 0.0f,
+
+	0.5f,  0.5f,  0.5f,	1.0f, 0.0f,	1.0f, 0.0f, 0.0f,
+	0.5f,  0.5f, -0.5f,	1.0f, 1.0f,	1.0f, 0.0f, 0.0f,
+	0.5f, -0.5f, -0.5f,	0.0f, 1.0f,	1.0f, 0.0f, 0.0f,
+	0.5f, -0.5f, -0.5f,	0.0f, 1.0f,	1.0f, 0.0f, 0.0f,
+	0.5f, -0.5f,  0.5f,	0.0f, 0.0f,	1.0f, 0.0f, 0.0f,
+	0.5f,  0.5f,  0.5f,	1.0f, 0.0f,	1.0f, 0.0f, 0.0f,
+
+	-0.5f, -0.5f, -0.5f,	0.0f, 1.0f,	0.0f, -1.0f, 0.0f,
+	0.5f, -0.5f, -0.5f,	1.0f, 1.0f,	0.0f, -1.0f, 0.0f,
+	0.5f, -0.5f,  0.5f,	1.0f, 0.0f,	0.0f, -1.0f, 0.0f,
+	0.5f, -0.5f,  0.5f,	1.0f, 0.0f,	0.0f, -1.0f, 0.0f,
+	-0.5f, -0.5f,  0.5f,	0.0f, 0.0f,	0.0f, -1.0f, 0.0f,
+	-0.5f, -0.5f, -0.5f,	0.0f, 1.0f,	0.0f, -1.0f, 0.0f,
+
+	-0.5f,  0.5f, -0.5f,	0.0f, 1.0f,	0.0f, 1.0f, 0.0f,
+	0.5f,  0.5f, -0.5f,	1.0f, 1.0f,	0.0f, 1.0f, 0.0f,
+	0.5f,  0.5f,  0.5f,	1.0f, 0.0f,	0.0f, 1.0f, 0.0f,
+	0.5f,  0.5f,  0.5f,	1.0f, 0.0f,	0.0f, 1.0f, 0.0f,
+	-0.5f,  0.5f,  0.5f,	0.0f, 0.0f,	0.0f, 1.0f, 0.0f,
+	-0.5f,  0.5f, -0.5f,	0.0f, 1.0f,	0.0f, 1.0f, 0.0f,
+};
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB,
-		     GL_UNSIGNED_BYTE, data);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	stbi_image_free(data);
+/* The cooked mesh `name` and its occluder. Without a cooked cube, "cube"
+ * falls back on the one above. */
+Error openglCreateMesh(const char *name, MeshID *meshOut)
+{
+	bool fallback = strcmp(name, "cube") == 0;
+	GPUMesh mesh;
+	Error e = gpuMeshLoad(&mesh, name);
+	if (e != ERR_OK && !fallback) {
+		return e;
+	}
+	if (e != ERR_OK) {
+		gpuMeshFromVertices(&mesh, cubeVertices,
+				    (GLsizei)(ARRAY_COUNT_STATIC(cubeVertices)
+					      / 8));
+	}
 
-	*idOut = id;
+	OccluderID occluder = occluderLoad(name);
+	if (occluder == OCCLUDER_NONE && fallback) {
+		uint32_t indices[ARRAY_COUNT_STATIC(cubeVertices) / 8];
+		for (uint32_t i = 0; i < ARRAY_COUNT_STATIC(indices); i++) {
+			indices[i] = i;
+		}
+		occluder = occlusionAddMesh(cubeVertices, sizeof(GLfloat[8]),
+					    ARRAY_COUNT_STATIC(indices),
+					    indices,
+					    ARRAY_COUNT_STATIC(indices));
+	}
 
+	*meshOut = (MeshID)arrlen(gpuMeshes);
+	arrput(gpuMeshes, mesh);
+	arrput(meshOccluders, occluder);
 	return ERR_OK;
 }
 
-Error textureInit(GLuint shaderID)
+/* Textures start streaming in, see gl_texture_stream.c. */
+Error openglCreateMaterial(const MaterialDesc *desc, MaterialID *materialOut)
 {
-	stbi_set_flip_vertically_on_load(true);
+	GLMaterial material = {};
+	material.diffuse = desc->diffuse != nullptr
+		? textureStreamLoad(desc->diffuse)
+		: -1;
+	material.specular = desc->specular != nullptr
+		? textureStreamLoad(desc->specular)
+		: -1;
+	glm_vec4_copy((float *)desc->color, material.color);
+	material.emissive = desc->emissive;
+
+	*materialOut = (MaterialID)arrlen(glMaterials);
+	arrput(glMaterials, material);
+	return ERR_OK;
+}
 
-	Error e = bindTexture(&texture0, RESOURCE_PATH "/crate.png");
-	if (e != ERR_OK) {
-		return e;
+int glDrawCompare(const void *a, const void *b)
+{
+	MaterialID materialA = ((const GLDraw *)a)->material;
+	MaterialID materialB = ((const GLDraw *)b)->material;
+	return materialA < materialB ? -1 : materialA > materialB ? 1 : 0;
+}
+
+/* Draws of a material are drawn together, so the list is sorted by
+ * material. */
+Error openglSubmitDraws(const RenderDraw *draws, int32_t count)
+{
+	arrsetlen(glDraws, 0);
+	for (int32_t i = 0; i < count; i++) {
+		assert(draws[i].mesh >= 0 && draws[i].mesh < arrlen(gpuMeshes));
+		assert(draws[i].material >= 0
+		       && draws[i].material < arrlen(glMaterials));
+
+		GLDraw draw = {};
+		draw.mesh = draws[i].mesh;
+		draw.material = draws[i].material;
+		draw.transform = draws[i].transform;
+		arrput(glDraws, draw);
 	}
 
-	e = bindTexture(&texture1, RESOURCE_PATH "/crate-specular.png");
+	if (count > 0) {
+		qsort(glDraws, (size_t)count, sizeof(GLDraw), glDrawCompare);
+	}
+	return ERR_OK;
+}
+
+/* End of the run of draws sharing the material of draw `first`. */
+int32_t materialRunEnd(int32_t first)
+{
+	int32_t end = first + 1;
+	while (end < arrlen(glDraws)
+	       && glDraws[end].material == glDraws[first].material) {
+		end++;
+	}
+	return end;
+}
+
+/* Materials stream their textures in over the first frames, see
+ * gl_texture_stream.c. */
+Error textureInit(GLuint shaderID)
+{
+	Error e = textureStreamInit();
 	if (e != ERR_OK) {
 		return e;
 	}
 
-	glUseProgram(shaderID);
+	glStateUseProgram(shaderID);
 	setUniformInt(shaderID, "material.diffuse", 0);
 	setUniformInt(shaderID, "material.specular", 1);
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture0);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, texture1);
+	return ERR_OK;
+}
+
+/* Fill the light store with the scene's point light and camera spotlight,
+ * plus `--lights <count>` extra point lights to stress the clustered path. */
+Error lightsInit(void)
+{
+	Light point = {
+		.ambient = {0.0f, 0.5f, 0.5f},
+		.diffuse = {0.0f, 0.8f, 0.8f},
+		.specular = {0.0f, 1.0f, 1.0f},
+		.constant = 1.0f,
+		.linear = 0.045f,
+		.quad = 0.0075f,
+		.type = LIGHT_POINT,
+	};
+	glm_vec3_copy(lightPosition, point.position);
+	pointLight = lightAdd(&point);
+
+	Light spot = {
+		.ambient = {0.15f, 0.15f, 0.5f},
+		.diffuse = {0.24f, 0.24f, 0.8f},
+		.specular = {0.3f, 0.3f, 1.0f},
+		.constant = 1.0f,
+		.linear = 0.045f,
+		.quad = 0.0075f,
+		.cutoff = cosf(glm_rad(12.5f)),
+		.outerCutoff = cosf(glm_rad(17.5f)),
+		.type = LIGHT_SPOT,
+	};
+	spotlight = lightAdd(&spot);
+
+	if (pointLight < 0 || spotlight < 0) {
+		return ERR_OUT_OF_MEMORY;
+	}
+
+	firstExtraLight = lightCount();
+	ptrdiff_t extra = shgeti(arguments, "lights");
+	int extraCount = extra >= 0 ? atoi(arguments[extra].value) : 0;
+	for (int i = 0; i < extraCount; i++) {
+		Light light = {
+			.ambient = {0.0f, 0.0f, 0.0f},
+			.diffuse = {
+				0.2f + 0.6f * (float)((i * 7) % 11) / 10.0f,
+				0.2f + 0.6f * (float)((i * 5) % 7) / 6.0f,
+				0.2f + 0.6f * (float)((i * 3) % 5) / 4.0f,
+			},
+			.constant = 1.0f,
+			.linear = 0.7f,
+			.quad = 1.8f,
+			.type = LIGHT_POINT,
+		};
+		glm_vec3_copy(light.diffuse, light.specular);
+		if (lightAdd(&light) < 0) {
+			break;
+		}
+	}
 
 	return ERR_OK;
 }
 
 Error lightInit(GLuint shaderID)
 {
-	glUseProgram(shaderID);
+	glStateUseProgram(shaderID);
 
 	vec3 light = {1.0f, 1.0f, 1.0f};
 	setUniformVec3(shaderID, "lightColor", light);
 
+	return lightsInit();
+}
+
+/* Point the cluster samplers of a lit program at their texture units. */
+void bindClusterSamplers(GLuint shaderID)
+{
+	const GLchar *names[CLUSTER_TEXTURE_LAST] = {
+		[CLUSTER_TEXTURE_LIGHTS] = "clusters.lights",
+		[CLUSTER_TEXTURE_CELLS] = "clusters.cells",
+		[CLUSTER_TEXTURE_INDICES] = "clusters.indices",
+	};
+
+	glStateUseProgram(shaderID);
+	for (int i = 0; i < CLUSTER_TEXTURE_LAST; i++) {
+		setUniformInt(shaderID, names[i], CLUSTER_TEXTURE_UNIT + i);
+	}
+
+	glUniform3i(glGetUniformLocation(shaderID, "clusters.grid"),
+		    CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+}
+
+/* Buffer textures holding the packed lights, cluster cells and light
+ * indices, refilled every frame by drawClusteredLights(). With buffer
+ * ranges, all three stream through one ring buffer sized for the worst
+ * case. */
+Error clusterTexturesInit(void)
+{
+	const GLenum formats[CLUSTER_TEXTURE_LAST] = {
+		[CLUSTER_TEXTURE_LIGHTS] = GL_RGBA32F,
+		[CLUSTER_TEXTURE_CELLS] = GL_RG32UI,
+		[CLUSTER_TEXTURE_INDICES] = GL_R32UI,
+	};
+	packedLights = malloc(sizeof(float) * 4 * LIGHT_TEXELS * LIGHT_MAX);
+	if (packedLights == nullptr) {
+		return ERR_OUT_OF_MEMORY;
+	}
+
+	glGenBuffers(CLUSTER_TEXTURE_LAST, clusterBuffers);
+	glGenTextures(CLUSTER_TEXTURE_LAST, clusterTextures);
+	for (int i = 0; i < CLUSTER_TEXTURE_LAST; i++) {
+		glStateBindBuffer(GL_TEXTURE_BUFFER, clusterBuffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(uint32_t), nullptr,
+			     GL_STREAM_DRAW);
+		glStateActiveTexture(GL_TEXTURE0 + CLUSTER_TEXTURE_UNIT + i);
+		glStateBindTexture(GL_TEXTURE_BUFFER, clusterTextures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], clusterBuffers[i]);
+	}
+
+	bindClusterSamplers(shaderProgram);
+	bindClusterSamplers(deferredProgram);
+
+	if (!glExt.hasTexBufferRange) {
+		return ERR_OK;
+	}
+
+	glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT,
+		      &clusterRingAlignment);
+	if (clusterRingAlignment < 1) {
+		clusterRingAlignment = 1;
+	}
+	size_t size = sizeof(float) * 4 * LIGHT_TEXELS * LIGHT_MAX
+		+ sizeof(clusters.cells)
+		+ sizeof(uint32_t) * CLUSTER_COUNT * CLUSTER_MAX_CELL_LIGHTS
+		+ (size_t)clusterRingAlignment * CLUSTER_TEXTURE_LAST;
+	return ringBufferInit(&clusterRing, GL_TEXTURE_BUFFER, size);
+}
+
+/* Deferred path resources. The path is picked with `--shading
+ * forward|deferred` and toggled at runtime with F2. */
+Error deferredInit(void)
+{
+	ptrdiff_t shading = shgeti(arguments, "shading");
+	if (shading >= 0) {
+		if (strcmp(arguments[shading].value, "deferred") == 0) {
+			shadingPath = SHADING_DEFERRED;
+		} else if (strcmp(arguments[shading].value, "forward") != 0) {
+			return ERR_INVALID_ARGUMENTS;
+		}
+	}
+
+	glStateUseProgram(gbufferProgram);
+	setUniformInt(gbufferProgram, "material.diffuse", 0);
+	setUniformInt(gbufferProgram, "material.specular", 1);
+
+	const GLchar *names[GBUFFER_LAST] = {
+		[GBUFFER_ALBEDO] = "gbuffer.albedo",
+		[GBUFFER_SPECULAR] = "gbuffer.specular",
+		[GBUFFER_NORMAL] = "gbuffer.normal",
+		[GBUFFER_DEPTH] = "gbuffer.depth",
+	};
+	glStateUseProgram(deferredProgram);
+	for (int i = 0; i < GBUFFER_LAST; i++) {
+		setUniformInt(deferredProgram, names[i],
+			      GBUFFER_TEXTURE_UNIT + i);
+	}
+
+	/* Core profile refuses draws without a VAO, even attribute-less. */
+	glGenVertexArrays(1, &emptyVAO);
+
+	return ERR_OK;
+}
+
+/* Dynamic resolution, see dynamic_resolution.c. The upscale samples the
+ * scene bilinearly whatever the graph's texture filtering. */
+Error upscaleInit(void)
+{
+	Error e = dynamicResolutionInit();
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	glGenSamplers(1, &upscaleSampler);
+	glSamplerParameteri(upscaleSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glSamplerParameteri(upscaleSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glSamplerParameteri(upscaleSampler, GL_TEXTURE_WRAP_S,
+			    GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(upscaleSampler, GL_TEXTURE_WRAP_T,
+			    GL_CLAMP_TO_EDGE);
+
+	glStateUseProgram(upscaleProgram);
+	setUniformInt(upscaleProgram, "source", UPSCALE_TEXTURE_UNIT);
+	setUniformFloat(upscaleProgram, "sharpness", upscaleSharpness);
+
+	gpuTimerInit(&frameTimer);
 	return ERR_OK;
 }
 
@@ -456,9 +850,55 @@ Error compileShaders(void)
 #embed "shaders/gl-light.glsl"
 		, '\0'
 	};
+	const GLchar lightingShaderSource[] = {
+#embed "shaders/gl-lighting.glsl"
+		, '\0'
+	};
+	const GLchar gbufferShaderSource[] = {
+#embed "shaders/gl-gbuffer.glsl"
+		, '\0'
+	};
+	const GLchar fullscreenShaderSource[] = {
+#embed "shaders/gl-fullscreen.glsl"
+		, '\0'
+	};
+	const GLchar deferredShaderSource[] = {
+#embed "shaders/gl-deferred.glsl"
+		, '\0'
+	};
+	const GLchar upscaleShaderSource[] = {
+#embed "shaders/gl-upscale.glsl"
+		, '\0'
+	};
+
+	/* The lit shaders are appended to the shared lighting code. */
+	const GLchar *forwardSources[] = {
+		lightingShaderSource,
+		fragmentShaderSource,
+	};
+	const GLchar *deferredSources[] = {
+		lightingShaderSource,
+		deferredShaderSource,
+	};
 
-	Error e = compileShaderProgram(&shaderProgram, vertexShaderSource,
-				       fragmentShaderSource);
+	Error e = compileShaderProgramSources(&shaderProgram,
+					      vertexShaderSource,
+					      forwardSources,
+					      ARRAY_COUNT_STATIC(forwardSources));
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	e = compileShaderProgram(&gbufferProgram, vertexShaderSource,
+				 gbufferShaderSource);
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	e = compileShaderProgramSources(&deferredProgram,
+					fullscreenShaderSource,
+					deferredSources,
+					ARRAY_COUNT_STATIC(deferredSources));
 	if (e != ERR_OK) {
 		return e;
 	}
@@ -469,17 +909,53 @@ Error compileShaders(void)
 		return e;
 	}
 
+	e = compileShaderProgram(&upscaleProgram, fullscreenShaderSource,
+				 upscaleShaderSource);
+	if (e != ERR_OK) {
+		return e;
+	}
+
 	return ERR_OK;
 }
 
-Error graphicsInit(void)
+/* Indirect draws, when the context has them, reading their matrices from
+ * DRAW_TEXTURE_UNIT. */
+Error drawCommandsInit(void)
+{
+	Error e = indirectInit(DRAW_TEXTURE_UNIT);
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	glStateUseProgram(shaderProgram);
+	setUniformInt(shaderProgram, "draws", DRAW_TEXTURE_UNIT);
+	glStateUseProgram(gbufferProgram);
+	setUniformInt(gbufferProgram, "draws", DRAW_TEXTURE_UNIT);
+
+	return ERR_OK;
+}
+
+Error openglInit(void)
 {
 	Error e = compileShaders();
 	if (e != ERR_OK) {
 		return e;
 	}
 
-	vertexBuffersInit();
+	e = occlusionInit();
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	e = lodInit();
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	e = drawCommandsInit();
+	if (e != ERR_OK) {
+		return e;
+	}
 
 	e = textureInit(shaderProgram);
 	if (e != ERR_OK) {
@@ -491,175 +967,724 @@ Error graphicsInit(void)
 		return e;
 	}
 
-	glEnable(GL_DEPTH_TEST);
+	e = clusterTexturesInit();
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	e = deferredInit();
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	e = upscaleInit();
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	glStateEnable(GL_DEPTH_TEST);
 
 	return ERR_OK;
 }
 
-void bindTransformMatrices(void)
+void bindTransformMatrices(GLuint program)
 {
-	glUseProgram(shaderProgram);
+	glStateUseProgram(program);
 
 	mat4 projection = GLM_MAT4_IDENTITY_INIT;
-	glm_perspective(cameraFOV, (float)WIDTH / (float)HEIGHT, 0.1f,
-			100.0f, projection);
+	getCameraProjection(projection);
 
-	setUniformMatrix(shaderProgram, "projection", projection);
+	setUniformMatrix(program, "projection", projection);
 }
 
-void drawCamera(void)
+void drawCamera(GLuint program)
 {
-	glUseProgram(shaderProgram);
+	glStateUseProgram(program);
 
 	mat4 view = GLM_MAT4_IDENTITY_INIT;
-	glm_euler(cameraEuler, view);
-	glm_translate_to(view, cameraPosition, view);
-	setUniformMatrix(shaderProgram, "view", view);
-}
-
-void drawScene(void)
-{
-	glUseProgram(shaderProgram);
-	glBindVertexArray(cubeVAO);
-
-	vec3 cubePositions[] = {
-		{ 0.0f,  0.0f,  0.0f},
-		{ 2.0f,  5.0f, -15.0f},
-		{-1.5f, -2.2f, -2.5f},
-		{-3.8f, -2.0f, -12.3f},
-		{ 2.4f, -0.4f, -3.5f},
-		{-1.7f,  3.0f, -7.5f},
-		{ 1.3f, -2.0f, -2.5f},
-		{ 1.5f,  2.0f, -2.5f},
-		{ 1.5f,  0.2f, -1.5f},
-		{-1.3f,  1.0f, -1.5f},
-	};
+	getCameraView(view);
+	setUniformMatrix(program, "view", view);
+}
+
+/* Level of detail of `mesh` drawn at `transform`, given last frame's. */
+uint32_t selectLod(GPUMesh *mesh, TransformID transform, uint32_t current)
+{
+	/* The camera sits at -cameraPosition in world space. */
+	vec3 eye;
+	glm_vec3_negate_to(cameraPosition, eye);
+
+	/* Bounds are in object space, before any dequantization. */
+	float pixelsPerUnit = lodProject(*transformGetWorld(transform),
+					 mesh->boundsMin, mesh->boundsMax, eye,
+					 cameraFOV, renderHeight,
+					 cameraNear);
+
+	return lodSelect(mesh->lodErrors, mesh->lodCount, pixelsPerUnit,
+			 current);
+}
+
+/* Rasterize the draws as occluders of each other and keep those that may
+ * show. A closed mesh never hides itself, its box being nearer than its
+ * faces. */
+void cullScene(void)
+{
+	if (!occlusion.enabled) {
+		for (ptrdiff_t i = 0; i < arrlen(glDraws); i++) {
+			glDraws[i].visible = true;
+		}
+		return;
+	}
 
-	setUniformVec3(shaderProgram, "material.specular",
-		       (vec3){1.0f, 1.0f, 1.0f});
-	setUniformFloat(shaderProgram, "material.shininess", 32.0f);
+	mat4 view = GLM_MAT4_IDENTITY_INIT;
+	mat4 projection = GLM_MAT4_IDENTITY_INIT;
+	mat4 viewProjection;
+	getCameraView(view);
+	getCameraProjection(projection);
+	glm_mat4_mul(projection, view, viewProjection);
+
+	occlusionBegin(viewProjection, cameraNear);
+	for (ptrdiff_t i = 0; i < arrlen(glDraws); i++) {
+		OccluderID occluder = meshOccluders[glDraws[i].mesh];
+		if (occluder != OCCLUDER_NONE) {
+			occlusionSubmit(occluder, *transformGetWorld(
+						glDraws[i].transform));
+		}
+	}
+	occlusionRasterize();
 
-	for (GLuint i = 0; i < 10; i++) {
-		mat4 model = GLM_MAT4_IDENTITY_INIT;
-		glm_translate(model, cubePositions[i]);
-		GLfloat angle = (float)glfwGetTime() * ((GLfloat)i + 10);
-		glm_rotate(model, glm_rad(angle), (vec3){1.0f, 0.3f, 0.5f});
-		setUniformMatrix(shaderProgram, "model", model);
-		setUniformVec3(shaderProgram, "viewPos", cameraPosition);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+	for (ptrdiff_t i = 0; i < arrlen(glDraws); i++) {
+		GPUMesh *mesh = &gpuMeshes[glDraws[i].mesh];
+		glDraws[i].visible = occlusionTestBox(
+			mesh->boundsMin, mesh->boundsMax,
+			*transformGetWorld(glDraws[i].transform));
 	}
 }
 
-void drawLightCube(void)
+/* Queue the visible lit draws as indirect draws, each material's commands
+ * following each other. Those refused are drawn one by one. */
+void buildDrawCommands(void)
 {
-	glBindVertexArray(lightVAO);
-	glUseProgram(lightShaderProgram);
+	indirectBegin();
+	for (ptrdiff_t i = 0; i < arrlen(glMaterials); i++) {
+		glMaterials[i].commandCount = 0;
+	}
 
-	mat4 model = GLM_MAT4_IDENTITY_INIT;
-	glm_translate(model, lightPosition);
-	glDrawArrays(GL_TRIANGLES, 0, 36);
-	setUniformMatrix(lightShaderProgram, "model", model);
+	for (int32_t first = 0; first < arrlen(glDraws);) {
+		int32_t end = materialRunEnd(first);
+		GLMaterial *material = &glMaterials[glDraws[first].material];
+		material->firstCommand = indirectQueued();
+		for (int32_t i = first; i < end; i++) {
+			GLDraw *draw = &glDraws[i];
+			draw->indirect = false;
+			if (!draw->visible || material->emissive) {
+				continue;
+			}
+
+			GPUMesh *mesh = &gpuMeshes[draw->mesh];
+			mat4 model;
+			gpuMeshModelMatrix(mesh,
+					   *transformGetWorld(draw->transform),
+					   model);
+			draw->indirect = indirectAdd(
+				mesh, draw->lod, model,
+				*transformGetNormal(draw->transform));
+		}
+		material->commandCount =
+			indirectQueued() - material->firstCommand;
+		first = end;
+	}
+	indirectFinish();
+}
+
+/* Pick levels of detail, cull and build draw commands once for every pass
+ * of the frame, from the world matrices of sceneUpdate(). */
+void updateScene(void)
+{
+	for (ptrdiff_t i = 0; i < arrlen(glDraws); i++) {
+		glDraws[i].lod = selectLod(&gpuMeshes[glDraws[i].mesh],
+					   glDraws[i].transform,
+					   glDraws[i].lod);
+	}
+
+	cullScene();
+	buildDrawCommands();
+}
+
+/* Draw the lit draws with `program`, either the forward shader or the
+ * deferred geometry pass, one material after the other. */
+void drawScene(GLuint program)
+{
+	glStateUseProgram(program);
+
+	setUniformFloat(program, "material.shininess", 32.0f);
+	setUniformVec3(program, "viewPos", cameraPosition);
+
+	for (int32_t first = 0; first < arrlen(glDraws);) {
+		int32_t end = materialRunEnd(first);
+		GLMaterial *material = &glMaterials[glDraws[first].material];
+		if (material->emissive) {
+			first = end;
+			continue;
+		}
+
+		glStateActiveTexture(GL_TEXTURE0);
+		glStateBindTexture(GL_TEXTURE_2D,
+				   textureStreamGet(material->diffuse));
+		glStateActiveTexture(GL_TEXTURE1);
+		glStateBindTexture(GL_TEXTURE_2D,
+				   textureStreamGet(material->specular));
+
+		/* Pooled meshes share a layout, so any tells the program. */
+		gpuMeshSetUniforms(&gpuMeshes[glDraws[first].mesh], program);
+		indirectDrawRange(program, material->firstCommand,
+				  material->commandCount);
+		for (int32_t i = first; i < end; i++) {
+			GLDraw *draw = &glDraws[i];
+			if (!draw->visible || draw->indirect) {
+				continue;
+			}
+
+			GPUMesh *mesh = &gpuMeshes[draw->mesh];
+			mat4 model;
+			gpuMeshModelMatrix(mesh,
+					   *transformGetWorld(draw->transform),
+					   model);
+			setUniformMatrix(program, "model", model);
+			setUniformMatrix(program, "normalMatrix",
+					 *transformGetNormal(draw->transform));
+			gpuMeshSetUniforms(mesh, program);
+			gpuMeshDrawLod(mesh, draw->lod);
+		}
+		first = end;
+	}
+}
+
+/* Draw the emissive draws, the light cube, in their material's color. */
+void drawLightCube(void)
+{
+	glStateUseProgram(lightShaderProgram);
 
 	mat4 view = GLM_MAT4_IDENTITY_INIT;
-	glm_euler(cameraEuler, view);
-	glm_translate_to(view, cameraPosition, view);
+	getCameraView(view);
 	setUniformMatrix(lightShaderProgram, "view", view);
 
 	mat4 projection = GLM_MAT4_IDENTITY_INIT;
-	glm_perspective(cameraFOV, (float)WIDTH / (float)HEIGHT, 0.1f,
-			100.0f, projection);
+	getCameraProjection(projection);
 	setUniformMatrix(lightShaderProgram, "projection", projection);
+
+	for (ptrdiff_t i = 0; i < arrlen(glDraws); i++) {
+		GLDraw *draw = &glDraws[i];
+		GLMaterial *material = &glMaterials[draw->material];
+		if (!material->emissive || !draw->visible) {
+			continue;
+		}
+
+		GPUMesh *mesh = &gpuMeshes[draw->mesh];
+		mat4 model;
+		gpuMeshModelMatrix(mesh, *transformGetWorld(draw->transform),
+				   model);
+		setUniformMatrix(lightShaderProgram, "model", model);
+		glUniform4fv(glGetUniformLocation(lightShaderProgram, "color"),
+			     1, material->color);
+		gpuMeshDrawLod(mesh, draw->lod);
+	}
 }
 
-void drawDirectionalLight()
+void drawDirectionalLight(GLuint program)
 {
-	glUseProgram(shaderProgram);
-	setUniformVec3(shaderProgram, "sunlight.color.ambient",
+	glStateUseProgram(program);
+	setUniformVec3(program, "sunlight.color.ambient",
 		       (vec3){0.5f, 0.0f, 0.0f});
-	setUniformVec3(shaderProgram, "sunlight.color.diffuse",
+	setUniformVec3(program, "sunlight.color.diffuse",
 		       (vec3){0.8f, 0.0f, 0.0f});
-	setUniformVec3(shaderProgram, "sunlight.color.specular",
+	setUniformVec3(program, "sunlight.color.specular",
 		       (vec3){1.0f, 0.0f, 0.0f});
 
-	setUniformVec3(shaderProgram, "sunlight.dir", lightPosition);
+	setUniformVec3(program, "sunlight.dir", lightPosition);
 }
 
 void drawLightPoint()
 {
-	glUseProgram(shaderProgram);
-	setUniformVec3(shaderProgram, "lightPoint.color.ambient",
-		       (vec3){0.0f, 0.5f, 0.5f});
-	setUniformVec3(shaderProgram, "lightPoint.color.diffuse",
-		       (vec3){0.0f, 0.8f, 0.8f});
-	setUniformVec3(shaderProgram, "lightPoint.color.specular",
-		       (vec3){0.0f, 1.0f, 1.0f});
+	glm_vec3_copy(lightPosition, lights[pointLight].position);
+}
 
-	setUniformVec3(shaderProgram, "lightPoint.position", lightPosition);
+void drawSpotlight()
+{
+	/* The camera sits at -cameraPosition in world space, see
+	 * getCameraView(). */
+	glm_vec3_negate_to(cameraPosition, lights[spotlight].position);
+	getCameraFront(lights[spotlight].dir);
+}
 
-	setUniformFloat(shaderProgram, "lightPoint.falloff.constant", 1.0f);
-	setUniformFloat(shaderProgram, "lightPoint.falloff.linear", 0.045f);
-	setUniformFloat(shaderProgram, "lightPoint.falloff.quad", 0.0075f);
+/* Orbit the `--lights` lights around the cubes. */
+void drawExtraLights(void)
+{
+	float time = (float)glfwGetTime();
+	int32_t count = lightCount() - firstExtraLight;
+
+	for (int32_t i = 0; i < count; i++) {
+		Light *light = &lights[firstExtraLight + i];
+		float phase = (float)i * 2.399963f; /* Golden angle */
+		float radius = 2.0f + 8.0f * (float)i / (float)count;
+		light->position[0] = radius * cosf(phase + time * 0.3f);
+		light->position[1] = 4.0f * sinf(phase * 3.0f + time);
+		light->position[2] = -6.0f + radius * sinf(phase + time * 0.3f);
+	}
 }
 
-void drawSpotlight()
+/* Upload the cluster lists by orphaning each buffer, on plain 3.3. */
+void uploadClusterBuffers(void)
 {
-	glUseProgram(shaderProgram);
-	setUniformVec3(shaderProgram, "spotlight.color.ambient",
-		       (vec3){0.15f, 0.15f, 0.5f});
-	setUniformVec3(shaderProgram, "spotlight.color.diffuse",
-		       (vec3){0.24f, 0.24f, 0.8f});
-	setUniformVec3(shaderProgram, "spotlight.color.specular",
-		       (vec3){0.3f, 0.3f, 1.0f});
+	lightsPack(packedLights);
+
+	const void *data[CLUSTER_TEXTURE_LAST] = {
+		[CLUSTER_TEXTURE_LIGHTS] = packedLights,
+		[CLUSTER_TEXTURE_CELLS] = clusters.cells,
+		[CLUSTER_TEXTURE_INDICES] = clusters.indices,
+	};
+	const GLsizeiptr sizes[CLUSTER_TEXTURE_LAST] = {
+		[CLUSTER_TEXTURE_LIGHTS] = (GLsizeiptr)sizeof(float) * 4
+			* LIGHT_TEXELS * lightCount(),
+		[CLUSTER_TEXTURE_CELLS] = (GLsizeiptr)sizeof(clusters.cells),
+		[CLUSTER_TEXTURE_INDICES] = (GLsizeiptr)sizeof(uint32_t)
+			* arrlen(clusters.indices),
+	};
 
-	setUniformVec3(shaderProgram, "spotlight.position", cameraPosition);
-	setUniformFloat(shaderProgram, "spotlight.cutoff", cosf(glm_rad(12.5f)));
-	setUniformFloat(shaderProgram, "spotlight.outerCutoff",
-			cosf(glm_rad(17.5f)));
+	/* Orphan, so the driver never waits on last frame's draws. */
+	for (int i = 0; i < CLUSTER_TEXTURE_LAST; i++) {
+		if (sizes[i] == 0) {
+			continue;
+		}
+		glStateBindBuffer(GL_TEXTURE_BUFFER, clusterBuffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, sizes[i], nullptr,
+			     GL_STREAM_DRAW);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, sizes[i], data[i]);
+	}
+}
 
-	setUniformFloat(shaderProgram, "spotlight.falloff.constant", 1.0f);
-	setUniformFloat(shaderProgram, "spotlight.falloff.linear", 0.045f);
-	setUniformFloat(shaderProgram, "spotlight.falloff.quad", 0.0075f);
+/* Write the cluster lists straight into the ring and point the buffer
+ * textures at them. Lists that do not fit keep last frame's. */
+void uploadClusterRanges(void)
+{
+	const GLenum formats[CLUSTER_TEXTURE_LAST] = {
+		[CLUSTER_TEXTURE_LIGHTS] = GL_RGBA32F,
+		[CLUSTER_TEXTURE_CELLS] = GL_RG32UI,
+		[CLUSTER_TEXTURE_INDICES] = GL_R32UI,
+	};
+	const size_t sizes[CLUSTER_TEXTURE_LAST] = {
+		[CLUSTER_TEXTURE_LIGHTS] = sizeof(float) * 4 * LIGHT_TEXELS
+			* lightCount(),
+		[CLUSTER_TEXTURE_CELLS] = sizeof(clusters.cells),
+		[CLUSTER_TEXTURE_INDICES] = sizeof(uint32_t)
+			* arrlen(clusters.indices),
+	};
+
+	RingAllocation allocations[CLUSTER_TEXTURE_LAST];
+	bool allocated[CLUSTER_TEXTURE_LAST];
+	for (int i = 0; i < CLUSTER_TEXTURE_LAST; i++) {
+		allocated[i] = sizes[i] > 0
+			&& ringBufferAlloc(&clusterRing, sizes[i],
+					   (size_t)clusterRingAlignment,
+					   &allocations[i]);
+	}
 
-	vec3 dir = {};
-	getCameraFront(dir);
-	setUniformVec3(shaderProgram, "spotlight.dir", dir);
+	if (allocated[CLUSTER_TEXTURE_LIGHTS]) {
+		lightsPack(allocations[CLUSTER_TEXTURE_LIGHTS].data);
+	}
+	if (allocated[CLUSTER_TEXTURE_CELLS]) {
+		memcpy(allocations[CLUSTER_TEXTURE_CELLS].data, clusters.cells,
+		       sizes[CLUSTER_TEXTURE_CELLS]);
+	}
+	if (allocated[CLUSTER_TEXTURE_INDICES]) {
+		memcpy(allocations[CLUSTER_TEXTURE_INDICES].data,
+		       clusters.indices, sizes[CLUSTER_TEXTURE_INDICES]);
+	}
+	ringBufferFlush(&clusterRing);
+
+	for (int i = 0; i < CLUSTER_TEXTURE_LAST; i++) {
+		if (!allocated[i]) {
+			continue;
+		}
+		glStateActiveTexture(GL_TEXTURE0 + CLUSTER_TEXTURE_UNIT + i);
+		glStateBindTexture(GL_TEXTURE_BUFFER, clusterTextures[i]);
+		glExt.texBufferRange(GL_TEXTURE_BUFFER, formats[i],
+				     clusterRing.buffer, allocations[i].offset,
+				     (GLsizeiptr)sizes[i]);
+	}
+}
+
+/* Bin the light store into clusters and upload the lists for the lit
+ * `program`. */
+void drawClusteredLights(GLuint program)
+{
+	mat4 view = GLM_MAT4_IDENTITY_INIT;
+	mat4 projection = GLM_MAT4_IDENTITY_INIT;
+	getCameraView(view);
+	getCameraProjection(projection);
+
+	clusterBuild(view, projection, cameraNear, cameraFar);
+	if (clusterRing.buffer != 0) {
+		uploadClusterRanges();
+	} else {
+		uploadClusterBuffers();
+	}
+
+	glStateUseProgram(program);
+	glUniform2f(glGetUniformLocation(program, "clusters.tileSize"),
+		    (float)renderWidth / CLUSTER_X,
+		    (float)renderHeight / CLUSTER_Y);
+	setUniformFloat(program, "clusters.depthScale", clusters.depthScale);
+	setUniformFloat(program, "clusters.depthBias", clusters.depthBias);
+}
+
+/* Program evaluating lights for the current shading path. */
+GLuint getLitProgram(void)
+{
+	return shadingPath == SHADING_DEFERRED
+		? deferredProgram
+		: shaderProgram;
+}
+
+/* Program drawing the scene geometry for the current shading path. */
+GLuint getGeometryProgram(void)
+{
+	return shadingPath == SHADING_DEFERRED
+		? gbufferProgram
+		: shaderProgram;
 }
 
 void drawLight(void)
 {
-	drawLightCube();
-	drawDirectionalLight();
+	GLuint program = getLitProgram();
+
+	drawDirectionalLight(program);
 	drawLightPoint();
 	drawSpotlight();
+	drawExtraLights();
+	drawClusteredLights(program);
 }
 
-Error drawFrame(void)
+void geometryPass(RenderGraph *graph, RGPass pass, void *user)
 {
-	glClearColor(0.28f, 0.16f, 0.22f, 1.0f);
+	(void)graph;
+	(void)pass;
+	(void)user;
+
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	drawScene(gbufferProgram);
+}
+
+/* Light the G-buffer over a fullscreen triangle. */
+void lightingPass(RenderGraph *graph, RGPass pass, void *user)
+{
+	(void)pass;
+	(void)user;
+
+	/* Pixels nothing was drawn to are discarded, keeping the clear
+	 * color. */
+	glClear(GL_COLOR_BUFFER_BIT);
+	for (int i = 0; i < GBUFFER_LAST; i++) {
+		GLuint texture = glGraphTexture(graph, gbufferTargets[i]);
+		glStateActiveTexture(GL_TEXTURE0 + GBUFFER_TEXTURE_UNIT + i);
+		glStateBindTexture(GL_TEXTURE_2D, texture);
+	}
+
+	mat4 view = GLM_MAT4_IDENTITY_INIT;
+	mat4 projection = GLM_MAT4_IDENTITY_INIT;
+	getCameraView(view);
+	getCameraProjection(projection);
+	glm_mat4_inv(view, view);
+	glm_mat4_inv(projection, projection);
+
+	glStateUseProgram(deferredProgram);
+	setUniformMatrix(deferredProgram, "inverseView", view);
+	setUniformMatrix(deferredProgram, "inverseProjection", projection);
+	setUniformVec3(deferredProgram, "viewPos", cameraPosition);
+
+	glStateDisable(GL_DEPTH_TEST);
+	glStateBindVertexArray(emptyVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glStateEnable(GL_DEPTH_TEST);
+}
+
+/* Copy G-buffer depth over, so forward-drawn objects still depth test
+ * against the scene. */
+void depthCopyPass(RenderGraph *graph, RGPass pass, void *user)
+{
+	(void)graph;
+	(void)pass;
+	(void)user;
+
+	glBlitFramebuffer(0, 0, renderWidth, renderHeight,
+			  0, 0, renderWidth, renderHeight,
+			  GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+}
+
+void forwardPass(RenderGraph *graph, RGPass pass, void *user)
+{
+	(void)graph;
+	(void)pass;
+	(void)user;
+
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	drawScene(shaderProgram);
+}
+
+void lightCubePass(RenderGraph *graph, RGPass pass, void *user)
+{
+	(void)graph;
+	(void)pass;
+	(void)user;
+
+	drawLightCube();
+}
+
+/* Upscale the scene to the framebuffer, sharpening it. */
+void upscalePass(RenderGraph *graph, RGPass pass, void *user)
+{
+	(void)pass;
+	(void)user;
 
-	bindTransformMatrices();
+	glStateActiveTexture(GL_TEXTURE0 + UPSCALE_TEXTURE_UNIT);
+	glStateBindTexture(GL_TEXTURE_2D, glGraphTexture(graph, sceneTarget));
+	glBindSampler(UPSCALE_TEXTURE_UNIT, upscaleSampler);
 
-	drawCamera();
+	glStateUseProgram(upscaleProgram);
+	glUniform2f(glGetUniformLocation(upscaleProgram, "outputSize"),
+		    (float)framebufferWidth, (float)framebufferHeight);
+
+	glStateDisable(GL_DEPTH_TEST);
+	glStateBindVertexArray(emptyVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glStateEnable(GL_DEPTH_TEST);
+
+	glBindSampler(UPSCALE_TEXTURE_UNIT, 0);
+}
+
+/* Declare the frame's passes for the current shading path. The deferred path
+ * fills the G-buffer, lights it into the scene target, then copies depth
+ * over. The scene target is the default framebuffer, unless dynamic
+ * resolution renders it smaller and upscales it. */
+void buildRenderGraph(void)
+{
+	renderGraphReset(&renderGraph);
+
+	RGTextureDesc color = {
+		.width = framebufferWidth,
+		.height = framebufferHeight,
+		.format = RG_FORMAT_RGBA8,
+	};
+	RGTextureDesc depth = color;
+	/* Matches the default framebuffer, so depth can be blitted. */
+	depth.format = RG_FORMAT_DEPTH24_STENCIL8;
+
+	RGResource backbuffer = renderGraphImport(&renderGraph, "backbuffer",
+						  color, 0, RG_USAGE_NONE,
+						  RG_USAGE_PRESENT);
+	RGResource sceneColor = backbuffer;
+	RGResource sceneDepth = renderGraphImport(&renderGraph,
+						  "backbufferDepth", depth, 0,
+						  RG_USAGE_NONE, RG_USAGE_NONE);
+
+	bool scaled = renderWidth != framebufferWidth
+		|| renderHeight != framebufferHeight;
+	color.width = depth.width = renderWidth;
+	color.height = depth.height = renderHeight;
+	if (scaled) {
+		sceneColor = renderGraphCreateTexture(&renderGraph,
+						      "sceneColor", color);
+		sceneDepth = renderGraphCreateTexture(&renderGraph,
+						      "sceneDepth", depth);
+	}
+
+	if (shadingPath == SHADING_DEFERRED) {
+		const RGTextureDesc descs[GBUFFER_LAST] = {
+			[GBUFFER_ALBEDO] = color,
+			[GBUFFER_SPECULAR] = color,
+			[GBUFFER_NORMAL] = {color.width, color.height,
+					    RG_FORMAT_RGBA16F},
+			[GBUFFER_DEPTH] = depth,
+		};
+		const char *names[GBUFFER_LAST] = {
+			[GBUFFER_ALBEDO] = "gbufferAlbedo",
+			[GBUFFER_SPECULAR] = "gbufferSpecular",
+			[GBUFFER_NORMAL] = "gbufferNormal",
+			[GBUFFER_DEPTH] = "gbufferDepth",
+		};
+
+		RGPass geometry = renderGraphAddPass(&renderGraph, "geometry",
+						     geometryPass, nullptr);
+		RGPass lighting = renderGraphAddPass(&renderGraph, "lighting",
+						     lightingPass, nullptr);
+		for (int i = 0; i < GBUFFER_LAST; i++) {
+			gbufferTargets[i] = renderGraphCreateTexture(
+				&renderGraph, names[i], descs[i]);
+			renderGraphWrite(&renderGraph, geometry,
+					 gbufferTargets[i],
+					 i == GBUFFER_DEPTH
+					 ? RG_USAGE_DEPTH_ATTACHMENT
+					 : RG_USAGE_COLOR_ATTACHMENT);
+			renderGraphRead(&renderGraph, lighting,
+					gbufferTargets[i], RG_USAGE_SAMPLED);
+		}
+		renderGraphWrite(&renderGraph, lighting, sceneColor,
+				 RG_USAGE_COLOR_ATTACHMENT);
+
+		RGPass depthCopy = renderGraphAddPass(&renderGraph, "depthCopy",
+						      depthCopyPass, nullptr);
+		renderGraphRead(&renderGraph, depthCopy,
+				gbufferTargets[GBUFFER_DEPTH],
+				RG_USAGE_TRANSFER_SRC);
+		renderGraphWrite(&renderGraph, depthCopy, sceneDepth,
+				 RG_USAGE_TRANSFER_DST);
+	} else {
+		RGPass forward = renderGraphAddPass(&renderGraph, "forward",
+						    forwardPass, nullptr);
+		renderGraphWrite(&renderGraph, forward, sceneColor,
+				 RG_USAGE_COLOR_ATTACHMENT);
+		renderGraphWrite(&renderGraph, forward, sceneDepth,
+				 RG_USAGE_DEPTH_ATTACHMENT);
+	}
+
+	RGPass lightCube = renderGraphAddPass(&renderGraph, "lightCube",
+					      lightCubePass, nullptr);
+	renderGraphWrite(&renderGraph, lightCube, sceneColor,
+			 RG_USAGE_COLOR_ATTACHMENT);
+	/* Depth tests against the scene's, keeping whichever pass wrote it. */
+	renderGraphRead(&renderGraph, lightCube, sceneDepth,
+			RG_USAGE_DEPTH_ATTACHMENT);
+	renderGraphWrite(&renderGraph, lightCube, sceneDepth,
+			 RG_USAGE_DEPTH_ATTACHMENT);
+
+	if (scaled) {
+		RGPass upscale = renderGraphAddPass(&renderGraph, "upscale",
+						    upscalePass, nullptr);
+		renderGraphRead(&renderGraph, upscale, sceneColor,
+				RG_USAGE_SAMPLED);
+		sceneTarget = sceneColor;
+		renderGraphWrite(&renderGraph, upscale, backbuffer,
+				 RG_USAGE_COLOR_ATTACHMENT);
+	}
+
+	renderGraphCompile(&renderGraph);
+}
+
+/* Scale the scene to the GPU time of past frames, reading every result
+ * available so none stays pending after a hitch. */
+void updateRenderSize(void)
+{
+	float milliseconds;
+	while (gpuTimerRead(&frameTimer, &milliseconds)) {
+		dynamicResolutionUpdate(milliseconds);
+	}
+
+	float scale = dynamicResolutionScale();
+	renderWidth = (int)((float)framebufferWidth * scale + 0.5f);
+	renderHeight = (int)((float)framebufferHeight * scale + 0.5f);
+	renderWidth = renderWidth > 1 ? renderWidth : 1;
+	renderHeight = renderHeight > 1 ? renderHeight : 1;
+}
+
+/* OpenGL draws every frame. */
+Error openglBeginFrame(bool *drawing)
+{
+	*drawing = true;
+
+	captureBeginFrame();
+
+	/* Passes clear their own targets. */
+	glClearColor(0.28f, 0.16f, 0.22f, 1.0f);
+
+	/* Frees the queries of the results read, before timing this frame. */
+	updateRenderSize();
+	gpuTimerBegin(&frameTimer);
+
+	textureStreamUpdate();
+
+	if (clusterRing.buffer != 0) {
+		ringBufferBeginFrame(&clusterRing);
+	}
+
+	return ERR_OK;
+}
+
+Error openglDrawScene(void)
+{
+	GLuint geometryProgram = getGeometryProgram();
+
+	bindTransformMatrices(geometryProgram);
+
+	drawCamera(geometryProgram);
+
+	updateScene();
 
 	drawLight();
 
-	drawScene();
+	buildRenderGraph();
+	return glGraphExecute(&renderGraph);
+}
+
+Error openglEndFrame(void)
+{
+	if (clusterRing.buffer != 0) {
+		ringBufferEndFrame(&clusterRing);
+	}
+	indirectEnd();
+	gpuTimerEnd(&frameTimer);
+	glStateEndFrame();
+	captureEndFrame();
 
 	glfwSwapBuffers(window);
 
 	return ERR_OK;
 }
 
-void cleanupGraphics(void)
+void openglCleanup(void)
 {
-	glDeleteVertexArrays(1, &cubeVAO);
-	glDeleteVertexArrays(1, &lightVAO);
-	glDeleteBuffers(1, &VBO);
+	for (ptrdiff_t i = 0; i < arrlen(gpuMeshes); i++) {
+		gpuMeshFree(&gpuMeshes[i]);
+	}
+	arrfree(gpuMeshes);
+	arrfree(meshOccluders);
+	arrfree(glMaterials);
+	arrfree(glDraws);
+	gpuMeshPoolFree();
+	indirectFree();
+	occlusionFree();
+	glDeleteVertexArrays(1, &emptyVAO);
+	glGraphFree();
+	renderGraphFree(&renderGraph);
+	glDeleteSamplers(1, &upscaleSampler);
+	gpuTimerFree(&frameTimer);
+	glDeleteTextures(CLUSTER_TEXTURE_LAST, clusterTextures);
+	glDeleteBuffers(CLUSTER_TEXTURE_LAST, clusterBuffers);
+	if (clusterRing.buffer != 0) {
+		ringBufferFree(&clusterRing);
+	}
+	free(packedLights);
+	textureStreamShutdown();
+	clusterFree();
+	lightsFree();
+	captureFree();
 }
 
-void cleanupWindow(void)
+void openglCleanupWindow(void)
 {
 	glfwDestroyWindow(window);
 	glfwTerminate();
 }
+
+const Renderer openglRenderer = {
+	.name = "gl",
+	.windowInit = openglWindowInit,
+	.init = openglInit,
+	.createMesh = openglCreateMesh,
+	.createMaterial = openglCreateMaterial,
+	.submitDraws = openglSubmitDraws,
+	.processInput = openglProcessInput,
+	.beginFrame = openglBeginFrame,
+	.drawScene = openglDrawScene,
+	.endFrame = openglEndFrame,
+	.cleanup = openglCleanup,
+	.cleanupWindow = openglCleanupWindow,
+};
@@ -0,0 +1,397 @@
+/* Render graph - Declare passes and their targets, let the graph schedule them
+ *
+ * OVERVIEW: - Every frame, passes are declared in execution order along with
+ *   the virtual resources they read and write, then `renderGraphCompile()`
+ *   works out what actually has to run. Nothing here talks to a graphics API:
+ *   backends such as gl_render_graph.c realize the resources and run the
+ *   passes.
+ *
+ * - Resources are either transient textures, which only live within the
+ *   frame, or imported ones, such as the backbuffer, which the graph does not
+ *   own and always keeps.
+ *
+ * - Passes nothing depends on are culled: a pass survives only if something
+ *   it writes is imported or read by a surviving pass.
+ *
+ * - Each transient texture lives from the first to the last surviving pass
+ *   using it. Transient textures with the same description and disjoint
+ *   lifetimes share one physical slot, so memory follows the largest set of
+ *   targets alive at once rather than the number of targets.
+ *
+ * - Every access names a usage. Compiling records, before each pass, the
+ *   transitions from each resource's previous usage, and after the last pass,
+ *   those bringing imported resources to their final usage, for backends
+ *   with explicit barriers. OpenGL tracks hazards itself and ignores them.
+ *   The Vulkan renderer is not scheduled by the graph yet.
+ *
+ * USAGE:
+ * - renderGraphReset(&graph);
+ * - RGResource screen = renderGraphImport(&graph, "backbuffer", desc, 0,
+ * -					RG_USAGE_NONE, RG_USAGE_PRESENT);
+ * - RGResource color = renderGraphCreateTexture(&graph, "hdr", desc);
+ * - RGPass scene = renderGraphAddPass(&graph, "scene", drawScene, nullptr);
+ * - renderGraphWrite(&graph, scene, color, RG_USAGE_COLOR_ATTACHMENT);
+ * - RGPass tonemap = renderGraphAddPass(&graph, "tonemap", tonemap, nullptr);
+ * - renderGraphRead(&graph, tonemap, color, RG_USAGE_SAMPLED);
+ * - renderGraphWrite(&graph, tonemap, screen, RG_USAGE_COLOR_ATTACHMENT);
+ * - renderGraphCompile(&graph);
+ * - // Run the surviving passes through a backend
+ * - renderGraphFree(&graph);
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "stb_ds.h"
+
+enum : int {
+	RENDER_GRAPH_NAME_SIZE = 32,
+};
+
+typedef int32_t RGResource;
+typedef int32_t RGPass;
+#define RG_NONE (-1)
+
+typedef enum RGFormat : int {
+	RG_FORMAT_RGBA8 = 0,
+	RG_FORMAT_RGBA16F,
+	RG_FORMAT_DEPTH24_STENCIL8,
+} RGFormat;
+
+typedef enum RGUsage : int {
+	RG_USAGE_NONE = 0,	/* Contents undefined */
+	RG_USAGE_COLOR_ATTACHMENT,
+	RG_USAGE_DEPTH_ATTACHMENT,
+	RG_USAGE_SAMPLED,
+	RG_USAGE_TRANSFER_SRC,
+	RG_USAGE_TRANSFER_DST,
+	RG_USAGE_PRESENT,
+} RGUsage;
+
+typedef struct RGTextureDesc {
+	int32_t width;
+	int32_t height;
+	RGFormat format;
+} RGTextureDesc;
+
+typedef struct RGAccess {
+	RGResource resource;
+	RGUsage usage;
+	bool write;
+} RGAccess;
+
+typedef struct RGTransition {
+	RGResource resource;
+	RGUsage before;
+	RGUsage after;
+} RGTransition;
+
+typedef struct RenderGraph RenderGraph;
+typedef void (*RGExecuteFn)(RenderGraph *graph, RGPass pass, void *user);
+
+typedef struct RGResourceNode {
+	char name[RENDER_GRAPH_NAME_SIZE];
+	RGTextureDesc desc;
+	bool imported;
+	uint64_t handle;	/* Backend object of imported resources */
+	RGUsage initialUsage;	/* Imported only */
+	RGUsage finalUsage;	/* Imported only */
+	int32_t references;	/* Surviving readers, while compiling */
+	RGPass firstPass;	/* RG_NONE if unused */
+	RGPass lastPass;
+	int32_t slot;		/* Physical texture of transient resources */
+} RGResourceNode;
+
+typedef struct RGPassNode {
+	char name[RENDER_GRAPH_NAME_SIZE];
+	RGExecuteFn execute;
+	void *user;
+	RGAccess *accesses;		/* stb_ds.h array */
+	RGTransition *transitions;	/* stb_ds.h array, before executing */
+	int32_t references;	/* Needed writes, while compiling */
+	bool culled;
+} RGPassNode;
+
+/* Physical texture shared by transient resources. */
+typedef struct RGSlot {
+	RGTextureDesc desc;
+	RGPass lastPass;	/* Of its latest resource */
+} RGSlot;
+
+struct RenderGraph {
+	RGResourceNode *resources;		/* stb_ds.h array */
+	RGPassNode *passes;			/* stb_ds.h array */
+	RGSlot *slots;				/* stb_ds.h array */
+	RGTransition *finalTransitions;		/* stb_ds.h array */
+};
+
+/* Forget last frame's declarations. */
+void renderGraphReset(RenderGraph *graph)
+{
+	for (ptrdiff_t i = 0; i < arrlen(graph->passes); i++) {
+		arrfree(graph->passes[i].accesses);
+		arrfree(graph->passes[i].transitions);
+	}
+	arrsetlen(graph->passes, 0);
+	arrsetlen(graph->resources, 0);
+	arrsetlen(graph->slots, 0);
+	arrsetlen(graph->finalTransitions, 0);
+}
+
+RGResource renderGraphAddResource(RenderGraph *graph, const char *name,
+				  RGTextureDesc desc)
+{
+	RGResourceNode resource = {
+		.desc = desc,
+		.firstPass = RG_NONE,
+		.lastPass = RG_NONE,
+		.slot = RG_NONE,
+	};
+	(void)snprintf(resource.name, sizeof(resource.name), "%s", name);
+	arrput(graph->resources, resource);
+	return (RGResource)arrlen(graph->resources) - 1;
+}
+
+/* Texture owned by the graph, only valid within the frame. */
+RGResource renderGraphCreateTexture(RenderGraph *graph, const char *name,
+				    RGTextureDesc desc)
+{
+	return renderGraphAddResource(graph, name, desc);
+}
+
+/* Resource owned by the caller, found in `initialUsage` and left in
+ * `finalUsage`. `handle` is whatever the backend needs to bind it. */
+RGResource renderGraphImport(RenderGraph *graph, const char *name,
+			     RGTextureDesc desc, uint64_t handle,
+			     RGUsage initialUsage, RGUsage finalUsage)
+{
+	RGResource id = renderGraphAddResource(graph, name, desc);
+	RGResourceNode *resource = &graph->resources[id];
+	resource->imported = true;
+	resource->handle = handle;
+	resource->initialUsage = initialUsage;
+	resource->finalUsage = finalUsage;
+	return id;
+}
+
+/* Passes run in the order they are added, minus those culled. */
+RGPass renderGraphAddPass(RenderGraph *graph, const char *name,
+			  RGExecuteFn execute, void *user)
+{
+	RGPassNode pass = {
+		.execute = execute,
+		.user = user,
+	};
+	(void)snprintf(pass.name, sizeof(pass.name), "%s", name);
+	arrput(graph->passes, pass);
+	return (RGPass)arrlen(graph->passes) - 1;
+}
+
+void renderGraphRead(RenderGraph *graph, RGPass pass, RGResource resource,
+		     RGUsage usage)
+{
+	RGAccess access = {resource, usage, false};
+	arrput(graph->passes[pass].accesses, access);
+}
+
+void renderGraphWrite(RenderGraph *graph, RGPass pass, RGResource resource,
+		      RGUsage usage)
+{
+	RGAccess access = {resource, usage, true};
+	arrput(graph->passes[pass].accesses, access);
+}
+
+/* Cull `pass` and release what it reads, collecting in `unread` the
+ * resources it leaves with no reader. */
+void renderGraphCullPass(RenderGraph *graph, RGPass pass, RGResource **unread)
+{
+	RGPassNode *node = &graph->passes[pass];
+	node->culled = true;
+	for (ptrdiff_t i = 0; i < arrlen(node->accesses); i++) {
+		const RGAccess *access = &node->accesses[i];
+		if (!access->write
+		    && --graph->resources[access->resource].references == 0) {
+			arrput(*unread, access->resource);
+		}
+	}
+}
+
+void renderGraphCull(RenderGraph *graph)
+{
+	for (ptrdiff_t i = 0; i < arrlen(graph->resources); i++) {
+		RGResourceNode *resource = &graph->resources[i];
+		resource->references = resource->imported ? 1 : 0;
+	}
+	for (ptrdiff_t i = 0; i < arrlen(graph->passes); i++) {
+		RGPassNode *pass = &graph->passes[i];
+		pass->culled = false;
+		pass->references = 0;
+		for (ptrdiff_t j = 0; j < arrlen(pass->accesses); j++) {
+			if (pass->accesses[j].write) {
+				pass->references++;
+			} else {
+				graph->resources[pass->accesses[j].resource]
+					.references++;
+			}
+		}
+	}
+
+	/* Collected before culling passes that write nothing, which push what
+	 * they leave unread themselves: no resource is visited twice. */
+	RGResource *unread = nullptr;	/* stb_ds.h array */
+	for (ptrdiff_t i = 0; i < arrlen(graph->resources); i++) {
+		if (graph->resources[i].references == 0) {
+			arrput(unread, (RGResource)i);
+		}
+	}
+	for (ptrdiff_t i = 0; i < arrlen(graph->passes); i++) {
+		if (graph->passes[i].references == 0) {
+			renderGraphCullPass(graph, (RGPass)i, &unread);
+		}
+	}
+
+	/* Writing an unread resource is pointless. A pass whose writes all
+	 * are goes, and what it read may become unread in turn. */
+	while (arrlen(unread) > 0) {
+		RGResource resource = arrpop(unread);
+		for (ptrdiff_t i = 0; i < arrlen(graph->passes); i++) {
+			RGPassNode *pass = &graph->passes[i];
+			if (pass->culled) {
+				continue;
+			}
+			for (ptrdiff_t j = 0; j < arrlen(pass->accesses); j++) {
+				if (pass->accesses[j].write
+				    && pass->accesses[j].resource == resource
+				    && --pass->references == 0) {
+					renderGraphCullPass(graph, (RGPass)i,
+							    &unread);
+					break;
+				}
+			}
+		}
+	}
+	arrfree(unread);
+}
+
+bool renderGraphSameDesc(RGTextureDesc a, RGTextureDesc b)
+{
+	return a.width == b.width && a.height == b.height
+		&& a.format == b.format;
+}
+
+/* Lifetimes of the resources, and slots of the transient ones, reusing a
+ * slot once the lifetime of its last resource is over. */
+void renderGraphAlias(RenderGraph *graph)
+{
+	for (ptrdiff_t i = 0; i < arrlen(graph->passes); i++) {
+		const RGPassNode *pass = &graph->passes[i];
+		if (pass->culled) {
+			continue;
+		}
+		for (ptrdiff_t j = 0; j < arrlen(pass->accesses); j++) {
+			RGResourceNode *resource =
+				&graph->resources[pass->accesses[j].resource];
+			if (resource->firstPass == RG_NONE) {
+				resource->firstPass = (RGPass)i;
+			}
+			resource->lastPass = (RGPass)i;
+		}
+	}
+
+	for (ptrdiff_t i = 0; i < arrlen(graph->passes); i++) {
+		const RGPassNode *pass = &graph->passes[i];
+		if (pass->culled) {
+			continue;
+		}
+		for (ptrdiff_t j = 0; j < arrlen(pass->accesses); j++) {
+			RGResourceNode *resource =
+				&graph->resources[pass->accesses[j].resource];
+			if (resource->imported || resource->slot != RG_NONE) {
+				continue;
+			}
+
+			for (ptrdiff_t k = 0; k < arrlen(graph->slots); k++) {
+				RGSlot *slot = &graph->slots[k];
+				if (slot->lastPass < (RGPass)i
+				    && renderGraphSameDesc(slot->desc,
+							   resource->desc)) {
+					resource->slot = (int32_t)k;
+					slot->lastPass = resource->lastPass;
+					break;
+				}
+			}
+			if (resource->slot == RG_NONE) {
+				RGSlot slot = {resource->desc,
+					       resource->lastPass};
+				arrput(graph->slots, slot);
+				resource->slot = (int32_t)arrlen(graph->slots)
+					- 1;
+			}
+		}
+	}
+}
+
+/* Usage changes before every surviving pass, and after the last one. A
+ * transient resource starts undefined, whatever its slot held before. */
+void renderGraphTransitions(RenderGraph *graph)
+{
+	RGUsage *usages = nullptr;	/* stb_ds.h array */
+	arrsetlen(usages, arrlen(graph->resources));
+	for (ptrdiff_t i = 0; i < arrlen(graph->resources); i++) {
+		usages[i] = graph->resources[i].imported
+			? graph->resources[i].initialUsage
+			: RG_USAGE_NONE;
+	}
+
+	for (ptrdiff_t i = 0; i < arrlen(graph->passes); i++) {
+		RGPassNode *pass = &graph->passes[i];
+		if (pass->culled) {
+			continue;
+		}
+		for (ptrdiff_t j = 0; j < arrlen(pass->accesses); j++) {
+			const RGAccess *access = &pass->accesses[j];
+			if (usages[access->resource] != access->usage) {
+				RGTransition transition = {
+					access->resource,
+					usages[access->resource],
+					access->usage,
+				};
+				arrput(pass->transitions, transition);
+				usages[access->resource] = access->usage;
+			}
+		}
+	}
+
+	for (ptrdiff_t i = 0; i < arrlen(graph->resources); i++) {
+		const RGResourceNode *resource = &graph->resources[i];
+		if (resource->imported && usages[i] != resource->finalUsage) {
+			RGTransition transition = {
+				(RGResource)i,
+				usages[i],
+				resource->finalUsage,
+			};
+			arrput(graph->finalTransitions, transition);
+		}
+	}
+	arrfree(usages);
+}
+
+/* Cull, then work out lifetimes, aliasing and transitions. Declarations
+ * must not change afterwards. */
+void renderGraphCompile(RenderGraph *graph)
+{
+	renderGraphCull(graph);
+	renderGraphAlias(graph);
+	renderGraphTransitions(graph);
+}
+
+void renderGraphFree(RenderGraph *graph)
+{
+	renderGraphReset(graph);
+	arrfree(graph->passes);
+	arrfree(graph->resources);
+	arrfree(graph->slots);
+	arrfree(graph->finalTransitions);
+}
@@ -0,0 +1,94 @@
+/* Renderer - Interface of the graphics backends
+ *
+ * OVERVIEW: - OpenGL is always compiled in, Vulkan with the VULKAN_ENABLED
+ *   CMake option, and `--renderer gl|vulkan` picks one at startup.
+ *
+ * - After `init()`, the scene creates its meshes and materials through
+ *   `createMesh()` and `createMaterial()`, then hands over its draws with
+ *   `submitDraws()`. Backends keep the list until the next submission, and
+ *   each draw follows its transform as it moves, so the scene only submits
+ *   again when draws come or go.
+ *
+ * - `drawScene()` draws the list every frame from the camera of scene.c,
+ *   between `beginFrame()` and `endFrame()`.
+ *
+ * - `beginFrame()` may skip the frame, e.g. while minimized or once the
+ *   swapchain is out of date, in which case neither of the others is called.
+ *
+ * USAGE:
+ * - const Renderer *renderer = &openglRenderer;
+ * - renderer->windowInit();
+ * - renderer->init();
+ * - MeshID cube;
+ * - renderer->createMesh("cube", &cube);
+ * - MaterialID crate;
+ * - renderer->createMaterial(&(MaterialDesc){.diffuse = "crate"}, &crate);
+ * - renderer->submitDraws(&(RenderDraw){cube, crate, transform}, 1);
+ * - // Every frame
+ * - renderer->processInput(window);
+ * - bool drawing = true;
+ * - renderer->beginFrame(&drawing);
+ * - if (drawing) {
+ * -	renderer->drawScene();
+ * -	renderer->endFrame();
+ * - }
+ * - renderer->cleanup();
+ * - renderer->cleanupWindow();
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "cglm/cglm.h"
+#include "common.h"
+#include "GLFW/glfw3.h"
+#include "transform.c"
+
+typedef int32_t MeshID;
+typedef int32_t MaterialID;
+
+/* Backends without textures or lighting draw `color` instead. */
+typedef struct MaterialDesc {
+	vec4 color;
+	/* Streamed textures, or nullptr */
+	const char *diffuse;
+	const char *specular;
+	/* Drawn in `color` whatever the lights, as light sources are */
+	bool emissive;
+} MaterialDesc;
+
+/* `mesh` drawn with `material` wherever `transform` is. */
+typedef struct RenderDraw {
+	MeshID mesh;
+	MaterialID material;
+	TransformID transform;
+} RenderDraw;
+
+typedef struct Renderer {
+	/* As passed to --renderer */
+	const char *name;
+	/* Create `window` with the hints and callbacks of the backend. */
+	Error (*windowInit)(void);
+	Error (*init)(void);
+	/* The cooked mesh `name`, or the backend's own for "cube". */
+	Error (*createMesh)(const char *name, MeshID *meshOut);
+	Error (*createMaterial)(const MaterialDesc *desc,
+				MaterialID *materialOut);
+	/* Replace the draw list with `count` draws, copied. */
+	Error (*submitDraws)(const RenderDraw *draws, int32_t count);
+	void (*processInput)(GLFWwindow *window);
+	/* Sets `*drawing` to false to skip the frame. */
+	Error (*beginFrame)(bool *drawing);
+	Error (*drawScene)(void);
+	/* Submit the frame and present it. */
+	Error (*endFrame)(void);
+	void (*cleanup)(void);
+	void (*cleanupWindow)(void);
+} Renderer;
+
+/* Shared by the backends, defined in main.c. */
+extern GLFWwindow *window;
+extern uint64_t frameCount;
+extern float lastFrameTimeSec;
+extern float currentFrameTimeSec;
+extern float deltaTimeSec;
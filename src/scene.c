@@ -0,0 +1,214 @@
+/* Scene - Objects and camera shared by the renderers
+ *
+ * OVERVIEW: - The scene is CUBE_COUNT spinning cubes, a light, and a camera
+ *   moved with WASDQE, the mouse and the scroll wheel. It knows nothing of
+ *   the graphics API: `sceneSubmit()` creates the "cube" mesh and the
+ *   materials through the renderer, then submits a draw of the cube at every
+ *   cube transform and at the light's. Renderers follow the transforms as
+ *   they spin.
+ *
+ * - The camera sits at -cameraPosition in world space, rotated by
+ *   cameraEuler. Projections differ between APIs, so renderers build their
+ *   own from cameraFOV, cameraNear and cameraFar.
+ *
+ * USAGE:
+ * - sceneInit();
+ * - sceneSubmit(renderer); // After renderer->init()
+ * - glfwSetCursorPosCallback(window, mouseCallback);
+ * - glfwSetScrollCallback(window, scrollCallback);
+ * - // Every frame
+ * - processCamera(window);
+ * - sceneUpdate();
+ * - sceneFree();
+ */
+#pragma once
+
+#include <math.h>
+
+#include "cglm/cglm.h"
+#include "common.h"
+#include "GLFW/glfw3.h"
+#include "renderer.h"
+#include "transform.c"
+
+enum {
+	CUBE_COUNT = 10,
+};
+
+static constexpr float cameraFOVMin = 0.26f;
+static constexpr float cameraFOVMax = 1.75f;
+static constexpr float cameraNear = 0.1f;
+static constexpr float cameraFar = 100.0f;
+
+vec3 lightPosition = {0.0f, 0.0f, -10.0f};
+TransformID cubeTransforms[CUBE_COUNT];
+TransformID lightTransform;
+
+float cameraSpeed = 10.0f;
+float cameraFOV = GLM_PI / 2.0f;
+vec3 cameraEuler;
+vec3 cameraPosition = {0.0f, 0.0f, 3.0f};
+
+void getCameraView(mat4 out)
+{
+	glm_mat4_identity(out);
+	glm_euler(cameraEuler, out);
+	glm_translate_to(out, cameraPosition, out);
+}
+
+void getCameraFront(vec3 out)
+{
+	out[0] = 0.0f;
+	out[1] = 0.0f;
+	out[2] = 1.0f;
+
+	glm_vec3_rotate(out, cameraEuler[0], GLM_XUP);
+	glm_vec3_rotate(out, cameraEuler[1], GLM_YUP);
+	glm_vec3_rotate(out, cameraEuler[2], GLM_ZUP);
+
+	out[2] = -out[2];
+
+	glm_normalize(out);
+}
+
+void processCamera(GLFWwindow *window)
+{
+	vec3 velocity = {};
+
+	velocity[0] -= (float)(glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS);
+	velocity[0] += (float)(glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS);
+	velocity[1] += (float)(glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS);
+	velocity[1] -= (float)(glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS);
+	velocity[2] += (float)(glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS);
+	velocity[2] -= (float)(glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS);
+
+	glm_vec3_rotate(velocity, -cameraEuler[1], GLM_YUP);
+	glm_vec3_scale(velocity, cameraSpeed * deltaTimeSec, velocity);
+	glm_vec3_add(velocity, cameraPosition, cameraPosition);
+}
+
+void mouseCallback(GLFWwindow* window, double xpos, double ypos)
+{
+	(void)window;
+
+	static float lastX = NAN;
+	static float lastY = NAN;
+
+	if (isnan(lastX) || isnan(lastY)) {
+		lastX = (float)xpos;
+		lastY = (float)ypos;
+	}
+
+	float xoffset = (float)xpos - lastX;
+	float yoffset = -lastY + (float)ypos;
+	lastX = (float)xpos;
+	lastY = (float)ypos;
+
+	constexpr float sensitivity = 0.01f;
+	xoffset *= sensitivity;
+	yoffset *= sensitivity;
+
+	cameraEuler[0] += yoffset;
+	cameraEuler[1] += xoffset;
+
+	cameraEuler[0] =
+		CLAMP(cameraEuler[0], -(float)GLM_PI / 3.0f, (float)GLM_PI / 3.0f);
+}
+
+void scrollCallback(GLFWwindow* window, double xoffset, double yoffset)
+{
+	(void)window;
+	(void)xoffset;
+
+	cameraFOV -= (float)yoffset * 0.25f;
+	cameraFOV = CLAMP(cameraFOV, cameraFOVMin, cameraFOVMax);
+}
+
+Error sceneInit(void)
+{
+	vec3 cubePositions[CUBE_COUNT] = {
+		{ 0.0f,  0.0f,  0.0f},
+		{ 2.0f,  5.0f, -15.0f},
+		{-1.5f, -2.2f, -2.5f},
+		{-3.8f, -2.0f, -12.3f},
+		{ 2.4f, -0.4f, -3.5f},
+		{-1.7f,  3.0f, -7.5f},
+		{ 1.3f, -2.0f, -2.5f},
+		{ 1.5f,  2.0f, -2.5f},
+		{ 1.5f,  0.2f, -1.5f},
+		{-1.3f,  1.0f, -1.5f},
+	};
+
+	for (int i = 0; i < CUBE_COUNT; i++) {
+		cubeTransforms[i] = transformCreate(TRANSFORM_NONE);
+		if (cubeTransforms[i] == TRANSFORM_NONE) {
+			return ERR_OUT_OF_MEMORY;
+		}
+		transformSetPosition(cubeTransforms[i], cubePositions[i]);
+	}
+
+	lightTransform = transformCreate(TRANSFORM_NONE);
+	if (lightTransform == TRANSFORM_NONE) {
+		return ERR_OUT_OF_MEMORY;
+	}
+	transformSetPosition(lightTransform, lightPosition);
+
+	return ERR_OK;
+}
+
+/* Create the resources of the scene with `renderer` and submit its draws. */
+Error sceneSubmit(const Renderer *renderer)
+{
+	MeshID cube;
+	Error e = renderer->createMesh("cube", &cube);
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	const MaterialDesc crateDesc = {
+		.color = {0.9f, 0.6f, 0.3f, 1.0f},
+		.diffuse = "crate",
+		.specular = "crate-specular",
+	};
+	MaterialID crate;
+	e = renderer->createMaterial(&crateDesc, &crate);
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	const MaterialDesc lightDesc = {
+		.color = {0.0f, 1.0f, 0.0f, 1.0f},
+		.emissive = true,
+	};
+	MaterialID light;
+	e = renderer->createMaterial(&lightDesc, &light);
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	RenderDraw list[CUBE_COUNT + 1];
+	for (int i = 0; i < CUBE_COUNT; i++) {
+		list[i] = (RenderDraw){cube, crate, cubeTransforms[i]};
+	}
+	list[CUBE_COUNT] = (RenderDraw){cube, light, lightTransform};
+
+	return renderer->submitDraws(list, (int32_t)ARRAY_COUNT_STATIC(list));
+}
+
+/* Spin the cubes, then refresh every dirty world matrix. */
+void sceneUpdate(void)
+{
+	for (int i = 0; i < CUBE_COUNT; i++) {
+		float angle = (float)glfwGetTime() * ((float)i + 10);
+		versor rotation = GLM_QUAT_IDENTITY_INIT;
+		glm_quatv(rotation, glm_rad(angle), (vec3){1.0f, 0.3f, 0.5f});
+		transformSetRotation(cubeTransforms[i], rotation);
+	}
+
+	transformUpdate();
+}
+
+void sceneFree(void)
+{
+	transformsFree();
+}
@@ -0,0 +1,121 @@
+/* Shader cache - Persist compiled programs and pipeline caches across runs
+ *
+ * OVERVIEW: - Blobs live in SHADER_CACHE_PATH, one file per key. The cache
+ *   never interprets them: each backend writes its own header and must
+ *   validate it on load, since drivers may change between runs.
+ *
+ * - Keys are 64-bit FNV-1a hashes. Feed every input that affects the result
+ *   (sources, driver strings, ...) into one hash with `cacheHash()`.
+ *
+ * - `cacheStore()` writes to a temporary file and renames it, so a crash never
+ *   leaves a truncated blob behind. Failures are silent: the cache is only an
+ *   optimization.
+ *
+ * USAGE:
+ * - uint64_t key = cacheHashString(CACHE_HASH_SEED, source);
+ * - size_t size = 0;
+ * - void *blob = cacheLoad("gl", key, &size); // nullptr on miss
+ * - cacheStore("gl", key, blob, size);
+ * - free(blob);
+ */
+#pragma once
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "common.h"
+
+enum : uint64_t {
+	CACHE_HASH_SEED = 0xcbf29ce484222325,
+	CACHE_HASH_PRIME = 0x100000001b3,
+};
+
+enum : int {
+	CACHE_PATH_SIZE = 512,
+};
+
+uint64_t cacheHash(uint64_t hash, const void *data, size_t size)
+{
+	const unsigned char *bytes = data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= CACHE_HASH_PRIME;
+	}
+	return hash;
+}
+
+/* Hash a string, including its terminator so ("ab", "c") != ("a", "bc"). */
+uint64_t cacheHashString(uint64_t hash, const char *string)
+{
+	if (string == nullptr) {
+		string = "";
+	}
+	return cacheHash(hash, string, strlen(string) + 1);
+}
+
+bool cachePath(char *out, const char *prefix, uint64_t key)
+{
+	int length = snprintf(out, CACHE_PATH_SIZE, "%s/%s-%016llx.bin",
+			      SHADER_CACHE_PATH, prefix,
+			      (unsigned long long)key);
+	return length > 0 && length < CACHE_PATH_SIZE;
+}
+
+/* Return the malloc'd blob stored under `key`, or nullptr. */
+void *cacheLoad(const char *prefix, uint64_t key, size_t *sizeOut)
+{
+	char path[CACHE_PATH_SIZE];
+	if (!cachePath(path, prefix, key)) {
+		return nullptr;
+	}
+
+	FILE *file = fopen(path, "rb");
+	if (file == nullptr) {
+		return nullptr;
+	}
+
+	long size = 0;
+	if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) <= 0
+	    || fseek(file, 0, SEEK_SET) != 0) {
+		(void)fclose(file);
+		return nullptr;
+	}
+
+	void *blob = malloc((size_t)size);
+	if (blob != nullptr
+	    && fread(blob, 1, (size_t)size, file) != (size_t)size) {
+		free(blob);
+		blob = nullptr;
+	}
+	(void)fclose(file);
+
+	*sizeOut = blob != nullptr ? (size_t)size : 0;
+	return blob;
+}
+
+void cacheStore(const char *prefix, uint64_t key, const void *blob,
+		size_t size)
+{
+	char path[CACHE_PATH_SIZE];
+	char temporaryPath[CACHE_PATH_SIZE + 4];
+	if (!cachePath(path, prefix, key)) {
+		return;
+	}
+	(void)snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", path);
+
+	if (mkdir(SHADER_CACHE_PATH, 0755) != 0 && errno != EEXIST) {
+		return;
+	}
+
+	FILE *file = fopen(temporaryPath, "wb");
+	if (file == nullptr) {
+		return;
+	}
+	bool written = fwrite(blob, 1, size, file) == size;
+	if (fclose(file) != 0 || !written
+	    || rename(temporaryPath, path) != 0) {
+		(void)remove(temporaryPath);
+	}
+}
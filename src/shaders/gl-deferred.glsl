@@ -0,0 +1,41 @@
+// Lighting pass of the deferred path, over a fullscreen triangle. Lights are
+// looked up per screen tile in the same clusters as the forward path.
+// Appended to gl-lighting.glsl, which holds the #version directive.
+out vec4 FragColor;
+
+struct GBuffer {
+	sampler2D albedo;
+	sampler2D specular;
+	sampler2D normal;
+	sampler2D depth;
+};
+
+const float SHININESS_SCALE = 256.0f;
+
+uniform GBuffer gbuffer;
+uniform mat4 inverseProjection;
+uniform mat4 inverseView;
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(gbuffer.depth, pixel, 0).r;
+	// Nothing was drawn here, keep the clear color.
+	if (depth == 1.0f) {
+		discard;
+	}
+
+	vec2 uv = gl_FragCoord.xy / vec2(textureSize(gbuffer.depth, 0));
+	vec4 viewPosition = inverseProjection *
+		vec4(vec3(uv, depth) * 2.0f - 1.0f, 1.0f);
+	viewPosition /= viewPosition.w;
+
+	vec4 specular = texelFetch(gbuffer.specular, pixel, 0);
+	Surface s = Surface((inverseView * viewPosition).xyz, -viewPosition.z,
+			    texelFetch(gbuffer.albedo, pixel, 0).rgb,
+			    specular.rgb,
+			    normalize(texelFetch(gbuffer.normal, pixel, 0).xyz),
+			    specular.a * SHININESS_SCALE);
+
+	FragColor = vec4(computeLighting(s), 1.0f);
+}
@@ -0,0 +1,8 @@
+#version 330 core
+// One triangle covering the screen, drawn with 3 vertices and no attributes.
+
+void main()
+{
+	vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(position * 2.0f - 1.0f, 0.0f, 1.0f);
+}
@@ -0,0 +1,27 @@
+#version 330 core
+// Geometry pass of the deferred path. Lighting happens in gl-deferred.glsl.
+layout (location = 0) out vec4 gAlbedo;
+layout (location = 1) out vec4 gSpecular;
+layout (location = 2) out vec4 gNormal;
+
+in vec3 Normal;
+in vec2 TexCoord;
+
+struct Material {
+	sampler2D diffuse;
+	sampler2D specular;
+	float shininess;
+};
+
+// Shininess is stored in the specular alpha, scaled to fit 8 bits.
+const float SHININESS_SCALE = 256.0f;
+
+uniform Material material;
+
+void main()
+{
+	gAlbedo = vec4(texture(material.diffuse, TexCoord).rgb, 1.0f);
+	gSpecular = vec4(texture(material.specular, TexCoord).rgb,
+			 material.shininess / SHININESS_SCALE);
+	gNormal = vec4(normalize(Normal), 0.0f);
+}
@@ -1,7 +1,9 @@
 #version 330 core
 out vec4 FragColor;
+
+uniform vec4 color;
   
 void main()
 {
-	FragColor = vec4(0.0f, 1.0f, 0.0f, 1.0f);
+	FragColor = color;
 }
@@ -0,0 +1,137 @@
+#version 330 core
+// Lighting shared by the forward (gl-fragment.glsl) and deferred
+// (gl-deferred.glsl) paths. Those files are appended to this one, which holds
+// the #version directive.
+
+struct LightColor {
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+};
+
+struct Sunlight {
+	LightColor color;
+	vec3 dir;
+};
+
+// Point and spot lights, see lightsPack() in lights.c for the layout.
+struct Light {
+	vec3 position;
+	float radius;
+	LightColor color;
+	int type;
+	vec3 dir;
+	float cutoff;
+	float outerCutoff;
+	vec3 falloff; // constant, linear, quadratic
+};
+
+// Texels of the clustered light lists, see cluster.c.
+struct Clusters {
+	samplerBuffer lights;	// LIGHT_TEXELS vec4 per light
+	usamplerBuffer cells;	// (offset, count) per cluster
+	usamplerBuffer indices;	// Light IDs
+	ivec3 grid;
+	vec2 tileSize;		// Pixels per tile
+	float depthScale;
+	float depthBias;
+};
+
+// Everything lighting needs to know about the shaded point. The material is
+// fetched once and shared by every light.
+struct Surface {
+	vec3 position;
+	float viewDepth;
+	vec3 albedo;
+	vec3 specular;
+	vec3 normal;
+	float shininess;
+};
+
+const int LIGHT_TEXELS = 6;
+const int LIGHT_SPOT = 1;
+
+uniform Sunlight sunlight;
+uniform Clusters clusters;
+uniform vec3 viewPos;
+
+Light fetchLight(int id)
+{
+	int base = id * LIGHT_TEXELS;
+	vec4 t0 = texelFetch(clusters.lights, base);
+	vec4 t1 = texelFetch(clusters.lights, base + 1);
+	vec4 t2 = texelFetch(clusters.lights, base + 2);
+	vec4 t3 = texelFetch(clusters.lights, base + 3);
+	vec4 t4 = texelFetch(clusters.lights, base + 4);
+	vec4 t5 = texelFetch(clusters.lights, base + 5);
+
+	return Light(t0.xyz, t0.w, LightColor(t1.rgb, t2.rgb, t3.rgb),
+		     int(t1.w), t4.xyz, t2.w, t3.w, t5.xyz);
+}
+
+vec3 shade(Surface s, vec3 viewDir, LightColor color, vec3 lightDir)
+{
+	vec3 ambient = color.ambient * s.albedo;
+
+	float diff = max(dot(s.normal, lightDir), 0.0f);
+	vec3 diffuse = diff * color.diffuse * s.albedo;
+
+	vec3 reflectDir = reflect(-lightDir, s.normal);
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0f), s.shininess);
+	vec3 specular = spec * color.specular * s.specular;
+
+	return ambient + diffuse + specular;
+}
+
+vec3 getLight(Surface s, vec3 viewDir, Light light)
+{
+	vec3 toLight = light.position - s.position;
+	float distance = length(toLight);
+	vec3 lightDir = toLight / distance;
+
+	float attenuation = 1.0f / (light.falloff.x + light.falloff.y *
+				    distance + light.falloff.z *
+				    (distance * distance));
+
+	if (light.type == LIGHT_SPOT) {
+		float theta = dot(lightDir, normalize(-light.dir));
+		float epsilon = light.cutoff - light.outerCutoff;
+		float intensity = clamp((theta - light.outerCutoff) /
+					epsilon, 0.0f, 1.0f);
+		attenuation *= mix(intensity, 1.0f,
+				   step(light.cutoff, theta));
+	}
+
+	return shade(s, viewDir, light.color, lightDir) * attenuation;
+}
+
+ivec3 getCluster(float viewDepth)
+{
+	int slice = int(log(viewDepth) * clusters.depthScale +
+			clusters.depthBias);
+	ivec2 tile = ivec2(gl_FragCoord.xy / clusters.tileSize);
+
+	return clamp(ivec3(tile, slice), ivec3(0), clusters.grid - 1);
+}
+
+// Sunlight plus every light binned in the fragment's cluster.
+vec3 computeLighting(Surface s)
+{
+	// Very weird, I need to reverse the camera position (viewPos), maybe
+	// there is an issue with the coordinate system.
+	vec3 viewDir = normalize(-viewPos - s.position);
+
+	vec3 result = shade(s, viewDir, sunlight.color,
+			    normalize(-sunlight.dir));
+
+	ivec3 c = getCluster(s.viewDepth);
+	int cell = (c.z * clusters.grid.y + c.y) * clusters.grid.x + c.x;
+	uvec2 range = texelFetch(clusters.cells, cell).xy;
+	for (uint i = 0u; i < range.y; i++) {
+		int id = int(texelFetch(clusters.indices,
+					int(range.x + i)).x);
+		result += getLight(s, viewDir, fetchLight(id));
+	}
+
+	return result;
+}
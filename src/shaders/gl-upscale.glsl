@@ -0,0 +1,33 @@
+#version 330 core
+// Upscale of the dynamic resolution target to the window, over a fullscreen
+// triangle. Bilinear samples are sharpened against their neighbours, more
+// where local contrast is low, to make up for the blur of upscaling without
+// ringing on edges.
+out vec4 FragColor;
+
+uniform sampler2D source;	// Bilinear filtering
+uniform vec2 outputSize;
+uniform float sharpness;	// 0 to 1
+
+void main()
+{
+	vec2 uv = gl_FragCoord.xy / outputSize;
+	vec2 texel = 1.0f / vec2(textureSize(source, 0));
+
+	vec3 center = texture(source, uv).rgb;
+	vec3 north = texture(source, uv + vec2(0.0f, texel.y)).rgb;
+	vec3 south = texture(source, uv - vec2(0.0f, texel.y)).rgb;
+	vec3 east = texture(source, uv + vec2(texel.x, 0.0f)).rgb;
+	vec3 west = texture(source, uv - vec2(texel.x, 0.0f)).rgb;
+
+	vec3 low = min(center, min(min(north, south), min(east, west)));
+	vec3 high = max(center, max(max(north, south), max(east, west)));
+	// How far the neighbourhood can be pushed before clipping.
+	vec3 amount = sqrt(clamp(min(low, 1.0f - high) / max(high, 1e-4f),
+				 0.0f, 1.0f));
+	vec3 weight = -amount / mix(8.0f, 5.0f, sharpness);
+
+	vec3 color = (center + (north + south + east + west) * weight)
+		/ (1.0f + 4.0f * weight);
+	FragColor = vec4(clamp(color, 0.0f, 1.0f), 1.0f);
+}
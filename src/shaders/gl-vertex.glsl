@@ -2,20 +2,55 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoord;
 layout (location = 2) in vec3 aNormal;
+// Instance index, set to the draw's index by indirect draws.
+layout (location = 3) in uint aDrawID;
 
 out vec2 TexCoord;
 out vec3 Normal;
 out vec3 FragPos;
+out float ViewDepth;
 
 uniform mat4 projection;
 uniform mat4 view;
 uniform mat4 model;
+// transpose(inverse(model)), precomputed on the CPU by the transform store.
+uniform mat4 normalMatrix;
+// Set when aNormal is octahedral-encoded in its xy, remapped to [0, 1].
+uniform bool octahedralNormals;
+// Set by indirect draws, which read model then normalMatrix from `draws`,
+// 8 texels per draw, instead of the uniforms.
+uniform bool indirectDraws;
+uniform samplerBuffer draws;
+
+vec3 decodeOctahedral(vec2 encoded)
+{
+	vec2 f = encoded * 2.0 - 1.0;
+	vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	mat4 drawModel = model;
+	mat4 drawNormalMatrix = normalMatrix;
+	if (indirectDraws) {
+		int texel = int(aDrawID) * 8;
+		drawModel = mat4(texelFetch(draws, texel),
+				 texelFetch(draws, texel + 1),
+				 texelFetch(draws, texel + 2),
+				 texelFetch(draws, texel + 3));
+		drawNormalMatrix = mat4(texelFetch(draws, texel + 4),
+					texelFetch(draws, texel + 5),
+					texelFetch(draws, texel + 6),
+					texelFetch(draws, texel + 7));
+	}
+
+	gl_Position = projection * view * drawModel * vec4(aPos, 1.0);
 	TexCoord = aTexCoord;
-	// Very costly, try not to do it!! Use normal matrices instead.
-	Normal = mat3(transpose(inverse(model))) * aNormal;
-	FragPos = vec3(model * vec4(aPos, 1.0f));
+	vec3 normal = octahedralNormals ? decodeOctahedral(aNormal.xy) : aNormal;
+	Normal = mat3(drawNormalMatrix) * normal;
+	FragPos = vec3(drawModel * vec4(aPos, 1.0f));
+	ViewDepth = -(view * vec4(FragPos, 1.0f)).z;
 }
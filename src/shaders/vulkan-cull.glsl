@@ -0,0 +1,65 @@
+#version 450
+
+/* Frustum culls the objects, compacting the visible ones into indirect
+ * draws, with the object index as instance. */
+
+layout(local_size_x = 64) in;
+
+struct Object {
+	mat4 model;
+	vec4 bounds;	/* Model space sphere center and radius */
+	uint indexCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint material;
+};
+
+/* VkDrawIndexedIndirectCommand */
+struct DrawCommand {
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+layout(set = 0, binding = 0) readonly buffer Objects {
+	Object objects[];
+};
+
+layout(set = 0, binding = 1) writeonly buffer Commands {
+	DrawCommand commands[];
+};
+
+layout(set = 0, binding = 2) buffer Count {
+	uint drawCount;
+};
+
+layout(push_constant) uniform Cull {
+	vec4 planes[6];	/* World space, normalized, pointing inside */
+	uint objectCount;
+} cull;
+
+void main() {
+	uint index = gl_GlobalInvocationID.x;
+	if (index >= cull.objectCount) {
+		return;
+	}
+
+	Object object = objects[index];
+	vec3 center = (object.model * vec4(object.bounds.xyz, 1.0)).xyz;
+	float scale = max(max(length(object.model[0].xyz),
+			      length(object.model[1].xyz)),
+			  length(object.model[2].xyz));
+	float radius = object.bounds.w * scale;
+	for (int i = 0; i < 6; i++) {
+		if (dot(cull.planes[i].xyz, center) + cull.planes[i].w
+		    < -radius) {
+			return;
+		}
+	}
+
+	uint slot = atomicAdd(drawCount, 1);
+	commands[slot] = DrawCommand(object.indexCount, 1, object.firstIndex,
+				     object.vertexOffset, index);
+}
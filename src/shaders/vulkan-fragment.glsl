@@ -1,8 +1,25 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) flat in uint fragMaterial;
 layout(location = 0) out vec4 outColor;
 
+/* Bindless set, indexed through the push constants. */
+layout(set = 0, binding = 1) readonly buffer Materials {
+	vec4 tints[];
+} materials[];
+
+layout(push_constant) uniform Draw {
+	mat4 model;
+	uint materialBuffer;
+	uint material;
+	uint texture;
+	uint objectBuffer;
+} draw;
+
 void main() {
-	outColor = vec4(fragColor, 1.0);
+	vec4 tint = materials[nonuniformEXT(draw.materialBuffer)]
+		.tints[fragMaterial];
+	outColor = vec4(fragColor, 1.0) * tint;
 }
@@ -1,11 +1,49 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
-layout(location = 0) in vec2 inPosition;
+layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 
+layout(set = 1, binding = 0) uniform Frame {
+	mat4 viewProjection;
+	float time;
+} frame;
+
+struct Object {
+	mat4 model;
+	vec4 bounds;
+	uint indexCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint material;
+};
+
+/* Bindless set, indexed through the push constants. */
+layout(set = 0, binding = 1) readonly buffer Objects {
+	Object objects[];
+} objectBuffers[];
+
+layout(push_constant) uniform Draw {
+	mat4 model;
+	uint materialBuffer;
+	uint material;
+	uint texture;
+	uint objectBuffer;	/* Object of the instance unless ~0 */
+} draw;
+
 layout(location = 0) out vec3 fragColor;
+layout(location = 1) flat out uint fragMaterial;
 
 void main() {
-	gl_Position = vec4(inPosition, 0.0, 1.0);
+	mat4 model = draw.model;
+	fragMaterial = draw.material;
+	if (draw.objectBuffer != ~0u) {
+		Object object = objectBuffers[draw.objectBuffer]
+			.objects[gl_InstanceIndex];
+		model = object.model;
+		fragMaterial = object.material;
+	}
+
+	gl_Position = frame.viewProjection * model * vec4(inPosition, 1.0);
 	fragColor = inColor;
 }
@@ -0,0 +1,111 @@
+/* Cooked texture loading - Map texture_format.h containers into memory
+ *
+ * OVERVIEW: - `textureMap()` maps a cooked texture read-only and validates its
+ *   header and level table, so callers can hand `textureLevelData()` straight
+ *   to the graphics API.
+ *
+ * - Mappings are backed by the page cache: only the levels actually read are
+ *   loaded from disk.
+ *
+ * USAGE:
+ * - MappedTexture texture;
+ * - if (textureMap(&texture, COOKED_RESOURCE_PATH "/crate.tex") == ERR_OK) {
+ * -	upload(textureLevelData(&texture, 0), texture.header->levels[0].size);
+ * -	textureUnmap(&texture);
+ * - }
+ */
+#pragma once
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "texture_format.h"
+
+typedef struct MappedTexture {
+	const TextureHeader *header;
+	const uint8_t *data;
+	size_t size;
+} MappedTexture;
+
+bool textureHeaderValid(const TextureHeader *header, size_t size)
+{
+	if (header->magic != TEXTURE_MAGIC || header->version != TEXTURE_VERSION
+	    || header->levelCount == 0
+	    || header->levelCount > TEXTURE_MAX_LEVELS) {
+		return false;
+	}
+
+	switch (header->format) {
+	case TEXTURE_FORMAT_BC1:
+	case TEXTURE_FORMAT_BC3:
+	case TEXTURE_FORMAT_BC7:
+		break;
+	default:
+		return false;
+	}
+
+	for (uint32_t i = 0; i < header->levelCount; i++) {
+		const TextureLevel *level = &header->levels[i];
+		if (level->size != textureLevelBytes(header->format,
+						     level->width,
+						     level->height)
+		    || level->offset > size || level->size > size - level->offset) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+Error textureMap(MappedTexture *textureOut, const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return ERR_TEXTURE_LOADING_FAILED;
+	}
+
+	struct stat status;
+	if (fstat(fd, &status) != 0
+	    || (size_t)status.st_size < sizeof(TextureHeader)) {
+		(void)close(fd);
+		return ERR_TEXTURE_LOADING_FAILED;
+	}
+
+	size_t size = (size_t)status.st_size;
+	void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	/* The mapping stays valid after closing. */
+	(void)close(fd);
+	if (data == MAP_FAILED) {
+		return ERR_TEXTURE_LOADING_FAILED;
+	}
+
+	if (!textureHeaderValid(data, size)) {
+		(void)munmap(data, size);
+		return ERR_TEXTURE_LOADING_FAILED;
+	}
+
+	*textureOut = (MappedTexture){
+		.header = data,
+		.data = data,
+		.size = size,
+	};
+
+	return ERR_OK;
+}
+
+const void *textureLevelData(const MappedTexture *texture, uint32_t level)
+{
+	return texture->data + texture->header->levels[level].offset;
+}
+
+void textureUnmap(MappedTexture *texture)
+{
+	if (texture->data != nullptr) {
+		(void)munmap((void *)texture->data, texture->size);
+	}
+	*texture = (MappedTexture){};
+}
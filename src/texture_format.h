@@ -0,0 +1,74 @@
+/* Cooked textures - Container format shared by the cooker and the runtime
+ *
+ * OVERVIEW: - A cooked texture is a TextureHeader followed by every level of
+ *   its mip chain, largest first, already block compressed. Levels start on
+ *   TEXTURE_ALIGNMENT boundaries so they can be uploaded straight from a
+ *   mapping of the file.
+ *
+ * - Rows are stored bottom-up, the order OpenGL expects.
+ *
+ * - Blocks are 4x4 texels. Levels smaller than a block still take a whole
+ *   block.
+ *
+ * - Bump TEXTURE_VERSION on any layout change. Readers must reject versions
+ *   they do not know, and recook.
+ */
+#pragma once
+
+#include <stdint.h>
+
+enum : uint32_t {
+	TEXTURE_MAGIC = 0x5845544c, /* "LTEX" */
+	TEXTURE_VERSION = 1,
+	TEXTURE_MAX_LEVELS = 16,
+	TEXTURE_ALIGNMENT = 16,
+	TEXTURE_BLOCK_SIZE = 4,
+};
+
+typedef enum TextureFormat : uint32_t {
+	TEXTURE_FORMAT_BC1 = 1,	/* RGB, 8 bytes per block */
+	TEXTURE_FORMAT_BC3 = 3,	/* RGBA, 16 bytes per block */
+	TEXTURE_FORMAT_BC7 = 7,	/* RGBA, 16 bytes per block */
+} TextureFormat;
+
+typedef enum TextureFlags : uint32_t {
+	/* Texels are sRGB encoded, and the mips were filtered in linear
+	 * light. */
+	TEXTURE_FLAG_SRGB = 1 << 0,
+} TextureFlags;
+
+typedef struct TextureLevel {
+	uint32_t width;
+	uint32_t height;
+	uint64_t offset;	/* From the start of the file */
+	uint64_t size;
+} TextureLevel;
+
+typedef struct TextureHeader {
+	uint32_t magic;
+	uint32_t version;
+	TextureFormat format;
+	uint32_t flags;
+	uint32_t width;
+	uint32_t height;
+	uint32_t levelCount;
+	uint32_t reserved;
+	TextureLevel levels[TEXTURE_MAX_LEVELS];
+} TextureHeader;
+
+uint32_t textureBlockBytes(TextureFormat format)
+{
+	return format == TEXTURE_FORMAT_BC1 ? 8 : 16;
+}
+
+uint32_t textureBlockCount(uint32_t texels)
+{
+	return (texels + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+}
+
+uint64_t textureLevelBytes(TextureFormat format, uint32_t width,
+			   uint32_t height)
+{
+	return (uint64_t)textureBlockCount(width) * textureBlockCount(height)
+		* textureBlockBytes(format);
+}
@@ -0,0 +1,422 @@
+/* Block compression - BC1, BC3 and BC7 encoders for 4x4 RGBA8 blocks
+ *
+ * OVERVIEW: - Endpoints are fitted on the principal axis of the block's
+ *   colors, then every texel picks its closest palette entry. BC1 and BC3
+ *   colors get one least-squares refinement pass on top.
+ *
+ * - BC7 only emits mode 6: one subset, RGBA endpoints with 7 bits plus a
+ *   p-bit per channel, and 4-bit indices. It is the most flexible single
+ *   mode, and keeps the encoder small.
+ *
+ * - Encoders are pure functions of their block, so blocks may be encoded on
+ *   any thread.
+ *
+ * USAGE:
+ * - BlockTexels block; // 16 RGBA8 texels, row by row
+ * - uint8_t out[16];
+ * - blockCompressBC7(block, out);
+ */
+#pragma once
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t BlockTexels[16][4];
+
+/* Sum of squared channel differences. */
+float blockDistance(const float *a, const float *b, int channels)
+{
+	float distance = 0.0f;
+	for (int c = 0; c < channels; c++) {
+		float d = a[c] - b[c];
+		distance += d * d;
+	}
+	return distance;
+}
+
+/* Endpoints of the block's principal axis, over the first `channels`
+ * channels. `start` is the low end of the axis. */
+void blockPrincipalAxis(const BlockTexels texels, int channels, float *start,
+			float *end)
+{
+	float mean[4] = {};
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < channels; c++) {
+			mean[c] += texels[i][c] / 16.0f;
+		}
+	}
+
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++) {
+		float d[4];
+		for (int c = 0; c < channels; c++) {
+			d[c] = texels[i][c] - mean[c];
+		}
+		for (int a = 0; a < channels; a++) {
+			for (int b = 0; b < channels; b++) {
+				covariance[a][b] += d[a] * d[b];
+			}
+		}
+	}
+
+	/* Power iteration, starting from the channel with most variance. */
+	float axis[4] = {};
+	int widest = 0;
+	for (int c = 1; c < channels; c++) {
+		if (covariance[c][c] > covariance[widest][widest]) {
+			widest = c;
+		}
+	}
+	axis[widest] = 1.0f;
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float next[4] = {};
+		float length = 0.0f;
+		for (int a = 0; a < channels; a++) {
+			for (int b = 0; b < channels; b++) {
+				next[a] += covariance[a][b] * axis[b];
+			}
+			length += next[a] * next[a];
+		}
+		if (length < FLT_EPSILON) {
+			break;
+		}
+		length = 1.0f / sqrtf(length);
+		for (int c = 0; c < channels; c++) {
+			axis[c] = next[c] * length;
+		}
+	}
+
+	float low = FLT_MAX;
+	float high = -FLT_MAX;
+	for (int i = 0; i < 16; i++) {
+		float t = 0.0f;
+		for (int c = 0; c < channels; c++) {
+			t += (texels[i][c] - mean[c]) * axis[c];
+		}
+		low = fminf(low, t);
+		high = fmaxf(high, t);
+	}
+
+	/* Inset the endpoints, since the extremes are rarely worth an exact
+	 * palette entry. */
+	float inset = (high - low) / 16.0f;
+	low += inset;
+	high -= inset;
+	for (int c = 0; c < channels; c++) {
+		start[c] = fminf(fmaxf(mean[c] + axis[c] * low, 0.0f), 255.0f);
+		end[c] = fminf(fmaxf(mean[c] + axis[c] * high, 0.0f), 255.0f);
+	}
+}
+
+uint16_t blockPack565(const float *color)
+{
+	uint16_t r = (uint16_t)lroundf(color[0] * 31.0f / 255.0f);
+	uint16_t g = (uint16_t)lroundf(color[1] * 63.0f / 255.0f);
+	uint16_t b = (uint16_t)lroundf(color[2] * 31.0f / 255.0f);
+	return (uint16_t)(r << 11 | g << 5 | b);
+}
+
+void blockUnpack565(uint16_t packed, float *color)
+{
+	int r = packed >> 11 & 31;
+	int g = packed >> 5 & 63;
+	int b = packed & 31;
+	color[0] = (float)(r << 3 | r >> 2);
+	color[1] = (float)(g << 2 | g >> 4);
+	color[2] = (float)(b << 3 | b >> 2);
+}
+
+/* Pick the closest 4-color palette entry for every texel. Return the total
+ * squared error. */
+float blockFitColorIndices(const BlockTexels texels, uint16_t c0, uint16_t c1,
+			   uint8_t indices[16])
+{
+	float palette[4][3];
+	blockUnpack565(c0, palette[0]);
+	blockUnpack565(c1, palette[1]);
+	for (int c = 0; c < 3; c++) {
+		palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+		palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+	}
+
+	float error = 0.0f;
+	for (int i = 0; i < 16; i++) {
+		float texel[3] = {texels[i][0], texels[i][1], texels[i][2]};
+		float best = FLT_MAX;
+		for (uint8_t p = 0; p < 4; p++) {
+			float distance = blockDistance(texel, palette[p], 3);
+			if (distance < best) {
+				best = distance;
+				indices[i] = p;
+			}
+		}
+		error += best;
+	}
+	return error;
+}
+
+/* Least-squares endpoints for fixed indices. */
+void blockRefineColorEndpoints(const BlockTexels texels,
+			       const uint8_t indices[16], float *start,
+			       float *end)
+{
+	static const float weights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float ax[3] = {}, bx[3] = {};
+	for (int i = 0; i < 16; i++) {
+		float b = weights[indices[i]];
+		float a = 1.0f - b;
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (int c = 0; c < 3; c++) {
+			ax[c] += a * texels[i][c];
+			bx[c] += b * texels[i][c];
+		}
+	}
+
+	float determinant = aa * bb - ab * ab;
+	if (fabsf(determinant) < FLT_EPSILON) {
+		return;
+	}
+	for (int c = 0; c < 3; c++) {
+		start[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+		end[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+		start[c] = fminf(fmaxf(start[c], 0.0f), 255.0f);
+		end[c] = fminf(fmaxf(end[c], 0.0f), 255.0f);
+	}
+}
+
+void blockWriteColor(uint16_t c0, uint16_t c1, const uint8_t indices[16],
+		     uint8_t *out)
+{
+	uint32_t packed = 0;
+	for (int i = 0; i < 16; i++) {
+		packed |= (uint32_t)indices[i] << (2 * i);
+	}
+	out[0] = (uint8_t)c0;
+	out[1] = (uint8_t)(c0 >> 8);
+	out[2] = (uint8_t)c1;
+	out[3] = (uint8_t)(c1 >> 8);
+	for (int i = 0; i < 4; i++) {
+		out[4 + i] = (uint8_t)(packed >> (8 * i));
+	}
+}
+
+/* Opaque 4-color block. Writes 8 bytes. */
+void blockCompressBC1(const BlockTexels texels, uint8_t *out)
+{
+	float start[4];
+	float end[4];
+	blockPrincipalAxis(texels, 3, start, end);
+
+	/* c0 > c1 selects the 4-color mode. */
+	uint16_t c0 = blockPack565(end);
+	uint16_t c1 = blockPack565(start);
+	if (c0 < c1) {
+		uint16_t swap = c0;
+		c0 = c1;
+		c1 = swap;
+	}
+
+	uint8_t indices[16];
+	float error = blockFitColorIndices(texels, c0, c1, indices);
+
+	float refinedStart[4];
+	float refinedEnd[4];
+	blockUnpack565(c0, refinedStart);
+	blockUnpack565(c1, refinedEnd);
+	blockRefineColorEndpoints(texels, indices, refinedStart, refinedEnd);
+	uint16_t r0 = blockPack565(refinedStart);
+	uint16_t r1 = blockPack565(refinedEnd);
+	if (r0 < r1) {
+		uint16_t swap = r0;
+		r0 = r1;
+		r1 = swap;
+	}
+
+	uint8_t refinedIndices[16];
+	if (r0 != r1
+	    && blockFitColorIndices(texels, r0, r1, refinedIndices) < error) {
+		c0 = r0;
+		c1 = r1;
+		memcpy(indices, refinedIndices, sizeof(indices));
+	}
+
+	if (c0 == c1) {
+		/* Equal endpoints select the 3-color mode, where index 0 is
+		 * still c0. */
+		memset(indices, 0, sizeof(indices));
+	}
+
+	blockWriteColor(c0, c1, indices, out);
+}
+
+/* 8-value interpolated alpha. Writes 8 bytes. */
+void blockCompressAlpha(const BlockTexels texels, uint8_t *out)
+{
+	uint8_t a0 = 0;
+	uint8_t a1 = 255;
+	for (int i = 0; i < 16; i++) {
+		a0 = texels[i][3] > a0 ? texels[i][3] : a0;
+		a1 = texels[i][3] < a1 ? texels[i][3] : a1;
+	}
+
+	/* a0 > a1 selects the 8-value mode. */
+	float palette[8] = {a0, a1};
+	for (int p = 1; p < 7; p++) {
+		palette[p + 1] = ((7 - p) * a0 + p * a1) / 7.0f;
+	}
+
+	uint64_t packed = 0;
+	for (int i = 0; a0 != a1 && i < 16; i++) {
+		float best = FLT_MAX;
+		uint64_t index = 0;
+		for (int p = 0; p < 8; p++) {
+			float distance = fabsf(palette[p] - texels[i][3]);
+			if (distance < best) {
+				best = distance;
+				index = (uint64_t)p;
+			}
+		}
+		packed |= index << (3 * i);
+	}
+
+	out[0] = a0;
+	out[1] = a1;
+	for (int i = 0; i < 6; i++) {
+		out[2 + i] = (uint8_t)(packed >> (8 * i));
+	}
+}
+
+/* Writes 16 bytes. */
+void blockCompressBC3(const BlockTexels texels, uint8_t *out)
+{
+	blockCompressAlpha(texels, out);
+	/* BC3 colors are always 4-color, whatever the endpoint order. */
+	blockCompressBC1(texels, out + 8);
+}
+
+typedef struct BlockBitWriter {
+	uint8_t *out;
+	int bit;
+} BlockBitWriter;
+
+void blockWriteBits(BlockBitWriter *writer, uint32_t value, int count)
+{
+	for (int i = 0; i < count; i++, writer->bit++) {
+		if (value >> i & 1) {
+			writer->out[writer->bit >> 3] |=
+				(uint8_t)(1 << (writer->bit & 7));
+		}
+	}
+}
+
+static const int bc7Weights4[16] = {
+	0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64,
+};
+
+/* Quantize endpoints to 7 bits for the given p-bits, then fit indices.
+ * Return the total squared error. */
+float blockFitBC7Mode6(const BlockTexels texels, const float *start,
+		       const float *end, int p0, int p1, uint8_t q[2][4],
+		       uint8_t indices[16])
+{
+	const float *endpoints[2] = {start, end};
+	const int pbits[2] = {p0, p1};
+	float expanded[2][4];
+	for (int e = 0; e < 2; e++) {
+		for (int c = 0; c < 4; c++) {
+			long value = lroundf((endpoints[e][c] - pbits[e]) / 2.0f);
+			q[e][c] = (uint8_t)(value < 0 ? 0 : (value > 127 ? 127 : value));
+			expanded[e][c] = (float)(q[e][c] << 1 | pbits[e]);
+		}
+	}
+
+	float palette[16][4];
+	for (int p = 0; p < 16; p++) {
+		for (int c = 0; c < 4; c++) {
+			palette[p][c] = (float)(((64 - bc7Weights4[p])
+						 * (int)expanded[0][c]
+						 + bc7Weights4[p] * (int)expanded[1][c]
+						 + 32) >> 6);
+		}
+	}
+
+	float error = 0.0f;
+	for (int i = 0; i < 16; i++) {
+		float texel[4] = {
+			texels[i][0], texels[i][1], texels[i][2], texels[i][3],
+		};
+		float best = FLT_MAX;
+		for (uint8_t p = 0; p < 16; p++) {
+			float distance = blockDistance(texel, palette[p], 4);
+			if (distance < best) {
+				best = distance;
+				indices[i] = p;
+			}
+		}
+		error += best;
+	}
+	return error;
+}
+
+/* Mode 6 block. Writes 16 bytes. */
+void blockCompressBC7(const BlockTexels texels, uint8_t *out)
+{
+	float start[4];
+	float end[4];
+	blockPrincipalAxis(texels, 4, start, end);
+
+	/* Try every p-bit pair, keep the closest. */
+	uint8_t q[2][4];
+	uint8_t indices[16];
+	int p0 = 0;
+	int p1 = 0;
+	float error = FLT_MAX;
+	for (int p = 0; p < 4; p++) {
+		uint8_t candidateQ[2][4];
+		uint8_t candidateIndices[16];
+		float candidate = blockFitBC7Mode6(texels, start, end, p & 1,
+						   p >> 1, candidateQ,
+						   candidateIndices);
+		if (candidate < error) {
+			error = candidate;
+			p0 = p & 1;
+			p1 = p >> 1;
+			memcpy(q, candidateQ, sizeof(q));
+			memcpy(indices, candidateIndices, sizeof(indices));
+		}
+	}
+
+	/* The first index has an implicit zero high bit. */
+	if (indices[0] & 8) {
+		for (int c = 0; c < 4; c++) {
+			uint8_t swap = q[0][c];
+			q[0][c] = q[1][c];
+			q[1][c] = swap;
+		}
+		int swap = p0;
+		p0 = p1;
+		p1 = swap;
+		for (int i = 0; i < 16; i++) {
+			indices[i] = (uint8_t)(15 - indices[i]);
+		}
+	}
+
+	memset(out, 0, 16);
+	BlockBitWriter writer = {.out = out};
+	blockWriteBits(&writer, 1 << 6, 7);
+	for (int c = 0; c < 4; c++) {
+		blockWriteBits(&writer, q[0][c], 7);
+		blockWriteBits(&writer, q[1][c], 7);
+	}
+	blockWriteBits(&writer, (uint32_t)p0, 1);
+	blockWriteBits(&writer, (uint32_t)p1, 1);
+	blockWriteBits(&writer, indices[0], 3);
+	for (int i = 1; i < 16; i++) {
+		blockWriteBits(&writer, indices[i], 4);
+	}
+}
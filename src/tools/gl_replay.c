@@ -0,0 +1,782 @@
+/* GL replay - Play back a frame captured with `--capture`, and time it
+ *
+ * OVERVIEW: - Opens a hidden window at the size of the capturing framebuffer,
+ *   plays the trace's setup once, then the captured frame `--loops` times in
+ *   a row, 100 by default. See gl_trace_format.h and gl_capture.c.
+ *
+ * - Object names, uniform locations and syncs are mapped from the capturing
+ *   context's to the ones created here. Uniform locations are looked up per
+ *   program, so draws keep their uniforms even when programs link
+ *   differently.
+ *
+ * - Every marker of the frame starts a range of calls, timed on the CPU, and
+ *   on the GPU with GL_TIMESTAMP queries, which do not conflict with the
+ *   trace's own GL_TIME_ELAPSED queries. Queries are read REPLAY_LATENCY
+ *   loops late so the CPU and GPU overlap as they did in the engine. The
+ *   average of every range is reported at the end.
+ *
+ * USAGE:
+ * - gl_replay [--loops <count>] <trace>
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glad/glad.h"
+#include "GLFW/glfw3.h"
+#include "common.h"
+#include "gl_ext.c"
+#include "gl_trace_format.h"
+#include "stb_ds.h"
+
+#define USAGE "usage: gl_replay [--loops <count>] <trace>"
+
+enum : int {
+	REPLAY_LATENCY = 4,
+	REPLAY_MAX_MAPPINGS = 4,
+};
+
+typedef enum ReplayObject : int {
+	REPLAY_BUFFER = 0,
+	REPLAY_TEXTURE,
+	REPLAY_VERTEX_ARRAY,
+	REPLAY_FRAMEBUFFER,
+	REPLAY_SAMPLER,
+	REPLAY_QUERY,
+	REPLAY_SHADER,
+	REPLAY_PROGRAM,
+	REPLAY_OBJECT_LAST,
+} ReplayObject;
+
+typedef struct ReplayName {
+	uint64_t key;		/* Captured name */
+	GLuint value;
+} ReplayName;
+
+typedef struct ReplayLocation {
+	uint64_t key;		/* Captured program << 32 | captured location */
+	GLint value;
+} ReplayLocation;
+
+typedef struct ReplaySync {
+	uint64_t key;		/* Captured sync */
+	GLsync value;
+} ReplaySync;
+
+typedef struct ReplayMapping {
+	GLenum target;		/* 0 if unused */
+	void *pointer;
+} ReplayMapping;
+
+typedef struct ReplayRange {
+	const char *name;
+	uint64_t calls;
+	double cpuSeconds;	/* Summed over loops */
+	double gpuSeconds;
+	uint64_t gpuSamples;
+} ReplayRange;
+
+/* One GL_TIMESTAMP query per range, plus one ending the last range. */
+typedef struct ReplayQueries {
+	GLuint *queries;	/* stb_ds.h array */
+	bool pending;
+} ReplayQueries;
+
+struct Replay {
+	uint8_t *file;
+	TraceHeader header;
+	const uint64_t *words;
+	const TracePayload *payloads;
+	const uint8_t *data;
+	ReplayName *names[REPLAY_OBJECT_LAST];	/* stb_ds.h hashmaps */
+	ReplayLocation *locations;		/* stb_ds.h hashmap */
+	ReplaySync *syncs;			/* stb_ds.h hashmap */
+	uint64_t program;			/* Captured, in use */
+	ReplayMapping mappings[REPLAY_MAX_MAPPINGS];
+	ReplayRange *ranges;			/* stb_ds.h array */
+	ReplayQueries queries[REPLAY_LATENCY];
+};
+
+struct Replay replay;
+
+Error replayLoad(const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == nullptr) {
+		return ERR_TRACE_LOADING_FAILED;
+	}
+	(void)fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	(void)fseek(file, 0, SEEK_SET);
+	if (size < (long)sizeof(TraceHeader)) {
+		(void)fclose(file);
+		return ERR_TRACE_LOADING_FAILED;
+	}
+
+	replay.file = malloc((size_t)size);
+	size_t read = fread(replay.file, (size_t)size, 1, file);
+	(void)fclose(file);
+	if (read != 1) {
+		return ERR_TRACE_LOADING_FAILED;
+	}
+
+	TraceHeader *header = &replay.header;
+	memcpy(header, replay.file, sizeof(*header));
+	if (header->magic != TRACE_MAGIC || header->version != TRACE_VERSION
+	    || header->frameWord > header->callWords
+	    || header->callOffset + sizeof(uint64_t) * header->callWords
+		> (uint64_t)size
+	    || header->payloadOffset
+		+ sizeof(TracePayload) * header->payloadCount > (uint64_t)size
+	    || header->dataOffset + header->dataSize > (uint64_t)size) {
+		return ERR_TRACE_LOADING_FAILED;
+	}
+
+	replay.words = (const uint64_t *)(replay.file + header->callOffset);
+	replay.payloads =
+		(const TracePayload *)(replay.file + header->payloadOffset);
+	replay.data = replay.file + header->dataOffset;
+	for (uint64_t i = 0; i < header->payloadCount; i++) {
+		if (replay.payloads[i].offset + replay.payloads[i].size
+		    > header->dataSize) {
+			return ERR_TRACE_LOADING_FAILED;
+		}
+	}
+	return ERR_OK;
+}
+
+/* Client memory behind a TRACE_DATA_* word. */
+const void *replayData(uint64_t word)
+{
+	if (word == TRACE_DATA_NONE) {
+		return nullptr;
+	}
+	if (word & TRACE_DATA_OFFSET) {
+		return (const void *)(uintptr_t)(word & ~TRACE_DATA_OFFSET);
+	}
+	if (word > replay.header.payloadCount) {
+		return nullptr;
+	}
+	return replay.data + replay.payloads[word - 1].offset;
+}
+
+uint64_t replayDataSize(uint64_t word)
+{
+	if (word == TRACE_DATA_NONE || (word & TRACE_DATA_OFFSET)
+	    || word > replay.header.payloadCount) {
+		return 0;
+	}
+	return replay.payloads[word - 1].size;
+}
+
+float replayFloat(uint64_t word)
+{
+	uint32_t bits = (uint32_t)word;
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+/* Name created here for a captured one. 0 stays 0. */
+GLuint replayName(ReplayObject object, uint64_t name)
+{
+	return hmget(replay.names[object], name);
+}
+
+/* Create `n` names of `object`, mapped to the captured `names`. */
+void replayGen(ReplayObject object, uint64_t n, const uint64_t *names)
+{
+	GLuint *created = calloc(n > 0 ? n : 1, sizeof(GLuint));
+	GLsizei count = (GLsizei)n;
+	switch (object) {
+	case REPLAY_BUFFER:
+		glGenBuffers(count, created);
+		break;
+	case REPLAY_TEXTURE:
+		glGenTextures(count, created);
+		break;
+	case REPLAY_VERTEX_ARRAY:
+		glGenVertexArrays(count, created);
+		break;
+	case REPLAY_FRAMEBUFFER:
+		glGenFramebuffers(count, created);
+		break;
+	case REPLAY_SAMPLER:
+		glGenSamplers(count, created);
+		break;
+	case REPLAY_QUERY:
+		glGenQueries(count, created);
+		break;
+	default:
+		break;
+	}
+
+	for (uint64_t i = 0; i < n; i++) {
+		hmput(replay.names[object], names[i], created[i]);
+	}
+	free(created);
+}
+
+void replayDelete(ReplayObject object, uint64_t n, const uint64_t *names)
+{
+	GLuint *deleted = calloc(n > 0 ? n : 1, sizeof(GLuint));
+	for (uint64_t i = 0; i < n; i++) {
+		deleted[i] = replayName(object, names[i]);
+		(void)hmdel(replay.names[object], names[i]);
+	}
+
+	GLsizei count = (GLsizei)n;
+	switch (object) {
+	case REPLAY_BUFFER:
+		glDeleteBuffers(count, deleted);
+		break;
+	case REPLAY_TEXTURE:
+		glDeleteTextures(count, deleted);
+		break;
+	case REPLAY_VERTEX_ARRAY:
+		glDeleteVertexArrays(count, deleted);
+		break;
+	case REPLAY_FRAMEBUFFER:
+		glDeleteFramebuffers(count, deleted);
+		break;
+	case REPLAY_SAMPLER:
+		glDeleteSamplers(count, deleted);
+		break;
+	case REPLAY_QUERY:
+		glDeleteQueries(count, deleted);
+		break;
+	default:
+		break;
+	}
+	free(deleted);
+}
+
+/* Location in the program in use for a captured one. -1 stays -1. */
+GLint replayLocation(uint64_t location)
+{
+	if ((int64_t)location < 0) {
+		return -1;
+	}
+	uint64_t key = replay.program << 32 | (uint32_t)location;
+	ptrdiff_t found = hmgeti(replay.locations, key);
+	return found >= 0 ? replay.locations[found].value : -1;
+}
+
+void replayMap(GLenum target, void *pointer)
+{
+	for (int i = 0; i < REPLAY_MAX_MAPPINGS; i++) {
+		if (replay.mappings[i].target == 0) {
+			replay.mappings[i] = (ReplayMapping){target, pointer};
+			return;
+		}
+	}
+}
+
+/* Copy what was written to the mapping of `target`, and forget it. */
+void replayUnmap(GLenum target, uint64_t written)
+{
+	for (int i = 0; i < REPLAY_MAX_MAPPINGS; i++) {
+		ReplayMapping *mapping = &replay.mappings[i];
+		if (mapping->target != target) {
+			continue;
+		}
+		if (mapping->pointer != nullptr && written != TRACE_DATA_NONE) {
+			memcpy(mapping->pointer, replayData(written),
+			       replayDataSize(written));
+		}
+		*mapping = (ReplayMapping){};
+		return;
+	}
+}
+
+/* Issue a call, with its captured arguments `a`. */
+void replayCall(TraceFunction function, const uint64_t *a)
+{
+	switch (function) {
+	case TRACE_MARKER:
+		break;
+	case TRACE_GEN_BUFFERS:
+		replayGen(REPLAY_BUFFER, a[0], &a[1]);
+		break;
+	case TRACE_DELETE_BUFFERS:
+		replayDelete(REPLAY_BUFFER, a[0], &a[1]);
+		break;
+	case TRACE_GEN_TEXTURES:
+		replayGen(REPLAY_TEXTURE, a[0], &a[1]);
+		break;
+	case TRACE_DELETE_TEXTURES:
+		replayDelete(REPLAY_TEXTURE, a[0], &a[1]);
+		break;
+	case TRACE_GEN_VERTEX_ARRAYS:
+		replayGen(REPLAY_VERTEX_ARRAY, a[0], &a[1]);
+		break;
+	case TRACE_DELETE_VERTEX_ARRAYS:
+		replayDelete(REPLAY_VERTEX_ARRAY, a[0], &a[1]);
+		break;
+	case TRACE_GEN_FRAMEBUFFERS:
+		replayGen(REPLAY_FRAMEBUFFER, a[0], &a[1]);
+		break;
+	case TRACE_DELETE_FRAMEBUFFERS:
+		replayDelete(REPLAY_FRAMEBUFFER, a[0], &a[1]);
+		break;
+	case TRACE_GEN_SAMPLERS:
+		replayGen(REPLAY_SAMPLER, a[0], &a[1]);
+		break;
+	case TRACE_DELETE_SAMPLERS:
+		replayDelete(REPLAY_SAMPLER, a[0], &a[1]);
+		break;
+	case TRACE_GEN_QUERIES:
+		replayGen(REPLAY_QUERY, a[0], &a[1]);
+		break;
+	case TRACE_DELETE_QUERIES:
+		replayDelete(REPLAY_QUERY, a[0], &a[1]);
+		break;
+	case TRACE_CREATE_SHADER:
+		hmput(replay.names[REPLAY_SHADER], a[1],
+		      glCreateShader((GLenum)a[0]));
+		break;
+	case TRACE_DELETE_SHADER:
+		glDeleteShader(replayName(REPLAY_SHADER, a[0]));
+		(void)hmdel(replay.names[REPLAY_SHADER], a[0]);
+		break;
+	case TRACE_SHADER_SOURCE: {
+		const GLchar *source = replayData(a[1]);
+		glShaderSource(replayName(REPLAY_SHADER, a[0]), 1, &source,
+			       nullptr);
+		break;
+	}
+	case TRACE_COMPILE_SHADER:
+		glCompileShader(replayName(REPLAY_SHADER, a[0]));
+		break;
+	case TRACE_CREATE_PROGRAM:
+		hmput(replay.names[REPLAY_PROGRAM], a[0], glCreateProgram());
+		break;
+	case TRACE_DELETE_PROGRAM:
+		glDeleteProgram(replayName(REPLAY_PROGRAM, a[0]));
+		(void)hmdel(replay.names[REPLAY_PROGRAM], a[0]);
+		break;
+	case TRACE_ATTACH_SHADER:
+		glAttachShader(replayName(REPLAY_PROGRAM, a[0]),
+			       replayName(REPLAY_SHADER, a[1]));
+		break;
+	case TRACE_LINK_PROGRAM:
+		glLinkProgram(replayName(REPLAY_PROGRAM, a[0]));
+		break;
+	case TRACE_GET_UNIFORM_LOCATION: {
+		GLint location = glGetUniformLocation(
+			replayName(REPLAY_PROGRAM, a[0]), replayData(a[1]));
+		if ((int64_t)a[2] >= 0) {
+			hmput(replay.locations, a[0] << 32 | (uint32_t)a[2],
+			      location);
+		}
+		break;
+	}
+	case TRACE_USE_PROGRAM:
+		replay.program = a[0];
+		glUseProgram(replayName(REPLAY_PROGRAM, a[0]));
+		break;
+	case TRACE_UNIFORM_1I:
+		glUniform1i(replayLocation(a[0]), (GLint)a[1]);
+		break;
+	case TRACE_UNIFORM_1F:
+		glUniform1f(replayLocation(a[0]), replayFloat(a[1]));
+		break;
+	case TRACE_UNIFORM_2F:
+		glUniform2f(replayLocation(a[0]), replayFloat(a[1]),
+			    replayFloat(a[2]));
+		break;
+	case TRACE_UNIFORM_3I:
+		glUniform3i(replayLocation(a[0]), (GLint)a[1], (GLint)a[2],
+			    (GLint)a[3]);
+		break;
+	case TRACE_UNIFORM_3FV:
+		glUniform3fv(replayLocation(a[0]), (GLsizei)a[1],
+			     replayData(a[2]));
+		break;
+	case TRACE_UNIFORM_4FV:
+		glUniform4fv(replayLocation(a[0]), (GLsizei)a[1],
+			     replayData(a[2]));
+		break;
+	case TRACE_UNIFORM_MATRIX_4FV:
+		glUniformMatrix4fv(replayLocation(a[0]), (GLsizei)a[1],
+				   (GLboolean)a[2], replayData(a[3]));
+		break;
+	case TRACE_BIND_VERTEX_ARRAY:
+		glBindVertexArray(replayName(REPLAY_VERTEX_ARRAY, a[0]));
+		break;
+	case TRACE_BIND_BUFFER:
+		glBindBuffer((GLenum)a[0], replayName(REPLAY_BUFFER, a[1]));
+		break;
+	case TRACE_BUFFER_DATA:
+		glBufferData((GLenum)a[0], (GLsizeiptr)a[1], replayData(a[2]),
+			     (GLenum)a[3]);
+		break;
+	case TRACE_BUFFER_SUB_DATA:
+		glBufferSubData((GLenum)a[0], (GLintptr)a[1], (GLsizeiptr)a[2],
+				replayData(a[3]));
+		break;
+	case TRACE_MAP_BUFFER_RANGE:
+		replayMap((GLenum)a[0],
+			  glMapBufferRange((GLenum)a[0], (GLintptr)a[1],
+					   (GLsizeiptr)a[2], (GLbitfield)a[3]));
+		break;
+	case TRACE_UNMAP_BUFFER:
+		replayUnmap((GLenum)a[0], a[1]);
+		(void)glUnmapBuffer((GLenum)a[0]);
+		break;
+	case TRACE_ENABLE_VERTEX_ATTRIB_ARRAY:
+		glEnableVertexAttribArray((GLuint)a[0]);
+		break;
+	case TRACE_VERTEX_ATTRIB_POINTER:
+		glVertexAttribPointer((GLuint)a[0], (GLint)a[1], (GLenum)a[2],
+				      (GLboolean)a[3], (GLsizei)a[4],
+				      replayData(a[5]));
+		break;
+	case TRACE_VERTEX_ATTRIB_I_POINTER:
+		glVertexAttribIPointer((GLuint)a[0], (GLint)a[1], (GLenum)a[2],
+				       (GLsizei)a[3], replayData(a[4]));
+		break;
+	case TRACE_VERTEX_ATTRIB_DIVISOR:
+		glVertexAttribDivisor((GLuint)a[0], (GLuint)a[1]);
+		break;
+	case TRACE_ACTIVE_TEXTURE:
+		glActiveTexture((GLenum)a[0]);
+		break;
+	case TRACE_BIND_TEXTURE:
+		glBindTexture((GLenum)a[0], replayName(REPLAY_TEXTURE, a[1]));
+		break;
+	case TRACE_TEX_PARAMETER_I:
+		glTexParameteri((GLenum)a[0], (GLenum)a[1], (GLint)a[2]);
+		break;
+	case TRACE_TEX_IMAGE_2D:
+		glTexImage2D((GLenum)a[0], (GLint)a[1], (GLint)a[2],
+			     (GLsizei)a[3], (GLsizei)a[4], (GLint)a[5],
+			     (GLenum)a[6], (GLenum)a[7], replayData(a[8]));
+		break;
+	case TRACE_TEX_SUB_IMAGE_2D:
+		glTexSubImage2D((GLenum)a[0], (GLint)a[1], (GLint)a[2],
+				(GLint)a[3], (GLsizei)a[4], (GLsizei)a[5],
+				(GLenum)a[6], (GLenum)a[7], replayData(a[8]));
+		break;
+	case TRACE_COMPRESSED_TEX_IMAGE_2D:
+		glCompressedTexImage2D((GLenum)a[0], (GLint)a[1], (GLenum)a[2],
+				       (GLsizei)a[3], (GLsizei)a[4],
+				       (GLint)a[5], (GLsizei)a[6],
+				       replayData(a[7]));
+		break;
+	case TRACE_COMPRESSED_TEX_SUB_IMAGE_2D:
+		glCompressedTexSubImage2D((GLenum)a[0], (GLint)a[1],
+					  (GLint)a[2], (GLint)a[3],
+					  (GLsizei)a[4], (GLsizei)a[5],
+					  (GLenum)a[6], (GLsizei)a[7],
+					  replayData(a[8]));
+		break;
+	case TRACE_TEX_BUFFER:
+		glTexBuffer((GLenum)a[0], (GLenum)a[1],
+			    replayName(REPLAY_BUFFER, a[2]));
+		break;
+	case TRACE_TEX_BUFFER_RANGE:
+		if (glExt.hasTexBufferRange) {
+			glExt.texBufferRange((GLenum)a[0], (GLenum)a[1],
+					     replayName(REPLAY_BUFFER, a[2]),
+					     (GLintptr)a[3], (GLsizeiptr)a[4]);
+		}
+		break;
+	case TRACE_BIND_SAMPLER:
+		glBindSampler((GLuint)a[0], replayName(REPLAY_SAMPLER, a[1]));
+		break;
+	case TRACE_SAMPLER_PARAMETER_I:
+		glSamplerParameteri(replayName(REPLAY_SAMPLER, a[0]),
+				    (GLenum)a[1], (GLint)a[2]);
+		break;
+	case TRACE_BIND_FRAMEBUFFER:
+		glBindFramebuffer((GLenum)a[0],
+				  replayName(REPLAY_FRAMEBUFFER, a[1]));
+		break;
+	case TRACE_FRAMEBUFFER_TEXTURE_2D:
+		glFramebufferTexture2D((GLenum)a[0], (GLenum)a[1],
+				       (GLenum)a[2],
+				       replayName(REPLAY_TEXTURE, a[3]),
+				       (GLint)a[4]);
+		break;
+	case TRACE_DRAW_BUFFERS: {
+		GLenum buffers[16] = {};
+		GLsizei count = a[0] < 16 ? (GLsizei)a[0] : 16;
+		for (GLsizei i = 0; i < count; i++) {
+			buffers[i] = (GLenum)a[1 + i];
+		}
+		glDrawBuffers(count, buffers);
+		break;
+	}
+	case TRACE_READ_BUFFER:
+		glReadBuffer((GLenum)a[0]);
+		break;
+	case TRACE_BLIT_FRAMEBUFFER:
+		glBlitFramebuffer((GLint)a[0], (GLint)a[1], (GLint)a[2],
+				  (GLint)a[3], (GLint)a[4], (GLint)a[5],
+				  (GLint)a[6], (GLint)a[7], (GLbitfield)a[8],
+				  (GLenum)a[9]);
+		break;
+	case TRACE_ENABLE:
+		glEnable((GLenum)a[0]);
+		break;
+	case TRACE_DISABLE:
+		glDisable((GLenum)a[0]);
+		break;
+	case TRACE_VIEWPORT:
+		glViewport((GLint)a[0], (GLint)a[1], (GLsizei)a[2],
+			   (GLsizei)a[3]);
+		break;
+	case TRACE_CLEAR_COLOR:
+		glClearColor(replayFloat(a[0]), replayFloat(a[1]),
+			     replayFloat(a[2]), replayFloat(a[3]));
+		break;
+	case TRACE_CLEAR:
+		glClear((GLbitfield)a[0]);
+		break;
+	case TRACE_DRAW_ARRAYS:
+		glDrawArrays((GLenum)a[0], (GLint)a[1], (GLsizei)a[2]);
+		break;
+	case TRACE_DRAW_ELEMENTS_BASE_VERTEX:
+		glDrawElementsBaseVertex((GLenum)a[0], (GLsizei)a[1],
+					 (GLenum)a[2], replayData(a[3]),
+					 (GLint)a[4]);
+		break;
+	case TRACE_MULTI_DRAW_ELEMENTS_INDIRECT:
+		if (glExt.hasMultiDrawIndirect) {
+			glExt.multiDrawElementsIndirect(
+				(GLenum)a[0], (GLenum)a[1], replayData(a[2]),
+				(GLsizei)a[3], (GLsizei)a[4]);
+		}
+		break;
+	case TRACE_BEGIN_QUERY:
+		glBeginQuery((GLenum)a[0], replayName(REPLAY_QUERY, a[1]));
+		break;
+	case TRACE_END_QUERY:
+		glEndQuery((GLenum)a[0]);
+		break;
+	case TRACE_FENCE_SYNC:
+		hmput(replay.syncs, a[2],
+		      glFenceSync((GLenum)a[0], (GLbitfield)a[1]));
+		break;
+	case TRACE_CLIENT_WAIT_SYNC: {
+		ptrdiff_t found = hmgeti(replay.syncs, a[0]);
+		if (found >= 0) {
+			(void)glClientWaitSync(replay.syncs[found].value,
+					       (GLbitfield)a[1], a[2]);
+		}
+		break;
+	}
+	case TRACE_DELETE_SYNC: {
+		ptrdiff_t found = hmgeti(replay.syncs, a[0]);
+		if (found >= 0) {
+			glDeleteSync(replay.syncs[found].value);
+			(void)hmdel(replay.syncs, a[0]);
+		}
+		break;
+	}
+	case TRACE_FUNCTION_LAST:
+		break;
+	}
+}
+
+/* Play the calls from word `begin` to word `end`. When timing, every marker
+ * ends the range before it and writes a timestamp into `queries`. */
+Error replayRun(uint64_t begin, uint64_t end, ReplayQueries *queries)
+{
+	ptrdiff_t range = -1;
+	double rangeStart = glfwGetTime();
+
+	for (uint64_t word = begin; word < end;) {
+		uint64_t call = replay.words[word++];
+		TraceFunction function = TRACE_CALL_FUNCTION(call);
+		uint32_t argumentCount = TRACE_CALL_ARGUMENTS(call);
+		if (function >= TRACE_FUNCTION_LAST
+		    || argumentCount > end - word) {
+			return ERR_TRACE_LOADING_FAILED;
+		}
+
+		if (queries != nullptr && function == TRACE_MARKER) {
+			double now = glfwGetTime();
+			if (range >= 0) {
+				replay.ranges[range].cpuSeconds +=
+					now - rangeStart;
+			}
+			range++;
+			rangeStart = now;
+			if (range == arrlen(replay.ranges)) {
+				ReplayRange added = {.name =
+					replayData(replay.words[word])};
+				arrput(replay.ranges, added);
+			}
+			if (range == arrlen(queries->queries)) {
+				GLuint query;
+				glGenQueries(1, &query);
+				arrput(queries->queries, query);
+			}
+			glQueryCounter(queries->queries[range], GL_TIMESTAMP);
+		}
+
+		replayCall(function, &replay.words[word]);
+		word += argumentCount;
+		if (queries != nullptr && range >= 0) {
+			replay.ranges[range].calls++;
+		}
+	}
+
+	if (queries != nullptr && range >= 0) {
+		replay.ranges[range].cpuSeconds += glfwGetTime() - rangeStart;
+		if (range + 1 == arrlen(queries->queries)) {
+			GLuint query;
+			glGenQueries(1, &query);
+			arrput(queries->queries, query);
+		}
+		glQueryCounter(queries->queries[range + 1], GL_TIMESTAMP);
+		queries->pending = true;
+	}
+	return ERR_OK;
+}
+
+/* Add the GPU time of every range measured by `queries`, waiting on them. */
+void replayReadQueries(ReplayQueries *queries)
+{
+	if (!queries->pending) {
+		return;
+	}
+	queries->pending = false;
+
+	GLuint64 previous = 0;
+	glGetQueryObjectui64v(queries->queries[0], GL_QUERY_RESULT, &previous);
+	for (ptrdiff_t i = 1; i < arrlen(queries->queries); i++) {
+		GLuint64 timestamp = 0;
+		glGetQueryObjectui64v(queries->queries[i], GL_QUERY_RESULT,
+				      &timestamp);
+		replay.ranges[i - 1].gpuSeconds +=
+			(double)(timestamp - previous) / 1.0e9;
+		replay.ranges[i - 1].gpuSamples++;
+		previous = timestamp;
+	}
+}
+
+void replayReport(uint64_t loops)
+{
+	double cpuTotal = 0.0;
+	double gpuTotal = 0.0;
+	printf("%-24s %10s %10s %10s\n", "range", "calls", "cpu ms", "gpu ms");
+	for (ptrdiff_t i = 0; i < arrlen(replay.ranges); i++) {
+		const ReplayRange *range = &replay.ranges[i];
+		double cpuMs = range->cpuSeconds * 1.0e3 / (double)loops;
+		double gpuMs = range->gpuSamples > 0
+			? range->gpuSeconds * 1.0e3 / (double)range->gpuSamples
+			: 0.0;
+		cpuTotal += cpuMs;
+		gpuTotal += gpuMs;
+		printf("%-24s %10llu %10.3f %10.3f\n", range->name,
+		       (unsigned long long)(range->calls / loops), cpuMs,
+		       gpuMs);
+	}
+	printf("%-24s %10s %10.3f %10.3f\n", "total", "", cpuTotal, gpuTotal);
+}
+
+void replayFree(void)
+{
+	for (int i = 0; i < REPLAY_LATENCY; i++) {
+		glDeleteQueries((GLsizei)arrlen(replay.queries[i].queries),
+				replay.queries[i].queries);
+		arrfree(replay.queries[i].queries);
+	}
+	for (int i = 0; i < REPLAY_OBJECT_LAST; i++) {
+		hmfree(replay.names[i]);
+	}
+	hmfree(replay.locations);
+	hmfree(replay.syncs);
+	arrfree(replay.ranges);
+	free(replay.file);
+	replay = (struct Replay){};
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t loops = 100;
+	const char *path = nullptr;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--loops") == 0 && i + 1 < argc) {
+			char *end = nullptr;
+			long long count = strtoll(argv[++i], &end, 10);
+			if (*end != '\0' || count < 1) {
+				(void)fprintf(stderr, "invalid loops: %s\n",
+					      argv[i]);
+				return EXIT_FAILURE;
+			}
+			loops = (uint64_t)count;
+		} else if (path == nullptr && argv[i][0] != '-') {
+			path = argv[i];
+		} else {
+			(void)fprintf(stderr, "%s\n", USAGE);
+			return EXIT_FAILURE;
+		}
+	}
+	if (path == nullptr) {
+		(void)fprintf(stderr, "%s\n", USAGE);
+		return EXIT_FAILURE;
+	}
+
+	Error e = replayLoad(path);
+	if (e != ERR_OK) {
+		(void)fprintf(stderr, "%s: ", path);
+		printError(e);
+		free(replay.file);
+		return EXIT_FAILURE;
+	}
+
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow *window = glfwCreateWindow((int)replay.header.width,
+					      (int)replay.header.height,
+					      "gl_replay", nullptr, nullptr);
+	if (window == nullptr) {
+		e = ERR_WINDOW_CREATION_FAILED;
+	} else {
+		glfwMakeContextCurrent(window);
+		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+			e = ERR_GLAD_INITIALIZATION_FAILED;
+		}
+	}
+	if (e != ERR_OK) {
+		printError(e);
+		glfwTerminate();
+		free(replay.file);
+		return EXIT_FAILURE;
+	}
+	glExtInit();
+	glfwSwapInterval(0);
+
+	e = replayRun(0, replay.header.frameWord, nullptr);
+	for (uint64_t loop = 0; loop < loops && e == ERR_OK; loop++) {
+		ReplayQueries *queries = &replay.queries[loop % REPLAY_LATENCY];
+		replayReadQueries(queries);
+		e = replayRun(replay.header.frameWord, replay.header.callWords,
+			      queries);
+		glfwSwapBuffers(window);
+	}
+	for (int i = 0; i < REPLAY_LATENCY; i++) {
+		replayReadQueries(&replay.queries[i]);
+	}
+
+	if (e == ERR_OK) {
+		replayReport(loops);
+	} else {
+		(void)fprintf(stderr, "%s: ", path);
+		printError(e);
+	}
+
+	replayFree();
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	return e == ERR_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,991 @@
+/* Mesh cooker - Convert OBJ meshes into indexed, memory-mappable meshes
+ *
+ * OVERVIEW: - Reads positions, texture coordinates, normals and faces.
+ *   Polygons are triangulated as fans, and identical corners are merged into
+ *   one indexed vertex. Vertices without a normal get a smooth one.
+ *
+ * - Every `usemtl` starts or resumes a submesh of that name, so a mesh draws
+ *   with one call per material.
+ *
+ * - Up to `--lods` levels of detail are generated by quadric simplification,
+ *   each aiming at half the triangles of the previous one. A level that
+ *   cannot shed a quarter of them ends the chain.
+ *
+ * - Every level is then reordered for the post-transform vertex cache and for
+ *   overdraw, and vertices are renumbered in order of first use for vertex
+ *   fetch. The ACMR and vertex fetch before and after are reported. See
+ *   mesh_optimize.c.
+ *
+ * - The output is described in mesh_format.h. `--layout split` writes one
+ *   stream per attribute instead of a single interleaved stream.
+ *
+ * - Attributes are compressed unless `--uncompressed` is given:
+ *   - Positions become 16-bit unorms over the mesh's bounds, when the
+ *     quantization error stays within `--position-tolerance` object units.
+ *   - Texture coordinates become half floats when they lie in [-1, 1], where
+ *     half precision is within a quarter texel of a 1024 texel texture.
+ *   - Normals are octahedral-encoded in two 16-bit unorms, under 0.01 degree
+ *     of error.
+ *   The chosen formats and the measured errors are reported.
+ *
+ * USAGE:
+ * - mesh_cooker [--layout interleaved|split] [--uncompressed]
+ * -	[--position-tolerance <units>] [--lods <count>] <input.obj> <output>
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "mesh_format.h"
+#include "mesh_optimize.c"
+#include "stb_ds.h"
+
+#define USAGE \
+	"usage: mesh_cooker [--layout interleaved|split] [--uncompressed]\n" \
+	"\t[--position-tolerance <units>] [--lods <count>] <input> <output>"
+
+static constexpr float cookDegreesPerRadian = 57.2957795f;
+/* ACMR increase traded for overdraw, see optimizeOverdraw(). */
+static constexpr float cookOverdrawThreshold = 1.05f;
+
+typedef struct CookOptions {
+	bool split;
+	bool compress;
+	float positionTolerance;
+	uint32_t lodCount;
+} CookOptions;
+
+const char *const cookFormatNames[] = {
+	[VERTEX_FORMAT_NONE] = "none",
+	[VERTEX_FORMAT_FLOAT2] = "float2",
+	[VERTEX_FORMAT_FLOAT3] = "float3",
+	[VERTEX_FORMAT_HALF2] = "half2",
+	[VERTEX_FORMAT_UNORM16X4] = "unorm16x4",
+	[VERTEX_FORMAT_OCT_UNORM16X2] = "oct-unorm16x2",
+};
+
+typedef struct CookVertex {
+	float position[3];
+	float texcoord[2];
+	float normal[3];
+} CookVertex;
+
+/* One face corner, as 0-based OBJ indices. -1 when absent. */
+typedef struct CookCorner {
+	int32_t position;
+	int32_t texcoord;
+	int32_t normal;
+} CookCorner;
+
+typedef struct CookSubmesh {
+	char name[MESH_NAME_SIZE];
+	uint32_t *lods[MESH_MAX_LODS];	/* stb_ds.h arrays of indices */
+} CookSubmesh;
+
+struct CookMesh {
+	float (*positions)[3];	/* stb_ds.h array */
+	float (*texcoords)[2];	/* stb_ds.h array */
+	float (*normals)[3];	/* stb_ds.h array */
+
+	struct {
+		CookCorner key;
+		uint32_t value;
+	} *corners;		/* stb_ds.h hashmap, corner to vertex */
+	CookVertex *vertices;	/* stb_ds.h array */
+	bool *generateNormal;	/* stb_ds.h array, one per vertex */
+
+	CookSubmesh *submeshes;	/* stb_ds.h array */
+	int32_t submesh;	/* Current `usemtl` */
+
+	uint32_t lodCount;
+	float lodErrors[MESH_MAX_LODS];
+	uint32_t *parsedIndices;	/* stb_ds.h array, LOD 0 as parsed */
+};
+
+struct CookMesh mesh;
+
+/* Resolve a 1-based or negative OBJ index against `count` elements. */
+int32_t cookResolveIndex(long index, ptrdiff_t count)
+{
+	if (index > 0 && index <= count) {
+		return (int32_t)(index - 1);
+	}
+	if (index < 0 && -index <= count) {
+		return (int32_t)(count + index);
+	}
+	return -1;
+}
+
+/* Parse "p", "p/t", "p//n" or "p/t/n". */
+bool cookParseCorner(const char *token, CookCorner *cornerOut)
+{
+	char *end = nullptr;
+	CookCorner corner = {-1, -1, -1};
+
+	corner.position = cookResolveIndex(strtol(token, &end, 10),
+					   arrlen(mesh.positions));
+	if (corner.position < 0) {
+		return false;
+	}
+	if (*end == '/') {
+		token = end + 1;
+		if (*token != '/') {
+			corner.texcoord = cookResolveIndex(
+				strtol(token, &end, 10),
+				arrlen(mesh.texcoords));
+			if (corner.texcoord < 0) {
+				return false;
+			}
+		} else {
+			end = (char *)token;
+		}
+		if (*end == '/') {
+			corner.normal = cookResolveIndex(
+				strtol(end + 1, &end, 10),
+				arrlen(mesh.normals));
+			if (corner.normal < 0) {
+				return false;
+			}
+		}
+	}
+
+	*cornerOut = corner;
+	return true;
+}
+
+uint32_t cookVertexOf(CookCorner corner)
+{
+	ptrdiff_t found = hmgeti(mesh.corners, corner);
+	if (found >= 0) {
+		return mesh.corners[found].value;
+	}
+
+	CookVertex vertex = {};
+	memcpy(vertex.position, mesh.positions[corner.position],
+	       sizeof(vertex.position));
+	if (corner.texcoord >= 0) {
+		memcpy(vertex.texcoord, mesh.texcoords[corner.texcoord],
+		       sizeof(vertex.texcoord));
+	}
+	if (corner.normal >= 0) {
+		memcpy(vertex.normal, mesh.normals[corner.normal],
+		       sizeof(vertex.normal));
+	}
+
+	uint32_t index = (uint32_t)arrlen(mesh.vertices);
+	arrput(mesh.vertices, vertex);
+	arrput(mesh.generateNormal, corner.normal < 0);
+	hmput(mesh.corners, corner, index);
+
+	return index;
+}
+
+void cookUseSubmesh(const char *name)
+{
+	for (ptrdiff_t i = 0; i < arrlen(mesh.submeshes); i++) {
+		if (strncmp(mesh.submeshes[i].name, name, MESH_NAME_SIZE - 1)
+		    == 0) {
+			mesh.submesh = (int32_t)i;
+			return;
+		}
+	}
+
+	CookSubmesh submesh = {};
+	(void)snprintf(submesh.name, sizeof(submesh.name), "%s", name);
+	arrput(mesh.submeshes, submesh);
+	mesh.submesh = (int32_t)arrlen(mesh.submeshes) - 1;
+}
+
+bool cookParseFace(char *arguments)
+{
+	if (mesh.submesh < 0) {
+		cookUseSubmesh("default");
+	}
+
+	uint32_t first = 0;
+	uint32_t previous = 0;
+	int count = 0;
+	for (char *token = strtok(arguments, " \t\r"); token != nullptr;
+	     token = strtok(nullptr, " \t\r")) {
+		CookCorner corner;
+		if (!cookParseCorner(token, &corner)) {
+			return false;
+		}
+
+		uint32_t vertex = cookVertexOf(corner);
+		if (count == 0) {
+			first = vertex;
+		} else if (count >= 2) {
+			uint32_t **indices = &mesh.submeshes[mesh.submesh].lods[0];
+			arrput(*indices, first);
+			arrput(*indices, previous);
+			arrput(*indices, vertex);
+		}
+		previous = vertex;
+		count++;
+	}
+
+	return count >= 3;
+}
+
+bool cookParseLine(char *line)
+{
+	while (*line == ' ' || *line == '\t') {
+		line++;
+	}
+
+	if (strncmp(line, "v ", 2) == 0) {
+		float *position = arraddnptr(mesh.positions, 1)[0];
+		return sscanf(line + 2, "%f %f %f", &position[0], &position[1],
+			      &position[2]) == 3;
+	}
+	if (strncmp(line, "vt ", 3) == 0) {
+		float *texcoord = arraddnptr(mesh.texcoords, 1)[0];
+		return sscanf(line + 3, "%f %f", &texcoord[0],
+			      &texcoord[1]) == 2;
+	}
+	if (strncmp(line, "vn ", 3) == 0) {
+		float *normal = arraddnptr(mesh.normals, 1)[0];
+		return sscanf(line + 3, "%f %f %f", &normal[0], &normal[1],
+			      &normal[2]) == 3;
+	}
+	if (strncmp(line, "f ", 2) == 0) {
+		return cookParseFace(line + 2);
+	}
+	if (strncmp(line, "usemtl ", 7) == 0) {
+		line[strcspn(line, "\r")] = '\0';
+		cookUseSubmesh(line + 7);
+	}
+
+	/* Comments, groups, smoothing groups and material libraries. */
+	return true;
+}
+
+/* Area-weighted smooth normals, for vertices the file gave none. */
+void cookGenerateNormals(void)
+{
+	for (ptrdiff_t s = 0; s < arrlen(mesh.submeshes); s++) {
+		const uint32_t *indices = mesh.submeshes[s].lods[0];
+		for (ptrdiff_t i = 0; i + 2 < arrlen(indices); i += 3) {
+			const float *a = mesh.vertices[indices[i]].position;
+			const float *b = mesh.vertices[indices[i + 1]].position;
+			const float *c = mesh.vertices[indices[i + 2]].position;
+			float u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+			float v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+			float normal[3] = {
+				u[1] * v[2] - u[2] * v[1],
+				u[2] * v[0] - u[0] * v[2],
+				u[0] * v[1] - u[1] * v[0],
+			};
+			for (int k = 0; k < 3; k++) {
+				uint32_t vertex = indices[i + k];
+				if (!mesh.generateNormal[vertex]) {
+					continue;
+				}
+				for (int j = 0; j < 3; j++) {
+					mesh.vertices[vertex].normal[j] +=
+						normal[j];
+				}
+			}
+		}
+	}
+
+	for (ptrdiff_t i = 0; i < arrlen(mesh.vertices); i++) {
+		float *normal = mesh.vertices[i].normal;
+		float length = sqrtf(normal[0] * normal[0]
+				     + normal[1] * normal[1]
+				     + normal[2] * normal[2]);
+		if (mesh.generateNormal[i] && length > 0.0f) {
+			for (int j = 0; j < 3; j++) {
+				normal[j] /= length;
+			}
+		}
+	}
+}
+
+void cookBounds(const uint32_t *indices, ptrdiff_t count, float *min,
+		float *max)
+{
+	for (int j = 0; j < 3; j++) {
+		min[j] = count > 0 ? INFINITY : 0.0f;
+		max[j] = count > 0 ? -INFINITY : 0.0f;
+	}
+	for (ptrdiff_t i = 0; i < count; i++) {
+		const float *position = mesh.vertices[indices[i]].position;
+		for (int j = 0; j < 3; j++) {
+			min[j] = fminf(min[j], position[j]);
+			max[j] = fmaxf(max[j], position[j]);
+		}
+	}
+}
+
+/* Round to nearest even, with overflow to infinity and gradual underflow. */
+uint16_t cookFloatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t biased = (bits >> 23) & 0xff;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	if (biased == 0xff) {
+		return (uint16_t)(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+	}
+	int32_t exponent = (int32_t)biased - 127 + 15;
+	if (exponent >= 31) {
+		return (uint16_t)(sign | 0x7c00);
+	}
+
+	uint32_t shift = 13;
+	uint32_t half = 0;
+	if (exponent <= 0) {
+		if (exponent < -10) {
+			return (uint16_t)sign;
+		}
+		mantissa |= 0x800000;
+		shift = (uint32_t)(14 - exponent);
+	} else {
+		half = (uint32_t)exponent << 10;
+	}
+	/* A carry out of the mantissa correctly bumps the exponent. */
+	half += mantissa >> shift;
+	uint32_t rest = mantissa & ((1u << shift) - 1);
+	uint32_t midpoint = 1u << (shift - 1);
+	if (rest > midpoint || (rest == midpoint && (half & 1) != 0)) {
+		half++;
+	}
+
+	return (uint16_t)(sign | half);
+}
+
+float cookHalfToFloat(uint16_t half)
+{
+	uint32_t exponent = (half >> 10) & 0x1f;
+	float mantissa = (float)(half & 0x3ff);
+	float value = exponent == 0 ? ldexpf(mantissa, -24)
+		: exponent == 31 ? INFINITY
+		: ldexpf(mantissa + 1024.0f, (int)exponent - 25);
+	return (half & 0x8000) != 0 ? -value : value;
+}
+
+uint16_t cookUnorm16(float value)
+{
+	return (uint16_t)lroundf(fminf(fmaxf(value, 0.0f), 1.0f) * 65535.0f);
+}
+
+/* The vertex shader's decodeOctahedral(). */
+void cookDecodeOctahedral(const uint16_t encoded[2], float normalOut[3])
+{
+	float x = encoded[0] / 65535.0f * 2.0f - 1.0f;
+	float y = encoded[1] / 65535.0f * 2.0f - 1.0f;
+	float z = 1.0f - fabsf(x) - fabsf(y);
+	float t = fmaxf(-z, 0.0f);
+	x += x >= 0.0f ? -t : t;
+	y += y >= 0.0f ? -t : t;
+	float length = sqrtf(x * x + y * y + z * z);
+	normalOut[0] = x / length;
+	normalOut[1] = y / length;
+	normalOut[2] = z / length;
+}
+
+/* Project on the octahedron, fold the lower half over, then keep whichever
+ * of the four neighbouring codes decodes closest to `normal`. */
+void cookEncodeOctahedral(const float normal[3], uint16_t encodedOut[2])
+{
+	float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+	if (length == 0.0f) {
+		encodedOut[0] = cookUnorm16(0.5f);
+		encodedOut[1] = cookUnorm16(0.5f);
+		return;
+	}
+	float x = normal[0] / length;
+	float y = normal[1] / length;
+	if (normal[2] < 0.0f) {
+		float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	float u = (x * 0.5f + 0.5f) * 65535.0f;
+	float v = (y * 0.5f + 0.5f) * 65535.0f;
+	float best = -INFINITY;
+	for (int i = 0; i < 4; i++) {
+		uint16_t candidate[2] = {
+			(uint16_t)fminf(fmaxf((i & 1) ? ceilf(u) : floorf(u),
+					      0.0f), 65535.0f),
+			(uint16_t)fminf(fmaxf((i & 2) ? ceilf(v) : floorf(v),
+					      0.0f), 65535.0f),
+		};
+		float decoded[3];
+		cookDecodeOctahedral(candidate, decoded);
+		float similarity = decoded[0] * normal[0]
+			+ decoded[1] * normal[1] + decoded[2] * normal[2];
+		if (similarity > best) {
+			best = similarity;
+			encodedOut[0] = candidate[0];
+			encodedOut[1] = candidate[1];
+		}
+	}
+}
+
+/* Pick each attribute's format, and the position dequantization. */
+void cookChooseFormats(const CookOptions *options, MeshHeader *header,
+		       VertexFormat formats[MESH_ATTRIBUTE_COUNT])
+{
+	formats[MESH_ATTRIBUTE_POSITION] = VERTEX_FORMAT_FLOAT3;
+	formats[MESH_ATTRIBUTE_TEXCOORD] = arrlen(mesh.texcoords) > 0
+		? VERTEX_FORMAT_FLOAT2
+		: VERTEX_FORMAT_NONE;
+	formats[MESH_ATTRIBUTE_NORMAL] = VERTEX_FORMAT_FLOAT3;
+	for (int j = 0; j < 3; j++) {
+		header->positionOffset[j] = 0.0f;
+		header->positionScale[j] = 1.0f;
+	}
+	if (!options->compress || arrlen(mesh.vertices) == 0) {
+		return;
+	}
+
+	float min[3] = {INFINITY, INFINITY, INFINITY};
+	float max[3] = {-INFINITY, -INFINITY, -INFINITY};
+	float texcoordRange = 0.0f;
+	for (ptrdiff_t i = 0; i < arrlen(mesh.vertices); i++) {
+		const CookVertex *vertex = &mesh.vertices[i];
+		for (int j = 0; j < 3; j++) {
+			min[j] = fminf(min[j], vertex->position[j]);
+			max[j] = fmaxf(max[j], vertex->position[j]);
+		}
+		texcoordRange = fmaxf(texcoordRange,
+				      fmaxf(fabsf(vertex->texcoord[0]),
+					    fabsf(vertex->texcoord[1])));
+	}
+
+	/* Rounding is off by at most half a step. */
+	float extent = 0.0f;
+	for (int j = 0; j < 3; j++) {
+		extent = fmaxf(extent, max[j] - min[j]);
+	}
+	if (extent / 65535.0f * 0.5f <= options->positionTolerance) {
+		formats[MESH_ATTRIBUTE_POSITION] = VERTEX_FORMAT_UNORM16X4;
+		for (int j = 0; j < 3; j++) {
+			header->positionOffset[j] = min[j];
+			header->positionScale[j] =
+				max[j] > min[j] ? max[j] - min[j] : 1.0f;
+		}
+	}
+	if (formats[MESH_ATTRIBUTE_TEXCOORD] != VERTEX_FORMAT_NONE
+	    && texcoordRange <= 1.0f) {
+		formats[MESH_ATTRIBUTE_TEXCOORD] = VERTEX_FORMAT_HALF2;
+	}
+	formats[MESH_ATTRIBUTE_NORMAL] = VERTEX_FORMAT_OCT_UNORM16X2;
+}
+
+/* Write `vertex`'s `attribute` as `format` to `out`, tracking the largest
+ * error in `errors`: object units, texcoord units and degrees. */
+void cookEncodeAttribute(const MeshHeader *header, const CookVertex *vertex,
+			 MeshAttribute attribute, VertexFormat format,
+			 uint8_t *out, float errors[MESH_ATTRIBUTE_COUNT])
+{
+	const float *value = attribute == MESH_ATTRIBUTE_POSITION
+		? vertex->position
+		: attribute == MESH_ATTRIBUTE_TEXCOORD ? vertex->texcoord
+		: vertex->normal;
+
+	switch (format) {
+	case VERTEX_FORMAT_NONE:
+		break;
+	case VERTEX_FORMAT_FLOAT2:
+	case VERTEX_FORMAT_FLOAT3:
+		memcpy(out, value, vertexFormatInfo(format).size);
+		break;
+	case VERTEX_FORMAT_HALF2:
+		for (int j = 0; j < 2; j++) {
+			uint16_t half = cookFloatToHalf(value[j]);
+			memcpy(out + 2 * j, &half, sizeof(half));
+			errors[attribute] = fmaxf(errors[attribute],
+						  fabsf(cookHalfToFloat(half)
+							- value[j]));
+		}
+		break;
+	case VERTEX_FORMAT_UNORM16X4: {
+		uint16_t quantized[4] = {};
+		for (int j = 0; j < 3; j++) {
+			float offset = header->positionOffset[j];
+			float scale = header->positionScale[j];
+			quantized[j] = cookUnorm16((value[j] - offset) / scale);
+			errors[attribute] = fmaxf(
+				errors[attribute],
+				fabsf(offset + quantized[j] / 65535.0f * scale
+				      - value[j]));
+		}
+		memcpy(out, quantized, sizeof(quantized));
+		break;
+	}
+	case VERTEX_FORMAT_OCT_UNORM16X2: {
+		uint16_t encoded[2];
+		float decoded[3];
+		cookEncodeOctahedral(value, encoded);
+		cookDecodeOctahedral(encoded, decoded);
+		/* atan2 stays accurate for tiny angles, where acos does not. */
+		float cross[3] = {
+			decoded[1] * value[2] - decoded[2] * value[1],
+			decoded[2] * value[0] - decoded[0] * value[2],
+			decoded[0] * value[1] - decoded[1] * value[0],
+		};
+		float dot = decoded[0] * value[0] + decoded[1] * value[1]
+			+ decoded[2] * value[2];
+		errors[attribute] = fmaxf(
+			errors[attribute],
+			atan2f(sqrtf(cross[0] * cross[0] + cross[1] * cross[1]
+				     + cross[2] * cross[2]), dot)
+			* cookDegreesPerRadian);
+		memcpy(out, encoded, sizeof(encoded));
+		break;
+	}
+	}
+}
+
+/* Build the chain of levels of detail, reorder every level for the vertex
+ * cache and overdraw, then renumber vertices for vertex fetch. */
+void cookOptimize(const CookOptions *options)
+{
+	uint32_t vertexCount = (uint32_t)arrlen(mesh.vertices);
+	mesh.lodCount = 1;
+	if (vertexCount == 0) {
+		return;
+	}
+	const float *positions = mesh.vertices[0].position;
+	const size_t stride = sizeof(CookVertex);
+
+	size_t previousCount = 0;
+	for (ptrdiff_t s = 0; s < arrlen(mesh.submeshes); s++) {
+		const uint32_t *indices = mesh.submeshes[s].lods[0];
+		ptrdiff_t count = arrlen(indices);
+		if (count > 0) {
+			memcpy(arraddnptr(mesh.parsedIndices, count), indices,
+			       sizeof(uint32_t) * (size_t)count);
+		}
+		previousCount += (size_t)count;
+	}
+
+	/* Simplify from the full mesh every time, so errors do not stack. */
+	for (uint32_t lod = 1; lod < options->lodCount; lod++) {
+		size_t total = 0;
+		float error = mesh.lodErrors[lod - 1];
+		for (ptrdiff_t s = 0; s < arrlen(mesh.submeshes); s++) {
+			CookSubmesh *submesh = &mesh.submeshes[s];
+			size_t count = (size_t)arrlen(submesh->lods[0]);
+			size_t target = (count / 3 >> lod) * 3;
+			float submeshError = 0.0f;
+			arrsetlen(submesh->lods[lod], count);
+			size_t reached = count == 0 ? 0
+				: optimizeSimplify(submesh->lods[lod],
+						   submesh->lods[0], count,
+						   positions, stride,
+						   vertexCount, target,
+						   &submeshError);
+			arrsetlen(submesh->lods[lod], reached);
+			total += reached;
+			error = fmaxf(error, submeshError);
+		}
+
+		if (total > previousCount * 3 / 4) {
+			for (ptrdiff_t s = 0; s < arrlen(mesh.submeshes); s++) {
+				arrfree(mesh.submeshes[s].lods[lod]);
+			}
+			break;
+		}
+		mesh.lodErrors[lod] = error;
+		mesh.lodCount++;
+		previousCount = total;
+	}
+
+	uint32_t *all = nullptr;	/* stb_ds.h array */
+	for (uint32_t lod = 0; lod < mesh.lodCount; lod++) {
+		for (ptrdiff_t s = 0; s < arrlen(mesh.submeshes); s++) {
+			uint32_t *indices = mesh.submeshes[s].lods[lod];
+			size_t count = (size_t)arrlen(indices);
+			optimizeVertexCache(indices, count, vertexCount);
+			optimizeOverdraw(indices, count, positions, stride,
+					 vertexCount, cookOverdrawThreshold);
+			if (count > 0) {
+				memcpy(arraddnptr(all, count), indices,
+				       sizeof(uint32_t) * count);
+			}
+		}
+	}
+
+	/* LOD 0 uses every vertex, so it alone decides the order. */
+	uint32_t *remap = nullptr;	/* stb_ds.h array */
+	CookVertex *vertices = nullptr;	/* stb_ds.h array */
+	arrsetlen(remap, vertexCount);
+	arrsetlen(vertices, vertexCount);
+	optimizeVertexFetchRemap(remap, all, (size_t)arrlen(all), vertexCount);
+	for (uint32_t v = 0; v < vertexCount; v++) {
+		vertices[remap[v]] = mesh.vertices[v];
+	}
+	for (uint32_t lod = 0; lod < mesh.lodCount; lod++) {
+		for (ptrdiff_t s = 0; s < arrlen(mesh.submeshes); s++) {
+			uint32_t *indices = mesh.submeshes[s].lods[lod];
+			for (ptrdiff_t i = 0; i < arrlen(indices); i++) {
+				indices[i] = remap[indices[i]];
+			}
+		}
+	}
+	arrfree(mesh.vertices);
+	mesh.vertices = vertices;
+
+	arrfree(all);
+	arrfree(remap);
+}
+
+/* Vertex cache and fetch efficiency of LOD 0, as parsed and as cooked.
+ * Fetch is modelled per stream, and compared to reading every vertex
+ * once. */
+void cookReport(const MeshHeader *header, const uint32_t *indices)
+{
+	size_t count = (size_t)arrlen(mesh.parsedIndices);
+	uint64_t vertexBytes = 0;
+	uint64_t parsedBytes = 0;
+	uint64_t cookedBytes = 0;
+	for (uint32_t i = 0; i < header->streamCount; i++) {
+		uint32_t stride = header->streams[i].stride;
+		vertexBytes += header->streams[i].size;
+		parsedBytes += optimizeAnalyzeFetch(mesh.parsedIndices, count,
+						    stride);
+		cookedBytes += optimizeAnalyzeFetch(indices, count, stride);
+	}
+	if (vertexBytes == 0) {
+		return;
+	}
+
+	(void)printf("  ACMR %.3f -> %.3f, vertex fetch %.2fx -> %.2fx\n",
+		     (double)optimizeAnalyzeCache(mesh.parsedIndices, count,
+						  header->vertexCount),
+		     (double)optimizeAnalyzeCache(indices, count,
+						  header->vertexCount),
+		     (double)parsedBytes / (double)vertexBytes,
+		     (double)cookedBytes / (double)vertexBytes);
+	for (uint32_t i = 0; i < header->lodCount; i++) {
+		(void)printf("  LOD %u: %u triangles, error %g\n", i,
+			     header->lods[i].indexCount / 3,
+			     (double)header->lods[i].error);
+	}
+}
+
+uint64_t cookAlign(uint64_t offset)
+{
+	return (offset + MESH_ALIGNMENT - 1) / MESH_ALIGNMENT * MESH_ALIGNMENT;
+}
+
+bool cookWriteAt(FILE *file, uint64_t *position, uint64_t offset,
+		 const void *data, size_t size)
+{
+	static const uint8_t zeros[MESH_ALIGNMENT] = {};
+	size_t padding = (size_t)(offset - *position);
+	if (fwrite(zeros, 1, padding, file) != padding
+	    || fwrite(data, 1, size, file) != size) {
+		return false;
+	}
+	*position = offset + size;
+	return true;
+}
+
+/* Describe the streams, then write every block in file order. */
+Error cookWrite(const char *path, const CookOptions *options)
+{
+	uint32_t vertexCount = (uint32_t)arrlen(mesh.vertices);
+	MeshHeader header = {
+		.magic = MESH_MAGIC,
+		.version = MESH_VERSION,
+		.vertexCount = vertexCount,
+		.indexType = vertexCount <= UINT16_MAX + 1 ? MESH_INDEX_U16
+			: MESH_INDEX_U32,
+		.submeshCount = (uint32_t)arrlen(mesh.submeshes),
+		.lodCount = mesh.lodCount,
+	};
+
+	VertexFormat formats[MESH_ATTRIBUTE_COUNT];
+	cookChooseFormats(options, &header, formats);
+
+	/* Stream layouts. Interleaved packs the present attributes tightly. */
+	uint32_t interleavedStride = 0;
+	for (uint32_t i = 0; i < MESH_ATTRIBUTE_COUNT; i++) {
+		if (formats[i] == VERTEX_FORMAT_NONE) {
+			continue;
+		}
+		MeshVertexAttribute *attribute = &header.attributes[i];
+		uint32_t size = vertexFormatInfo(formats[i]).size;
+		attribute->format = formats[i];
+		if (options->split) {
+			attribute->stream = header.streamCount++;
+			header.streams[attribute->stream].stride = size;
+		} else {
+			attribute->stream = 0;
+			attribute->offset = interleavedStride;
+			interleavedStride += size;
+		}
+	}
+	if (!options->split) {
+		header.streamCount = 1;
+		header.streams[0].stride = interleavedStride;
+	}
+
+	/* Block offsets. */
+	uint64_t offset = cookAlign(sizeof(header));
+	header.submeshOffset = offset;
+	uint32_t submeshEntries = header.submeshCount * header.lodCount;
+	offset = cookAlign(offset + sizeof(MeshSubmesh) * submeshEntries);
+	for (uint32_t i = 0; i < header.streamCount; i++) {
+		header.streams[i].offset = offset;
+		header.streams[i].size = (uint64_t)header.streams[i].stride
+			* vertexCount;
+		offset = cookAlign(offset + header.streams[i].size);
+	}
+
+	MeshSubmesh *submeshes = calloc(submeshEntries + 1,
+					sizeof(MeshSubmesh));
+	uint32_t *indices = nullptr;	/* stb_ds.h array */
+	for (uint32_t lod = 0; submeshes != nullptr && lod < header.lodCount;
+	     lod++) {
+		header.lods[lod].indexOffset = (uint32_t)arrlen(indices);
+		header.lods[lod].error = mesh.lodErrors[lod];
+		for (uint32_t i = 0; i < header.submeshCount; i++) {
+			const CookSubmesh *source = &mesh.submeshes[i];
+			const uint32_t *lodIndices = source->lods[lod];
+			ptrdiff_t count = arrlen(lodIndices);
+			MeshSubmesh *submesh =
+				&submeshes[lod * header.submeshCount + i];
+			memcpy(submesh->name, source->name, MESH_NAME_SIZE);
+			submesh->indexOffset = (uint32_t)arrlen(indices);
+			submesh->indexCount = (uint32_t)count;
+			cookBounds(lodIndices, count, submesh->boundsMin,
+				   submesh->boundsMax);
+			if (count > 0) {
+				memcpy(arraddnptr(indices, count), lodIndices,
+				       sizeof(uint32_t) * (size_t)count);
+			}
+		}
+		header.lods[lod].indexCount = (uint32_t)arrlen(indices)
+			- header.lods[lod].indexOffset;
+	}
+	header.indexCount = (uint32_t)arrlen(indices);
+	header.indexOffset = offset;
+	header.indexSize = (uint64_t)header.indexCount * header.indexType;
+	cookBounds(indices, header.lods[0].indexCount, header.boundsMin,
+		   header.boundsMax);
+
+	/* Streams and indices in their final encoding. */
+	uint8_t *streams[MESH_MAX_STREAMS] = {};
+	for (uint32_t i = 0; i < header.streamCount; i++) {
+		streams[i] = malloc(header.streams[i].size + 1);
+	}
+	uint8_t *indexData = malloc(header.indexSize + 1);
+
+	FILE *file = fopen(path, "wb");
+	Error e = file != nullptr ? ERR_OK : ERR_INVALID_ARGUMENTS;
+	for (uint32_t i = 0; e == ERR_OK && i < header.streamCount; i++) {
+		if (streams[i] == nullptr) {
+			e = ERR_OUT_OF_MEMORY;
+		}
+	}
+	if (e == ERR_OK && (submeshes == nullptr || indexData == nullptr)) {
+		e = ERR_OUT_OF_MEMORY;
+	}
+
+	float errors[MESH_ATTRIBUTE_COUNT] = {};
+	if (e == ERR_OK) {
+		for (uint32_t v = 0; v < vertexCount; v++) {
+			for (uint32_t i = 0; i < MESH_ATTRIBUTE_COUNT; i++) {
+				const MeshVertexAttribute *attribute =
+					&header.attributes[i];
+				uint32_t stride =
+					header.streams[attribute->stream].stride;
+				cookEncodeAttribute(
+					&header, &mesh.vertices[v], i,
+					attribute->format,
+					streams[attribute->stream]
+					+ (size_t)v * stride + attribute->offset,
+					errors);
+			}
+		}
+		for (uint32_t i = 0; i < header.indexCount; i++) {
+			if (header.indexType == MESH_INDEX_U16) {
+				uint16_t index = (uint16_t)indices[i];
+				memcpy(indexData + 2 * (size_t)i, &index, 2);
+			} else {
+				memcpy(indexData + 4 * (size_t)i, &indices[i], 4);
+			}
+		}
+
+		uint64_t position = 0;
+		bool written = cookWriteAt(file, &position, 0, &header,
+					   sizeof(header))
+			&& cookWriteAt(file, &position, header.submeshOffset,
+				       submeshes,
+				       sizeof(MeshSubmesh) * submeshEntries);
+		for (uint32_t i = 0; written && i < header.streamCount; i++) {
+			written = cookWriteAt(file, &position,
+					      header.streams[i].offset,
+					      streams[i],
+					      header.streams[i].size);
+		}
+		written = written && cookWriteAt(file, &position,
+						 header.indexOffset, indexData,
+						 header.indexSize);
+		if (!written) {
+			e = ERR_INVALID_ARGUMENTS;
+		}
+	}
+
+	if (file != nullptr && fclose(file) != 0 && e == ERR_OK) {
+		e = ERR_INVALID_ARGUMENTS;
+	}
+	if (file != nullptr && e != ERR_OK) {
+		(void)remove(path);
+	}
+
+	if (e == ERR_OK) {
+		uint32_t vertexSize = 0;
+		for (uint32_t i = 0; i < header.streamCount; i++) {
+			vertexSize += header.streams[i].stride;
+		}
+		(void)printf("%s: %u vertices, %u triangles, %u submeshes\n"
+			     "  %u bytes per vertex: position %s (error %g),"
+			     " texcoord %s (error %g), normal %s (error %g"
+			     " degrees)\n",
+			     path, vertexCount, header.lods[0].indexCount / 3,
+			     header.submeshCount, vertexSize,
+			     cookFormatNames[formats[MESH_ATTRIBUTE_POSITION]],
+			     (double)errors[MESH_ATTRIBUTE_POSITION],
+			     cookFormatNames[formats[MESH_ATTRIBUTE_TEXCOORD]],
+			     (double)errors[MESH_ATTRIBUTE_TEXCOORD],
+			     cookFormatNames[formats[MESH_ATTRIBUTE_NORMAL]],
+			     (double)errors[MESH_ATTRIBUTE_NORMAL]);
+		cookReport(&header, indices);
+	}
+
+	for (uint32_t i = 0; i < header.streamCount; i++) {
+		free(streams[i]);
+	}
+	free(indexData);
+	free(submeshes);
+	arrfree(indices);
+
+	return e;
+}
+
+Error cookParse(const char *path)
+{
+	FILE *file = fopen(path, "r");
+	if (file == nullptr) {
+		return ERR_MESH_LOADING_FAILED;
+	}
+
+	mesh.submesh = -1;
+	char line[1024];
+	int number = 0;
+	Error e = ERR_OK;
+	while (fgets(line, sizeof(line), file) != nullptr) {
+		number++;
+		line[strcspn(line, "\n")] = '\0';
+		if (!cookParseLine(line)) {
+			(void)fprintf(stderr, "%s:%d: malformed line\n", path,
+				      number);
+			e = ERR_MESH_LOADING_FAILED;
+			break;
+		}
+	}
+	(void)fclose(file);
+
+	return e;
+}
+
+void cookFree(void)
+{
+	arrfree(mesh.positions);
+	arrfree(mesh.texcoords);
+	arrfree(mesh.normals);
+	hmfree(mesh.corners);
+	arrfree(mesh.vertices);
+	arrfree(mesh.generateNormal);
+	for (ptrdiff_t i = 0; i < arrlen(mesh.submeshes); i++) {
+		for (uint32_t lod = 0; lod < MESH_MAX_LODS; lod++) {
+			arrfree(mesh.submeshes[i].lods[lod]);
+		}
+	}
+	arrfree(mesh.submeshes);
+	arrfree(mesh.parsedIndices);
+}
+
+int main(int argc, char **argv)
+{
+	CookOptions options = {
+		.compress = true,
+		.positionTolerance = 0.001f,
+		.lodCount = 4,
+	};
+	const char *paths[2] = {};
+	int pathCount = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--layout") == 0 && i + 1 < argc) {
+			i++;
+			if (strcmp(argv[i], "split") == 0) {
+				options.split = true;
+			} else if (strcmp(argv[i], "interleaved") != 0) {
+				(void)fprintf(stderr, "unknown layout: %s\n",
+					      argv[i]);
+				return EXIT_FAILURE;
+			}
+		} else if (strcmp(argv[i], "--uncompressed") == 0) {
+			options.compress = false;
+		} else if (strcmp(argv[i], "--position-tolerance") == 0
+			   && i + 1 < argc) {
+			char *end = nullptr;
+			options.positionTolerance = strtof(argv[++i], &end);
+			if (*end != '\0' || !(options.positionTolerance >= 0.0f)) {
+				(void)fprintf(stderr, "invalid tolerance: %s\n",
+					      argv[i]);
+				return EXIT_FAILURE;
+			}
+		} else if (strcmp(argv[i], "--lods") == 0 && i + 1 < argc) {
+			char *end = nullptr;
+			long count = strtol(argv[++i], &end, 10);
+			if (*end != '\0' || count < 1 || count > MESH_MAX_LODS) {
+				(void)fprintf(stderr,
+					      "--lods must be 1 to %u\n",
+					      MESH_MAX_LODS);
+				return EXIT_FAILURE;
+			}
+			options.lodCount = (uint32_t)count;
+		} else if (pathCount < 2 && argv[i][0] != '-') {
+			paths[pathCount++] = argv[i];
+		} else {
+			(void)fprintf(stderr, "%s\n", USAGE);
+			return EXIT_FAILURE;
+		}
+	}
+	if (pathCount != 2) {
+		(void)fprintf(stderr, "%s\n", USAGE);
+		return EXIT_FAILURE;
+	}
+
+	Error e = cookParse(paths[0]);
+	if (e == ERR_OK) {
+		cookGenerateNormals();
+		cookOptimize(&options);
+		e = cookWrite(paths[1], &options);
+	}
+	cookFree();
+
+	if (e != ERR_OK) {
+		printError(e);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,857 @@
+/* Mesh optimisation - Reorder and simplify indexed triangle lists
+ *
+ * OVERVIEW: - `optimizeVertexCache()` reorders triangles so that vertices are
+ *   reused while still in the post-transform cache. It is Forsyth's
+ *   linear-speed greedy algorithm, against a modelled LRU cache.
+ *
+ * - `optimizeOverdraw()` cuts a cache-optimised list into clusters where the
+ *   modelled cache flushes, splits them further while the cache miss ratio
+ *   stays within a threshold, and draws outward-facing clusters first, as in
+ *   Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced
+ *   Overdraw". Convex parts of the mesh then occlude the rest early.
+ *
+ * - `optimizeVertexFetchRemap()` renumbers vertices in order of first use, so
+ *   vertex fetch walks the vertex buffer forwards.
+ *
+ * - `optimizeSimplify()` collapses edges by quadric error (Garland and
+ *   Heckbert). Each collapse moves a vertex onto a neighbour rather than to a
+ *   new position, so every level of detail indexes the same vertex buffer.
+ *   Border vertices and vertices on attribute seams never move.
+ *
+ * - `optimizeAnalyzeCache()` and `optimizeAnalyzeFetch()` measure the average
+ *   cache miss ratio (ACMR) against a FIFO cache and the bytes fetched against
+ *   a direct-mapped cache, the way the reference hardware models do.
+ *
+ * - Every pass works on plain uint32_t index arrays. Positions are read
+ *   through a byte stride, so they may live inside larger vertices.
+ *
+ * USAGE:
+ * - optimizeVertexCache(indices, indexCount, vertexCount);
+ * - optimizeOverdraw(indices, indexCount, &vertices[0].position,
+ * -		  sizeof(vertices[0]), vertexCount, 1.05f);
+ * - float acmr = optimizeAnalyzeCache(indices, indexCount, vertexCount);
+ */
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stb_ds.h"
+
+enum : uint32_t {
+	OPTIMIZE_CACHE_SIZE = 32,	/* LRU entries for Forsyth's scores */
+	OPTIMIZE_FIFO_SIZE = 16,	/* For ACMR and overdraw clustering */
+	OPTIMIZE_FETCH_LINE = 64,	/* In bytes */
+	OPTIMIZE_FETCH_LINES = 256,	/* A 16 KiB vertex fetch cache */
+};
+
+const float *optimizePosition(const float *positions, size_t positionStride,
+			      uint32_t vertex)
+{
+	return (const float *)((const uint8_t *)positions
+			       + positionStride * vertex);
+}
+
+/* Twice the area, along the triangle's normal. */
+void optimizeTriangleNormal(const float *a, const float *b, const float *c,
+			    float *normal)
+{
+	float u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+	float v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+	normal[0] = u[1] * v[2] - u[2] * v[1];
+	normal[1] = u[2] * v[0] - u[0] * v[2];
+	normal[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+/* Vertex cache */
+
+/* Forsyth's score: recently used vertices, and vertices with few triangles
+ * left, are worth emitting first. */
+float optimizeVertexScore(int32_t cachePosition, uint32_t liveTriangles)
+{
+	if (liveTriangles == 0) {
+		return -1.0f;
+	}
+
+	float score = 0.0f;
+	if (cachePosition >= 0 && cachePosition < 3) {
+		/* The last triangle's vertices: deliberately not the best, or
+		 * strips would zig-zag. */
+		score = 0.75f;
+	} else if (cachePosition >= 0) {
+		score = powf(1.0f - (float)(cachePosition - 3)
+				     / (OPTIMIZE_CACHE_SIZE - 3),
+			     1.5f);
+	}
+
+	return score + 2.0f / sqrtf((float)liveTriangles);
+}
+
+void optimizeVertexCache(uint32_t *indices, size_t indexCount,
+			 uint32_t vertexCount)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	/* Triangles of every vertex, compacted as triangles are emitted. */
+	uint32_t *liveTriangles = nullptr;	/* stb_ds.h array */
+	uint32_t *adjacencyOffsets = nullptr;	/* stb_ds.h array */
+	uint32_t *adjacency = nullptr;		/* stb_ds.h array */
+	arrsetlen(liveTriangles, vertexCount);
+	arrsetlen(adjacencyOffsets, vertexCount + 1);
+	arrsetlen(adjacency, indexCount);
+	memset(liveTriangles, 0, sizeof(uint32_t) * vertexCount);
+	for (size_t i = 0; i < indexCount; i++) {
+		liveTriangles[indices[i]]++;
+	}
+	adjacencyOffsets[0] = 0;
+	for (uint32_t v = 0; v < vertexCount; v++) {
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+		liveTriangles[v] = 0;
+	}
+	for (size_t i = 0; i < indexCount; i++) {
+		uint32_t v = indices[i];
+		adjacency[adjacencyOffsets[v] + liveTriangles[v]++] =
+			(uint32_t)(i / 3);
+	}
+
+	int32_t *cachePositions = nullptr;	/* stb_ds.h array */
+	float *vertexScores = nullptr;		/* stb_ds.h array */
+	float *triangleScores = nullptr;	/* stb_ds.h array */
+	bool *emitted = nullptr;		/* stb_ds.h array */
+	uint32_t *output = nullptr;		/* stb_ds.h array */
+	arrsetlen(cachePositions, vertexCount);
+	arrsetlen(vertexScores, vertexCount);
+	arrsetlen(triangleScores, triangleCount);
+	arrsetlen(emitted, triangleCount);
+	arrsetcap(output, indexCount);
+	for (uint32_t v = 0; v < vertexCount; v++) {
+		cachePositions[v] = -1;
+		vertexScores[v] = optimizeVertexScore(-1, liveTriangles[v]);
+	}
+	int64_t best = -1;
+	for (size_t t = 0; t < triangleCount; t++) {
+		emitted[t] = false;
+		triangleScores[t] = vertexScores[indices[3 * t]]
+			+ vertexScores[indices[3 * t + 1]]
+			+ vertexScores[indices[3 * t + 2]];
+		if (best < 0 || triangleScores[t] > triangleScores[best]) {
+			best = (int64_t)t;
+		}
+	}
+
+	uint32_t cache[OPTIMIZE_CACHE_SIZE + 3];
+	uint32_t cacheCount = 0;
+	size_t cursor = 0;
+	for (size_t count = 0; count < triangleCount; count++) {
+		/* Nothing in cache has triangles left: take the next triangle
+		 * in input order. */
+		if (best < 0) {
+			while (emitted[cursor]) {
+				cursor++;
+			}
+			best = (int64_t)cursor;
+		}
+
+		const uint32_t *triangle = &indices[3 * best];
+		emitted[best] = true;
+		for (int k = 0; k < 3; k++) {
+			uint32_t v = triangle[k];
+			arrput(output, v);
+
+			uint32_t *live = &adjacency[adjacencyOffsets[v]];
+			for (uint32_t i = 0; i < liveTriangles[v]; i++) {
+				if (live[i] == (uint32_t)best) {
+					live[i] = live[--liveTriangles[v]];
+					break;
+				}
+			}
+		}
+
+		/* Move the triangle's vertices to the front of the cache. */
+		uint32_t updated[OPTIMIZE_CACHE_SIZE + 3];
+		uint32_t updatedCount = 0;
+		for (int k = 0; k < 3; k++) {
+			updated[updatedCount++] = triangle[k];
+		}
+		for (uint32_t i = 0; i < cacheCount; i++) {
+			uint32_t v = cache[i];
+			if (v != triangle[0] && v != triangle[1]
+			    && v != triangle[2]) {
+				updated[updatedCount++] = v;
+			}
+		}
+		for (uint32_t i = 0; i < updatedCount; i++) {
+			uint32_t v = updated[i];
+			cachePositions[v] = i < OPTIMIZE_CACHE_SIZE
+				? (int32_t)i
+				: -1;
+			vertexScores[v] = optimizeVertexScore(cachePositions[v],
+							      liveTriangles[v]);
+		}
+		cacheCount = updatedCount < OPTIMIZE_CACHE_SIZE
+			? updatedCount
+			: OPTIMIZE_CACHE_SIZE;
+		memcpy(cache, updated, sizeof(uint32_t) * cacheCount);
+
+		/* Only triangles touching the cache changed score. */
+		best = -1;
+		for (uint32_t i = 0; i < cacheCount; i++) {
+			uint32_t v = cache[i];
+			const uint32_t *live = &adjacency[adjacencyOffsets[v]];
+			for (uint32_t j = 0; j < liveTriangles[v]; j++) {
+				uint32_t t = live[j];
+				triangleScores[t] =
+					vertexScores[indices[3 * t]]
+					+ vertexScores[indices[3 * t + 1]]
+					+ vertexScores[indices[3 * t + 2]];
+				if (best < 0
+				    || triangleScores[t] > triangleScores[best]) {
+					best = t;
+				}
+			}
+		}
+	}
+
+	memcpy(indices, output, sizeof(uint32_t) * triangleCount * 3);
+
+	arrfree(liveTriangles);
+	arrfree(adjacencyOffsets);
+	arrfree(adjacency);
+	arrfree(cachePositions);
+	arrfree(vertexScores);
+	arrfree(triangleScores);
+	arrfree(emitted);
+	arrfree(output);
+}
+
+/* Overdraw */
+
+/* FIFO cache model: a vertex is cached while fewer than OPTIMIZE_FIFO_SIZE
+ * misses happened since its own. Bump `time` by OPTIMIZE_FIFO_SIZE to flush.
+ * Returns the triangle's misses. */
+uint32_t optimizeFifoMisses(const uint32_t *triangle, uint32_t *missTimes,
+			    uint32_t *time)
+{
+	uint32_t misses = 0;
+	for (int k = 0; k < 3; k++) {
+		uint32_t v = triangle[k];
+		if (*time - missTimes[v] >= OPTIMIZE_FIFO_SIZE) {
+			missTimes[v] = (*time)++;
+			misses++;
+		}
+	}
+	return misses;
+}
+
+typedef struct OptimizeCluster {
+	uint32_t start;		/* In triangles */
+	uint32_t count;
+	float sortKey;
+} OptimizeCluster;
+
+int optimizeClusterCompare(const void *a, const void *b)
+{
+	float keyA = ((const OptimizeCluster *)a)->sortKey;
+	float keyB = ((const OptimizeCluster *)b)->sortKey;
+	return keyA > keyB ? -1 : keyA < keyB ? 1 : 0;
+}
+
+/* `threshold` is the ACMR increase allowed for finer clusters, 1.05 being a
+ * good trade. */
+void optimizeOverdraw(uint32_t *indices, size_t indexCount,
+		      const float *positions, size_t positionStride,
+		      uint32_t vertexCount, float threshold)
+{
+	uint32_t triangleCount = (uint32_t)(indexCount / 3);
+	if (triangleCount == 0) {
+		return;
+	}
+
+	uint32_t *missTimes = nullptr;		/* stb_ds.h array */
+	arrsetlen(missTimes, vertexCount);
+	memset(missTimes, 0, sizeof(uint32_t) * vertexCount);
+	uint32_t time = OPTIMIZE_FIFO_SIZE;
+
+	/* Hard boundaries: triangles missing on all three vertices. */
+	uint32_t *hardStarts = nullptr;		/* stb_ds.h array */
+	for (uint32_t t = 0; t < triangleCount; t++) {
+		if (optimizeFifoMisses(&indices[3 * t], missTimes, &time) == 3) {
+			arrput(hardStarts, t);
+		}
+	}
+	arrput(hardStarts, triangleCount);
+
+	/* Soft boundaries: split while the ACMR stays close to the hard
+	 * cluster's. Each cluster starts with a flushed cache. */
+	OptimizeCluster *clusters = nullptr;	/* stb_ds.h array */
+	for (ptrdiff_t h = 0; h + 1 < arrlen(hardStarts); h++) {
+		uint32_t start = hardStarts[h];
+		uint32_t end = hardStarts[h + 1];
+
+		time += OPTIMIZE_FIFO_SIZE;
+		uint32_t misses = 0;
+		for (uint32_t t = start; t < end; t++) {
+			misses += optimizeFifoMisses(&indices[3 * t], missTimes,
+						     &time);
+		}
+		float limit = threshold * (float)misses / (float)(end - start);
+
+		time += OPTIMIZE_FIFO_SIZE;
+		uint32_t clusterStart = start;
+		misses = 0;
+		for (uint32_t t = start; t < end; t++) {
+			misses += optimizeFifoMisses(&indices[3 * t], missTimes,
+						     &time);
+			uint32_t count = t + 1 - clusterStart;
+			if (t + 1 < end && (float)misses <= limit * (float)count) {
+				arrput(clusters, ((OptimizeCluster){
+							 clusterStart, count,
+							 0.0f}));
+				clusterStart = t + 1;
+				misses = 0;
+				time += OPTIMIZE_FIFO_SIZE;
+			}
+		}
+		arrput(clusters, ((OptimizeCluster){
+					 clusterStart, end - clusterStart,
+					 0.0f}));
+	}
+
+	/* Outward-facing, outlying clusters first. */
+	float meshCentroid[3] = {};
+	float meshArea = 0.0f;
+	for (uint32_t t = 0; t < triangleCount; t++) {
+		const float *a = optimizePosition(positions, positionStride,
+						  indices[3 * t]);
+		const float *b = optimizePosition(positions, positionStride,
+						  indices[3 * t + 1]);
+		const float *c = optimizePosition(positions, positionStride,
+						  indices[3 * t + 2]);
+		float normal[3];
+		optimizeTriangleNormal(a, b, c, normal);
+		float area = sqrtf(normal[0] * normal[0] + normal[1] * normal[1]
+				   + normal[2] * normal[2]);
+		for (int j = 0; j < 3; j++) {
+			meshCentroid[j] += (a[j] + b[j] + c[j]) / 3.0f * area;
+		}
+		meshArea += area;
+	}
+	for (int j = 0; j < 3; j++) {
+		meshCentroid[j] /= meshArea > 0.0f ? meshArea : 1.0f;
+	}
+
+	for (ptrdiff_t i = 0; i < arrlen(clusters); i++) {
+		OptimizeCluster *cluster = &clusters[i];
+		float centroid[3] = {};
+		float clusterNormal[3] = {};
+		float clusterArea = 0.0f;
+		for (uint32_t t = cluster->start;
+		     t < cluster->start + cluster->count; t++) {
+			const float *a = optimizePosition(
+				positions, positionStride, indices[3 * t]);
+			const float *b = optimizePosition(
+				positions, positionStride, indices[3 * t + 1]);
+			const float *c = optimizePosition(
+				positions, positionStride, indices[3 * t + 2]);
+			float normal[3];
+			optimizeTriangleNormal(a, b, c, normal);
+			float area = sqrtf(normal[0] * normal[0]
+					   + normal[1] * normal[1]
+					   + normal[2] * normal[2]);
+			for (int j = 0; j < 3; j++) {
+				centroid[j] += (a[j] + b[j] + c[j]) / 3.0f
+					* area;
+				clusterNormal[j] += normal[j];
+			}
+			clusterArea += area;
+		}
+
+		float length = sqrtf(clusterNormal[0] * clusterNormal[0]
+				     + clusterNormal[1] * clusterNormal[1]
+				     + clusterNormal[2] * clusterNormal[2]);
+		cluster->sortKey = 0.0f;
+		for (int j = 0; j < 3; j++) {
+			float offset = (clusterArea > 0.0f
+					? centroid[j] / clusterArea
+					: 0.0f)
+				- meshCentroid[j];
+			cluster->sortKey += length > 0.0f
+				? offset * clusterNormal[j] / length
+				: 0.0f;
+		}
+	}
+	qsort(clusters, (size_t)arrlen(clusters), sizeof(OptimizeCluster),
+	      optimizeClusterCompare);
+
+	uint32_t *output = nullptr;		/* stb_ds.h array */
+	arrsetcap(output, indexCount);
+	for (ptrdiff_t i = 0; i < arrlen(clusters); i++) {
+		uint32_t clusterIndexCount = 3 * clusters[i].count;
+		memcpy(arraddnptr(output, clusterIndexCount),
+		       &indices[3 * clusters[i].start],
+		       sizeof(uint32_t) * clusterIndexCount);
+	}
+	memcpy(indices, output, sizeof(uint32_t) * triangleCount * 3);
+
+	arrfree(missTimes);
+	arrfree(hardStarts);
+	arrfree(clusters);
+	arrfree(output);
+}
+
+/* Vertex fetch */
+
+/* New index of every vertex, in order of first use across `indices`.
+ * Unused vertices go last, in their original order. */
+void optimizeVertexFetchRemap(uint32_t *remap, const uint32_t *indices,
+			      size_t indexCount, uint32_t vertexCount)
+{
+	for (uint32_t v = 0; v < vertexCount; v++) {
+		remap[v] = UINT32_MAX;
+	}
+
+	uint32_t next = 0;
+	for (size_t i = 0; i < indexCount; i++) {
+		if (remap[indices[i]] == UINT32_MAX) {
+			remap[indices[i]] = next++;
+		}
+	}
+	for (uint32_t v = 0; v < vertexCount; v++) {
+		if (remap[v] == UINT32_MAX) {
+			remap[v] = next++;
+		}
+	}
+}
+
+/* Analysis */
+
+/* Vertex shader invocations per triangle, between 0.5 and 3. */
+float optimizeAnalyzeCache(const uint32_t *indices, size_t indexCount,
+			   uint32_t vertexCount)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0) {
+		return 0.0f;
+	}
+
+	uint32_t *missTimes = nullptr;		/* stb_ds.h array */
+	arrsetlen(missTimes, vertexCount);
+	memset(missTimes, 0, sizeof(uint32_t) * vertexCount);
+	uint32_t time = OPTIMIZE_FIFO_SIZE;
+	size_t misses = 0;
+	for (size_t t = 0; t < triangleCount; t++) {
+		misses += optimizeFifoMisses(&indices[3 * t], missTimes, &time);
+	}
+	arrfree(missTimes);
+
+	return (float)misses / (float)triangleCount;
+}
+
+/* Bytes read from a stream of `vertexSize` byte vertices. */
+uint64_t optimizeAnalyzeFetch(const uint32_t *indices, size_t indexCount,
+			      uint32_t vertexSize)
+{
+	uint64_t lines[OPTIMIZE_FETCH_LINES];
+	for (uint32_t i = 0; i < OPTIMIZE_FETCH_LINES; i++) {
+		lines[i] = UINT64_MAX;
+	}
+
+	uint64_t bytes = 0;
+	for (size_t i = 0; i < indexCount; i++) {
+		uint64_t start = (uint64_t)indices[i] * vertexSize;
+		uint64_t end = start + vertexSize;
+		for (uint64_t line = start / OPTIMIZE_FETCH_LINE;
+		     line * OPTIMIZE_FETCH_LINE < end; line++) {
+			uint64_t *slot = &lines[line % OPTIMIZE_FETCH_LINES];
+			if (*slot != line) {
+				*slot = line;
+				bytes += OPTIMIZE_FETCH_LINE;
+			}
+		}
+	}
+
+	return bytes;
+}
+
+/* Simplification */
+
+/* Sum of squared distances to planes, weighted by triangle area. */
+typedef struct OptimizeQuadric {
+	double a2, b2, c2, ab, ac, bc, ad, bd, cd, d2;
+	double weight;
+} OptimizeQuadric;
+
+void optimizeQuadricAdd(OptimizeQuadric *q, const OptimizeQuadric *other)
+{
+	q->a2 += other->a2;
+	q->b2 += other->b2;
+	q->c2 += other->c2;
+	q->ab += other->ab;
+	q->ac += other->ac;
+	q->bc += other->bc;
+	q->ad += other->ad;
+	q->bd += other->bd;
+	q->cd += other->cd;
+	q->d2 += other->d2;
+	q->weight += other->weight;
+}
+
+/* Plane quadric of triangle abc, weighted by its area. */
+OptimizeQuadric optimizeQuadricFromTriangle(const float *a, const float *b,
+					    const float *c)
+{
+	float normal[3];
+	optimizeTriangleNormal(a, b, c, normal);
+	double length = sqrt((double)normal[0] * normal[0]
+			     + (double)normal[1] * normal[1]
+			     + (double)normal[2] * normal[2]);
+	if (length == 0.0) {
+		return (OptimizeQuadric){};
+	}
+
+	double x = normal[0] / length;
+	double y = normal[1] / length;
+	double z = normal[2] / length;
+	double d = -(x * a[0] + y * a[1] + z * a[2]);
+	double w = length * 0.5;
+	return (OptimizeQuadric){
+		.a2 = w * x * x, .b2 = w * y * y, .c2 = w * z * z,
+		.ab = w * x * y, .ac = w * x * z, .bc = w * y * z,
+		.ad = w * x * d, .bd = w * y * d, .cd = w * z * d,
+		.d2 = w * d * d,
+		.weight = w,
+	};
+}
+
+/* Distance-like error of moving to `p`, in object units. */
+float optimizeQuadricError(const OptimizeQuadric *q, const float *p)
+{
+	double x = p[0];
+	double y = p[1];
+	double z = p[2];
+	double error = q->a2 * x * x + q->b2 * y * y + q->c2 * z * z
+		+ 2.0 * (q->ab * x * y + q->ac * x * z + q->bc * y * z)
+		+ 2.0 * (q->ad * x + q->bd * y + q->cd * z) + q->d2;
+	return q->weight > 0.0 ? (float)sqrt(fmax(error, 0.0) / q->weight)
+		: 0.0f;
+}
+
+typedef struct OptimizeCollapse {
+	uint32_t from;
+	uint32_t to;
+	float error;
+} OptimizeCollapse;
+
+int optimizeCollapseCompare(const void *a, const void *b)
+{
+	float errorA = ((const OptimizeCollapse *)a)->error;
+	float errorB = ((const OptimizeCollapse *)b)->error;
+	return errorA < errorB ? -1 : errorA > errorB ? 1 : 0;
+}
+
+typedef struct OptimizePositionKey {
+	float position[3];
+} OptimizePositionKey;
+
+/* Vertices that must not move: those on an open edge, and those sharing
+ * their position with another vertex, which marks an attribute seam. */
+void optimizeLockedVertices(bool *locked, const uint32_t *indices,
+			    size_t indexCount, const float *positions,
+			    size_t positionStride, uint32_t vertexCount)
+{
+	struct {
+		OptimizePositionKey key;
+		uint32_t value;
+	} *seen = nullptr;			/* stb_ds.h hashmap */
+	for (uint32_t v = 0; v < vertexCount; v++) {
+		locked[v] = false;
+	}
+	for (uint32_t v = 0; v < vertexCount; v++) {
+		const float *p = optimizePosition(positions, positionStride, v);
+		OptimizePositionKey key = {{p[0], p[1], p[2]}};
+		ptrdiff_t found = hmgeti(seen, key);
+		if (found >= 0) {
+			locked[v] = true;
+			locked[seen[found].value] = true;
+		} else {
+			hmput(seen, key, v);
+		}
+	}
+	hmfree(seen);
+
+	/* An edge is open when its reverse is missing. */
+	struct {
+		uint64_t key;
+		uint32_t value;
+	} *edges = nullptr;			/* stb_ds.h hashmap */
+	for (size_t i = 0; i < indexCount; i++) {
+		uint32_t a = indices[i];
+		uint32_t b = indices[i - i % 3 + (i + 1) % 3];
+		uint64_t key = (uint64_t)a << 32 | b;
+		/* hmput() inserts the key before evaluating the value. */
+		uint32_t count = hmget(edges, key) + 1;
+		hmput(edges, key, count);
+	}
+	for (size_t i = 0; i < indexCount; i++) {
+		uint32_t a = indices[i];
+		uint32_t b = indices[i - i % 3 + (i + 1) % 3];
+		if (hmget(edges, (uint64_t)b << 32 | a) != 1
+		    || hmget(edges, (uint64_t)a << 32 | b) != 1) {
+			locked[a] = true;
+			locked[b] = true;
+		}
+	}
+	hmfree(edges);
+}
+
+/* Would moving `from` onto `to` flip or collapse one of its triangles
+ * that survives? */
+bool optimizeCollapseFlips(const uint32_t *indices, const uint32_t *triangles,
+			   uint32_t triangleCount, uint32_t from, uint32_t to,
+			   const float *positions, size_t positionStride)
+{
+	const float *target = optimizePosition(positions, positionStride, to);
+	for (uint32_t i = 0; i < triangleCount; i++) {
+		const uint32_t *triangle = &indices[3 * triangles[i]];
+		if (triangle[0] == to || triangle[1] == to
+		    || triangle[2] == to) {
+			continue;
+		}
+
+		const float *before[3];
+		const float *after[3];
+		for (int k = 0; k < 3; k++) {
+			before[k] = optimizePosition(positions, positionStride,
+						     triangle[k]);
+			after[k] = triangle[k] == from ? target : before[k];
+		}
+		float normalBefore[3];
+		float normalAfter[3];
+		optimizeTriangleNormal(before[0], before[1], before[2],
+				       normalBefore);
+		optimizeTriangleNormal(after[0], after[1], after[2],
+				       normalAfter);
+		if (normalBefore[0] * normalAfter[0]
+		    + normalBefore[1] * normalAfter[1]
+		    + normalBefore[2] * normalAfter[2] <= 0.0f) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Link condition: an interior edge's ends must share exactly the two
+ * vertices opposite the edge, or collapsing it folds the surface onto
+ * itself. `stamps` is per-vertex scratch, bumped through `stamp`. */
+bool optimizeCollapseLinked(const uint32_t *indices,
+			    const uint32_t *adjacencyOffsets,
+			    const uint32_t *adjacency, uint32_t from,
+			    uint32_t to, uint32_t *stamps, uint32_t *stamp)
+{
+	uint32_t mark = ++*stamp;
+	for (uint32_t i = adjacencyOffsets[to]; i < adjacencyOffsets[to + 1];
+	     i++) {
+		const uint32_t *triangle = &indices[3 * adjacency[i]];
+		for (int k = 0; k < 3; k++) {
+			stamps[triangle[k]] = mark;
+		}
+	}
+
+	uint32_t shared = 0;
+	uint32_t counted = ++*stamp;
+	for (uint32_t i = adjacencyOffsets[from];
+	     i < adjacencyOffsets[from + 1]; i++) {
+		const uint32_t *triangle = &indices[3 * adjacency[i]];
+		for (int k = 0; k < 3; k++) {
+			uint32_t v = triangle[k];
+			if (v != from && v != to && stamps[v] == mark) {
+				stamps[v] = counted;
+				shared++;
+			}
+		}
+	}
+	return shared == 2;
+}
+
+/* Simplify `indices` to about `targetIndexCount` indices, into `out`, which
+ * must hold `indexCount`. Returns the index count reached, and the largest
+ * error introduced in `errorOut`, in object units. */
+size_t optimizeSimplify(uint32_t *out, const uint32_t *indices,
+			size_t indexCount, const float *positions,
+			size_t positionStride, uint32_t vertexCount,
+			size_t targetIndexCount, float *errorOut)
+{
+	memcpy(out, indices, sizeof(uint32_t) * indexCount);
+	size_t triangleCount = indexCount / 3;
+	size_t targetTriangleCount = targetIndexCount / 3;
+	*errorOut = 0.0f;
+
+	bool *locked = nullptr;			/* stb_ds.h array */
+	bool *touched = nullptr;		/* stb_ds.h array */
+	uint32_t *stamps = nullptr;		/* stb_ds.h array */
+	uint32_t stamp = 0;
+	OptimizeQuadric *quadrics = nullptr;	/* stb_ds.h array */
+	arrsetlen(locked, vertexCount);
+	arrsetlen(touched, vertexCount);
+	arrsetlen(stamps, vertexCount);
+	memset(stamps, 0, sizeof(uint32_t) * vertexCount);
+	arrsetlen(quadrics, vertexCount);
+	optimizeLockedVertices(locked, indices, indexCount, positions,
+			       positionStride, vertexCount);
+	memset(quadrics, 0, sizeof(OptimizeQuadric) * vertexCount);
+	for (size_t t = 0; t < triangleCount; t++) {
+		const uint32_t *triangle = &out[3 * t];
+		OptimizeQuadric q = optimizeQuadricFromTriangle(
+			optimizePosition(positions, positionStride, triangle[0]),
+			optimizePosition(positions, positionStride, triangle[1]),
+			optimizePosition(positions, positionStride,
+					 triangle[2]));
+		for (int k = 0; k < 3; k++) {
+			optimizeQuadricAdd(&quadrics[triangle[k]], &q);
+		}
+	}
+
+	uint32_t *adjacencyOffsets = nullptr;	/* stb_ds.h array */
+	uint32_t *adjacency = nullptr;		/* stb_ds.h array */
+	OptimizeCollapse *collapses = nullptr;	/* stb_ds.h array */
+	arrsetlen(adjacencyOffsets, vertexCount + 1);
+
+	while (triangleCount > targetTriangleCount) {
+		/* Triangles of every vertex. */
+		memset(adjacencyOffsets, 0, sizeof(uint32_t) * (vertexCount + 1));
+		for (size_t i = 0; i < triangleCount * 3; i++) {
+			adjacencyOffsets[out[i] + 1]++;
+		}
+		for (uint32_t v = 0; v < vertexCount; v++) {
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+		arrsetlen(adjacency, triangleCount * 3);
+		for (size_t i = 0; i < triangleCount * 3; i++) {
+			adjacency[adjacencyOffsets[out[i]]++] = (uint32_t)(i / 3);
+		}
+		for (uint32_t v = vertexCount; v > 0; v--) {
+			adjacencyOffsets[v] = adjacencyOffsets[v - 1];
+		}
+		adjacencyOffsets[0] = 0;
+
+		/* Every edge leaving an unlocked vertex, cheapest first. */
+		arrsetlen(collapses, 0);
+		for (size_t i = 0; i < triangleCount * 3; i++) {
+			uint32_t from = out[i];
+			uint32_t to = out[i - i % 3 + (i + 1) % 3];
+			for (int direction = 0; direction < 2; direction++) {
+				if (!locked[from]) {
+					arrput(collapses,
+					       ((OptimizeCollapse){
+						       from, to,
+						       optimizeQuadricError(
+							       &quadrics[from],
+							       optimizePosition(
+								       positions,
+								       positionStride,
+								       to)),
+					       }));
+				}
+				uint32_t swap = from;
+				from = to;
+				to = swap;
+			}
+		}
+		if (arrlen(collapses) == 0) {
+			break;
+		}
+		qsort(collapses, (size_t)arrlen(collapses),
+		      sizeof(OptimizeCollapse), optimizeCollapseCompare);
+
+		/* An interior collapse removes two triangles. Allow somewhat
+		 * more than the needed collapses per pass, each edge being
+		 * listed up to four times, but stop before costlier ones that
+		 * cheaper collapses of the next pass would beat. */
+		size_t needed = (triangleCount - targetTriangleCount + 1) / 2;
+		size_t limitIndex = needed * 6 < (size_t)arrlen(collapses)
+			? needed * 6
+			: (size_t)arrlen(collapses) - 1;
+		float passLimit = collapses[limitIndex].error;
+
+		memset(touched, 0, sizeof(bool) * vertexCount);
+		size_t removed = 0;
+		for (ptrdiff_t i = 0; i < arrlen(collapses)
+		     && triangleCount - removed > targetTriangleCount; i++) {
+			const OptimizeCollapse *collapse = &collapses[i];
+			if (collapse->error > passLimit) {
+				break;
+			}
+			uint32_t from = collapse->from;
+			uint32_t to = collapse->to;
+			if (touched[from] || touched[to]) {
+				continue;
+			}
+			const uint32_t *triangles =
+				&adjacency[adjacencyOffsets[from]];
+			uint32_t count = adjacencyOffsets[from + 1]
+				- adjacencyOffsets[from];
+			if (!optimizeCollapseLinked(out, adjacencyOffsets,
+						    adjacency, from, to, stamps,
+						    &stamp)
+			    || optimizeCollapseFlips(out, triangles, count, from,
+						     to, positions,
+						     positionStride)) {
+				continue;
+			}
+
+			/* Triangles around `from` are rewritten: keep the
+			 * whole ring out of this pass. */
+			for (uint32_t j = 0; j < count; j++) {
+				uint32_t *triangle = &out[3 * triangles[j]];
+				bool degenerate = false;
+				for (int k = 0; k < 3; k++) {
+					touched[triangle[k]] = true;
+					degenerate = degenerate
+						|| triangle[k] == to;
+				}
+				for (int k = 0; k < 3; k++) {
+					if (triangle[k] == from) {
+						triangle[k] = to;
+					}
+				}
+				removed += degenerate;
+			}
+			optimizeQuadricAdd(&quadrics[to], &quadrics[from]);
+			if (collapse->error > *errorOut) {
+				*errorOut = collapse->error;
+			}
+		}
+		if (removed == 0) {
+			break;
+		}
+
+		/* Drop the triangles collapsed to a line. */
+		size_t kept = 0;
+		for (size_t t = 0; t < triangleCount; t++) {
+			const uint32_t *triangle = &out[3 * t];
+			if (triangle[0] != triangle[1]
+			    && triangle[1] != triangle[2]
+			    && triangle[0] != triangle[2]) {
+				memmove(&out[3 * kept], triangle,
+					sizeof(uint32_t) * 3);
+				kept++;
+			}
+		}
+		triangleCount = kept;
+	}
+
+	arrfree(locked);
+	arrfree(touched);
+	arrfree(stamps);
+	arrfree(quadrics);
+	arrfree(adjacencyOffsets);
+	arrfree(adjacency);
+	arrfree(collapses);
+
+	return triangleCount * 3;
+}
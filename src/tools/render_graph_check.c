@@ -0,0 +1,166 @@
+/* Render graph check - Compile small graphs and compare what survives with
+ * what should
+ *
+ * OVERVIEW: - Each case declares a few passes, compiles them, and lists the
+ *   passes expected to be culled. Case names and mismatches are printed, and
+ *   the exit status fails if any case does.
+ *
+ * - Cases cover passes writing nothing, such as debug readbacks, chains
+ *   left unread, passes kept by one write among several, and transient
+ *   textures sharing a slot.
+ *
+ * USAGE:
+ * - render_graph_check
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "render_graph.c"
+
+static constexpr RGTextureDesc checkDesc = {
+	.width = 64,
+	.height = 64,
+	.format = RG_FORMAT_RGBA8,
+};
+
+struct Check {
+	RenderGraph graph;
+	RGResource backbuffer;
+	uint32_t errors;
+};
+
+struct Check check;
+
+void checkExecute(RenderGraph *graph, RGPass pass, void *user)
+{
+	(void)graph;
+	(void)pass;
+	(void)user;
+}
+
+void checkBegin(void)
+{
+	renderGraphReset(&check.graph);
+	check.backbuffer = renderGraphImport(&check.graph, "backbuffer",
+					     checkDesc, 0, RG_USAGE_NONE,
+					     RG_USAGE_PRESENT);
+}
+
+RGPass checkPass(const char *name)
+{
+	return renderGraphAddPass(&check.graph, name, checkExecute, nullptr);
+}
+
+/* Compile, and compare every pass's culling with `culled`, one flag per
+ * pass in declaration order. */
+void checkCulled(const char *name, const bool *culled)
+{
+	renderGraphCompile(&check.graph);
+	uint32_t errors = 0;
+	for (ptrdiff_t i = 0; i < arrlen(check.graph.passes); i++) {
+		const RGPassNode *pass = &check.graph.passes[i];
+		if (pass->culled != culled[i]) {
+			printf("%s: pass %s %s\n", name, pass->name,
+			       pass->culled ? "culled" : "kept");
+			errors++;
+		}
+	}
+	printf("%s: %s\n", name, errors == 0 ? "ok" : "FAILED");
+	check.errors += errors;
+}
+
+/* A pass writing nothing is culled, and the scene it alone reads goes with
+ * it, while another output of the pass writing it keeps that pass. */
+void checkNoWrites(void)
+{
+	checkBegin();
+	RGResource color = renderGraphCreateTexture(&check.graph, "color",
+						    checkDesc);
+	RGResource debug = renderGraphCreateTexture(&check.graph, "debug",
+						    checkDesc);
+
+	RGPass scene = checkPass("scene");
+	renderGraphWrite(&check.graph, scene, color,
+			 RG_USAGE_COLOR_ATTACHMENT);
+	renderGraphWrite(&check.graph, scene, debug,
+			 RG_USAGE_COLOR_ATTACHMENT);
+	RGPass readback = checkPass("readback");
+	renderGraphRead(&check.graph, readback, debug, RG_USAGE_TRANSFER_SRC);
+	RGPass present = checkPass("present");
+	renderGraphRead(&check.graph, present, color, RG_USAGE_SAMPLED);
+	renderGraphWrite(&check.graph, present, check.backbuffer,
+			 RG_USAGE_COLOR_ATTACHMENT);
+
+	checkCulled("no writes", (const bool[]){false, true, false});
+
+	checkBegin();
+	debug = renderGraphCreateTexture(&check.graph, "debug", checkDesc);
+	RGPass probe = checkPass("probe");
+	renderGraphWrite(&check.graph, probe, debug,
+			 RG_USAGE_COLOR_ATTACHMENT);
+	readback = checkPass("readback");
+	renderGraphRead(&check.graph, readback, debug, RG_USAGE_TRANSFER_SRC);
+
+	checkCulled("no writes, chain", (const bool[]){true, true});
+}
+
+/* Passes feeding only unread textures are culled back to the first. */
+void checkUnreadChain(void)
+{
+	checkBegin();
+	RGResource a = renderGraphCreateTexture(&check.graph, "a", checkDesc);
+	RGResource b = renderGraphCreateTexture(&check.graph, "b", checkDesc);
+
+	RGPass first = checkPass("first");
+	renderGraphWrite(&check.graph, first, a, RG_USAGE_COLOR_ATTACHMENT);
+	RGPass second = checkPass("second");
+	renderGraphRead(&check.graph, second, a, RG_USAGE_SAMPLED);
+	renderGraphWrite(&check.graph, second, b, RG_USAGE_COLOR_ATTACHMENT);
+	RGPass present = checkPass("present");
+	renderGraphWrite(&check.graph, present, check.backbuffer,
+			 RG_USAGE_COLOR_ATTACHMENT);
+
+	checkCulled("unread chain", (const bool[]){true, true, false});
+}
+
+/* Transient textures alive one after the other share a slot. */
+void checkAliasing(void)
+{
+	checkBegin();
+	RGResource a = renderGraphCreateTexture(&check.graph, "a", checkDesc);
+	RGResource b = renderGraphCreateTexture(&check.graph, "b", checkDesc);
+	RGResource c = renderGraphCreateTexture(&check.graph, "c", checkDesc);
+
+	RGPass first = checkPass("first");
+	renderGraphWrite(&check.graph, first, a, RG_USAGE_COLOR_ATTACHMENT);
+	RGPass second = checkPass("second");
+	renderGraphRead(&check.graph, second, a, RG_USAGE_SAMPLED);
+	renderGraphWrite(&check.graph, second, b, RG_USAGE_COLOR_ATTACHMENT);
+	RGPass third = checkPass("third");
+	renderGraphRead(&check.graph, third, b, RG_USAGE_SAMPLED);
+	renderGraphWrite(&check.graph, third, c, RG_USAGE_COLOR_ATTACHMENT);
+	RGPass present = checkPass("present");
+	renderGraphRead(&check.graph, present, c, RG_USAGE_SAMPLED);
+	renderGraphWrite(&check.graph, present, check.backbuffer,
+			 RG_USAGE_COLOR_ATTACHMENT);
+
+	checkCulled("aliasing", (const bool[]){false, false, false, false});
+	const RGResourceNode *resources = check.graph.resources;
+	if (resources[a].slot != resources[c].slot
+	    || arrlen(check.graph.slots) != 2) {
+		printf("aliasing: %td slots, a in %d, c in %d\n",
+		       arrlen(check.graph.slots), resources[a].slot,
+		       resources[c].slot);
+		check.errors++;
+	}
+}
+
+int main(void)
+{
+	checkNoWrites();
+	checkUnreadChain();
+	checkAliasing();
+	renderGraphFree(&check.graph);
+	return check.errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,363 @@
+/* Texture cooker - Convert images into block-compressed, mipmapped textures
+ *
+ * OVERVIEW: - Builds the whole mip chain offline, with an area-weighted box
+ *   filter that also handles odd sizes. Color textures are filtered in linear
+ *   light. Pass `--linear` for data textures, such as specular maps.
+ *
+ * - Levels are block compressed on the job system, one row of blocks per
+ *   job, and written in the container format of texture_format.h.
+ *
+ * USAGE:
+ * - texture_cooker [--format auto|bc1|bc3|bc7] [--linear] <input> <output>
+ * - `auto` picks BC1 for opaque images and BC3 otherwise.
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "block_compress.c"
+#include "common.h"
+#include "jobs.c"
+#include "texture_format.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define USAGE "usage: texture_cooker [--format auto|bc1|bc3|bc7] [--linear] " \
+	"<input> <output>"
+
+/* One level of the mip chain, as linear floats. */
+typedef struct CookImage {
+	float *texels;	/* RGBA */
+	uint32_t width;
+	uint32_t height;
+} CookImage;
+
+/* A level being encoded by the job system. */
+typedef struct CookLevel {
+	const uint8_t *texels;	/* RGBA8 */
+	uint32_t width;
+	uint32_t height;
+	TextureFormat format;
+	uint8_t *out;
+} CookLevel;
+
+float cookSRGBToLinear(float value)
+{
+	return value <= 0.04045f
+		? value / 12.92f
+		: powf((value + 0.055f) / 1.055f, 2.4f);
+}
+
+float cookLinearToSRGB(float value)
+{
+	return value <= 0.0031308f
+		? value * 12.92f
+		: 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+}
+
+/* Area-weighted box filter along one axis. `stride` is the distance between
+ * consecutive samples of a line, `pitch` between lines. */
+void cookResample(const float *src, uint32_t srcLength, float *dst,
+		  uint32_t dstLength, uint32_t lines, uint32_t stride,
+		  uint32_t srcPitch, uint32_t dstPitch)
+{
+	float scale = (float)srcLength / (float)dstLength;
+	for (uint32_t line = 0; line < lines; line++) {
+		for (uint32_t x = 0; x < dstLength; x++) {
+			float begin = (float)x * scale;
+			float end = begin + scale;
+			float sum[4] = {};
+			for (uint32_t i = (uint32_t)begin;
+			     i < srcLength && (float)i < end; i++) {
+				float weight = fminf(end, (float)i + 1.0f)
+					- fmaxf(begin, (float)i);
+				const float *texel =
+					&src[(line * srcPitch + i * stride) * 4];
+				for (int c = 0; c < 4; c++) {
+					sum[c] += texel[c] * weight;
+				}
+			}
+			float *texel = &dst[(line * dstPitch + x * stride) * 4];
+			for (int c = 0; c < 4; c++) {
+				texel[c] = sum[c] / scale;
+			}
+		}
+	}
+}
+
+bool cookDownsample(const CookImage *src, CookImage *dst)
+{
+	dst->width = src->width > 1 ? src->width / 2 : 1;
+	dst->height = src->height > 1 ? src->height / 2 : 1;
+
+	/* Horizontal pass into `half`, then vertical pass into `dst`. */
+	float *half = malloc(sizeof(float) * 4 * dst->width * src->height);
+	dst->texels = malloc(sizeof(float) * 4 * dst->width * dst->height);
+	if (half == nullptr || dst->texels == nullptr) {
+		free(half);
+		free(dst->texels);
+		return false;
+	}
+
+	cookResample(src->texels, src->width, half, dst->width, src->height, 1,
+		     src->width, dst->width);
+	cookResample(half, src->height, dst->texels, dst->height, dst->width,
+		     dst->width, 1, 1);
+	free(half);
+
+	return true;
+}
+
+void cookQuantize(const CookImage *image, bool srgb, uint8_t *out)
+{
+	size_t count = (size_t)image->width * image->height * 4;
+	for (size_t i = 0; i < count; i++) {
+		float value = image->texels[i];
+		if (srgb && (i & 3) != 3) {
+			value = cookLinearToSRGB(value);
+		}
+		out[i] = (uint8_t)lroundf(fminf(fmaxf(value, 0.0f), 1.0f)
+					  * 255.0f);
+	}
+}
+
+/* Job: encode row `row` of blocks. Edge blocks replicate the last texels. */
+void cookEncodeRow(int row, void *user)
+{
+	const CookLevel *level = user;
+	uint32_t blocksWide = textureBlockCount(level->width);
+	uint32_t blockBytes = textureBlockBytes(level->format);
+	uint8_t *out = level->out + (size_t)row * blocksWide * blockBytes;
+
+	for (uint32_t bx = 0; bx < blocksWide; bx++) {
+		BlockTexels block;
+		for (uint32_t i = 0; i < 16; i++) {
+			uint32_t x = bx * 4 + (i & 3);
+			uint32_t y = (uint32_t)row * 4 + (i >> 2);
+			x = x < level->width ? x : level->width - 1;
+			y = y < level->height ? y : level->height - 1;
+			memcpy(block[i],
+			       &level->texels[((size_t)y * level->width + x) * 4],
+			       4);
+		}
+
+		uint8_t *blockOut = out + (size_t)bx * blockBytes;
+		switch (level->format) {
+		case TEXTURE_FORMAT_BC1:
+			blockCompressBC1(block, blockOut);
+			break;
+		case TEXTURE_FORMAT_BC3:
+			blockCompressBC3(block, blockOut);
+			break;
+		case TEXTURE_FORMAT_BC7:
+			blockCompressBC7(block, blockOut);
+			break;
+		}
+	}
+}
+
+bool cookParseFormat(const char *name, TextureFormat *formatOut, bool *autoOut)
+{
+	*autoOut = strcmp(name, "auto") == 0;
+	if (*autoOut) {
+		return true;
+	}
+	if (strcmp(name, "bc1") == 0) {
+		*formatOut = TEXTURE_FORMAT_BC1;
+	} else if (strcmp(name, "bc3") == 0) {
+		*formatOut = TEXTURE_FORMAT_BC3;
+	} else if (strcmp(name, "bc7") == 0) {
+		*formatOut = TEXTURE_FORMAT_BC7;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+bool cookWritePadding(FILE *file, uint64_t offset)
+{
+	static const uint8_t zeros[TEXTURE_ALIGNMENT] = {};
+	uint64_t padding = (TEXTURE_ALIGNMENT - offset % TEXTURE_ALIGNMENT)
+		% TEXTURE_ALIGNMENT;
+	return fwrite(zeros, 1, padding, file) == padding;
+}
+
+/* Filter, encode and write every level. */
+Error cook(const char *inputPath, const char *outputPath, TextureFormat format,
+	   bool autoFormat, bool srgb)
+{
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+	stbi_set_flip_vertically_on_load(true);
+	uint8_t *pixels = stbi_load(inputPath, &width, &height, &channels, 4);
+	if (pixels == nullptr) {
+		(void)fprintf(stderr, "%s: %s\n", inputPath,
+			      stbi_failure_reason());
+		return ERR_TEXTURE_LOADING_FAILED;
+	}
+
+	size_t texelCount = (size_t)width * (size_t)height;
+	if (autoFormat) {
+		format = TEXTURE_FORMAT_BC1;
+		for (size_t i = 0; i < texelCount; i++) {
+			if (pixels[i * 4 + 3] != 255) {
+				format = TEXTURE_FORMAT_BC3;
+				break;
+			}
+		}
+	}
+
+	CookImage image = {
+		.texels = malloc(sizeof(float) * 4 * texelCount),
+		.width = (uint32_t)width,
+		.height = (uint32_t)height,
+	};
+	/* Sized for level 0, reused by every smaller level. */
+	uint8_t *quantized = malloc(texelCount * 4);
+	uint8_t *encoded = malloc(textureLevelBytes(format, image.width,
+						    image.height));
+	FILE *file = fopen(outputPath, "wb");
+	if (image.texels == nullptr || quantized == nullptr
+	    || encoded == nullptr || file == nullptr) {
+		free(image.texels);
+		free(quantized);
+		free(encoded);
+		if (file != nullptr) {
+			(void)fclose(file);
+		}
+		stbi_image_free(pixels);
+		return file == nullptr ? ERR_INVALID_ARGUMENTS
+			: ERR_OUT_OF_MEMORY;
+	}
+
+	for (size_t i = 0; i < texelCount * 4; i++) {
+		float value = pixels[i] / 255.0f;
+		image.texels[i] = srgb && (i & 3) != 3
+			? cookSRGBToLinear(value)
+			: value;
+	}
+	stbi_image_free(pixels);
+
+	TextureHeader header = {
+		.magic = TEXTURE_MAGIC,
+		.version = TEXTURE_VERSION,
+		.format = format,
+		.flags = srgb ? TEXTURE_FLAG_SRGB : 0,
+		.width = image.width,
+		.height = image.height,
+	};
+
+	/* Levels are written after the header, so leave room for it. */
+	Error e = ERR_OK;
+	uint64_t offset = sizeof(header);
+	if (fwrite(&header, sizeof(header), 1, file) != 1) {
+		e = ERR_INVALID_ARGUMENTS;
+	}
+
+	while (e == ERR_OK && header.levelCount < TEXTURE_MAX_LEVELS) {
+		CookLevel level = {
+			.texels = quantized,
+			.width = image.width,
+			.height = image.height,
+			.format = format,
+			.out = encoded,
+		};
+		cookQuantize(&image, srgb, quantized);
+		jobsParallelFor((int)textureBlockCount(image.height),
+				cookEncodeRow, &level);
+
+		uint64_t size = textureLevelBytes(format, image.width,
+						  image.height);
+		if (!cookWritePadding(file, offset)) {
+			e = ERR_INVALID_ARGUMENTS;
+			break;
+		}
+		offset += (TEXTURE_ALIGNMENT - offset % TEXTURE_ALIGNMENT)
+			% TEXTURE_ALIGNMENT;
+		header.levels[header.levelCount++] = (TextureLevel){
+			.width = image.width,
+			.height = image.height,
+			.offset = offset,
+			.size = size,
+		};
+		if (fwrite(encoded, 1, size, file) != size) {
+			e = ERR_INVALID_ARGUMENTS;
+			break;
+		}
+		offset += size;
+
+		if (image.width == 1 && image.height == 1) {
+			break;
+		}
+		CookImage next;
+		if (!cookDownsample(&image, &next)) {
+			e = ERR_OUT_OF_MEMORY;
+			break;
+		}
+		free(image.texels);
+		image = next;
+	}
+
+	/* Now that the level table is known. */
+	if (e == ERR_OK && (fseek(file, 0, SEEK_SET) != 0
+			    || fwrite(&header, sizeof(header), 1, file) != 1)) {
+		e = ERR_INVALID_ARGUMENTS;
+	}
+	if (fclose(file) != 0 && e == ERR_OK) {
+		e = ERR_INVALID_ARGUMENTS;
+	}
+	if (e != ERR_OK) {
+		(void)remove(outputPath);
+	}
+
+	free(image.texels);
+	free(quantized);
+	free(encoded);
+
+	return e;
+}
+
+int main(int argc, char **argv)
+{
+	TextureFormat format = TEXTURE_FORMAT_BC1;
+	bool autoFormat = true;
+	bool srgb = true;
+	const char *paths[2] = {};
+	int pathCount = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+			if (!cookParseFormat(argv[++i], &format, &autoFormat)) {
+				(void)fprintf(stderr, "unknown format: %s\n",
+					      argv[i]);
+				return EXIT_FAILURE;
+			}
+		} else if (strcmp(argv[i], "--linear") == 0) {
+			srgb = false;
+		} else if (pathCount < 2 && argv[i][0] != '-') {
+			paths[pathCount++] = argv[i];
+		} else {
+			(void)fprintf(stderr, "%s\n", USAGE);
+			return EXIT_FAILURE;
+		}
+	}
+	if (pathCount != 2) {
+		(void)fprintf(stderr, "%s\n", USAGE);
+		return EXIT_FAILURE;
+	}
+
+	jobsInit();
+	Error e = cook(paths[0], paths[1], format, autoFormat, srgb);
+	jobsShutdown();
+
+	if (e != ERR_OK) {
+		printError(e);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,418 @@
+/* Vulkan cull check - Run the culling shader over known objects, and compare
+ * the draws it compacts with the CPU's
+ *
+ * OVERVIEW: - Creates a headless device, the first with a compute queue, or
+ *   with `--cpu` the first CPU one, such as lavapipe, so the check runs
+ *   without a GPU. Exits with CHECK_SKIPPED when there is none, or no
+ *   Vulkan driver at all.
+ *
+ * - A grid of CHECK_OBJECTS scaled objects, spanning several workgroups and
+ *   the frustum's sides and far plane, is culled once through vulkan_cull.c
+ *   with readable draws. Every object the CPU finds inside the frustum must
+ *   be drawn exactly once, with its draw arguments, and none found outside.
+ *   Objects within checkEpsilon of a plane may go either way, as the GPU
+ *   rounds differently.
+ *
+ * USAGE:
+ * - vulkan_cull_check [--cpu]
+ */
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cglm/cglm.h"
+#define GLFW_INCLUDE_VULKAN
+#include "GLFW/glfw3.h"
+#include "common.h"
+#include "stb_ds.h"
+#include "vulkan_cull.c"
+#include "vulkan_memory.c"
+
+#define USAGE "usage: vulkan_cull_check [--cpu]"
+
+enum : int {
+	CHECK_SKIPPED = 77,	/* CTest's SKIP_RETURN_CODE */
+};
+
+enum : uint32_t {
+	/* Per side, 1331 objects leaving the last workgroup partial */
+	CHECK_GRID = 11,
+	CHECK_OBJECTS = CHECK_GRID * CHECK_GRID * CHECK_GRID,
+};
+
+static constexpr float checkEpsilon = 1e-3f;
+
+struct Check {
+	VkInstance instance;
+	VkPhysicalDevice physicalDevice;
+	VkDevice device;
+	uint32_t queueFamily;
+	VkQueue queue;
+	VkCommandPool commandPool;
+	VulkanBuffer objects;	/* Host-visible */
+	VulkanCull cull;
+	mat4 viewProjection;
+};
+
+struct Check check;
+
+/* Pick the first device with a compute queue, or the first CPU one. */
+Error checkPickDevice(bool cpu)
+{
+	uint32_t deviceCount = 0;
+	vkEnumeratePhysicalDevices(check.instance, &deviceCount, nullptr);
+	VkPhysicalDevice *devices = nullptr;	/* stb_ds.h array */
+	arrsetlen(devices, deviceCount);
+	vkEnumeratePhysicalDevices(check.instance, &deviceCount, devices);
+
+	VkQueueFamilyProperties *families = nullptr;	/* stb_ds.h array */
+	for (uint32_t i = 0; i < deviceCount
+	     && check.physicalDevice == VK_NULL_HANDLE; i++) {
+		VkPhysicalDeviceProperties properties = {};
+		vkGetPhysicalDeviceProperties(devices[i], &properties);
+		if (cpu && properties.deviceType
+		    != VK_PHYSICAL_DEVICE_TYPE_CPU) {
+			continue;
+		}
+
+		uint32_t familyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(devices[i],
+							 &familyCount, nullptr);
+		arrsetlen(families, familyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(devices[i],
+							 &familyCount,
+							 families);
+		for (uint32_t j = 0; j < familyCount; j++) {
+			if (families[j].queueFlags & VK_QUEUE_COMPUTE_BIT) {
+				check.physicalDevice = devices[i];
+				check.queueFamily = j;
+				printf("Checking on %s\n",
+				       properties.deviceName);
+				break;
+			}
+		}
+	}
+	arrfree(families);
+	arrfree(devices);
+
+	return check.physicalDevice != VK_NULL_HANDLE
+		? ERR_OK
+		: ERR_NO_GPU_FOUND;
+}
+
+Error checkInit(bool cpu)
+{
+	VkApplicationInfo appInfo = {};
+	appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+	appInfo.pApplicationName = "vulkan_cull_check";
+	appInfo.apiVersion = VK_API_VERSION_1_2;
+
+	VkInstanceCreateInfo instanceInfo = {};
+	instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+	instanceInfo.pApplicationInfo = &appInfo;
+	if (vkCreateInstance(&instanceInfo, nullptr, &check.instance)
+	    != VK_SUCCESS) {
+		return ERR_INSTANCE_CREATION_FAILED;
+	}
+
+	Error e = checkPickDevice(cpu);
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	float priority = 1.0f;
+	VkDeviceQueueCreateInfo queueInfo = {};
+	queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	queueInfo.queueFamilyIndex = check.queueFamily;
+	queueInfo.queueCount = 1;
+	queueInfo.pQueuePriorities = &priority;
+
+	VkDeviceCreateInfo deviceInfo = {};
+	deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	deviceInfo.queueCreateInfoCount = 1;
+	deviceInfo.pQueueCreateInfos = &queueInfo;
+	if (vkCreateDevice(check.physicalDevice, &deviceInfo, nullptr,
+			   &check.device)
+	    != VK_SUCCESS) {
+		return ERR_LOGICAL_DEVICE_CREATION_FAILED;
+	}
+	vkGetDeviceQueue(check.device, check.queueFamily, 0, &check.queue);
+	vulkanMemoryInit(check.device, check.physicalDevice, false);
+
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = check.queueFamily;
+	if (vkCreateCommandPool(check.device, &poolInfo, nullptr,
+				&check.commandPool)
+	    != VK_SUCCESS) {
+		return ERR_COMMAND_POOL_CREATION_FAILED;
+	}
+
+	return ERR_OK;
+}
+
+/* A grid around the origin, two units apart, of objects scaled differently
+ * along each axis, with draw arguments telling them apart. */
+void checkFillObjects(VulkanCullObject *objects)
+{
+	for (uint32_t i = 0; i < CHECK_OBJECTS; i++) {
+		vec3 position = {
+			(float)(i % CHECK_GRID) * 2.0f - (float)CHECK_GRID,
+			(float)(i / CHECK_GRID % CHECK_GRID) * 2.0f
+			- (float)CHECK_GRID,
+			(float)(i / (CHECK_GRID * CHECK_GRID)) * 2.0f
+			- (float)CHECK_GRID,
+		};
+		vec3 scale = {
+			0.5f + (float)(i % 3) * 0.25f,
+			0.5f + (float)(i % 5) * 0.25f,
+			0.5f + (float)(i % 7) * 0.25f,
+		};
+
+		VulkanCullObject object = {};
+		glm_translate_make(object.model, position);
+		glm_scale(object.model, scale);
+		glm_vec4_copy((vec4){0.1f, -0.1f, 0.0f, 0.9f}, object.bounds);
+		object.indexCount = 36 + i;
+		object.firstIndex = i * 3;
+		object.vertexOffset = -(int32_t)i;
+		object.material = i % 4;
+		objects[i] = object;
+	}
+}
+
+/* By how much the bounding sphere of `object` is inside every plane, as the
+ * shader computes it: negative when culled. */
+float checkMargin(const VulkanCullObject *object, vec4 planes[6])
+{
+	vec4 center = {};
+	glm_mat4_mulv((vec4 *)object->model,
+		      (vec4){object->bounds[0], object->bounds[1],
+			     object->bounds[2], 1.0f},
+		      center);
+	float scale = fmaxf(fmaxf(glm_vec3_norm((float *)object->model[0]),
+				  glm_vec3_norm((float *)object->model[1])),
+			    glm_vec3_norm((float *)object->model[2]));
+	float radius = object->bounds[3] * scale;
+
+	float margin = FLT_MAX;
+	for (int i = 0; i < 6; i++) {
+		margin = fminf(margin, glm_vec3_dot(planes[i], center)
+			       + planes[i][3] + radius);
+	}
+	return margin;
+}
+
+Error checkCull(void)
+{
+	Error e = vulkanCreateBuffer(CHECK_OBJECTS * sizeof(VulkanCullObject),
+				     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+				     | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				     &check.objects);
+	if (e != ERR_OK) {
+		return e;
+	}
+	checkFillObjects((VulkanCullObject *)check.objects.allocation->mapped);
+
+	const char cullCode[] = {
+#embed VULKAN_CULL_SHADER_PATH
+		/* Null term + buffer for 32 bit interpretation */
+		, '\0', '\0', '\0', '\0'
+	};
+
+	VulkanCullDesc desc = {};
+	desc.device = check.device;
+	desc.pipelineCache = VK_NULL_HANDLE;
+	desc.shaderCode = cullCode;
+	desc.shaderSize = sizeof(cullCode) - 4;
+	desc.objects = check.objects.buffer;
+	desc.objectCount = CHECK_OBJECTS;
+	desc.frameCount = 1;
+	desc.readable = true;
+	e = vulkanCullInit(&check.cull, &desc);
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	/* Looking down the grid from past its front, with the far plane
+	 * cutting through its back half. */
+	mat4 view = GLM_MAT4_IDENTITY_INIT;
+	mat4 projection = GLM_MAT4_IDENTITY_INIT;
+	glm_lookat((vec3){1.0f, 2.0f, (float)CHECK_GRID * 2.0f},
+		   (vec3){0.0f, 0.0f, 0.0f}, GLM_YUP, view);
+	glm_perspective(glm_rad(50.0f), 1.5f, 0.1f,
+			(float)CHECK_GRID * 2.5f, projection);
+	glm_mat4_mul(projection, view, check.viewProjection);
+
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = check.commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	if (vkAllocateCommandBuffers(check.device, &allocInfo, &commandBuffer)
+	    != VK_SUCCESS) {
+		return ERR_COMMAND_BUFFER_ALLOCATION_FAILED;
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+		return ERR_COMMAND_BUFFER_RECORDING_FAILED;
+	}
+
+	vulkanCullDispatch(&check.cull, commandBuffer, 0,
+			   check.viewProjection);
+
+	VkMemoryBarrier culled = {};
+	culled.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	culled.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	culled.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer,
+			     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			     VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &culled, 0,
+			     nullptr, 0, nullptr);
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		return ERR_COMMAND_BUFFER_RECORDING_FAILED;
+	}
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	if (vkQueueSubmit(check.queue, 1, &submitInfo, VK_NULL_HANDLE)
+	    != VK_SUCCESS) {
+		return ERR_COMMAND_BUFFER_DRAWING_FAILED;
+	}
+	vkQueueWaitIdle(check.queue);
+	return ERR_OK;
+}
+
+/* Compare the draws compacted with the CPU's culling. Returns the number of
+ * mismatches, printed. */
+uint32_t checkCompare(void)
+{
+	const VulkanCullObject *objects =
+		(const VulkanCullObject *)check.objects.allocation->mapped;
+	const VkDrawIndexedIndirectCommand *commands =
+		(const VkDrawIndexedIndirectCommand *)
+		check.cull.commands[0].allocation->mapped;
+	uint32_t drawCount =
+		*(const uint32_t *)check.cull.counts[0].allocation->mapped;
+
+	vec4 planes[6];
+	glm_frustum_planes(check.viewProjection, planes);
+
+	uint32_t errors = 0;
+	uint32_t expected = 0;
+	bool drawn[CHECK_OBJECTS] = {};
+	if (drawCount > CHECK_OBJECTS) {
+		(void)fprintf(stderr, "%u draws for %u objects\n", drawCount,
+			      CHECK_OBJECTS);
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < drawCount; i++) {
+		const VkDrawIndexedIndirectCommand *command = &commands[i];
+		uint32_t index = command->firstInstance;
+		if (index >= CHECK_OBJECTS || drawn[index]) {
+			(void)fprintf(stderr, "draw %u: object %u drawn twice "
+				      "or unknown\n", i, index);
+			errors++;
+			continue;
+		}
+		drawn[index] = true;
+
+		const VulkanCullObject *object = &objects[index];
+		if (command->indexCount != object->indexCount
+		    || command->instanceCount != 1
+		    || command->firstIndex != object->firstIndex
+		    || command->vertexOffset != object->vertexOffset) {
+			(void)fprintf(stderr, "draw %u: wrong arguments for "
+				      "object %u\n", i, index);
+			errors++;
+		}
+	}
+
+	for (uint32_t i = 0; i < CHECK_OBJECTS; i++) {
+		float margin = checkMargin(&objects[i], planes);
+		expected += margin >= 0.0f;
+		if (margin > checkEpsilon && !drawn[i]) {
+			(void)fprintf(stderr, "object %u: visible but culled\n",
+				      i);
+			errors++;
+		} else if (margin < -checkEpsilon && drawn[i]) {
+			(void)fprintf(stderr, "object %u: culled but drawn\n",
+				      i);
+			errors++;
+		}
+	}
+
+	printf("%u of %u objects drawn, %u expected\n", drawCount,
+	       CHECK_OBJECTS, expected);
+	return errors;
+}
+
+void checkFree(void)
+{
+	if (check.device != VK_NULL_HANDLE) {
+		vkDeviceWaitIdle(check.device);
+		if (check.cull.desc.device != VK_NULL_HANDLE) {
+			vulkanCullFree(&check.cull);
+		}
+		if (check.objects.buffer != VK_NULL_HANDLE) {
+			vulkanDestroyBuffer(&check.objects);
+		}
+		vulkanMemoryFree();
+		vkDestroyCommandPool(check.device, check.commandPool,
+				     nullptr);
+		vkDestroyDevice(check.device, nullptr);
+	}
+	vkDestroyInstance(check.instance, nullptr);
+	check = (struct Check){};
+}
+
+int main(int argc, char **argv)
+{
+	bool cpu = false;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--cpu") == 0) {
+			cpu = true;
+		} else {
+			(void)fprintf(stderr, "%s\n", USAGE);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* Without a Vulkan driver, such as VK_ERROR_INCOMPATIBLE_DRIVER from a
+	 * bare loader, there is nothing to check on either. */
+	Error e = checkInit(cpu);
+	if (e == ERR_INSTANCE_CREATION_FAILED) {
+		printf("No Vulkan driver to check on, skipped\n");
+		checkFree();
+		return CHECK_SKIPPED;
+	}
+	if (e == ERR_NO_GPU_FOUND) {
+		printf("No %sdevice to check on, skipped\n", cpu ? "CPU " : "");
+		checkFree();
+		return CHECK_SKIPPED;
+	}
+	if (e == ERR_OK) {
+		e = checkCull();
+	}
+	if (e != ERR_OK) {
+		printError(e);
+		checkFree();
+		return EXIT_FAILURE;
+	}
+
+	uint32_t errors = checkCompare();
+	checkFree();
+	return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,329 @@
+/* Transform hierarchy - SoA transform component store
+ *
+ * OVERVIEW: - Every node owns a local translation, rotation (quaternion) and
+ *   scale, stored one component per array (SoA) so batches can be computed
+ *   lane by lane.
+ *
+ * - A node's parent must be created before the node itself, so a single
+ *   forward sweep over the store always visits parents before children.
+ *
+ * - Setting any local component marks the node dirty. `transformUpdate()`
+ *   propagates the flag to the whole subtree, then recomputes world and normal
+ *   matrices of dirty nodes only. Static objects cost nothing after the first
+ *   update. `transformUpdated()` lists the nodes the last update recomputed,
+ *   so copies elsewhere can follow only those.
+ *
+ * - World and normal matrices are aligned for CGLM's SIMD paths. Pointers
+ *   returned by `transformGetWorld()` and `transformGetNormal()` are
+ *   invalidated by `transformCreate()`.
+ *
+ * USAGE:
+ * - TransformID root = transformCreate(TRANSFORM_NONE);
+ * - TransformID child = transformCreate(root);
+ * - transformSetPosition(child, (vec3){1.0f, 0.0f, 0.0f});
+ * - transformUpdate(); // Once per frame, before drawing
+ * - setUniformMatrix(shader, "model", *transformGetWorld(child));
+ * - transformsFree(); // Release the store
+ */
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cglm/cglm.h"
+#include "common.h"
+#include "stb_ds.h"
+
+typedef int32_t TransformID;
+
+enum : TransformID {
+	TRANSFORM_NONE = -1,
+};
+
+enum : int {
+	/* Nodes computed together. Loops over a batch are written so that the
+	 * compiler maps one lane to one node. */
+	TRANSFORM_BATCH = 4,
+	TRANSFORM_INITIAL_CAPACITY = 64,
+};
+
+struct TransformStore {
+	TransformID *parent;	/* stb_ds.h array */
+	bool *dirty;		/* stb_ds.h array */
+
+	/* Local TRS */
+	float *posX;		/* stb_ds.h array */
+	float *posY;		/* stb_ds.h array */
+	float *posZ;		/* stb_ds.h array */
+	float *rotX;		/* stb_ds.h array */
+	float *rotY;		/* stb_ds.h array */
+	float *rotZ;		/* stb_ds.h array */
+	float *rotW;		/* stb_ds.h array */
+	float *scaleX;		/* stb_ds.h array */
+	float *scaleY;		/* stb_ds.h array */
+	float *scaleZ;		/* stb_ds.h array */
+
+	/* Outputs, allocated with GLM_ALLOCN() for SIMD alignment. */
+	mat4 *world;
+	mat4 *normal;
+	int32_t capacity;
+
+	TransformID *dirtyList;	/* stb_ds.h array, scratch */
+};
+
+struct TransformStore transforms;
+
+void transformsFree(void)
+{
+	arrfree(transforms.parent);
+	arrfree(transforms.dirty);
+	arrfree(transforms.posX);
+	arrfree(transforms.posY);
+	arrfree(transforms.posZ);
+	arrfree(transforms.rotX);
+	arrfree(transforms.rotY);
+	arrfree(transforms.rotZ);
+	arrfree(transforms.rotW);
+	arrfree(transforms.scaleX);
+	arrfree(transforms.scaleY);
+	arrfree(transforms.scaleZ);
+	arrfree(transforms.dirtyList);
+	free(transforms.world);
+	free(transforms.normal);
+	memset(&transforms, 0, sizeof(transforms));
+}
+
+int32_t transformCount(void)
+{
+	return (int32_t)arrlen(transforms.parent);
+}
+
+/* Grow the aligned output arrays. Return false when out of memory. */
+bool transformReserve(int32_t count)
+{
+	if (count <= transforms.capacity) {
+		return true;
+	}
+
+	int32_t capacity = transforms.capacity == 0
+		? TRANSFORM_INITIAL_CAPACITY
+		: transforms.capacity;
+	while (capacity < count) {
+		capacity *= 2;
+	}
+
+	mat4 *world = GLM_ALLOCN(mat4, capacity);
+	mat4 *normal = GLM_ALLOCN(mat4, capacity);
+	if (unlikely(world == nullptr || normal == nullptr)) {
+		free(world);
+		free(normal);
+		return false;
+	}
+
+	size_t used = sizeof(mat4) * (size_t)transformCount();
+	if (transforms.world != nullptr) {
+		memcpy(world, transforms.world, used);
+		memcpy(normal, transforms.normal, used);
+	}
+	free(transforms.world);
+	free(transforms.normal);
+
+	transforms.world = world;
+	transforms.normal = normal;
+	transforms.capacity = capacity;
+
+	return true;
+}
+
+/* Create an identity node under `parent`, or a root with TRANSFORM_NONE.
+ * Return TRANSFORM_NONE when out of memory. */
+TransformID transformCreate(TransformID parent)
+{
+	TransformID id = transformCount();
+	assert(parent == TRANSFORM_NONE || (parent >= 0 && parent < id));
+
+	if (unlikely(!transformReserve(id + 1))) {
+		return TRANSFORM_NONE;
+	}
+
+	arrput(transforms.parent, parent);
+	arrput(transforms.dirty, true);
+	arrput(transforms.posX, 0.0f);
+	arrput(transforms.posY, 0.0f);
+	arrput(transforms.posZ, 0.0f);
+	arrput(transforms.rotX, 0.0f);
+	arrput(transforms.rotY, 0.0f);
+	arrput(transforms.rotZ, 0.0f);
+	arrput(transforms.rotW, 1.0f);
+	arrput(transforms.scaleX, 1.0f);
+	arrput(transforms.scaleY, 1.0f);
+	arrput(transforms.scaleZ, 1.0f);
+
+	glm_mat4_identity(transforms.world[id]);
+	glm_mat4_identity(transforms.normal[id]);
+
+	return id;
+}
+
+void transformSetPosition(TransformID id, vec3 position)
+{
+	transforms.posX[id] = position[0];
+	transforms.posY[id] = position[1];
+	transforms.posZ[id] = position[2];
+	transforms.dirty[id] = true;
+}
+
+/* `rotation` must be a unit quaternion. */
+void transformSetRotation(TransformID id, versor rotation)
+{
+	transforms.rotX[id] = rotation[0];
+	transforms.rotY[id] = rotation[1];
+	transforms.rotZ[id] = rotation[2];
+	transforms.rotW[id] = rotation[3];
+	transforms.dirty[id] = true;
+}
+
+void transformSetScale(TransformID id, vec3 scale)
+{
+	transforms.scaleX[id] = scale[0];
+	transforms.scaleY[id] = scale[1];
+	transforms.scaleZ[id] = scale[2];
+	transforms.dirty[id] = true;
+}
+
+mat4 *transformGetWorld(TransformID id)
+{
+	return &transforms.world[id];
+}
+
+/* Upper 3x3 is transpose(inverse(world)), for transforming normals. */
+mat4 *transformGetNormal(TransformID id)
+{
+	return &transforms.normal[id];
+}
+
+/* Write the local TRS matrices of `count` (<= TRANSFORM_BATCH) nodes into
+ * their world slots. Gathering into lanes first keeps the arithmetic free of
+ * indirection, so it vectorizes across nodes. */
+void transformComputeLocalBatch(const TransformID *ids, int count)
+{
+	float px[TRANSFORM_BATCH] = {};
+	float py[TRANSFORM_BATCH] = {};
+	float pz[TRANSFORM_BATCH] = {};
+	float qx[TRANSFORM_BATCH] = {};
+	float qy[TRANSFORM_BATCH] = {};
+	float qz[TRANSFORM_BATCH] = {};
+	float qw[TRANSFORM_BATCH] = {};
+	float sx[TRANSFORM_BATCH] = {};
+	float sy[TRANSFORM_BATCH] = {};
+	float sz[TRANSFORM_BATCH] = {};
+
+	for (int l = 0; l < count; l++) {
+		TransformID id = ids[l];
+		px[l] = transforms.posX[id];
+		py[l] = transforms.posY[id];
+		pz[l] = transforms.posZ[id];
+		qx[l] = transforms.rotX[id];
+		qy[l] = transforms.rotY[id];
+		qz[l] = transforms.rotZ[id];
+		qw[l] = transforms.rotW[id];
+		sx[l] = transforms.scaleX[id];
+		sy[l] = transforms.scaleY[id];
+		sz[l] = transforms.scaleZ[id];
+	}
+
+	/* m[column][row][lane] */
+	float m[4][3][TRANSFORM_BATCH];
+	for (int l = 0; l < TRANSFORM_BATCH; l++) {
+		float xx = qx[l] * qx[l];
+		float yy = qy[l] * qy[l];
+		float zz = qz[l] * qz[l];
+		float xy = qx[l] * qy[l];
+		float xz = qx[l] * qz[l];
+		float yz = qy[l] * qz[l];
+		float wx = qw[l] * qx[l];
+		float wy = qw[l] * qy[l];
+		float wz = qw[l] * qz[l];
+
+		m[0][0][l] = (1.0f - 2.0f * (yy + zz)) * sx[l];
+		m[0][1][l] = 2.0f * (xy + wz) * sx[l];
+		m[0][2][l] = 2.0f * (xz - wy) * sx[l];
+
+		m[1][0][l] = 2.0f * (xy - wz) * sy[l];
+		m[1][1][l] = (1.0f - 2.0f * (xx + zz)) * sy[l];
+		m[1][2][l] = 2.0f * (yz + wx) * sy[l];
+
+		m[2][0][l] = 2.0f * (xz + wy) * sz[l];
+		m[2][1][l] = 2.0f * (yz - wx) * sz[l];
+		m[2][2][l] = (1.0f - 2.0f * (xx + yy)) * sz[l];
+
+		m[3][0][l] = px[l];
+		m[3][1][l] = py[l];
+		m[3][2][l] = pz[l];
+	}
+
+	for (int l = 0; l < count; l++) {
+		float (*out)[4] = transforms.world[ids[l]];
+		for (int c = 0; c < 4; c++) {
+			out[c][0] = m[c][0][l];
+			out[c][1] = m[c][1][l];
+			out[c][2] = m[c][2][l];
+			out[c][3] = c == 3 ? 1.0f : 0.0f;
+		}
+	}
+}
+
+/* Recompute world and normal matrices of dirty nodes and their descendants.
+ * Call once per frame after moving objects and before drawing them. */
+void transformUpdate(void)
+{
+	int32_t count = transformCount();
+	arrsetlen(transforms.dirtyList, 0);
+
+	/* Parents come first, so one sweep propagates dirtiness down. */
+	for (TransformID i = 0; i < count; i++) {
+		TransformID parent = transforms.parent[i];
+		if (parent != TRANSFORM_NONE && transforms.dirty[parent]) {
+			transforms.dirty[i] = true;
+		}
+		if (transforms.dirty[i]) {
+			arrput(transforms.dirtyList, i);
+		}
+	}
+
+	int32_t dirtyCount = (int32_t)arrlen(transforms.dirtyList);
+	if (dirtyCount == 0) {
+		return;
+	}
+
+	for (int32_t i = 0; i < dirtyCount; i += TRANSFORM_BATCH) {
+		int batch = dirtyCount - i < TRANSFORM_BATCH
+			? dirtyCount - i
+			: TRANSFORM_BATCH;
+		transformComputeLocalBatch(&transforms.dirtyList[i], batch);
+	}
+
+	/* A dirty node's parent is either clean or already resolved, since it
+	 * appears earlier in the list. */
+	for (int32_t i = 0; i < dirtyCount; i++) {
+		TransformID id = transforms.dirtyList[i];
+		TransformID parent = transforms.parent[id];
+		if (parent != TRANSFORM_NONE) {
+			glm_mat4_mul(transforms.world[parent], transforms.world[id],
+				     transforms.world[id]);
+		}
+
+		glm_mat4_inv(transforms.world[id], transforms.normal[id]);
+		glm_mat4_transpose(transforms.normal[id]);
+		transforms.dirty[id] = false;
+	}
+}
+
+/* The nodes whose matrices the last transformUpdate() recomputed, parents
+ * first. Valid until the next update. */
+const TransformID *transformUpdated(int32_t *countOut)
+{
+	*countOut = (int32_t)arrlen(transforms.dirtyList);
+	return transforms.dirtyList;
+}
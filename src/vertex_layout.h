@@ -0,0 +1,79 @@
+/* Vertex layouts - Describe vertex streams independently of the graphics API
+ *
+ * OVERVIEW: - A VertexLayout lists the streams of a vertex buffer, and for
+ *   every attribute its shader location, format, stream and offset. The
+ *   OpenGL and Vulkan backends translate it into VAO attribute pointers and
+ *   VkVertexInput descriptions, so neither hard-codes offsets.
+ *
+ * - Compressed formats are decoded by the vertex fetch hardware where
+ *   possible. Two need help from the shader or the model matrix:
+ *   - VERTEX_FORMAT_UNORM16X4 positions are in [0, 1] over the mesh's bounds.
+ *     The mesh carries the matrix mapping them back.
+ *   - VERTEX_FORMAT_OCT_UNORM16X2 normals are octahedral-encoded unit vectors,
+ *     remapped to [0, 1].
+ *
+ * - VertexFormat values are stored in cooked meshes. Never renumber them.
+ */
+#pragma once
+
+#include <stdint.h>
+
+enum : uint32_t {
+	VERTEX_MAX_STREAMS = 4,
+	VERTEX_MAX_ATTRIBUTES = 8,
+};
+
+typedef enum VertexFormat : uint32_t {
+	VERTEX_FORMAT_NONE = 0,		/* Attribute absent */
+	VERTEX_FORMAT_FLOAT2 = 1,
+	VERTEX_FORMAT_FLOAT3 = 2,
+	VERTEX_FORMAT_HALF2 = 3,
+	VERTEX_FORMAT_UNORM16X4 = 4,
+	VERTEX_FORMAT_OCT_UNORM16X2 = 5,
+} VertexFormat;
+
+typedef enum VertexComponentType : uint32_t {
+	VERTEX_COMPONENT_FLOAT,
+	VERTEX_COMPONENT_HALF,
+	VERTEX_COMPONENT_UNORM16,
+} VertexComponentType;
+
+typedef struct VertexFormatInfo {
+	uint32_t components;
+	uint32_t size;		/* In bytes */
+	VertexComponentType type;
+	bool normalized;
+} VertexFormatInfo;
+
+typedef struct VertexAttribute {
+	uint32_t location;
+	VertexFormat format;
+	uint32_t stream;
+	uint32_t offset;	/* Within a stream element */
+} VertexAttribute;
+
+typedef struct VertexLayout {
+	uint32_t streamCount;
+	uint32_t strides[VERTEX_MAX_STREAMS];
+	uint32_t attributeCount;
+	VertexAttribute attributes[VERTEX_MAX_ATTRIBUTES];
+} VertexLayout;
+
+VertexFormatInfo vertexFormatInfo(VertexFormat format)
+{
+	switch (format) {
+	case VERTEX_FORMAT_NONE:
+		break;
+	case VERTEX_FORMAT_FLOAT2:
+		return (VertexFormatInfo){2, 8, VERTEX_COMPONENT_FLOAT, false};
+	case VERTEX_FORMAT_FLOAT3:
+		return (VertexFormatInfo){3, 12, VERTEX_COMPONENT_FLOAT, false};
+	case VERTEX_FORMAT_HALF2:
+		return (VertexFormatInfo){2, 4, VERTEX_COMPONENT_HALF, false};
+	case VERTEX_FORMAT_UNORM16X4:
+		return (VertexFormatInfo){4, 8, VERTEX_COMPONENT_UNORM16, true};
+	case VERTEX_FORMAT_OCT_UNORM16X2:
+		return (VertexFormatInfo){2, 4, VERTEX_COMPONENT_UNORM16, true};
+	}
+	return (VertexFormatInfo){};
+}
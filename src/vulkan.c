@@ -1,7 +1,8 @@
-/* This is an unfinished Vulkan renderer. The renderer is currently at the
- * "Staging buffer" stage. */
+/* This is an unfinished Vulkan renderer. It draws the submitted draw list
+ * depth tested but unlit, in the colors of its materials. */
 
 #include <assert.h>
+#include <float.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -9,11 +10,25 @@
 #include <string.h>
 
 #include "cglm/cglm.h"
+/* cglm declares only the projections of its default clip space, OpenGL's. */
+#include "cglm/clipspace/persp_rh_zo.h"
 #include "common.h"
 #include "config.h"
 #define GLFW_INCLUDE_VULKAN
 #include "GLFW/glfw3.h"
+#include "mesh.c"
+#include "renderer.h"
+#include "scene.c"
+#include "shader_cache.c"
 #include "stb_ds.h"
+#include "vertex_layout.h"
+#include "vulkan_cull.c"
+#include "vulkan_deletion.c"
+#include "vulkan_descriptors.c"
+#include "vulkan_latency.c"
+#include "vulkan_memory.c"
+#include "vulkan_record.c"
+#include "vulkan_staging.c"
 
 #ifdef NDEBUG
 #define ENABLE_VALIDATION_LAYERS false
@@ -21,30 +36,116 @@
 #define ENABLE_VALIDATION_LAYERS true
 #endif
 
-#define CLAMP(x, min, max) ((x) < (min) ? (min) : ((x) > (max) ? (max) : (x)))
-#define ARRAY_COUNT_STATIC(array) (sizeof(array) / sizeof((array)[0]))
-
-enum : size_t {
-	/* If you want to change this to a non-power of 2, change the frame
-	 * incrementing logic to use modulo instead of AND. */
-	MAX_FRAMES_IN_FLIGHT = 2
+enum : uint32_t {
+	DEFAULT_FRAMES_IN_FLIGHT = 2,
+	MAX_FRAMES_IN_FLIGHT = 4,
+	/* Capacity of the geometry buffers, which every mesh shares */
+	MESH_MAX_VERTICES = 1 << 16,
+	MESH_MAX_INDICES = 1 << 18,
+	MAX_MATERIALS = 256,
+	MESH_PATH_SIZE = 512,
 };
 
-typedef struct ALIGN(32) Vertex {
-	vec2 pos;
+/* Seconds between checks for events while minimized. */
+static constexpr double minimizedWaitSec = 0.05;
+
+/* Tightly packed: padding would only cost vertex fetch bandwidth. */
+typedef struct Vertex {
+	vec3 pos;
 	vec3 color;
 } Vertex;
 
+/* The "cube" mesh, counter-clockwise seen from outside, each face shaded as
+ * if lit from above. */
 const Vertex vertices[] = {
-    {{0.0f, -0.5f}, {1.0f, 1.0f, 1.0f}},
-    {{0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}},
-    {{-0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}}	
+	{{-0.5f, -0.5f,  0.5f}, {0.7f, 0.7f, 0.7f}},
+	{{ 0.5f, -0.5f,  0.5f}, {0.7f, 0.7f, 0.7f}},
+	{{ 0.5f,  0.5f,  0.5f}, {0.7f, 0.7f, 0.7f}},
+	{{-0.5f,  0.5f,  0.5f}, {0.7f, 0.7f, 0.7f}},
+
+	{{ 0.5f, -0.5f, -0.5f}, {0.6f, 0.6f, 0.6f}},
+	{{-0.5f, -0.5f, -0.5f}, {0.6f, 0.6f, 0.6f}},
+	{{-0.5f,  0.5f, -0.5f}, {0.6f, 0.6f, 0.6f}},
+	{{ 0.5f,  0.5f, -0.5f}, {0.6f, 0.6f, 0.6f}},
+
+	{{ 0.5f, -0.5f,  0.5f}, {0.8f, 0.8f, 0.8f}},
+	{{ 0.5f, -0.5f, -0.5f}, {0.8f, 0.8f, 0.8f}},
+	{{ 0.5f,  0.5f, -0.5f}, {0.8f, 0.8f, 0.8f}},
+	{{ 0.5f,  0.5f,  0.5f}, {0.8f, 0.8f, 0.8f}},
+
+	{{-0.5f, -0.5f, -0.5f}, {0.8f, 0.8f, 0.8f}},
+	{{-0.5f, -0.5f,  0.5f}, {0.8f, 0.8f, 0.8f}},
+	{{-0.5f,  0.5f,  0.5f}, {0.8f, 0.8f, 0.8f}},
+	{{-0.5f,  0.5f, -0.5f}, {0.8f, 0.8f, 0.8f}},
+
+	{{-0.5f,  0.5f,  0.5f}, {1.0f, 1.0f, 1.0f}},
+	{{ 0.5f,  0.5f,  0.5f}, {1.0f, 1.0f, 1.0f}},
+	{{ 0.5f,  0.5f, -0.5f}, {1.0f, 1.0f, 1.0f}},
+	{{-0.5f,  0.5f, -0.5f}, {1.0f, 1.0f, 1.0f}},
+
+	{{-0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, 0.5f}},
+	{{ 0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, 0.5f}},
+	{{ 0.5f, -0.5f,  0.5f}, {0.5f, 0.5f, 0.5f}},
+	{{-0.5f, -0.5f,  0.5f}, {0.5f, 0.5f, 0.5f}},
+};
+
+const uint32_t indices[] = {
+	0, 1, 2, 2, 3, 0,
+	4, 5, 6, 6, 7, 4,
+	8, 9, 10, 10, 11, 8,
+	12, 13, 14, 14, 15, 12,
+	16, 17, 18, 18, 19, 16,
+	20, 21, 22, 22, 23, 20,
 };
 
-struct ALIGN(32) AttributeDescriptions {
-	VkVertexInputAttributeDescription descriptions[2];
+const VertexLayout vertexLayout = {
+	.streamCount = 1,
+	.strides = {sizeof(Vertex)},
+	.attributeCount = 2,
+	.attributes = {
+		{0, VERTEX_FORMAT_FLOAT3, 0, offsetof(Vertex, pos)},
+		{1, VERTEX_FORMAT_FLOAT3, 0, offsetof(Vertex, color)},
+	},
 };
 
+/* A range of the geometry buffers. */
+typedef struct VulkanMesh {
+	vec4 bounds;		/* Model space sphere center and radius */
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+} VulkanMesh;
+
+typedef struct Draw {
+	/* Of the scene, refreshed as it moves */
+	TransformID transform;
+	mat4 model;
+	vec4 bounds;		/* Model space sphere center and radius */
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t material;
+	int32_t nextDraw;	/* Of the same transform, or -1 */
+	bool moved;		/* Queued in movedDraws */
+} Draw;
+
+/* Matches the push constants of the shaders. */
+typedef struct DrawConstants {
+	mat4 model;
+	uint32_t materialBuffer;	/* Bindless buffer index */
+	uint32_t material;
+	uint32_t texture;		/* Or VULKAN_BINDLESS_NONE */
+	/* Bindless index of the objects, whose index is the instance, or
+	 * VULKAN_BINDLESS_NONE to use the fields above */
+	uint32_t objectBuffer;
+} DrawConstants;
+
+/* Matches the frame uniform block of the shaders. */
+typedef struct FrameUniforms {
+	mat4 viewProjection;
+	float time;
+} FrameUniforms;
+
 /* Must initialize to nullptr. To use with stb_ds. */
 typedef const char **vector_str;
 
@@ -57,6 +158,11 @@ typedef struct QueueFamilyIndices {
 		uint32_t value;
 		bool exists;
 	} ALIGN(8) presentFamily;
+	/* Without graphics, so transfers run beside rendering */
+	struct {
+		uint32_t value;
+		bool exists;
+	} ALIGN(8) transferFamily;
 } ALIGN(16) QueueFamilyIndices;
 
 typedef struct {
@@ -70,41 +176,78 @@ typedef struct {
 /* stb_ds.h string hashmap */
 extern Arguments arguments;
 
-GLFWwindow *window;
 uint32_t currentFrame;
-VkBuffer vertexBuffer;
+/* Acquired by vulkanBeginFrame() */
+uint32_t imageIndex;
+Draw *draws; /* stb_ds.h array */
+/* First draw of each transform, or -1 */
+int32_t *transformDraws; /* stb_ds.h array */
+/* Draws moved since their object was last copied to the object buffer */
+int32_t *movedDraws; /* stb_ds.h array */
+VkBufferCopy *objectCopies; /* stb_ds.h array, scratch */
 VkCommandBuffer *commandBuffers; /* stb_ds.h array */
 VkCommandPool commandPool;
 VkDebugUtilsMessengerEXT debugMessenger;
 VkDevice device;
-VkDeviceMemory vertexBufferMemory;
 VkExtent2D swapChainExtent;
-VkFence *inFlightFences; /* stb_ds.h array */
 VkFormat swapChainImageFormat;
+VkFormat depthFormat;
+VulkanImage depthImage;
+VkImageView depthImageView;
 VkFramebuffer *swapChainFramebuffers; /* stb_ds.h array */
 VkImage *swapChainImages; /* stb_ds.h array */
 VkImageView *swapChainImageViews; /* stb_ds.h array */
 VkInstance instance;
 VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 VkPipeline graphicsPipeline;
+VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+uint64_t pipelineCacheKey;
 VkPipelineLayout pipelineLayout;
 VkQueue graphicsQueue;
 VkQueue presentQueue;
+VkQueue transferQueue;
 VkRenderPass renderPass;
 VkSemaphore *imageAvailableSemaphores; /* stb_ds.h array */
 VkSemaphore *renderFinishedSemaphores; /* stb_ds.h array */
+/* Signalled with the number of frames submitted when each one completes. */
+VkSemaphore frameTimeline;
 VkSurfaceKHR surface;
 VkSwapchainKHR swapChain;
+VulkanBuffer indexBuffer;
+VulkanBuffer materialBuffer;
+VulkanBuffer objectBuffer;
+VulkanBuffer objectUploads[MAX_FRAMES_IN_FLIGHT];
+VulkanBuffer vertexBuffer;
+VulkanMesh *meshes; /* stb_ds.h array */
+VulkanCull cull;
+VulkanDeletionQueue deletions;
+VulkanDescriptors descriptors;
+VulkanLatency latency;
+VulkanRecorder recorder;
+VulkanRecordPass scenePass;
+VulkanStaging staging;
 
 bool framebufferResized;
-float lastFrameTimeSec;
-float currentFrameTimeSec;
-float deltaTimeSec;
-uint64_t frameCount;
-
-vec3 cameraPos;
-
-extern GLFWwindow *window;
+uint32_t frameUniformsOffset;
+uint32_t materialBufferIndex;
+uint32_t materialCount;
+uint32_t meshVertexCount;
+uint32_t meshIndexCount;
+uint32_t objectBufferIndex;
+mat4 viewProjection;
+bool hasMemoryBudget;
+bool hasPresentWait;
+/* Set by --gpu-culling. */
+bool gpuCulling;
+/* Set by --frames-in-flight and --present-mode. */
+uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+VkPresentModeKHR requestedPresentMode;
+bool presentModeRequested;
+VkPresentModeKHR presentMode;
+/* Timeline value of the last frame submitted, and of the last one submitted
+ * from each frame slot. */
+uint64_t frameValue;
+uint64_t *frameSlotValues; /* stb_ds.h array */
 
 const char *const validationLayers[] = {
 	"VK_LAYER_KHRONOS_validation",
@@ -113,7 +256,94 @@ const char *const deviceExtensions[] = {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 };
 
-void framebufferResizeCallback(GLFWwindow *window, int width, int height)
+enum : uint32_t {
+	DEFRAGMENT_MOVES = 4,
+};
+
+/* A defragmentation pass, from the frame recording its copies until that
+ * frame's slot is next waited on. */
+struct Defragment {
+	VulkanMove moves[DEFRAGMENT_MOVES];
+	VkBuffer oldBuffers[DEFRAGMENT_MOVES];
+	uint32_t moveCount;
+	uint32_t frame;
+} defragment;
+
+const char *presentModeName(VkPresentModeKHR mode)
+{
+	switch (mode) {
+	case VK_PRESENT_MODE_IMMEDIATE_KHR:
+		return "immediate";
+	case VK_PRESENT_MODE_MAILBOX_KHR:
+		return "mailbox";
+	case VK_PRESENT_MODE_FIFO_KHR:
+		return "fifo";
+	default:
+		return "other";
+	}
+}
+
+/* Submit-to-present latency, or submit-to-GPU-completion without
+ * VK_KHR_present_wait. */
+void latencyReport(void)
+{
+	printf("Present mode %s, %u frames in flight\n",
+	       presentModeName(presentMode), framesInFlight);
+
+	VulkanLatencyStats stats = {};
+	if (!vulkanLatencyStats(&latency, &stats)) {
+		printf("No latency measured yet\n");
+		return;
+	}
+	printf("%s latency over %u frames: %.2f ms average, "
+	       "%.2f ms min, %.2f ms max\n",
+	       hasPresentWait ? "Submit-to-present" : "Submit-to-completion",
+	       stats.frameCount, stats.averageMs, stats.minMs, stats.maxMs);
+}
+
+/* Read --frames-in-flight, --gpu-culling and --present-mode. */
+Error optionsInit(void)
+{
+	ptrdiff_t frames = shgeti(arguments, "frames-in-flight");
+	if (frames >= 0) {
+		char *end;
+		long count = strtol(arguments[frames].value, &end, 10);
+		if (*end != '\0' || end == arguments[frames].value
+		    || count < 1 || count > MAX_FRAMES_IN_FLIGHT) {
+			return ERR_INVALID_ARGUMENTS;
+		}
+		framesInFlight = (uint32_t)count;
+	}
+
+	ptrdiff_t mode = shgeti(arguments, "present-mode");
+	if (mode >= 0) {
+		const char *value = arguments[mode].value;
+		if (strcmp(value, "fifo") == 0) {
+			requestedPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+		} else if (strcmp(value, "mailbox") == 0) {
+			requestedPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+		} else if (strcmp(value, "immediate") == 0) {
+			requestedPresentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+		} else {
+			return ERR_INVALID_ARGUMENTS;
+		}
+		presentModeRequested = true;
+	}
+
+	ptrdiff_t culling = shgeti(arguments, "gpu-culling");
+	if (culling >= 0) {
+		if (strcmp(arguments[culling].value, "on") == 0) {
+			gpuCulling = true;
+		} else if (strcmp(arguments[culling].value, "off") != 0) {
+			return ERR_INVALID_ARGUMENTS;
+		}
+	}
+
+	return ERR_OK;
+}
+
+void vulkanFramebufferResizeCallback(GLFWwindow *window, int width,
+				     int height)
 {
 	(void)window;
 	(void)width;
@@ -121,8 +351,8 @@ void framebufferResizeCallback(GLFWwindow *window, int width, int height)
 	framebufferResized = true;
 }
 
-void keyCallback(GLFWwindow *window, int key, int scancode, int action,
-		 int mods)
+void vulkanKeyCallback(GLFWwindow *window, int key, int scancode,
+		       int action, int mods)
 {
 	(void)scancode;
 	(void)mods;
@@ -130,9 +360,17 @@ void keyCallback(GLFWwindow *window, int key, int scancode, int action,
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
 		glfwSetWindowShouldClose(window, GLFW_TRUE);
 	}
+
+	if (key == GLFW_KEY_F3 && action == GLFW_PRESS) {
+		vulkanMemoryReport();
+	}
+
+	if (key == GLFW_KEY_F4 && action == GLFW_PRESS) {
+		latencyReport();
+	}
 }
 
-Error windowInit(void)
+Error vulkanWindowInit(void)
 {
 	if (!glfwInit()) {
 		return ERR_WINDOW_CREATION_FAILED;
@@ -141,24 +379,26 @@ Error windowInit(void)
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 	window = glfwCreateWindow(WIDTH, HEIGHT, ENGINE_NAME, nullptr,
 				  nullptr);
-	glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+	glfwSetFramebufferSizeCallback(window, vulkanFramebufferResizeCallback);
 
 	if (!window) {
 		return ERR_WINDOW_CREATION_FAILED;
 	}
 
-	glfwSetKeyCallback(window, keyCallback);
+	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	glfwSetKeyCallback(window, vulkanKeyCallback);
+	glfwSetCursorPosCallback(window, mouseCallback);
+	glfwSetScrollCallback(window, scrollCallback);
 
 	return ERR_OK;
 }
 
-void processInput(GLFWwindow *window)
+void vulkanProcessInput(GLFWwindow *window)
 {
-	(void)window;
 	glfwPollEvents();
+	processCamera(window);
 }
 
-
 bool checkValidationLayerSupport(void)
 {
 	uint32_t layerCount = 0;
@@ -283,7 +523,7 @@ Error createInstance(void)
 	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 	appInfo.pEngineName = "No Engine";
 	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-	appInfo.apiVersion = VK_API_VERSION_1_0;
+	appInfo.apiVersion = VK_API_VERSION_1_2;
 	appInfo.pNext = nullptr;
 
 	VkInstanceCreateInfo createInfo = { 0 };
@@ -368,10 +608,13 @@ QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device)
 						 queueFamilies);
 
 	QueueFamilyIndices indices = { 0 };
+	/* GPU culling dispatches on the graphics queue. */
+	VkQueueFlags graphicsFlags = VK_QUEUE_GRAPHICS_BIT
+		| (gpuCulling ? VK_QUEUE_COMPUTE_BIT : 0);
 
 	for (int i = 0; i < arrlen(queueFamilies); i++) {
 		VkQueueFamilyProperties queueFamily = queueFamilies[i];
-		if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+		if ((queueFamily.queueFlags & graphicsFlags) == graphicsFlags) {
 			indices.graphicsFamily.value = i;
 			indices.graphicsFamily.exists = true;
 
@@ -382,6 +625,14 @@ QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device)
 				indices.presentFamily.value = i;
 				indices.presentFamily.exists = true;
 			}
+		} else if (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) {
+			/* Transfer-only families are the DMA engines. */
+			bool transferOnly =
+				!(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT);
+			if (!indices.transferFamily.exists || transferOnly) {
+				indices.transferFamily.value = i;
+				indices.transferFamily.exists = true;
+			}
 		}
 	}
 
@@ -422,6 +673,27 @@ bool checkDeviceExtensionSupport(VkPhysicalDevice device)
 	return supported;
 }
 
+bool isDeviceExtensionAvailable(VkPhysicalDevice device, const char *name)
+{
+	uint32_t extensionCount = 0;
+	VkExtensionProperties *availableExtensions = nullptr;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+					     nullptr);
+	arrsetlen(availableExtensions, extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+					     availableExtensions);
+
+	bool available = false;
+	for (uint32_t i = 0; i < extensionCount; i++) {
+		available |= strcmp(availableExtensions[i].extensionName, name)
+			== 0;
+	}
+
+	arrfree(availableExtensions);
+
+	return available;
+}
+
 VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR *capabilities)
 {
 	if (capabilities->currentExtent.width != UINT32_MAX) {
@@ -447,7 +719,9 @@ VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR *capabilities)
 	return actualExtent;
 }
 
-/* Return VK_PRESENT_MODE_MAILBOX_KHR if present, otherwise
+/* Return the mode requested with --present-mode if present, otherwise
+ * VK_PRESENT_MODE_FIFO_KHR, which is always supported. Without a request,
+ * return VK_PRESENT_MODE_MAILBOX_KHR if present, otherwise
  * VK_PRESENT_MODE_FIFO_KHR. */
 VkPresentModeKHR
 chooseSwapPresentMode(const VkPresentModeKHR *availablePresentModes,
@@ -455,14 +729,24 @@ chooseSwapPresentMode(const VkPresentModeKHR *availablePresentModes,
 {
 	assert(availablePresentModesLength >= 1);
 
+	VkPresentModeKHR wanted = presentModeRequested
+		? requestedPresentMode
+		: VK_PRESENT_MODE_MAILBOX_KHR;
 	for (uint32_t i = 0; i < availablePresentModesLength; i++) {
 		VkPresentModeKHR availablePresentMode =
 			availablePresentModes[i];
-		if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
+		if (availablePresentMode == wanted) {
 			return availablePresentMode;
 		}
 	}
 
+	if (presentModeRequested && wanted != VK_PRESENT_MODE_FIFO_KHR) {
+		(void)fprintf(stderr,
+			      "Present mode %s unavailable, using fifo\n",
+			      presentModeName(wanted));
+		/* Warn once, swapchains are recreated on every resize. */
+		requestedPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+	}
 	return VK_PRESENT_MODE_FIFO_KHR;
 }
 
@@ -517,6 +801,88 @@ SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device)
 	return details;
 }
 
+/* Descriptor indexing, for the bindless set, timeline semaphores, for frame
+ * pacing, and indirect draw counts for GPU culling. */
+void getRequiredFeatures12(VkPhysicalDeviceVulkan12Features *features)
+{
+	*features = (VkPhysicalDeviceVulkan12Features){};
+	features->sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	features->descriptorIndexing = VK_TRUE;
+	features->runtimeDescriptorArray = VK_TRUE;
+	features->descriptorBindingPartiallyBound = VK_TRUE;
+	features->descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	features->descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+	features->descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+	features->shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	features->shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+	features->timelineSemaphore = VK_TRUE;
+	features->drawIndirectCount = gpuCulling;
+}
+
+bool checkDeviceFeatureSupport(VkPhysicalDevice device)
+{
+	VkPhysicalDeviceProperties properties = {};
+	vkGetPhysicalDeviceProperties(device, &properties);
+	if (properties.apiVersion < VK_API_VERSION_1_2) {
+		return false;
+	}
+
+	VkPhysicalDeviceVulkan12Features features12 = {};
+	features12.sType =
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceFeatures2 features = {};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &features12;
+	vkGetPhysicalDeviceFeatures2(device, &features);
+
+	VkPhysicalDeviceVulkan12Features required = {};
+	getRequiredFeatures12(&required);
+
+	return (!required.descriptorIndexing || features12.descriptorIndexing)
+		&& (!required.runtimeDescriptorArray
+		    || features12.runtimeDescriptorArray)
+		&& (!required.descriptorBindingPartiallyBound
+		    || features12.descriptorBindingPartiallyBound)
+		&& (!required.descriptorBindingSampledImageUpdateAfterBind
+		    || features12.descriptorBindingSampledImageUpdateAfterBind)
+		&& (!required.descriptorBindingStorageBufferUpdateAfterBind
+		    || features12.descriptorBindingStorageBufferUpdateAfterBind)
+		&& (!required.descriptorBindingUpdateUnusedWhilePending
+		    || features12.descriptorBindingUpdateUnusedWhilePending)
+		&& (!required.shaderSampledImageArrayNonUniformIndexing
+		    || features12.shaderSampledImageArrayNonUniformIndexing)
+		&& (!required.shaderStorageBufferArrayNonUniformIndexing
+		    || features12.shaderStorageBufferArrayNonUniformIndexing)
+		&& (!required.timelineSemaphore || features12.timelineSemaphore)
+		&& (!required.drawIndirectCount || features12.drawIndirectCount)
+		&& (!gpuCulling || features.features.drawIndirectFirstInstance);
+}
+
+/* VK_KHR_present_wait, to measure latency up to presentation. */
+bool isPresentWaitSupported(VkPhysicalDevice device)
+{
+	if (!isDeviceExtensionAvailable(device,
+					VK_KHR_PRESENT_ID_EXTENSION_NAME)
+	    || !isDeviceExtensionAvailable(device,
+					   VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+		return false;
+	}
+
+	VkPhysicalDevicePresentWaitFeaturesKHR presentWait = {};
+	presentWait.sType =
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+	VkPhysicalDevicePresentIdFeaturesKHR presentId = {};
+	presentId.sType =
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+	presentId.pNext = &presentWait;
+	VkPhysicalDeviceFeatures2 features = {};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &presentId;
+	vkGetPhysicalDeviceFeatures2(device, &features);
+
+	return presentId.presentId && presentWait.presentWait;
+}
+
 bool isDeviceSuitable(VkPhysicalDevice device)
 {
 	QueueFamilyIndices indices = findQueueFamilies(device);
@@ -530,7 +896,8 @@ bool isDeviceSuitable(VkPhysicalDevice device)
 		swapChainAdequate = swapChainSupport.formatsLength > 0 &&
 				    swapChainSupport.presentModesLength > 0;
 	}
-	return indicesComplete && extensionsSupported && swapChainAdequate;
+	return indicesComplete && extensionsSupported && swapChainAdequate
+		&& checkDeviceFeatureSupport(device);
 }
 
 bool isDeviceDiscreteGPU(VkPhysicalDevice device)
@@ -591,9 +958,8 @@ Error createSwapChain(void)
 		querySwapChainSupport(physicalDevice);
 	VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(
 		swapChainSupport.formats, swapChainSupport.formatsLength);
-	VkPresentModeKHR presentMode =
-		chooseSwapPresentMode(swapChainSupport.presentModes,
-				      swapChainSupport.presentModesLength);
+	presentMode = chooseSwapPresentMode(swapChainSupport.presentModes,
+					    swapChainSupport.presentModesLength);
 	VkExtent2D extent = chooseSwapExtent(&swapChainSupport.capabilities);
 
 	uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
@@ -617,6 +983,9 @@ Error createSwapChain(void)
 	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	createInfo.presentMode = presentMode;
 	createInfo.clipped = VK_TRUE;
+	/* Lets the presentation engine reuse resources, and keep presenting
+	 * the images already queued. */
+	createInfo.oldSwapchain = swapChain;
 
 	QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 	uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value,
@@ -632,8 +1001,19 @@ Error createSwapChain(void)
 		createInfo.pQueueFamilyIndices = nullptr; /* Optional */
 	}
 
-	if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) !=
-	    VK_SUCCESS) {
+	VkSwapchainKHR newSwapChain = VK_NULL_HANDLE;
+	VkResult result = vkCreateSwapchainKHR(device, &createInfo, nullptr,
+					       &newSwapChain);
+	/* Retired even if the creation failed. */
+	if (swapChain != VK_NULL_HANDLE) {
+		vulkanDeletionRetire(&deletions, (VulkanDeletion){
+			.value = frameValue,
+			.kind = VULKAN_DELETION_SWAPCHAIN,
+			.swapchain = swapChain,
+		});
+	}
+	swapChain = newSwapChain;
+	if (result != VK_SUCCESS) {
 		return ERR_SWAP_CHAIN_CREATION_FAILED;
 	}
 
@@ -651,35 +1031,80 @@ Error createLogicalDevice(void)
 {
 	QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
-	/* Graphics queue, and maybe present queue if they're the same. */
-	VkDeviceQueueCreateInfo queuesCreateInfo[2] = { 0 };
-	size_t queuesCreateInfoLength = 1;
+	/* One queue per family among the graphics, present and transfer
+	 * ones. */
+	uint32_t families[] = {
+		indices.graphicsFamily.value,
+		indices.presentFamily.value,
+		indices.transferFamily.exists ? indices.transferFamily.value
+					      : indices.graphicsFamily.value,
+	};
+	VkDeviceQueueCreateInfo queuesCreateInfo[3] = { 0 };
+	size_t queuesCreateInfoLength = 0;
 	float queuePriority = 1.0f;
-	queuesCreateInfo[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-	queuesCreateInfo[0].queueFamilyIndex = indices.graphicsFamily.value;
-	queuesCreateInfo[0].queueCount = 1;
-	queuesCreateInfo[0].pQueuePriorities = &queuePriority;
+	for (size_t i = 0; i < ARRAY_COUNT_STATIC(families); i++) {
+		bool created = false;
+		for (size_t j = 0; j < queuesCreateInfoLength; j++) {
+			created |= queuesCreateInfo[j].queueFamilyIndex
+				== families[i];
+		}
+		if (created) {
+			continue;
+		}
 
-	/* Present queue if it is different from graphics queue. */
-	if (indices.graphicsFamily.value != indices.presentFamily.value) {
-		queuesCreateInfoLength = 2;
-		queuesCreateInfo[1].sType =
+		VkDeviceQueueCreateInfo *queueCreateInfo =
+			&queuesCreateInfo[queuesCreateInfoLength++];
+		queueCreateInfo->sType =
 			VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-		queuesCreateInfo[1].queueFamilyIndex =
-			indices.presentFamily.value;
-		queuesCreateInfo[1].queueCount = 1;
-		queuesCreateInfo[1].pQueuePriorities = &queuePriority;
+		queueCreateInfo->queueFamilyIndex = families[i];
+		queueCreateInfo->queueCount = 1;
+		queueCreateInfo->pQueuePriorities = &queuePriority;
 	}
 
 	VkPhysicalDeviceFeatures deviceFeatures = { 0 };
+	/* GPU culling draws take the object index as first instance. */
+	deviceFeatures.drawIndirectFirstInstance = gpuCulling;
 
 	VkDeviceCreateInfo createInfo = { 0 };
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	createInfo.pQueueCreateInfos = queuesCreateInfo;
 	createInfo.queueCreateInfoCount = queuesCreateInfoLength;
 	createInfo.pEnabledFeatures = &deviceFeatures;
-	createInfo.enabledExtensionCount = ARRAY_COUNT_STATIC(deviceExtensions);
-	createInfo.ppEnabledExtensionNames = deviceExtensions;
+
+	VkPhysicalDeviceVulkan12Features features12 = {};
+	getRequiredFeatures12(&features12);
+	createInfo.pNext = &features12;
+
+	/* Required extensions, then the optional ones available. */
+	const char *extensions[ARRAY_COUNT_STATIC(deviceExtensions) + 3] = {};
+	uint32_t extensionCount = 0;
+	for (size_t i = 0; i < ARRAY_COUNT_STATIC(deviceExtensions); i++) {
+		extensions[extensionCount++] = deviceExtensions[i];
+	}
+	hasMemoryBudget = isDeviceExtensionAvailable(
+		physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	if (hasMemoryBudget) {
+		extensions[extensionCount++] =
+			VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+	}
+	VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = {};
+	presentIdFeatures.sType =
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+	presentIdFeatures.presentId = VK_TRUE;
+	VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {};
+	presentWaitFeatures.sType =
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+	presentWaitFeatures.presentWait = VK_TRUE;
+	hasPresentWait = isPresentWaitSupported(physicalDevice);
+	if (hasPresentWait) {
+		extensions[extensionCount++] = VK_KHR_PRESENT_ID_EXTENSION_NAME;
+		extensions[extensionCount++] =
+			VK_KHR_PRESENT_WAIT_EXTENSION_NAME;
+		features12.pNext = &presentIdFeatures;
+		presentIdFeatures.pNext = &presentWaitFeatures;
+	}
+	createInfo.enabledExtensionCount = extensionCount;
+	createInfo.ppEnabledExtensionNames = extensions;
 
 	if (ENABLE_VALIDATION_LAYERS) {
 		createInfo.enabledLayerCount =
@@ -697,6 +1122,7 @@ Error createLogicalDevice(void)
 	vkGetDeviceQueue(device, indices.graphicsFamily.value, 0,
 			 &graphicsQueue);
 	vkGetDeviceQueue(device, indices.presentFamily.value, 0, &presentQueue);
+	vkGetDeviceQueue(device, families[2], 0, &transferQueue);
 
 	return ERR_OK;
 }
@@ -743,6 +1169,73 @@ Error createImageViews(void)
 	return ERR_OK;
 }
 
+/* Vulkan guarantees one of the first two as a depth attachment. */
+VkFormat chooseDepthFormat(void)
+{
+	static constexpr VkFormat candidates[] = {
+		VK_FORMAT_D32_SFLOAT,
+		VK_FORMAT_X8_D24_UNORM_PACK32,
+		VK_FORMAT_D24_UNORM_S8_UINT,
+	};
+	for (size_t i = 0; i < ARRAY_COUNT_STATIC(candidates); i++) {
+		VkFormatProperties properties = {};
+		vkGetPhysicalDeviceFormatProperties(physicalDevice,
+						    candidates[i],
+						    &properties);
+		if (properties.optimalTilingFeatures
+		    & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+			return candidates[i];
+		}
+	}
+	return VK_FORMAT_D32_SFLOAT;
+}
+
+/* Sized to the swapchain, and recreated with it. */
+Error createDepthResources(void)
+{
+	depthFormat = chooseDepthFormat();
+
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = depthFormat;
+	imageInfo.extent.width = swapChainExtent.width;
+	imageInfo.extent.height = swapChainExtent.height;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	Error e = vulkanCreateImage(&imageInfo,
+				    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				    &depthImage);
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = depthImage.image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = depthFormat;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	if (vkCreateImageView(device, &viewInfo, nullptr, &depthImageView)
+	    != VK_SUCCESS) {
+		return ERR_IMAGE_VIEW_CREATION_FAILED;
+	}
+
+	return ERR_OK;
+}
+
 Error createRenderPass(void)
 {
 	VkAttachmentDescription colorAttachment = {};
@@ -755,31 +1248,58 @@ Error createRenderPass(void)
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
+	VkAttachmentDescription depthAttachment = {};
+	depthAttachment.format = depthFormat;
+	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depthAttachment.finalLayout =
+		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
 	VkAttachmentReference colorAttachmentRef = {};
 	colorAttachmentRef.attachment = 0;
 	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+	VkAttachmentReference depthAttachmentRef = {};
+	depthAttachmentRef.attachment = 1;
+	depthAttachmentRef.layout =
+		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
 	VkSubpassDescription subpass = {};
 	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 	subpass.colorAttachmentCount = 1;
 	subpass.pColorAttachments = &colorAttachmentRef;
+	subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
+	VkAttachmentDescription attachments[] = {
+		colorAttachment,
+		depthAttachment,
+	};
 	VkRenderPassCreateInfo renderPassInfo = {};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassInfo.attachmentCount = 1;
-	renderPassInfo.pAttachments = &colorAttachment;
+	renderPassInfo.attachmentCount = ARRAY_COUNT_STATIC(attachments);
+	renderPassInfo.pAttachments = attachments;
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpass;
 
 	VkSubpassDependency dependency = {};
 	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
 	dependency.dstSubpass = 0;
+	/* The depth buffer is shared by the frames in flight, so the previous
+	 * frame's depth writes are waited on too. */
 	dependency.srcStageMask =
-		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+		| VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependency.srcAccessMask =
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 	dependency.dstStageMask =
-		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+		| VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+		| VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
 	renderPassInfo.dependencyCount = 1;
 	renderPassInfo.pDependencies = &dependency;
@@ -810,33 +1330,139 @@ Error createShaderModule(const char *code, size_t length, VkShaderModule *module
 	return ERR_OK;
 }
 
-VkVertexInputBindingDescription vertexGetBindingDescription(void)
+VkFormat vertexFormatToVulkan(VertexFormat format)
+{
+	switch (format) {
+	case VERTEX_FORMAT_NONE:
+		break;
+	case VERTEX_FORMAT_FLOAT2:
+		return VK_FORMAT_R32G32_SFLOAT;
+	case VERTEX_FORMAT_FLOAT3:
+		return VK_FORMAT_R32G32B32_SFLOAT;
+	case VERTEX_FORMAT_HALF2:
+		return VK_FORMAT_R16G16_SFLOAT;
+	case VERTEX_FORMAT_UNORM16X4:
+		return VK_FORMAT_R16G16B16A16_UNORM;
+	case VERTEX_FORMAT_OCT_UNORM16X2:
+		return VK_FORMAT_R16G16_UNORM;
+	}
+	return VK_FORMAT_UNDEFINED;
+}
+
+/* One binding per stream of `layout`. Returns the binding count. */
+uint32_t vertexGetBindingDescriptions(
+	const VertexLayout *layout,
+	VkVertexInputBindingDescription bindingsOut[VERTEX_MAX_STREAMS])
 {
-	VkVertexInputBindingDescription bindingDescription = {};
+	for (uint32_t i = 0; i < layout->streamCount; i++) {
+		bindingsOut[i] = (VkVertexInputBindingDescription){
+			.binding = i,
+			.stride = layout->strides[i],
+			.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+		};
+	}
 
-	bindingDescription.binding = 0;
-	bindingDescription.stride = sizeof(Vertex);
-	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	return layout->streamCount;
+}
 
-	return bindingDescription;
+/* Returns the attribute count. */
+uint32_t vertexGetAttributeDescriptions(
+	const VertexLayout *layout,
+	VkVertexInputAttributeDescription attributesOut[VERTEX_MAX_ATTRIBUTES])
+{
+	for (uint32_t i = 0; i < layout->attributeCount; i++) {
+		const VertexAttribute *attribute = &layout->attributes[i];
+		attributesOut[i] = (VkVertexInputAttributeDescription){
+			.location = attribute->location,
+			.binding = attribute->stream,
+			.format = vertexFormatToVulkan(attribute->format),
+			.offset = attribute->offset,
+		};
+	}
+
+	return layout->attributeCount;
 }
 
-struct AttributeDescriptions vertexGetAttributeDescriptions(void)
+/* The driver validates the blob too, but some drivers crash on foreign data,
+ * so check the header against this device first. */
+bool pipelineCacheValid(const void *blob, size_t size,
+			const VkPhysicalDeviceProperties *properties)
 {
-	struct AttributeDescriptions attributeDescriptions = {};
+	VkPipelineCacheHeaderVersionOne header;
+	if (size < sizeof(header)) {
+		return false;
+	}
+	memcpy(&header, blob, sizeof(header));
+
+	return header.headerSize >= sizeof(header)
+		&& header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		&& header.vendorID == properties->vendorID
+		&& header.deviceID == properties->deviceID
+		&& memcmp(header.pipelineCacheUUID,
+			  properties->pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
 
-	attributeDescriptions.descriptions[0].binding = 0;
-	attributeDescriptions.descriptions[0].location = 0;
-	attributeDescriptions.descriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
-	attributeDescriptions.descriptions[0].offset = offsetof(Vertex, pos);
+/* Seed the pipeline cache from the previous run. Without a cache, pipelines
+ * are simply built from scratch, so failures are not fatal. */
+void createPipelineCache(void)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	pipelineCacheKey = cacheHash(CACHE_HASH_SEED, &properties.vendorID,
+				     sizeof(properties.vendorID));
+	pipelineCacheKey = cacheHash(pipelineCacheKey, &properties.deviceID,
+				     sizeof(properties.deviceID));
+
+	size_t size = 0;
+	void *blob = cacheLoad("vk", pipelineCacheKey, &size);
+	if (blob != nullptr && !pipelineCacheValid(blob, size, &properties)) {
+		free(blob);
+		blob = nullptr;
+		size = 0;
+	}
+
+	VkPipelineCacheCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = size;
+	createInfo.pInitialData = blob;
+
+	VkResult vkE = vkCreatePipelineCache(device, &createInfo, nullptr,
+					     &pipelineCache);
+	if (vkE != VK_SUCCESS && blob != nullptr) {
+		/* Rejected, start over with an empty cache. */
+		createInfo.initialDataSize = 0;
+		createInfo.pInitialData = nullptr;
+		vkE = vkCreatePipelineCache(device, &createInfo, nullptr,
+					    &pipelineCache);
+	}
+	if (vkE != VK_SUCCESS) {
+		pipelineCache = VK_NULL_HANDLE;
+	}
+	free(blob);
+}
+
+void savePipelineCache(void)
+{
+	if (pipelineCache == VK_NULL_HANDLE) {
+		return;
+	}
 
-	attributeDescriptions.descriptions[1].binding = 0;
-	attributeDescriptions.descriptions[1].location = 1;
-	attributeDescriptions.descriptions[1].format =
-		VK_FORMAT_R32G32B32_SFLOAT;
-	attributeDescriptions.descriptions[1].offset = offsetof(Vertex, color);
+	size_t size = 0;
+	if (vkGetPipelineCacheData(device, pipelineCache, &size, nullptr)
+	    != VK_SUCCESS || size == 0) {
+		return;
+	}
 
-	return attributeDescriptions;
+	void *blob = malloc(size);
+	if (blob == nullptr) {
+		return;
+	}
+	if (vkGetPipelineCacheData(device, pipelineCache, &size, blob)
+	    == VK_SUCCESS) {
+		cacheStore("vk", pipelineCacheKey, blob, size);
+	}
+	free(blob);
 }
 
 Error createGraphicsPipeline(void)
@@ -888,20 +1514,21 @@ Error createGraphicsPipeline(void)
 	};
 
 	/* Vertex input */
-	VkVertexInputBindingDescription bindingDescription
-		= vertexGetBindingDescription();
-	struct AttributeDescriptions attributeDescriptions
-		= vertexGetAttributeDescriptions();
+	VkVertexInputBindingDescription bindingDescriptions[VERTEX_MAX_STREAMS];
+	VkVertexInputAttributeDescription
+		attributeDescriptions[VERTEX_MAX_ATTRIBUTES];
 
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
 	vertexInputInfo.sType =
 		VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.vertexAttributeDescriptionCount
-		= ARRAY_COUNT_STATIC(attributeDescriptions.descriptions);
-	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-	vertexInputInfo.pVertexAttributeDescriptions
-		= attributeDescriptions.descriptions;
+	vertexInputInfo.vertexBindingDescriptionCount =
+		vertexGetBindingDescriptions(&vertexLayout,
+					     bindingDescriptions);
+	vertexInputInfo.vertexAttributeDescriptionCount =
+		vertexGetAttributeDescriptions(&vertexLayout,
+					       attributeDescriptions);
+	vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions;
+	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions;
 
 	/* Input assembly */
 	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
@@ -954,7 +1581,8 @@ Error createGraphicsPipeline(void)
 	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
 	rasterizer.lineWidth = 1.0f;
 	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+	/* Counter-clockwise as in OpenGL, the projection flipping Y. */
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 	rasterizer.depthBiasEnable = VK_FALSE;
 	rasterizer.depthBiasConstantFactor = 0.0f;
 	rasterizer.depthBiasClamp = 0.0f;
@@ -972,7 +1600,14 @@ Error createGraphicsPipeline(void)
 	multisampling.alphaToOneEnable = VK_FALSE;
 
 	/* Depth and stencil testing */
-	/* ¯\_(ツ)_/¯ */
+	VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+	depthStencil.sType =
+		VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = VK_TRUE;
+	depthStencil.depthWriteEnable = VK_TRUE;
+	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+	depthStencil.depthBoundsTestEnable = VK_FALSE;
+	depthStencil.stencilTestEnable = VK_FALSE;
 
 	/* Color bending */
 	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
@@ -1004,10 +1639,16 @@ Error createGraphicsPipeline(void)
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
 	pipelineLayoutInfo.sType =
 		VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 0;
-	pipelineLayoutInfo.pSetLayouts = nullptr;
-	pipelineLayoutInfo.pushConstantRangeCount = 0;
-	pipelineLayoutInfo.pPushConstantRanges = nullptr;
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT
+		| VK_SHADER_STAGE_FRAGMENT_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(DrawConstants);
+
+	pipelineLayoutInfo.setLayoutCount = VULKAN_SET_COUNT;
+	pipelineLayoutInfo.pSetLayouts = descriptors.layouts;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
 	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
 				   &pipelineLayout) != VK_SUCCESS) {
@@ -1025,7 +1666,7 @@ Error createGraphicsPipeline(void)
 	pipelineInfo.pViewportState = &viewportState;
 	pipelineInfo.pRasterizationState = &rasterizer;
 	pipelineInfo.pMultisampleState = &multisampling;
-	pipelineInfo.pDepthStencilState = nullptr; // Optional
+	pipelineInfo.pDepthStencilState = &depthStencil;
 	pipelineInfo.pColorBlendState = &colorBlending;
 	pipelineInfo.pDynamicState = &dynamicState;
 	pipelineInfo.layout = pipelineLayout;
@@ -1034,7 +1675,7 @@ Error createGraphicsPipeline(void)
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 	pipelineInfo.basePipelineIndex = -1;
 
-	VkResult vkE = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1,
+	VkResult vkE = vkCreateGraphicsPipelines(device, pipelineCache, 1,
 						 &pipelineInfo, nullptr,
 						 &graphicsPipeline);
 
@@ -1053,13 +1694,15 @@ Error createFramebuffers(void)
 	arrsetlen(swapChainFramebuffers, swapChainImageViewsLength);
 	for (size_t i = 0; i < swapChainImageViewsLength; i++) {
 		VkImageView attachments[] = {
-			swapChainImageViews[i]
+			swapChainImageViews[i],
+			depthImageView,
 		};
 		VkFramebufferCreateInfo framebufferInfo = {};
 		framebufferInfo.sType =
 			VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 		framebufferInfo.renderPass = renderPass;
-		framebufferInfo.attachmentCount = 1;
+		framebufferInfo.attachmentCount =
+			ARRAY_COUNT_STATIC(attachments);
 		framebufferInfo.pAttachments = attachments;
 		framebufferInfo.width = swapChainExtent.width;
 		framebufferInfo.height = swapChainExtent.height;
@@ -1095,7 +1738,7 @@ Error createCommandPool(void)
 
 Error createCommandBuffers(void)
 {
-	arrsetlen(commandBuffers, MAX_FRAMES_IN_FLIGHT);
+	arrsetlen(commandBuffers, framesInFlight);
 
 	VkCommandBufferAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -1111,99 +1754,332 @@ Error createCommandBuffers(void)
 	return ERR_OK;
 }
 
-/* Return -1 if there are no suitable memory types. */
-uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+Error createStaging(void)
 {
-	VkPhysicalDeviceMemoryProperties memProperties;
-	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+	QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
-	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-		if (typeFilter & (1 << i)
-		    && (memProperties.memoryTypes[i].propertyFlags
-			& properties) == properties) {
-			return i;
-		}
+	VulkanStagingDesc desc = {};
+	desc.device = device;
+	desc.graphicsQueue = graphicsQueue;
+	desc.graphicsFamily = indices.graphicsFamily.value;
+	desc.transferQueue = transferQueue;
+	desc.transferFamily = indices.transferFamily.exists
+		? indices.transferFamily.value
+		: indices.graphicsFamily.value;
+	desc.size = VULKAN_STAGING_SIZE;
+
+	return vulkanStagingInit(&staging, &desc);
+}
+
+/* Device-local, filled by createMesh(). */
+Error createVertexBuffer(void)
+{
+	return vulkanCreateBuffer(MESH_MAX_VERTICES * sizeof(Vertex),
+				  VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+				  | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+				  | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				  &vertexBuffer);
+}
+
+Error createDescriptors(void)
+{
+	return vulkanDescriptorsInit(&descriptors, device, physicalDevice,
+				     framesInFlight);
+}
+
+/* Device-local tints, filled by createMaterial(). Without
+ * VK_BUFFER_USAGE_TRANSFER_SRC_BIT, so defragmentation leaves it where its
+ * bindless descriptor points. */
+Error createMaterialBuffer(void)
+{
+	Error e = vulkanCreateBuffer(MAX_MATERIALS * sizeof(vec4),
+				     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+				     | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				     &materialBuffer);
+	if (e != ERR_OK) {
+		return e;
 	}
 
-	return (uint32_t)-1;
+	return vulkanDescriptorsAddBuffer(&descriptors, materialBuffer.buffer, 0,
+					  VK_WHOLE_SIZE, &materialBufferIndex);
 }
 
-Error createVertexBuffer(void)
+/* Device-local, filled by createMesh(). */
+Error createIndexBuffer(void)
 {
-	VkBufferCreateInfo bufferInfo = {};
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.size = sizeof(vertices);
-	bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	return vulkanCreateBuffer(MESH_MAX_INDICES * sizeof(uint32_t),
+				  VK_BUFFER_USAGE_INDEX_BUFFER_BIT
+				  | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+				  | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				  &indexBuffer);
+}
 
-	if (vkCreateBuffer(device, &bufferInfo, nullptr, &vertexBuffer)
-	    != VK_SUCCESS) {
-		return ERR_SHADER_CREATION_FAILED;
+/* Append a mesh to the geometry buffers, uploaded by the next staging flush,
+ * at the latest when the next frame begins. */
+Error addMesh(const Vertex *meshVertices, uint32_t vertexCount,
+	      const uint32_t *meshIndices, uint32_t indexCount,
+	      MeshID *meshOut)
+{
+	if (vertexCount > MESH_MAX_VERTICES - meshVertexCount
+	    || indexCount > MESH_MAX_INDICES - meshIndexCount) {
+		return ERR_OUT_OF_MEMORY;
+	}
+
+	Error e = vulkanStagingUpload(&staging, vertexBuffer.buffer,
+				      meshVertexCount * sizeof(Vertex),
+				      meshVertices,
+				      vertexCount * sizeof(Vertex),
+				      VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+				      VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+	if (e != ERR_OK) {
+		return e;
+	}
+	e = vulkanStagingUpload(&staging, indexBuffer.buffer,
+				meshIndexCount * sizeof(uint32_t), meshIndices,
+				indexCount * sizeof(uint32_t),
+				VK_ACCESS_INDEX_READ_BIT,
+				VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+	if (e != ERR_OK) {
+		return e;
 	}
 
-	VkMemoryRequirements memRequirements = {};
-	vkGetBufferMemoryRequirements(device, vertexBuffer, &memRequirements);
+	VulkanMesh mesh = {};
+	mesh.indexCount = indexCount;
+	mesh.firstIndex = meshIndexCount;
+	mesh.vertexOffset = (int32_t)meshVertexCount;
 
-	uint32_t memoryTypeIndex =
-		findMemoryType(memRequirements.memoryTypeBits,
-			       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-			       | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	if (memoryTypeIndex == (uint32_t)-1) {
-		return ERR_SHADER_CREATION_FAILED;
+	/* Sphere around the bounding box of the vertices. */
+	vec3 min = {FLT_MAX, FLT_MAX, FLT_MAX};
+	vec3 max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+	for (uint32_t i = 0; i < vertexCount; i++) {
+		glm_vec3_minv(min, (float *)meshVertices[i].pos, min);
+		glm_vec3_maxv(max, (float *)meshVertices[i].pos, max);
 	}
+	glm_vec3_center(min, max, mesh.bounds);
+	mesh.bounds[3] = glm_vec3_distance(min, max) * 0.5f;
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = memoryTypeIndex;
+	meshVertexCount += vertexCount;
+	meshIndexCount += indexCount;
+	*meshOut = (MeshID)arrlen(meshes);
+	arrput(meshes, mesh);
+	return ERR_OK;
+}
 
-	if (vkAllocateMemory(device, &allocInfo, nullptr, &vertexBufferMemory)
-	    != VK_SUCCESS) {
-		return ERR_SHADER_CREATION_FAILED;
+/* The finest level of the cooked mesh `name`, in flat grey until this
+ * renderer has lighting. */
+Error addCookedMesh(const char *name, MeshID *meshOut)
+{
+	char path[MESH_PATH_SIZE];
+	(void)snprintf(path, sizeof(path), COOKED_RESOURCE_PATH "/%s.mesh",
+		       name);
+
+	MappedMesh mapped;
+	Error e = meshMap(&mapped, path);
+	if (e != ERR_OK) {
+		return e;
 	}
 
-	vkBindBufferMemory(device, vertexBuffer, vertexBufferMemory, 0);
+	uint32_t vertexCount = mapped.header->vertexCount;
+	uint32_t indexCount = mapped.header->lods[0].indexCount;
+	float (*positions)[3] = malloc(sizeof(float[3]) * vertexCount);
+	Vertex *meshVertices = malloc(sizeof(Vertex) * vertexCount);
+	uint32_t *meshIndices = malloc(sizeof(uint32_t) * indexCount);
+	if (positions == nullptr || meshVertices == nullptr
+	    || meshIndices == nullptr) {
+		e = ERR_OUT_OF_MEMORY;
+	} else if (!meshDecodePositions(&mapped, positions)) {
+		e = ERR_MESH_LOADING_FAILED;
+	} else {
+		meshDecodeIndices(&mapped, mapped.header->lods[0].indexOffset,
+				  indexCount, meshIndices);
+		for (uint32_t i = 0; i < vertexCount; i++) {
+			glm_vec3_copy(positions[i], meshVertices[i].pos);
+			glm_vec3_fill(meshVertices[i].color, 0.8f);
+		}
+		e = addMesh(meshVertices, vertexCount, meshIndices, indexCount,
+			    meshOut);
+	}
 
-	void *data = NULL;
-	vkMapMemory(device, vertexBufferMemory, 0, bufferInfo.size, 0, &data);
-	memcpy(data, vertices, (size_t)bufferInfo.size);
-	vkUnmapMemory(device, vertexBufferMemory);
+	free(positions);
+	free(meshVertices);
+	free(meshIndices);
+	meshUnmap(&mapped);
+	return e;
+}
 
+/* "cube" is the one above, shaded by face, others are cooked. */
+Error vulkanCreateMesh(const char *name, MeshID *meshOut)
+{
+	if (strcmp(name, "cube") == 0) {
+		return addMesh(vertices, ARRAY_COUNT_STATIC(vertices), indices,
+			       ARRAY_COUNT_STATIC(indices), meshOut);
+	}
+	return addCookedMesh(name, meshOut);
+}
+
+/* Only the color, this renderer having neither textures nor lighting yet.
+ * Uploaded by the next staging flush. */
+Error vulkanCreateMaterial(const MaterialDesc *desc, MaterialID *materialOut)
+{
+	if (materialCount >= MAX_MATERIALS) {
+		return ERR_OUT_OF_MEMORY;
+	}
+
+	Error e = vulkanStagingUpload(&staging, materialBuffer.buffer,
+				      materialCount * sizeof(vec4), desc->color,
+				      sizeof(vec4), VK_ACCESS_SHADER_READ_BIT,
+				      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	*materialOut = (MaterialID)materialCount++;
 	return ERR_OK;
 }
 
-Error recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+/* The stages using buffers of `usage` after a copy into them, and with what
+ * access in `accessOut`. */
+VkPipelineStageFlags bufferStages(VkBufferUsageFlags usage,
+				  VkAccessFlags *accessOut)
 {
-	VkCommandBufferBeginInfo beginInfo = {};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = 0;
-	beginInfo.pInheritanceInfo = nullptr;
+	VkPipelineStageFlags stages = 0;
+	VkAccessFlags access = 0;
+	constexpr VkPipelineStageFlags shaders =
+		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+		| VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
+		| VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 
-	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-		/* Failed to begin recording command buffer. */
-		return ERR_COMMAND_BUFFER_RECORDING_FAILED;
+	if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT) {
+		stages |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+		access |= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	}
+	if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) {
+		stages |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+		access |= VK_ACCESS_INDEX_READ_BIT;
+	}
+	if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) {
+		stages |= shaders;
+		access |= VK_ACCESS_UNIFORM_READ_BIT;
+	}
+	if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) {
+		stages |= shaders;
+		access |= VK_ACCESS_SHADER_READ_BIT
+			| VK_ACCESS_SHADER_WRITE_BIT;
+	}
+	if (usage & VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT) {
+		stages |= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+		access |= VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	}
+	if (usage & VK_BUFFER_USAGE_TRANSFER_SRC_BIT) {
+		stages |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+		access |= VK_ACCESS_TRANSFER_READ_BIT;
+	}
+	if (usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT) {
+		stages |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+		access |= VK_ACCESS_TRANSFER_WRITE_BIT;
 	}
 
-	VkRenderPassBeginInfo renderPassInfo = {};
-	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassInfo.renderPass = renderPass;
-	renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
-	renderPassInfo.renderArea.offset.x = 0;
-	renderPassInfo.renderArea.offset.y = 0;
-	renderPassInfo.renderArea.extent = swapChainExtent;
+	*accessOut = access;
+	return stages;
+}
+
+/* Start a defragmentation pass, copying the buffers moved to their new
+ * ranges. Later commands use the new buffers. */
+void defragmentBegin(VkCommandBuffer commandBuffer)
+{
+	if (defragment.moveCount > 0) {
+		return;
+	}
+
+	defragment.moveCount = vulkanMemoryDefragmentBegin(defragment.moves,
+							   DEFRAGMENT_MOVES);
+	defragment.frame = currentFrame;
+	if (defragment.moveCount == 0) {
+		return;
+	}
+	/* Recordings reference the buffers moved. */
+	vulkanRecordInvalidate(&recorder);
+
+	/* The moved buffers' users wait for the copies. */
+	VkPipelineStageFlags stages = 0;
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	for (uint32_t i = 0; i < defragment.moveCount; i++) {
+		VulkanMove *move = &defragment.moves[i];
+		VulkanBuffer *buffer = move->allocation->user;
+		defragment.oldBuffers[i] = VK_NULL_HANDLE;
+
+		VkBufferCreateInfo bufferInfo = {};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = buffer->size;
+		bufferInfo.usage = buffer->usage;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		VkBuffer moved = VK_NULL_HANDLE;
+		if (vkCreateBuffer(device, &bufferInfo, nullptr, &moved)
+		    != VK_SUCCESS) {
+			vulkanMemoryDefragmentCancel(move);
+			continue;
+		}
+		if (vkBindBufferMemory(device, moved, move->block->memory,
+				       move->offset)
+		    != VK_SUCCESS) {
+			vkDestroyBuffer(device, moved, nullptr);
+			vulkanMemoryDefragmentCancel(move);
+			continue;
+		}
 
-	VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-	renderPassInfo.clearValueCount = 1;
-	renderPassInfo.pClearValues= &clearColor;
+		/* Staging flushes order their uploads before transfers on
+		 * the graphics queue, acquires from a dedicated transfer
+		 * queue included, so the copy reads what was uploaded. */
+		VkBufferCopy copyRegion = {};
+		copyRegion.size = buffer->size;
+		vkCmdCopyBuffer(commandBuffer, buffer->buffer, moved, 1,
+				&copyRegion);
+		defragment.oldBuffers[i] = buffer->buffer;
+		buffer->buffer = moved;
+
+		VkAccessFlags access = 0;
+		stages |= bufferStages(buffer->usage, &access);
+		barrier.dstAccessMask |= access;
+	}
+
+	if (stages != 0) {
+		vkCmdPipelineBarrier(commandBuffer,
+				     VK_PIPELINE_STAGE_TRANSFER_BIT, stages, 0,
+				     1, &barrier, 0, nullptr, 0, nullptr);
+	}
+}
 
-	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
-			     VK_SUBPASS_CONTENTS_INLINE);
+/* End the defragmentation pass once the frame that recorded it and the ones
+ * before, which may use the old buffers, are done. */
+void defragmentEnd(void)
+{
+	for (uint32_t i = 0; i < defragment.moveCount; i++) {
+		vkDestroyBuffer(device, defragment.oldBuffers[i], nullptr);
+	}
+	vulkanMemoryDefragmentEnd(defragment.moves, defragment.moveCount);
+	defragment.moveCount = 0;
+}
+
+/* Pipeline, descriptor sets, geometry and viewport of the scene draws. */
+void bindDrawState(VkCommandBuffer commandBuffer)
+{
 	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
 			  graphicsPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+				pipelineLayout, 0, VULKAN_SET_COUNT,
+				descriptors.sets, 1, &frameUniformsOffset);
 
-	VkBuffer vertexBuffers[] = {vertexBuffer};
+	VkBuffer vertexBuffers[] = {vertexBuffer.buffer};
 	VkDeviceSize offsets[] = {0};
 	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0,
+			     VK_INDEX_TYPE_UINT32);
 
 	VkViewport viewport = {};
 	viewport.x = 0.0f;
@@ -1219,8 +2095,341 @@ Error recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
 	scissor.offset.y = 0;
 	scissor.extent = swapChainExtent;
 	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+/* Secondary command buffers inherit no state, so every slice binds it all. */
+void recordDraws(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count,
+		 void *user)
+{
+	(void)user;
+
+	bindDrawState(commandBuffer);
+
+	/* Models and materials come from the object buffer, updated every
+	 * frame, so recordings stay valid as the scene moves. */
+	DrawConstants constants = {};
+	constants.materialBuffer = materialBufferIndex;
+	constants.texture = VULKAN_BINDLESS_NONE;
+	constants.objectBuffer = objectBufferIndex;
+	vkCmdPushConstants(commandBuffer, pipelineLayout,
+			   VK_SHADER_STAGE_VERTEX_BIT
+			   | VK_SHADER_STAGE_FRAGMENT_BIT,
+			   0, sizeof(constants), &constants);
+
+	for (uint32_t i = first; i < first + count; i++) {
+		vkCmdDrawIndexed(commandBuffer, draws[i].indexCount, 1,
+				 draws[i].firstIndex, draws[i].vertexOffset, i);
+	}
+}
+
+void addDraw(const RenderDraw *item)
+{
+	assert(item->mesh >= 0 && item->mesh < arrlen(meshes));
+	assert(item->material >= 0 && (uint32_t)item->material < materialCount);
+	const VulkanMesh *mesh = &meshes[item->mesh];
+	TransformID transform = item->transform;
+
+	Draw draw = {};
+	draw.transform = transform;
+	glm_mat4_copy(*transformGetWorld(transform), draw.model);
+	glm_vec4_copy((float *)mesh->bounds, draw.bounds);
+	draw.indexCount = mesh->indexCount;
+	draw.firstIndex = mesh->firstIndex;
+	draw.vertexOffset = mesh->vertexOffset;
+	draw.material = (uint32_t)item->material;
+
+	while (arrlen(transformDraws) <= transform) {
+		arrput(transformDraws, -1);
+	}
+	draw.nextDraw = transformDraws[transform];
+	transformDraws[transform] = (int32_t)arrlen(draws);
+	arrput(draws, draw);
+}
+
+/* The draw list as culling objects. */
+void fillObjects(VulkanCullObject *objects)
+{
+	for (ptrdiff_t i = 0; i < arrlen(draws); i++) {
+		VulkanCullObject object = {};
+		glm_mat4_copy(draws[i].model, object.model);
+		glm_vec4_copy(draws[i].bounds, object.bounds);
+		object.indexCount = draws[i].indexCount;
+		object.firstIndex = draws[i].firstIndex;
+		object.vertexOffset = draws[i].vertexOffset;
+		object.material = draws[i].material;
+		objects[i] = object;
+	}
+}
+
+/* The draw list as culling objects, read by the culling pass and the vertex
+ * shader. Device-local, filled by the next staging flush, then by
+ * updateObjects() as objects move, from a host-visible copy per frame in
+ * flight. Without VK_BUFFER_USAGE_TRANSFER_SRC_BIT, so defragmentation
+ * leaves it where its descriptors point. */
+Error createObjectBuffer(void)
+{
+	VulkanCullObject *objects = nullptr; /* stb_ds.h array */
+	arrsetlen(objects, arrlen(draws));
+	fillObjects(objects);
+	VkDeviceSize used = arrlen(objects) * sizeof(VulkanCullObject);
+	/* Empty buffers are invalid. */
+	VkDeviceSize size = used > 0 ? used : sizeof(VulkanCullObject);
+
+	Error e = vulkanCreateBuffer(size,
+				     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+				     | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				     &objectBuffer);
+	if (e == ERR_OK) {
+		e = vulkanDescriptorsAddBuffer(&descriptors,
+					       objectBuffer.buffer, 0,
+					       VK_WHOLE_SIZE,
+					       &objectBufferIndex);
+	}
+	if (e == ERR_OK) {
+		e = vulkanStagingUpload(&staging, objectBuffer.buffer, 0,
+					objects, used,
+					VK_ACCESS_SHADER_READ_BIT,
+					VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+					| VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	}
+	for (uint32_t i = 0; i < framesInFlight && e == ERR_OK; i++) {
+		e = vulkanCreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+				       | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				       &objectUploads[i]);
+		if (e == ERR_OK) {
+			memcpy(objectUploads[i].allocation->mapped, objects,
+			       (size_t)used);
+		}
+	}
+
+	arrfree(objects);
+	return e;
+}
+
+/* Queue the draws of the transforms the last transformUpdate() moved, for
+ * the next frame recorded to copy. Frames not drawn keep them queued. */
+void queueMovedDraws(void)
+{
+	int32_t count = 0;
+	const TransformID *moved = transformUpdated(&count);
+	for (int32_t i = 0; i < count; i++) {
+		if (moved[i] >= arrlen(transformDraws)) {
+			continue;
+		}
+		for (int32_t d = transformDraws[moved[i]]; d != -1;
+		     d = draws[d].nextDraw) {
+			if (!draws[d].moved) {
+				draws[d].moved = true;
+				arrput(movedDraws, d);
+			}
+		}
+	}
+}
+
+/* Copy the objects of the draws moved to the object buffer, through the
+ * frame's upload buffer, which the GPU is done with. Costs nothing while
+ * nothing moves, whatever the draw count. */
+void updateObjects(VkCommandBuffer commandBuffer)
+{
+	if (arrlen(movedDraws) == 0) {
+		return;
+	}
+
+	VulkanBuffer *upload = &objectUploads[currentFrame];
+	VulkanCullObject *uploads =
+		(VulkanCullObject *)upload->allocation->mapped;
+	arrsetlen(objectCopies, 0);
+	for (ptrdiff_t i = 0; i < arrlen(movedDraws); i++) {
+		Draw *draw = &draws[movedDraws[i]];
+		draw->moved = false;
+		glm_mat4_copy(*transformGetWorld(draw->transform), draw->model);
+		glm_mat4_copy(draw->model, uploads[movedDraws[i]].model);
+
+		/* Neighbours are copied together. */
+		VkDeviceSize offset =
+			(VkDeviceSize)movedDraws[i] * sizeof(VulkanCullObject);
+		ptrdiff_t last = arrlen(objectCopies) - 1;
+		if (last >= 0
+		    && objectCopies[last].srcOffset + objectCopies[last].size
+		    == offset) {
+			objectCopies[last].size += sizeof(VulkanCullObject);
+		} else {
+			VkBufferCopy copy = {offset, offset,
+					     sizeof(VulkanCullObject)};
+			arrput(objectCopies, copy);
+		}
+	}
+	arrsetlen(movedDraws, 0);
+
+	/* After the previous frames read the objects. */
+	vkCmdPipelineBarrier(commandBuffer,
+			     VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+			     | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			     VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+			     nullptr, 0, nullptr);
+	vkCmdCopyBuffer(commandBuffer, upload->buffer, objectBuffer.buffer,
+			(uint32_t)arrlen(objectCopies), objectCopies);
+
+	VkMemoryBarrier updated = {};
+	updated.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	updated.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	updated.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			     VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+			     | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			     0, 1, &updated, 0, nullptr, 0, nullptr);
+}
+
+Error createCull(void)
+{
+	const char cullCode[] = {
+#embed VULKAN_CULL_SHADER_PATH
+		/* Null term + buffer for 32 bit interpretation */
+		, '\0', '\0', '\0', '\0'
+	};
+
+	VulkanCullDesc desc = {};
+	desc.device = device;
+	desc.pipelineCache = pipelineCache;
+	desc.shaderCode = cullCode;
+	desc.shaderSize = sizeof(cullCode) - 4;
+	desc.objects = objectBuffer.buffer;
+	desc.objectCount = (uint32_t)arrlen(draws);
+	desc.frameCount = framesInFlight;
+
+	return vulkanCullInit(&cull, &desc);
+}
+
+Error createRecorder(void)
+{
+	QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+
+	Error e = vulkanRecordInit(&recorder, device,
+				   indices.graphicsFamily.value,
+				   framesInFlight);
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	/* Only changes with the draw list, buffers, pipeline and swapchain
+	 * extent. */
+	scenePass.renderPass = renderPass;
+	scenePass.subpass = 0;
+	scenePass.drawCount = (uint32_t)arrlen(draws);
+	scenePass.record = recordDraws;
+	scenePass.reusable = true;
+
+	return ERR_OK;
+}
+
+/* Release what is sized to the draw list, once the GPU is done with it. */
+void destroyDrawList(void)
+{
+	if (objectBuffer.buffer == VK_NULL_HANDLE) {
+		return;
+	}
+
+	vkDeviceWaitIdle(device);
+	if (gpuCulling) {
+		vulkanCullFree(&cull);
+	}
+	vulkanDescriptorsRemoveBuffer(&descriptors, objectBufferIndex);
+	vulkanDestroyBuffer(&objectBuffer);
+	for (uint32_t i = 0; i < framesInFlight; i++) {
+		if (objectUploads[i].buffer != VK_NULL_HANDLE) {
+			vulkanDestroyBuffer(&objectUploads[i]);
+		}
+	}
+	for (ptrdiff_t i = 0; i < arrlen(draws); i++) {
+		transformDraws[draws[i].transform] = -1;
+	}
+	arrsetlen(draws, 0);
+	arrsetlen(movedDraws, 0);
+}
+
+/* Size the object buffer and culling to the new list. Replacing a list
+ * waits for the GPU, which submissions are rare enough to afford. */
+Error vulkanSubmitDraws(const RenderDraw *list, int32_t count)
+{
+	destroyDrawList();
+	for (int32_t i = 0; i < count; i++) {
+		addDraw(&list[i]);
+	}
+
+	Error e = createObjectBuffer();
+	if (e == ERR_OK && gpuCulling) {
+		e = createCull();
+	}
+
+	scenePass.drawCount = (uint32_t)arrlen(draws);
+	vulkanRecordInvalidate(&recorder);
+	return e;
+}
+
+/* Whatever the object count, one indirect draw of the objects the culling
+ * pass left. */
+void recordCulledDraws(VkCommandBuffer commandBuffer)
+{
+	bindDrawState(commandBuffer);
+
+	DrawConstants constants = {};
+	constants.materialBuffer = materialBufferIndex;
+	constants.texture = VULKAN_BINDLESS_NONE;
+	constants.objectBuffer = objectBufferIndex;
+	vkCmdPushConstants(commandBuffer, pipelineLayout,
+			   VK_SHADER_STAGE_VERTEX_BIT
+			   | VK_SHADER_STAGE_FRAGMENT_BIT,
+			   0, sizeof(constants), &constants);
+
+	vulkanCullDraw(&cull, commandBuffer, currentFrame);
+}
+
+Error recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = 0;
+	beginInfo.pInheritanceInfo = nullptr;
+
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+		/* Failed to begin recording command buffer. */
+		return ERR_COMMAND_BUFFER_RECORDING_FAILED;
+	}
+
+	defragmentBegin(commandBuffer);
+	updateObjects(commandBuffer);
+	if (gpuCulling) {
+		vulkanCullDispatch(&cull, commandBuffer, currentFrame,
+				   viewProjection);
+	}
+
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = renderPass;
+	renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+	renderPassInfo.renderArea.offset.x = 0;
+	renderPassInfo.renderArea.offset.y = 0;
+	renderPassInfo.renderArea.extent = swapChainExtent;
 
-	vkCmdDraw(commandBuffer, ARRAY_COUNT_STATIC(vertices), 1, 0, 0);
+	VkClearValue clearValues[2] = {};
+	clearValues[0].color = (VkClearColorValue){{0.0f, 0.0f, 0.0f, 1.0f}};
+	clearValues[1].depthStencil = (VkClearDepthStencilValue){1.0f, 0};
+	renderPassInfo.clearValueCount = ARRAY_COUNT_STATIC(clearValues);
+	renderPassInfo.pClearValues = clearValues;
+
+	Error e = ERR_OK;
+	if (gpuCulling) {
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+				     VK_SUBPASS_CONTENTS_INLINE);
+		recordCulledDraws(commandBuffer);
+	} else {
+		vkCmdBeginRenderPass(
+			commandBuffer, &renderPassInfo,
+			VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		e = vulkanRecordExecute(&recorder, commandBuffer, &scenePass);
+	}
 
 	vkCmdEndRenderPass(commandBuffer);
 
@@ -1229,40 +2438,85 @@ Error recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
 		return ERR_COMMAND_BUFFER_RECORDING_FAILED;
 	}
 
-	return ERR_OK;
+	return e;
 }
 
 Error createSyncObjects(void)
 {
-	arrsetlen(imageAvailableSemaphores, MAX_FRAMES_IN_FLIGHT);
-	arrsetlen(renderFinishedSemaphores, MAX_FRAMES_IN_FLIGHT);
-	arrsetlen(inFlightFences, MAX_FRAMES_IN_FLIGHT);
+	arrsetlen(imageAvailableSemaphores, framesInFlight);
+	arrsetlen(renderFinishedSemaphores, framesInFlight);
+	/* No frame submitted from any slot yet. */
+	arrsetlen(frameSlotValues, framesInFlight);
+	memset(frameSlotValues, 0, framesInFlight * sizeof(*frameSlotValues));
 
 	VkSemaphoreCreateInfo semaphoreInfo = {};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	VkFenceCreateInfo fenceInfo = {};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+	for (size_t i = 0; i < framesInFlight; i++) {
 		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr,
 				      &imageAvailableSemaphores[i])
 		    != VK_SUCCESS
 		    || vkCreateSemaphore(device, &semaphoreInfo, nullptr,
 					 &renderFinishedSemaphores[i])
-		    != VK_SUCCESS
-		    || vkCreateFence(device, &fenceInfo, nullptr,
-				     &inFlightFences[i])
 		    != VK_SUCCESS) {
 			/* Failed to create semaphores. */
 			return ERR_SEMAPHORE_CREATION_FAILED;
 		}
 	}
 
+	VkSemaphoreTypeCreateInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineInfo.initialValue = 0;
+	semaphoreInfo.pNext = &timelineInfo;
+	if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &frameTimeline)
+	    != VK_SUCCESS) {
+		return ERR_SEMAPHORE_CREATION_FAILED;
+	}
+
+	vulkanLatencyInit(&latency, device, frameTimeline, hasPresentWait);
+	vulkanLatencySetSwapchain(&latency, swapChain);
+
 	return ERR_OK;
 }
 
+/* Retire the views and framebuffers of the swapchain images, and the depth
+ * buffer, for the frames in flight still rendering to them. */
+void retireSwapChainViews(void)
+{
+	for (int i = 0; i < arrlen(swapChainFramebuffers); i++) {
+		vulkanDeletionRetire(&deletions, (VulkanDeletion){
+			.value = frameValue,
+			.kind = VULKAN_DELETION_FRAMEBUFFER,
+			.framebuffer = swapChainFramebuffers[i],
+		});
+	}
+
+	for (int i = 0; i < arrlen(swapChainImageViews); i++) {
+		vulkanDeletionRetire(&deletions, (VulkanDeletion){
+			.value = frameValue,
+			.kind = VULKAN_DELETION_IMAGE_VIEW,
+			.imageView = swapChainImageViews[i],
+		});
+	}
+
+	vulkanDeletionRetire(&deletions, (VulkanDeletion){
+		.value = frameValue,
+		.kind = VULKAN_DELETION_IMAGE_VIEW,
+		.imageView = depthImageView,
+	});
+	vulkanDeletionRetire(&deletions, (VulkanDeletion){
+		.value = frameValue,
+		.kind = VULKAN_DELETION_IMAGE,
+		.image = depthImage,
+	});
+
+	arrsetlen(swapChainFramebuffers, 0);
+	arrsetlen(swapChainImageViews, 0);
+	depthImageView = VK_NULL_HANDLE;
+	depthImage = (VulkanImage){};
+}
+
 void cleanupSwapChain(void)
 {
 	for (int i = 0; i < arrlen(swapChainFramebuffers); i++) {
@@ -1274,22 +2528,30 @@ void cleanupSwapChain(void)
 		vkDestroyImageView(device, swapChainImageViews[i], nullptr);
 	}
 
+	vkDestroyImageView(device, depthImageView, nullptr);
+	vulkanDestroyImage(&depthImage);
+
 	vkDestroySwapchainKHR(device, swapChain, nullptr);
 }
 
+/* Without waiting for the GPU: the old swapchain, its views, framebuffers and
+ * depth buffer are destroyed once the frames submitted so far complete. The
+ * old swapchain is passed as oldSwapchain, so images it already queued are
+ * presented. */
 Error recreateSwapChain(void)
 {
 	int width = 0;
 	int height = 0;
 	glfwGetFramebufferSize(window, &width, &height);
-	/* Handle minimized windows. */
-	while (width == 0 || height == 0) {
-		glfwGetFramebufferSize(window, &width, &height);
-		glfwWaitEvents();
+	if (width == 0 || height == 0) {
+		/* Minimized, retry once restored. */
+		framebufferResized = true;
+		return ERR_OK;
 	}
 
-	vkDeviceWaitIdle(device);
-	cleanupSwapChain();
+	retireSwapChainViews();
+	/* Recordings set the viewport to the extent. */
+	vulkanRecordInvalidate(&recorder);
 
 	Error e = ERR_OK;
 
@@ -1303,21 +2565,37 @@ Error recreateSwapChain(void)
 		return e;
 	}
 
+	e = createDepthResources();
+	if (e != ERR_OK) {
+		return e;
+	}
+
 	e = createFramebuffers();
 	if (e != ERR_OK) {
 		return e;
 	}
 
+	vulkanLatencySetSwapchain(&latency, swapChain);
+
 	return ERR_OK;
 }
 
-void cleanupGraphics(void)
+void vulkanCleanup(void)
 {
 	vkDeviceWaitIdle(device);
 	cleanupSwapChain();
-	vkDestroyBuffer(device, vertexBuffer, nullptr);
-	vkFreeMemory(device, vertexBufferMemory, nullptr);
+	vulkanDeletionFree(&deletions);
+	defragmentEnd();
+	vulkanDestroyBuffer(&vertexBuffer);
+	vulkanDestroyBuffer(&indexBuffer);
+	vulkanDestroyBuffer(&materialBuffer);
+	destroyDrawList();
+	vulkanDescriptorsFree(&descriptors);
+	vulkanStagingFree(&staging);
+	vulkanMemoryFree();
 	vkDestroyPipeline(device, graphicsPipeline, nullptr);
+	savePipelineCache();
+	vkDestroyPipelineCache(device, pipelineCache, nullptr);
 	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 	vkDestroyRenderPass(device, renderPass, nullptr);
 	for (int i = 0; i < arrlen(imageAvailableSemaphores); i++) {
@@ -1328,10 +2606,10 @@ void cleanupGraphics(void)
 		vkDestroySemaphore(device, renderFinishedSemaphores[i],
 				   nullptr);
 	}
-	for (int i = 0; i < arrlen(inFlightFences); i++) {
-		vkDestroyFence(device, inFlightFences[i], nullptr);
-	}
+	vkDestroySemaphore(device, frameTimeline, nullptr);
 	vkDestroyCommandPool(device, commandPool, nullptr);
+	vulkanRecordPassFree(&scenePass);
+	vulkanRecordFree(&recorder);
 	vkDestroyDevice(device, nullptr);
 	if (ENABLE_VALIDATION_LAYERS) {
 		destroyDebugUtilsMessengerEXT(instance, debugMessenger,
@@ -1343,18 +2621,28 @@ void cleanupGraphics(void)
 	arrfree(swapChainImageViews);
 	arrfree(swapChainFramebuffers);
 	arrfree(commandBuffers);
+	arrfree(meshes);
+	arrfree(draws);
+	arrfree(transformDraws);
+	arrfree(movedDraws);
+	arrfree(objectCopies);
 	arrfree(imageAvailableSemaphores);
 	arrfree(renderFinishedSemaphores);
-	arrfree(inFlightFences);
+	arrfree(frameSlotValues);
 }
 
-Error graphicsInit(void)
+Error vulkanInit(void)
 {
 	if (!glfwVulkanSupported()) {
 		return 3;
 	}
 
-	Error e = createInstance();
+	Error e = optionsInit();
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	e = createInstance();
 	if (e != ERR_OK) {
 		return e;
 	}
@@ -1379,6 +2667,14 @@ Error graphicsInit(void)
 		return e;
 	}
 
+	vulkanMemoryInit(device, physicalDevice, hasMemoryBudget);
+	vulkanDeletionInit(&deletions, device);
+
+	e = createDescriptors();
+	if (e != ERR_OK) {
+		return e;
+	}
+
 	e = createSwapChain();
 	if (e != ERR_OK) {
 		return e;
@@ -1389,11 +2685,18 @@ Error graphicsInit(void)
 		return e;
 	}
 
+	e = createDepthResources();
+	if (e != ERR_OK) {
+		return e;
+	}
+
 	e = createRenderPass();
 	if (e != ERR_OK) {
 		return e;
 	}
 
+	createPipelineCache();
+
 	e = createGraphicsPipeline();
 	if (e != ERR_OK) {
 		return e;
@@ -1409,16 +2712,36 @@ Error graphicsInit(void)
 		return e;
 	}
 
+	e = createStaging();
+	if (e != ERR_OK) {
+		return e;
+	}
+
 	e = createVertexBuffer();
 	if (e != ERR_OK) {
 		return e;
 	}
 
+	e = createIndexBuffer();
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	e = createMaterialBuffer();
+	if (e != ERR_OK) {
+		return e;
+	}
+
 	e = createCommandBuffers();
 	if (e != ERR_OK) {
 		return e;
 	}
 
+	e = createRecorder();
+	if (e != ERR_OK) {
+		return e;
+	}
+
 	e = createSyncObjects();
 	if (e != ERR_OK) {
 		return e;
@@ -1427,16 +2750,82 @@ Error graphicsInit(void)
 	return ERR_OK;
 }
 
-Error drawFrame(void) {
-	vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE,
-			UINT64_MAX);
+/* Pushed first each frame, so their offset is the same for a frame in flight
+ * every frame, and reusable recordings binding it stay valid. */
+Error updateFrameUniforms(void)
+{
+	mat4 view;
+	mat4 projection;
+	getCameraView(view);
+	glm_perspective_rh_zo(cameraFOV, (float)swapChainExtent.width
+			      / (float)swapChainExtent.height, cameraNear,
+			      cameraFar, projection);
+	/* Vulkan's clip space points Y down. */
+	projection[1][1] = -projection[1][1];
+
+	FrameUniforms uniforms = {};
+	glm_mat4_mul(projection, view, uniforms.viewProjection);
+	uniforms.time = currentFrameTimeSec;
+	glm_mat4_copy(uniforms.viewProjection, viewProjection);
+
+	return vulkanDescriptorsPushUniforms(&descriptors, &uniforms,
+					     sizeof(uniforms),
+					     &frameUniformsOffset);
+}
+
+/* Wait for the frame slot and acquire a swapchain image, skipping the frame
+ * when there is none to draw to. */
+Error vulkanBeginFrame(bool *drawing)
+{
+	*drawing = false;
+	queueMovedDraws();
+
+	/* Meshes, materials and draw lists created since the last frame. */
+	Error e = vulkanStagingFlush(&staging);
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	int width = 0;
+	int height = 0;
+	glfwGetFramebufferSize(window, &width, &height);
+	if (width == 0 || height == 0) {
+		/* Minimized: nothing to present, but keep the loop running
+		 * without spinning. */
+		glfwWaitEventsTimeout(minimizedWaitSec);
+		return ERR_OK;
+	}
+
+	/* Wait for the last frame submitted from this slot. */
+	VkSemaphoreWaitInfo waitInfo = {};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &frameTimeline;
+	waitInfo.pValues = &frameSlotValues[currentFrame];
+	vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+	vulkanLatencyPoll(&latency, glfwGetTime());
+
+	uint64_t completed = 0;
+	vkGetSemaphoreCounterValue(device, frameTimeline, &completed);
+	vulkanDeletionFlush(&deletions, completed);
+
+	if (defragment.moveCount > 0 && defragment.frame == currentFrame) {
+		defragmentEnd();
+	}
+	vulkanRecordBeginFrame(&recorder, currentFrame);
+	/* Counted in frames submitted, as frames whose image could not be
+	 * acquired submit nothing. */
+	vulkanDescriptorsBeginFrame(&descriptors, currentFrame,
+				    frameValue + 1);
 
 	if (framebufferResized) {
 		framebufferResized = false;
-		recreateSwapChain();
+		e = recreateSwapChain();
+		if (e != ERR_OK) {
+			return e;
+		}
 	}
 
-	uint32_t imageIndex = 0;
 	VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX,
 			      imageAvailableSemaphores[currentFrame],
 			      VK_NULL_HANDLE, &imageIndex);
@@ -1449,12 +2838,23 @@ Error drawFrame(void) {
 		return ERR_SWAP_CHAIN_CREATION_FAILED;
 	}
 
-	/* Only reset the fence if we are submitting work. */
-	vkResetFences(device, 1, &inFlightFences[currentFrame]);
+	*drawing = true;
+	return ERR_OK;
+}
+
+Error vulkanDrawScene(void)
+{
+	Error e = updateFrameUniforms();
+	if (e != ERR_OK) {
+		return e;
+	}
 
 	vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-	recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+	return recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+}
 
+Error vulkanEndFrame(void)
+{
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
@@ -1470,17 +2870,28 @@ Error drawFrame(void) {
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
 
+	/* The binary semaphore orders the present, the timeline paces the
+	 * frame slots. Values for binary semaphores are ignored. */
 	VkSemaphore signalSemaphores[] = {
-		renderFinishedSemaphores[currentFrame]
+		renderFinishedSemaphores[currentFrame],
+		frameTimeline,
 	};
-	submitInfo.signalSemaphoreCount = 1;
+	uint64_t signalValues[] = { 0, frameValue + 1 };
+	VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.signalSemaphoreValueCount = 2;
+	timelineInfo.pSignalSemaphoreValues = signalValues;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.signalSemaphoreCount = 2;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
-	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo,
-			  inFlightFences[currentFrame])
+	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE)
 	    != VK_SUCCESS) {
 		return ERR_COMMAND_BUFFER_DRAWING_FAILED;
 	}
+	frameValue += 1;
+	frameSlotValues[currentFrame] = frameValue;
+	vulkanLatencySubmitted(&latency, frameValue, glfwGetTime());
 
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1495,7 +2906,17 @@ Error drawFrame(void) {
 	presentInfo.pImageIndices = &imageIndex;
 	presentInfo.pResults = nullptr;
 
-	result = vkQueuePresentKHR(presentQueue, &presentInfo);
+	/* Identify the present by its frame, to wait for it when measuring
+	 * latency. */
+	VkPresentIdKHR presentId = {};
+	presentId.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+	presentId.swapchainCount = 1;
+	presentId.pPresentIds = &frameValue;
+	if (hasPresentWait) {
+		presentInfo.pNext = &presentId;
+	}
+
+	VkResult result = vkQueuePresentKHR(presentQueue, &presentInfo);
 	if (result == VK_ERROR_OUT_OF_DATE_KHR
 	    || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
 		framebufferResized = false;
@@ -1507,13 +2928,28 @@ Error drawFrame(void) {
 		return ERR_SWAP_CHAIN_PRESENTATION_FAILED;
 	}
 
-	currentFrame += 1;
-	currentFrame &= MAX_FRAMES_IN_FLIGHT - 1;
+	currentFrame = (currentFrame + 1) % framesInFlight;
 
 	return ERR_OK;
 }
 
-void cleanupWindow() {
+void vulkanCleanupWindow(void)
+{
 	glfwDestroyWindow(window);
 	glfwTerminate();
 }
+
+const Renderer vulkanRenderer = {
+	.name = "vulkan",
+	.windowInit = vulkanWindowInit,
+	.init = vulkanInit,
+	.createMesh = vulkanCreateMesh,
+	.createMaterial = vulkanCreateMaterial,
+	.submitDraws = vulkanSubmitDraws,
+	.processInput = vulkanProcessInput,
+	.beginFrame = vulkanBeginFrame,
+	.drawScene = vulkanDrawScene,
+	.endFrame = vulkanEndFrame,
+	.cleanup = vulkanCleanup,
+	.cleanupWindow = vulkanCleanupWindow,
+};
@@ -0,0 +1,331 @@
+/* Vulkan cull - Frustum cull objects and build their draws on the GPU
+ *
+ * OVERVIEW: - Objects, their model matrix, bounding sphere and draw
+ *   arguments, live in a storage buffer. A compute shader tests each one
+ *   against the frustum and appends the visible ones to an indirect buffer,
+ *   counting them in a count buffer, drawn by one
+ *   vkCmdDrawIndexedIndirectCount. The CPU cost per frame does not depend
+ *   on the object count.
+ *
+ * - Draws take the object index as first instance, for shaders to read the
+ *   object back with gl_InstanceIndex.
+ *
+ * - Each frame in flight has its own indirect and count buffers, so culling
+ *   a frame never waits for the draws of the previous one.
+ *
+ * - Needs the drawIndirectCount feature of Vulkan 1.2, and
+ *   drawIndirectFirstInstance. tools/vulkan_cull_check.c checks the shader
+ *   against the CPU, on software drivers such as lavapipe too.
+ *
+ * USAGE:
+ * - VulkanCull cull;
+ * - vulkanCullInit(&cull, &desc);
+ * - // Every frame, outside of render passes
+ * - vulkanCullDispatch(&cull, commandBuffer, frameIndex, viewProjection);
+ * - // In the render pass, with the graphics pipeline bound
+ * - vulkanCullDraw(&cull, commandBuffer, frameIndex);
+ * - vulkanCullFree(&cull);
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "cglm/cglm.h"
+#define GLFW_INCLUDE_VULKAN
+#include "GLFW/glfw3.h"
+#include "common.h"
+#include "stb_ds.h"
+#include "vulkan_memory.c"
+
+enum : uint32_t {
+	VULKAN_CULL_GROUP_SIZE = 64,	/* Matches the compute shader */
+	VULKAN_CULL_BINDINGS = 3,
+};
+
+/* Matches the object struct of the shaders, std430. */
+typedef struct VulkanCullObject {
+	mat4 model;
+	vec4 bounds;		/* Model space sphere center and radius */
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t material;
+} VulkanCullObject;
+
+/* Matches the push constants of the compute shader. */
+typedef struct VulkanCullConstants {
+	vec4 planes[6];		/* World space, normalized, pointing inside */
+	uint32_t objectCount;
+	uint32_t padding[3];
+} VulkanCullConstants;
+
+typedef struct VulkanCullDesc {
+	VkDevice device;
+	VkPipelineCache pipelineCache;
+	const char *shaderCode;
+	size_t shaderSize;
+	/* Storage buffer of objectCount VulkanCullObject */
+	VkBuffer objects;
+	uint32_t objectCount;
+	uint32_t frameCount;
+	/* Host-visible indirect and count buffers, for checks to read */
+	bool readable;
+} VulkanCullDesc;
+
+typedef struct VulkanCull {
+	VulkanCullDesc desc;
+	VkDescriptorSetLayout setLayout;
+	VkPipelineLayout layout;
+	VkPipeline pipeline;
+	VkDescriptorPool pool;
+	VkDescriptorSet *sets;		/* stb_ds.h array, per frame */
+	VulkanBuffer *commands;		/* stb_ds.h array, per frame */
+	VulkanBuffer *counts;		/* stb_ds.h array, per frame */
+} VulkanCull;
+
+Error vulkanCullCreatePipeline(VulkanCull *cull)
+{
+	VkDevice device = cull->desc.device;
+
+	VkDescriptorSetLayoutBinding bindings[VULKAN_CULL_BINDINGS] = {};
+	for (uint32_t i = 0; i < VULKAN_CULL_BINDINGS; i++) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	VkDescriptorSetLayoutCreateInfo setLayoutInfo = {};
+	setLayoutInfo.sType =
+		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	setLayoutInfo.bindingCount = VULKAN_CULL_BINDINGS;
+	setLayoutInfo.pBindings = bindings;
+	if (vkCreateDescriptorSetLayout(device, &setLayoutInfo, nullptr,
+					&cull->setLayout)
+	    != VK_SUCCESS) {
+		return ERR_DESCRIPTOR_SET_CREATION_FAILED;
+	}
+
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.size = sizeof(VulkanCullConstants);
+	VkPipelineLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &cull->setLayout;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushConstantRange;
+	if (vkCreatePipelineLayout(device, &layoutInfo, nullptr, &cull->layout)
+	    != VK_SUCCESS) {
+		return ERR_PIPELINE_LAYOUT_CREATION_FAILED;
+	}
+
+	VkShaderModuleCreateInfo moduleInfo = {};
+	moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleInfo.codeSize = cull->desc.shaderSize;
+	moduleInfo.pCode = (const uint32_t *)cull->desc.shaderCode;
+	VkShaderModule module = VK_NULL_HANDLE;
+	if (vkCreateShaderModule(device, &moduleInfo, nullptr, &module)
+	    != VK_SUCCESS) {
+		return ERR_SHADER_CREATION_FAILED;
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType =
+		VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = module;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = cull->layout;
+	VkResult result = vkCreateComputePipelines(device,
+						   cull->desc.pipelineCache, 1,
+						   &pipelineInfo, nullptr,
+						   &cull->pipeline);
+	vkDestroyShaderModule(device, module, nullptr);
+	if (result != VK_SUCCESS) {
+		return ERR_COMPUTE_PIPELINE_CREATION_FAILED;
+	}
+
+	return ERR_OK;
+}
+
+/* The indirect and count buffers of each frame, and their sets. */
+Error vulkanCullCreateFrames(VulkanCull *cull)
+{
+	VkDevice device = cull->desc.device;
+	uint32_t frameCount = cull->desc.frameCount;
+	/* Empty buffers are invalid. */
+	uint32_t capacity = cull->desc.objectCount > 0
+		? cull->desc.objectCount
+		: 1;
+
+	VkDescriptorPoolSize poolSize = {};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = frameCount * VULKAN_CULL_BINDINGS;
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = frameCount;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &cull->pool)
+	    != VK_SUCCESS) {
+		return ERR_DESCRIPTOR_SET_CREATION_FAILED;
+	}
+
+	arrsetlen(cull->sets, frameCount);
+	arrsetlen(cull->commands, frameCount);
+	arrsetlen(cull->counts, frameCount);
+	for (uint32_t i = 0; i < frameCount; i++) {
+		cull->commands[i] = (VulkanBuffer){};
+		cull->counts[i] = (VulkanBuffer){};
+	}
+
+	VkMemoryPropertyFlags properties = cull->desc.readable
+		? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+		: VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	for (uint32_t i = 0; i < frameCount; i++) {
+		/* Without VK_BUFFER_USAGE_TRANSFER_SRC_BIT, so
+		 * defragmentation leaves them where their sets point. */
+		Error e = vulkanCreateBuffer(
+			capacity * sizeof(VkDrawIndexedIndirectCommand),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+			| VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			properties, &cull->commands[i]);
+		if (e != ERR_OK) {
+			return e;
+		}
+		e = vulkanCreateBuffer(sizeof(uint32_t),
+				       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+				       | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+				       | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				       properties, &cull->counts[i]);
+		if (e != ERR_OK) {
+			return e;
+		}
+
+		VkDescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.sType =
+			VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = cull->pool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &cull->setLayout;
+		if (vkAllocateDescriptorSets(device, &allocInfo, &cull->sets[i])
+		    != VK_SUCCESS) {
+			return ERR_DESCRIPTOR_SET_CREATION_FAILED;
+		}
+
+		VkDescriptorBufferInfo bufferInfos[VULKAN_CULL_BINDINGS] = {
+			{cull->desc.objects, 0, VK_WHOLE_SIZE},
+			{cull->commands[i].buffer, 0, VK_WHOLE_SIZE},
+			{cull->counts[i].buffer, 0, VK_WHOLE_SIZE},
+		};
+		VkWriteDescriptorSet writes[VULKAN_CULL_BINDINGS] = {};
+		for (uint32_t j = 0; j < VULKAN_CULL_BINDINGS; j++) {
+			writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[j].dstSet = cull->sets[i];
+			writes[j].dstBinding = j;
+			writes[j].descriptorCount = 1;
+			writes[j].descriptorType =
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[j].pBufferInfo = &bufferInfos[j];
+		}
+		vkUpdateDescriptorSets(device, VULKAN_CULL_BINDINGS, writes, 0,
+				       nullptr);
+	}
+
+	return ERR_OK;
+}
+
+Error vulkanCullInit(VulkanCull *cull, const VulkanCullDesc *desc)
+{
+	*cull = (VulkanCull){
+		.desc = *desc,
+	};
+
+	Error e = vulkanCullCreatePipeline(cull);
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	return vulkanCullCreateFrames(cull);
+}
+
+/* Record the culling of the objects into the buffers of `frame`, followed
+ * by a barrier for the indirect draw. */
+void vulkanCullDispatch(VulkanCull *cull, VkCommandBuffer commandBuffer,
+			uint32_t frame, mat4 viewProjection)
+{
+	vkCmdFillBuffer(commandBuffer, cull->counts[frame].buffer, 0,
+			sizeof(uint32_t), 0);
+
+	VkMemoryBarrier cleared = {};
+	cleared.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	cleared.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	cleared.dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+		| VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+			     &cleared, 0, nullptr, 0, nullptr);
+
+	VulkanCullConstants constants = {};
+	/* For clip space depths in [-1, 1], so the near plane is only
+	 * conservative with Vulkan's [0, 1]. */
+	glm_frustum_planes(viewProjection, constants.planes);
+	constants.objectCount = cull->desc.objectCount;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+			  cull->pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+				cull->layout, 0, 1, &cull->sets[frame], 0,
+				nullptr);
+	vkCmdPushConstants(commandBuffer, cull->layout,
+			   VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+			   &constants);
+	vkCmdDispatch(commandBuffer,
+		      (cull->desc.objectCount + VULKAN_CULL_GROUP_SIZE - 1)
+		      / VULKAN_CULL_GROUP_SIZE,
+		      1, 1);
+
+	VkMemoryBarrier culled = {};
+	culled.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	culled.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	culled.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer,
+			     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			     VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1,
+			     &culled, 0, nullptr, 0, nullptr);
+}
+
+/* Draw the objects left by the culling of `frame`. */
+void vulkanCullDraw(const VulkanCull *cull, VkCommandBuffer commandBuffer,
+		    uint32_t frame)
+{
+	vkCmdDrawIndexedIndirectCount(commandBuffer,
+				      cull->commands[frame].buffer, 0,
+				      cull->counts[frame].buffer, 0,
+				      cull->desc.objectCount,
+				      sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void vulkanCullFree(VulkanCull *cull)
+{
+	VkDevice device = cull->desc.device;
+
+	for (ptrdiff_t i = 0; i < arrlen(cull->commands); i++) {
+		if (cull->commands[i].buffer != VK_NULL_HANDLE) {
+			vulkanDestroyBuffer(&cull->commands[i]);
+		}
+		if (cull->counts[i].buffer != VK_NULL_HANDLE) {
+			vulkanDestroyBuffer(&cull->counts[i]);
+		}
+	}
+	vkDestroyDescriptorPool(device, cull->pool, nullptr);
+	vkDestroyPipeline(device, cull->pipeline, nullptr);
+	vkDestroyPipelineLayout(device, cull->layout, nullptr);
+	vkDestroyDescriptorSetLayout(device, cull->setLayout, nullptr);
+	arrfree(cull->sets);
+	arrfree(cull->commands);
+	arrfree(cull->counts);
+	*cull = (VulkanCull){};
+}
@@ -0,0 +1,108 @@
+/* Vulkan deletion - Destroy objects once the frames using them completed
+ *
+ * OVERVIEW: - Objects are retired with the timeline semaphore value of the last
+ *   frame submitted that may use them, and destroyed once the timeline
+ *   reaches it, so replacing them never waits for the GPU.
+ *
+ * - Objects are destroyed in the order they were retired, so objects must be
+ *   retired before those they were created from, e.g. image views before
+ *   their swapchain.
+ *
+ * USAGE:
+ * - VulkanDeletionQueue deletions;
+ * - vulkanDeletionInit(&deletions, device);
+ * - vulkanDeletionRetire(&deletions, (VulkanDeletion){
+ *	.value = frameValue,
+ *	.kind = VULKAN_DELETION_IMAGE_VIEW,
+ *	.imageView = view,
+ *   });
+ * - // At the start of every frame
+ * - vulkanDeletionFlush(&deletions, completedValue);
+ * - // Once the device is idle
+ * - vulkanDeletionFree(&deletions);
+ */
+#pragma once
+
+#include <stdint.h>
+
+#define GLFW_INCLUDE_VULKAN
+#include "GLFW/glfw3.h"
+#include "stb_ds.h"
+#include "vulkan_memory.c"
+
+typedef enum VulkanDeletionKind : uint8_t {
+	VULKAN_DELETION_FRAMEBUFFER,
+	VULKAN_DELETION_IMAGE,
+	VULKAN_DELETION_IMAGE_VIEW,
+	VULKAN_DELETION_SWAPCHAIN,
+} VulkanDeletionKind;
+
+typedef struct VulkanDeletion {
+	/* Timeline value of the last frame that may use the object */
+	uint64_t value;
+	VulkanDeletionKind kind;
+	union {
+		VkFramebuffer framebuffer;
+		VulkanImage image;
+		VkImageView imageView;
+		VkSwapchainKHR swapchain;
+	};
+} VulkanDeletion;
+
+typedef struct VulkanDeletionQueue {
+	VkDevice device;
+	VulkanDeletion *deletions; /* stb_ds.h array */
+} VulkanDeletionQueue;
+
+void vulkanDeletionInit(VulkanDeletionQueue *queue, VkDevice device)
+{
+	*queue = (VulkanDeletionQueue){
+		.device = device,
+	};
+}
+
+void vulkanDeletionRetire(VulkanDeletionQueue *queue, VulkanDeletion deletion)
+{
+	arrput(queue->deletions, deletion);
+}
+
+void vulkanDeletionDestroy(VkDevice device, const VulkanDeletion *deletion)
+{
+	switch (deletion->kind) {
+	case VULKAN_DELETION_FRAMEBUFFER:
+		vkDestroyFramebuffer(device, deletion->framebuffer, nullptr);
+		break;
+	case VULKAN_DELETION_IMAGE:
+		vkDestroyImage(device, deletion->image.image, nullptr);
+		vulkanMemoryDeallocate(deletion->image.allocation);
+		break;
+	case VULKAN_DELETION_IMAGE_VIEW:
+		vkDestroyImageView(device, deletion->imageView, nullptr);
+		break;
+	case VULKAN_DELETION_SWAPCHAIN:
+		vkDestroySwapchainKHR(device, deletion->swapchain, nullptr);
+		break;
+	}
+}
+
+/* Destroy the objects retired up to the `completed` timeline value. */
+void vulkanDeletionFlush(VulkanDeletionQueue *queue, uint64_t completed)
+{
+	ptrdiff_t count = 0;
+	while (count < arrlen(queue->deletions)
+	       && queue->deletions[count].value <= completed) {
+		vulkanDeletionDestroy(queue->device, &queue->deletions[count]);
+		count++;
+	}
+
+	if (count > 0) {
+		arrdeln(queue->deletions, 0, count);
+	}
+}
+
+/* Destroy everything retired, the device must be idle. */
+void vulkanDeletionFree(VulkanDeletionQueue *queue)
+{
+	vulkanDeletionFlush(queue, UINT64_MAX);
+	arrfree(queue->deletions);
+}
@@ -0,0 +1,415 @@
+/* Vulkan descriptors - A bindless resource set and a per-frame uniform ring
+ *
+ * OVERVIEW: - Set VULKAN_SET_BINDLESS holds every texture and storage buffer
+ *   in two large arrays, partially bound and updated after bind. Resources
+ *   are added once, and shaders index the arrays with indices passed as push
+ *   constants, so draws need no descriptor set of their own.
+ *
+ * - Indices removed are only reused once every frame in flight since is
+ *   done, so descriptors in use by the GPU are never rewritten.
+ *
+ * - Set VULKAN_SET_FRAME holds one dynamic uniform buffer, a host-visible
+ *   ring with a region per frame in flight. `vulkanDescriptorsPushUniforms()`
+ *   copies constants to the current frame's region and returns the dynamic
+ *   offset to bind them at. Regions are reset by
+ *   `vulkanDescriptorsBeginFrame()`, once the frame's fence was waited on.
+ *
+ * USAGE:
+ * - VulkanDescriptors descriptors;
+ * - vulkanDescriptorsInit(&descriptors, device, physicalDevice,
+ * -	MAX_FRAMES_IN_FLIGHT);
+ * - vulkanDescriptorsAddBuffer(&descriptors, materials.buffer, 0,
+ * -	VK_WHOLE_SIZE, &materialsIndex);
+ * - vulkanDescriptorsBeginFrame(&descriptors, currentFrame, frameCount);
+ * - vulkanDescriptorsPushUniforms(&descriptors, &frame, sizeof(frame),
+ * -	&frameOffset);
+ * - vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+ * -	pipelineLayout, 0, VULKAN_SET_COUNT, descriptors.sets, 1,
+ * -	&frameOffset);
+ * - vulkanDescriptorsFree(&descriptors);
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define GLFW_INCLUDE_VULKAN
+#include "GLFW/glfw3.h"
+#include "common.h"
+#include "stb_ds.h"
+#include "vulkan_memory.c"
+
+enum : uint32_t {
+	VULKAN_SET_BINDLESS = 0,
+	VULKAN_SET_FRAME,
+	VULKAN_SET_COUNT,
+};
+
+enum : uint32_t {
+	/* Set VULKAN_SET_BINDLESS */
+	VULKAN_BINDING_TEXTURES = 0,
+	VULKAN_BINDING_BUFFERS = 1,
+	/* Set VULKAN_SET_FRAME */
+	VULKAN_BINDING_UNIFORMS = 0,
+};
+
+enum : uint32_t {
+	/* Capped by the device limits */
+	VULKAN_BINDLESS_TEXTURES = 4096,
+	VULKAN_BINDLESS_BUFFERS = 1024,
+	VULKAN_BINDLESS_NONE = UINT32_MAX,
+};
+
+enum : VkDeviceSize {
+	/* Per frame in flight */
+	VULKAN_UNIFORM_RING_SIZE = 64 << 10,
+	/* Largest constants pushed at once */
+	VULKAN_UNIFORM_RANGE = 1 << 10,
+};
+
+typedef struct VulkanRetiredSlot {
+	uint32_t index;
+	uint64_t frame;
+} VulkanRetiredSlot;
+
+typedef struct VulkanSlots {
+	uint32_t capacity;
+	uint32_t next;				/* Never used from here on */
+	uint32_t *free;			/* stb_ds.h array */
+	VulkanRetiredSlot *retired;	/* stb_ds.h array, oldest first */
+} VulkanSlots;
+
+typedef struct VulkanDescriptors {
+	VkDevice device;
+	uint32_t frameCount;
+	VkDescriptorSetLayout layouts[VULKAN_SET_COUNT];
+	VkDescriptorPool pool;
+	VkDescriptorSet sets[VULKAN_SET_COUNT];
+	VulkanSlots textures;
+	VulkanSlots buffers;
+	VulkanBuffer uniforms;
+	VkDeviceSize uniformAlignment;
+	VkDeviceSize uniformHead;		/* In the current region */
+	uint32_t frameIndex;
+	uint64_t frame;
+} VulkanDescriptors;
+
+Error vulkanDescriptorsCreateLayouts(VulkanDescriptors *descriptors)
+{
+	VkDescriptorSetLayoutBinding bindless[2] = {};
+	bindless[0].binding = VULKAN_BINDING_TEXTURES;
+	bindless[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindless[0].descriptorCount = descriptors->textures.capacity;
+	bindless[0].stageFlags = VK_SHADER_STAGE_ALL;
+	bindless[1].binding = VULKAN_BINDING_BUFFERS;
+	bindless[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindless[1].descriptorCount = descriptors->buffers.capacity;
+	bindless[1].stageFlags = VK_SHADER_STAGE_ALL;
+
+	VkDescriptorBindingFlags flags =
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
+		| VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+		| VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+	VkDescriptorBindingFlags bindingFlags[] = {flags, flags};
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo = {};
+	flagsInfo.sType =
+		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	flagsInfo.bindingCount = 2;
+	flagsInfo.pBindingFlags = bindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = &flagsInfo;
+	layoutInfo.flags =
+		VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	layoutInfo.bindingCount = 2;
+	layoutInfo.pBindings = bindless;
+	if (vkCreateDescriptorSetLayout(
+		    descriptors->device, &layoutInfo, nullptr,
+		    &descriptors->layouts[VULKAN_SET_BINDLESS])
+	    != VK_SUCCESS) {
+		return ERR_DESCRIPTOR_SET_CREATION_FAILED;
+	}
+
+	VkDescriptorSetLayoutBinding uniforms = {};
+	uniforms.binding = VULKAN_BINDING_UNIFORMS;
+	uniforms.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	uniforms.descriptorCount = 1;
+	uniforms.stageFlags = VK_SHADER_STAGE_ALL;
+
+	layoutInfo = (VkDescriptorSetLayoutCreateInfo){};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 1;
+	layoutInfo.pBindings = &uniforms;
+	if (vkCreateDescriptorSetLayout(descriptors->device, &layoutInfo,
+					nullptr,
+					&descriptors->layouts[VULKAN_SET_FRAME])
+	    != VK_SUCCESS) {
+		return ERR_DESCRIPTOR_SET_CREATION_FAILED;
+	}
+
+	return ERR_OK;
+}
+
+Error vulkanDescriptorsCreateSets(VulkanDescriptors *descriptors)
+{
+	VkDescriptorPoolSize poolSizes[3] = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = descriptors->textures.capacity;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[1].descriptorCount = descriptors->buffers.capacity;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[2].descriptorCount = 1;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	poolInfo.maxSets = VULKAN_SET_COUNT;
+	poolInfo.poolSizeCount = 3;
+	poolInfo.pPoolSizes = poolSizes;
+	if (vkCreateDescriptorPool(descriptors->device, &poolInfo, nullptr,
+				   &descriptors->pool)
+	    != VK_SUCCESS) {
+		return ERR_DESCRIPTOR_SET_CREATION_FAILED;
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = descriptors->pool;
+	allocInfo.descriptorSetCount = VULKAN_SET_COUNT;
+	allocInfo.pSetLayouts = descriptors->layouts;
+	if (vkAllocateDescriptorSets(descriptors->device, &allocInfo,
+				     descriptors->sets)
+	    != VK_SUCCESS) {
+		return ERR_DESCRIPTOR_SET_CREATION_FAILED;
+	}
+
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = descriptors->uniforms.buffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = VULKAN_UNIFORM_RANGE;
+
+	VkWriteDescriptorSet write = {};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = descriptors->sets[VULKAN_SET_FRAME];
+	write.dstBinding = VULKAN_BINDING_UNIFORMS;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	write.pBufferInfo = &bufferInfo;
+	vkUpdateDescriptorSets(descriptors->device, 1, &write, 0, nullptr);
+
+	return ERR_OK;
+}
+
+Error vulkanDescriptorsInit(VulkanDescriptors *descriptors, VkDevice device,
+			    VkPhysicalDevice physicalDevice,
+			    uint32_t frameCount)
+{
+	*descriptors = (VulkanDescriptors){
+		.device = device,
+		.frameCount = frameCount,
+	};
+
+	VkPhysicalDeviceVulkan12Properties properties12 = {};
+	properties12.sType =
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+	VkPhysicalDeviceProperties2 properties = {};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &properties12;
+	vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+	uint32_t maxTextures =
+		properties12.maxPerStageDescriptorUpdateAfterBindSampledImages;
+	if (properties12.maxPerStageDescriptorUpdateAfterBindSamplers
+	    < maxTextures) {
+		maxTextures = properties12
+			.maxPerStageDescriptorUpdateAfterBindSamplers;
+	}
+	uint32_t maxBuffers =
+		properties12.maxPerStageDescriptorUpdateAfterBindStorageBuffers;
+	descriptors->textures.capacity = VULKAN_BINDLESS_TEXTURES < maxTextures
+		? VULKAN_BINDLESS_TEXTURES
+		: maxTextures;
+	descriptors->buffers.capacity = VULKAN_BINDLESS_BUFFERS < maxBuffers
+		? VULKAN_BINDLESS_BUFFERS
+		: maxBuffers;
+
+	descriptors->uniformAlignment =
+		properties.properties.limits.minUniformBufferOffsetAlignment;
+
+	Error e = vulkanCreateBuffer(VULKAN_UNIFORM_RING_SIZE * frameCount,
+				     VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+				     | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				     &descriptors->uniforms);
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	e = vulkanDescriptorsCreateLayouts(descriptors);
+	if (e != ERR_OK) {
+		return e;
+	}
+
+	return vulkanDescriptorsCreateSets(descriptors);
+}
+
+/* Reuse the slots retired long enough ago, and reset the uniform region of
+ * `frameIndex`, whose fence was waited on. */
+void vulkanDescriptorsBeginFrame(VulkanDescriptors *descriptors,
+				 uint32_t frameIndex, uint64_t frame)
+{
+	descriptors->frameIndex = frameIndex;
+	descriptors->frame = frame;
+	descriptors->uniformHead = 0;
+
+	VulkanSlots *slots[] = {&descriptors->textures, &descriptors->buffers};
+	for (size_t i = 0; i < 2; i++) {
+		ptrdiff_t reused = 0;
+		while (reused < arrlen(slots[i]->retired)
+		       && slots[i]->retired[reused].frame
+				  + descriptors->frameCount
+			  <= frame) {
+			arrput(slots[i]->free, slots[i]->retired[reused].index);
+			reused++;
+		}
+		if (reused > 0) {
+			arrdeln(slots[i]->retired, 0, reused);
+		}
+	}
+}
+
+bool vulkanSlotsTake(VulkanSlots *slots, uint32_t *indexOut)
+{
+	if (arrlen(slots->free) > 0) {
+		*indexOut = arrpop(slots->free);
+		return true;
+	}
+	if (slots->next == slots->capacity) {
+		return false;
+	}
+	*indexOut = slots->next++;
+	return true;
+}
+
+/* Add a texture to the bindless set, in the layout
+ * VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL when sampled. */
+Error vulkanDescriptorsAddTexture(VulkanDescriptors *descriptors,
+				  VkImageView view, VkSampler sampler,
+				  uint32_t *indexOut)
+{
+	uint32_t index = 0;
+	if (!vulkanSlotsTake(&descriptors->textures, &index)) {
+		return ERR_OUT_OF_MEMORY;
+	}
+
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.sampler = sampler;
+	imageInfo.imageView = view;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet write = {};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = descriptors->sets[VULKAN_SET_BINDLESS];
+	write.dstBinding = VULKAN_BINDING_TEXTURES;
+	write.dstArrayElement = index;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.pImageInfo = &imageInfo;
+	vkUpdateDescriptorSets(descriptors->device, 1, &write, 0, nullptr);
+
+	*indexOut = index;
+	return ERR_OK;
+}
+
+/* Add a storage buffer range to the bindless set. The buffer must stay in
+ * place: buffers without VK_BUFFER_USAGE_TRANSFER_SRC_BIT are never
+ * defragmented. */
+Error vulkanDescriptorsAddBuffer(VulkanDescriptors *descriptors,
+				 VkBuffer buffer, VkDeviceSize offset,
+				 VkDeviceSize range, uint32_t *indexOut)
+{
+	uint32_t index = 0;
+	if (!vulkanSlotsTake(&descriptors->buffers, &index)) {
+		return ERR_OUT_OF_MEMORY;
+	}
+
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = buffer;
+	bufferInfo.offset = offset;
+	bufferInfo.range = range;
+
+	VkWriteDescriptorSet write = {};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = descriptors->sets[VULKAN_SET_BINDLESS];
+	write.dstBinding = VULKAN_BINDING_BUFFERS;
+	write.dstArrayElement = index;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write.pBufferInfo = &bufferInfo;
+	vkUpdateDescriptorSets(descriptors->device, 1, &write, 0, nullptr);
+
+	*indexOut = index;
+	return ERR_OK;
+}
+
+/* The texture may be destroyed once the frames in flight are done. */
+void vulkanDescriptorsRemoveTexture(VulkanDescriptors *descriptors,
+				    uint32_t index)
+{
+	VulkanRetiredSlot retired = {index, descriptors->frame};
+	arrput(descriptors->textures.retired, retired);
+}
+
+/* The buffer may be destroyed once the frames in flight are done. */
+void vulkanDescriptorsRemoveBuffer(VulkanDescriptors *descriptors,
+				   uint32_t index)
+{
+	VulkanRetiredSlot retired = {index, descriptors->frame};
+	arrput(descriptors->buffers.retired, retired);
+}
+
+/* Copy up to VULKAN_UNIFORM_RANGE bytes of constants to the current frame's
+ * region, returning the dynamic offset of VULKAN_BINDING_UNIFORMS to read
+ * them at. */
+Error vulkanDescriptorsPushUniforms(VulkanDescriptors *descriptors,
+				    const void *data, VkDeviceSize size,
+				    uint32_t *offsetOut)
+{
+	VkDeviceSize alignment = descriptors->uniformAlignment;
+	VkDeviceSize head = (descriptors->uniformHead + alignment - 1)
+		/ alignment * alignment;
+	/* The whole range is bound, so it has to fit in the region. */
+	if (size > VULKAN_UNIFORM_RANGE
+	    || head + VULKAN_UNIFORM_RANGE > VULKAN_UNIFORM_RING_SIZE) {
+		return ERR_BUFFER_UPLOAD_FAILED;
+	}
+
+	VkDeviceSize offset =
+		descriptors->frameIndex * VULKAN_UNIFORM_RING_SIZE + head;
+	memcpy(descriptors->uniforms.allocation->mapped + offset, data,
+	       (size_t)size);
+	descriptors->uniformHead = head + size;
+
+	*offsetOut = (uint32_t)offset;
+	return ERR_OK;
+}
+
+void vulkanDescriptorsFree(VulkanDescriptors *descriptors)
+{
+	vkDestroyDescriptorPool(descriptors->device, descriptors->pool,
+				nullptr);
+	for (uint32_t i = 0; i < VULKAN_SET_COUNT; i++) {
+		vkDestroyDescriptorSetLayout(descriptors->device,
+					     descriptors->layouts[i], nullptr);
+	}
+	if (descriptors->uniforms.buffer != VK_NULL_HANDLE) {
+		vulkanDestroyBuffer(&descriptors->uniforms);
+	}
+	arrfree(descriptors->textures.free);
+	arrfree(descriptors->textures.retired);
+	arrfree(descriptors->buffers.free);
+	arrfree(descriptors->buffers.retired);
+	*descriptors = (VulkanDescriptors){};
+}
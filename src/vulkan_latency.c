@@ -0,0 +1,172 @@
+/* Vulkan latency - Measure the time from submitting frames to presenting them
+ *
+ * OVERVIEW: - Frames are identified by the timeline semaphore value their
+ *   submission signals, which is also their present id.
+ *
+ * - With VK_KHR_present_wait, a frame is done once presented. Otherwise it is
+ *   done once the GPU finished it, which only bounds its latency from below.
+ *
+ * - Pending frames are polled without waiting at the start of the next
+ *   frames, so latencies are rounded up to when a frame starts.
+ *
+ * - Statistics cover the last VULKAN_LATENCY_FRAMES frames measured. Frames
+ *   still pending when VULKAN_LATENCY_PENDING more are submitted, or when
+ *   the swapchain is recreated, are not measured.
+ *
+ * USAGE:
+ * - VulkanLatency latency;
+ * - vulkanLatencyInit(&latency, device, timeline, hasPresentWait);
+ * - vulkanLatencySetSwapchain(&latency, swapChain);
+ * - // Every frame
+ * - vulkanLatencyPoll(&latency, glfwGetTime());
+ * - vulkanLatencySubmitted(&latency, timelineValue, glfwGetTime());
+ * - VulkanLatencyStats stats;
+ * - if (vulkanLatencyStats(&latency, &stats)) print(stats);
+ */
+#pragma once
+
+#include <stdint.h>
+
+#define GLFW_INCLUDE_VULKAN
+#include "GLFW/glfw3.h"
+#include "common.h"
+
+enum : uint32_t {
+	VULKAN_LATENCY_FRAMES = 128,
+	VULKAN_LATENCY_PENDING = 8,
+};
+
+typedef struct VulkanLatencyFrame {
+	uint64_t id;
+	double submitted;	/* Seconds */
+} VulkanLatencyFrame;
+
+typedef struct VulkanLatencyStats {
+	float averageMs;
+	float minMs;
+	float maxMs;
+	uint32_t frameCount;
+} VulkanLatencyStats;
+
+typedef struct VulkanLatency {
+	VkDevice device;
+	VkSemaphore timeline;
+	VkSwapchainKHR swapchain;
+	/* Null without VK_KHR_present_wait. */
+	PFN_vkWaitForPresentKHR waitForPresent;
+	/* Ring of frames submitted, oldest first */
+	VulkanLatencyFrame pending[VULKAN_LATENCY_PENDING];
+	uint32_t oldest;
+	uint32_t pendingCount;
+	/* Ring of the last latencies measured */
+	float samplesMs[VULKAN_LATENCY_FRAMES];
+	uint32_t nextSample;
+	uint32_t sampleCount;
+} VulkanLatency;
+
+void vulkanLatencyInit(VulkanLatency *latency, VkDevice device,
+		       VkSemaphore timeline, bool presentWait)
+{
+	*latency = (VulkanLatency){
+		.device = device,
+		.timeline = timeline,
+	};
+	if (presentWait) {
+		latency->waitForPresent = (PFN_vkWaitForPresentKHR)
+			vkGetDeviceProcAddr(device, "vkWaitForPresentKHR");
+	}
+}
+
+/* Frames presented to the previous swapchain are dropped. */
+void vulkanLatencySetSwapchain(VulkanLatency *latency, VkSwapchainKHR swapchain)
+{
+	latency->swapchain = swapchain;
+	latency->pendingCount = 0;
+}
+
+void vulkanLatencySubmitted(VulkanLatency *latency, uint64_t id,
+			    double submitted)
+{
+	if (latency->pendingCount == VULKAN_LATENCY_PENDING) {
+		latency->oldest = (latency->oldest + 1) % VULKAN_LATENCY_PENDING;
+		latency->pendingCount--;
+	}
+
+	uint32_t index = (latency->oldest + latency->pendingCount)
+		% VULKAN_LATENCY_PENDING;
+	latency->pending[index] = (VulkanLatencyFrame){id, submitted};
+	latency->pendingCount++;
+}
+
+bool vulkanLatencyIsDone(VulkanLatency *latency, uint64_t id,
+			 uint64_t completed)
+{
+	if (!latency->waitForPresent) {
+		return id <= completed;
+	}
+
+	VkResult result = latency->waitForPresent(latency->device,
+						  latency->swapchain, id, 0);
+	if (result == VK_TIMEOUT) {
+		return false;
+	}
+	if (result != VK_SUCCESS) {
+		/* Out of date, so nothing pending will be presented. */
+		latency->pendingCount = 0;
+		return false;
+	}
+	return true;
+}
+
+/* Measure the frames done by `now`. */
+void vulkanLatencyPoll(VulkanLatency *latency, double now)
+{
+	uint64_t completed = 0;
+	if (!latency->waitForPresent) {
+		vkGetSemaphoreCounterValue(latency->device, latency->timeline,
+					   &completed);
+	}
+
+	while (latency->pendingCount > 0) {
+		const VulkanLatencyFrame *frame =
+			&latency->pending[latency->oldest];
+		if (!vulkanLatencyIsDone(latency, frame->id, completed)) {
+			break;
+		}
+
+		latency->samplesMs[latency->nextSample] =
+			(float)((now - frame->submitted) * 1000.0);
+		latency->nextSample =
+			(latency->nextSample + 1) % VULKAN_LATENCY_FRAMES;
+		if (latency->sampleCount < VULKAN_LATENCY_FRAMES) {
+			latency->sampleCount++;
+		}
+
+		latency->oldest = (latency->oldest + 1) % VULKAN_LATENCY_PENDING;
+		latency->pendingCount--;
+	}
+}
+
+/* False if no frame was measured yet. */
+bool vulkanLatencyStats(const VulkanLatency *latency,
+			VulkanLatencyStats *stats)
+{
+	if (latency->sampleCount == 0) {
+		return false;
+	}
+
+	float sum = 0.0f;
+	*stats = (VulkanLatencyStats){
+		.minMs = latency->samplesMs[0],
+		.maxMs = latency->samplesMs[0],
+		.frameCount = latency->sampleCount,
+	};
+	for (uint32_t i = 0; i < latency->sampleCount; i++) {
+		float sample = latency->samplesMs[i];
+		sum += sample;
+		stats->minMs = sample < stats->minMs ? sample : stats->minMs;
+		stats->maxMs = sample > stats->maxMs ? sample : stats->maxMs;
+	}
+	stats->averageMs = sum / (float)latency->sampleCount;
+	return true;
+}
@@ -0,0 +1,724 @@
+/* Vulkan memory - Suballocate resources from large device memory blocks
+ *
+ * OVERVIEW: - Device memory is allocated in blocks of VULKAN_BLOCK_SIZE per
+ *   memory type, and resources get power-of-two ranges of them from a buddy
+ *   allocator, from VULKAN_MIN_ALLOCATION bytes up. Ranges are aligned to
+ *   their size, which covers any alignment up to it. Resources larger than a
+ *   block get a dedicated allocation.
+ *
+ * - Buffers and optimally tiled images never share a block, so
+ *   bufferImageGranularity never applies between neighbours.
+ *
+ * - New blocks stay within the heap's budget, from VK_EXT_memory_budget when
+ *   the device has it, or 80% of the heap otherwise. Blocks shrink down to
+ *   the size requested to fit. `vulkanMemoryReport()` prints every heap's
+ *   usage. Host-visible blocks are persistently mapped. Blocks left empty
+ *   are freed, but for one per memory type and kind, kept for the next
+ *   allocations.
+ *
+ * - Defragmentation is incremental. `vulkanMemoryDefragmentBegin()` picks a
+ *   few allocations of the emptiest block of a memory type and reserves room
+ *   for them in fuller blocks. The caller creates resources there, copies
+ *   the data over, and once the GPU is done with the old ranges,
+ *   `vulkanMemoryDefragmentEnd()` moves the allocations, freeing blocks left
+ *   empty. Only allocations marked movable move, which host-visible ones never
+ *   are, their mapping being in use.
+ *
+ * USAGE:
+ * - vulkanMemoryInit(device, physicalDevice, hasMemoryBudget);
+ * - VulkanBuffer buffer;
+ * - vulkanCreateBuffer(size,
+ * -	VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+ * -	VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffer);
+ * - vulkanDestroyBuffer(&buffer);
+ * - VulkanImage image;
+ * - vulkanCreateImage(&imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+ * -	&image);
+ * - vulkanDestroyImage(&image);
+ * - vulkanMemoryFree();
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define GLFW_INCLUDE_VULKAN
+#include "GLFW/glfw3.h"
+#include "common.h"
+#include "stb_ds.h"
+
+enum : VkDeviceSize {
+	VULKAN_BLOCK_SIZE = 64 << 20,
+	VULKAN_MIN_ALLOCATION = 256,
+};
+
+enum : uint32_t {
+	/* Orders from VULKAN_MIN_ALLOCATION to VULKAN_BLOCK_SIZE */
+	VULKAN_BUDDY_ORDERS = 19,
+};
+
+typedef enum VulkanResourceKind : int {
+	VULKAN_RESOURCE_LINEAR = 0,	/* Buffers and linear images */
+	VULKAN_RESOURCE_OPTIMAL,	/* Optimally tiled images */
+	VULKAN_RESOURCE_LAST,
+} VulkanResourceKind;
+
+typedef struct VulkanFreeRange {
+	VkDeviceSize key;	/* Offset */
+	bool value;
+} VulkanFreeRange;
+
+typedef struct VulkanMemoryBlock {
+	VkDeviceMemory memory;
+	VkDeviceSize size;	/* A power of two unless dedicated */
+	uint32_t memoryType;
+	VulkanResourceKind kind;
+	bool dedicated;
+	uint8_t *mapped;	/* If host-visible */
+	VkDeviceSize used;
+	/* stb_ds.h hashmaps of the free ranges of each order */
+	VulkanFreeRange *free[VULKAN_BUDDY_ORDERS];
+	struct VulkanAllocation **allocations;	/* stb_ds.h array */
+} VulkanMemoryBlock;
+
+typedef struct VulkanAllocation {
+	VulkanMemoryBlock *block;
+	VkDeviceSize offset;
+	VkDeviceSize size;	/* Of the range */
+	uint32_t order;
+	uint8_t *mapped;	/* If host-visible */
+	bool movable;		/* By defragmentation */
+	void *user;		/* For the caller to find moved allocations */
+	ptrdiff_t index;	/* In the block's allocations */
+} VulkanAllocation;
+
+/* An allocation to copy to `offset` in `block`. */
+typedef struct VulkanMove {
+	VulkanAllocation *allocation;
+	VulkanMemoryBlock *block;
+	VkDeviceSize offset;
+} VulkanMove;
+
+typedef struct VulkanBuffer {
+	VkBuffer buffer;
+	VulkanAllocation *allocation;
+	VkDeviceSize size;
+	VkBufferUsageFlags usage;
+} VulkanBuffer;
+
+typedef struct VulkanImage {
+	VkImage image;
+	VulkanAllocation *allocation;
+} VulkanImage;
+
+struct VulkanMemory {
+	VkDevice device;
+	VkPhysicalDevice physicalDevice;
+	VkPhysicalDeviceMemoryProperties properties;
+	bool hasBudget;
+	/* stb_ds.h arrays */
+	VulkanMemoryBlock **blocks[VK_MAX_MEMORY_TYPES];
+	VkDeviceSize heapBlockBytes[VK_MAX_MEMORY_HEAPS];	/* Our blocks */
+	VkDeviceSize heapUsedBytes[VK_MAX_MEMORY_HEAPS];	/* Our ranges */
+	VkDeviceSize heapBudget[VK_MAX_MEMORY_HEAPS];
+	VkDeviceSize heapUsage[VK_MAX_MEMORY_HEAPS];	/* By the process */
+};
+
+struct VulkanMemory vulkanMemory;
+
+/* Return -1 if there are no suitable memory types. */
+uint32_t vulkanMemoryFindType(uint32_t typeFilter,
+			      VkMemoryPropertyFlags properties)
+{
+	const VkPhysicalDeviceMemoryProperties *memProperties =
+		&vulkanMemory.properties;
+
+	for (uint32_t i = 0; i < memProperties->memoryTypeCount; i++) {
+		if (typeFilter & (1u << i)
+		    && (memProperties->memoryTypes[i].propertyFlags
+			& properties) == properties) {
+			return i;
+		}
+	}
+
+	return (uint32_t)-1;
+}
+
+uint32_t vulkanMemoryHeap(uint32_t memoryType)
+{
+	return vulkanMemory.properties.memoryTypes[memoryType].heapIndex;
+}
+
+/* Refresh every heap's budget and usage. */
+void vulkanMemoryUpdateBudget(void)
+{
+	const VkPhysicalDeviceMemoryProperties *properties =
+		&vulkanMemory.properties;
+
+	if (!vulkanMemory.hasBudget) {
+		for (uint32_t i = 0; i < properties->memoryHeapCount; i++) {
+			vulkanMemory.heapBudget[i] =
+				properties->memoryHeaps[i].size / 10 * 8;
+			vulkanMemory.heapUsage[i] =
+				vulkanMemory.heapBlockBytes[i];
+		}
+		return;
+	}
+
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+	budget.sType =
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+	VkPhysicalDeviceMemoryProperties2 properties2 = {};
+	properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+	properties2.pNext = &budget;
+	vkGetPhysicalDeviceMemoryProperties2(vulkanMemory.physicalDevice,
+					     &properties2);
+
+	for (uint32_t i = 0; i < properties->memoryHeapCount; i++) {
+		vulkanMemory.heapBudget[i] = budget.heapBudget[i];
+		vulkanMemory.heapUsage[i] = budget.heapUsage[i];
+	}
+}
+
+void vulkanMemoryInit(VkDevice device, VkPhysicalDevice physicalDevice,
+		      bool hasBudget)
+{
+	vulkanMemory = (struct VulkanMemory){
+		.device = device,
+		.physicalDevice = physicalDevice,
+		.hasBudget = hasBudget,
+	};
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice,
+					    &vulkanMemory.properties);
+	vulkanMemoryUpdateBudget();
+}
+
+/* Order of the range holding `size` bytes aligned to `alignment`. */
+uint32_t vulkanMemoryOrder(VkDeviceSize size, VkDeviceSize alignment)
+{
+	VkDeviceSize needed = size > alignment ? size : alignment;
+	uint32_t order = 0;
+	while ((VULKAN_MIN_ALLOCATION << order) < needed) {
+		order++;
+	}
+	return order;
+}
+
+uint32_t vulkanBlockMaxOrder(const VulkanMemoryBlock *block)
+{
+	return vulkanMemoryOrder(block->size, 0);
+}
+
+/* Take a free range of `order` from `block`, splitting larger ones. */
+bool vulkanBlockTake(VulkanMemoryBlock *block, uint32_t order,
+		     VkDeviceSize *offsetOut)
+{
+	uint32_t maxOrder = vulkanBlockMaxOrder(block);
+	uint32_t found = order;
+	while (found <= maxOrder && hmlen(block->free[found]) == 0) {
+		found++;
+	}
+	if (found > maxOrder) {
+		return false;
+	}
+
+	VkDeviceSize offset = block->free[found][0].key;
+	(void)hmdel(block->free[found], offset);
+	while (found > order) {
+		found--;
+		hmput(block->free[found],
+		      offset + (VULKAN_MIN_ALLOCATION << found), true);
+	}
+
+	block->used += VULKAN_MIN_ALLOCATION << order;
+	*offsetOut = offset;
+	return true;
+}
+
+/* Give a range back to `block`, merging it with its free buddies. */
+void vulkanBlockGive(VulkanMemoryBlock *block, VkDeviceSize offset,
+		     uint32_t order)
+{
+	block->used -= VULKAN_MIN_ALLOCATION << order;
+
+	uint32_t maxOrder = vulkanBlockMaxOrder(block);
+	while (order < maxOrder) {
+		VkDeviceSize buddy = offset ^ (VULKAN_MIN_ALLOCATION << order);
+		if (hmgeti(block->free[order], buddy) < 0) {
+			break;
+		}
+		(void)hmdel(block->free[order], buddy);
+		offset = offset < buddy ? offset : buddy;
+		order++;
+	}
+	hmput(block->free[order], offset, true);
+}
+
+void vulkanBlockAttach(VulkanMemoryBlock *block, VulkanAllocation *allocation)
+{
+	allocation->block = block;
+	allocation->mapped = block->mapped != nullptr
+		? block->mapped + allocation->offset
+		: nullptr;
+	allocation->index = arrlen(block->allocations);
+	arrput(block->allocations, allocation);
+}
+
+void vulkanBlockDetach(VulkanMemoryBlock *block, VulkanAllocation *allocation)
+{
+	VulkanAllocation *last = arrpop(block->allocations);
+	if (last != allocation) {
+		last->index = allocation->index;
+		block->allocations[allocation->index] = last;
+	}
+}
+
+/* Allocate a block of `size` bytes, within the heap's budget. */
+Error vulkanBlockCreate(uint32_t memoryType, VulkanResourceKind kind,
+			VkDeviceSize size, bool dedicated,
+			VulkanMemoryBlock **blockOut)
+{
+	uint32_t heap = vulkanMemoryHeap(memoryType);
+	vulkanMemoryUpdateBudget();
+	VkDeviceSize usage = vulkanMemory.heapUsage[heap];
+	if (usage + size > vulkanMemory.heapBudget[heap]) {
+		return ERR_OUT_OF_MEMORY;
+	}
+
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryType;
+
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	if (vkAllocateMemory(vulkanMemory.device, &allocInfo, nullptr, &memory)
+	    != VK_SUCCESS) {
+		return ERR_OUT_OF_MEMORY;
+	}
+
+	void *mapped = nullptr;
+	VkMemoryPropertyFlags flags = vulkanMemory.properties
+		.memoryTypes[memoryType].propertyFlags;
+	if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	    && vkMapMemory(vulkanMemory.device, memory, 0, VK_WHOLE_SIZE, 0,
+			   &mapped)
+	    != VK_SUCCESS) {
+		vkFreeMemory(vulkanMemory.device, memory, nullptr);
+		return ERR_OUT_OF_MEMORY;
+	}
+
+	VulkanMemoryBlock *block = calloc(1, sizeof(*block));
+	block->memory = memory;
+	block->size = size;
+	block->memoryType = memoryType;
+	block->kind = kind;
+	block->dedicated = dedicated;
+	block->mapped = mapped;
+	if (!dedicated) {
+		hmput(block->free[vulkanBlockMaxOrder(block)], 0, true);
+	}
+
+	arrput(vulkanMemory.blocks[memoryType], block);
+	vulkanMemory.heapBlockBytes[heap] += size;
+	*blockOut = block;
+	return ERR_OK;
+}
+
+void vulkanBlockDestroy(VulkanMemoryBlock *block)
+{
+	VulkanMemoryBlock **blocks = vulkanMemory.blocks[block->memoryType];
+	for (ptrdiff_t i = 0; i < arrlen(blocks); i++) {
+		if (blocks[i] == block) {
+			arrdel(vulkanMemory.blocks[block->memoryType], i);
+			break;
+		}
+	}
+
+	vulkanMemory.heapBlockBytes[vulkanMemoryHeap(block->memoryType)] -=
+		block->size;
+	vkFreeMemory(vulkanMemory.device, block->memory, nullptr);
+	for (uint32_t i = 0; i < VULKAN_BUDDY_ORDERS; i++) {
+		hmfree(block->free[i]);
+	}
+	arrfree(block->allocations);
+	free(block);
+}
+
+/* Destroy a block left empty, unless it is the only empty block of its
+ * memory type and kind, kept so that freeing and allocating again does not
+ * recreate one each time. */
+void vulkanBlockRelease(VulkanMemoryBlock *block)
+{
+	if (block->used > 0) {
+		return;
+	}
+	if (!block->dedicated) {
+		VulkanMemoryBlock **blocks =
+			vulkanMemory.blocks[block->memoryType];
+		bool spare = false;
+		for (ptrdiff_t i = 0; i < arrlen(blocks) && !spare; i++) {
+			spare = blocks[i] != block && !blocks[i]->dedicated
+				&& blocks[i]->kind == block->kind
+				&& blocks[i]->used == 0;
+		}
+		if (!spare) {
+			return;
+		}
+	}
+	vulkanBlockDestroy(block);
+}
+
+/* Allocate memory of `memoryType` for a resource. */
+Error vulkanMemoryAllocateType(const VkMemoryRequirements *requirements,
+			       uint32_t memoryType, VulkanResourceKind kind,
+			       VulkanAllocation **allocationOut)
+{
+	uint32_t order = vulkanMemoryOrder(requirements->size,
+					   requirements->alignment);
+	VulkanAllocation *allocation = calloc(1, sizeof(*allocation));
+	allocation->order = order;
+	allocation->size = VULKAN_MIN_ALLOCATION << order;
+
+	if (order >= VULKAN_BUDDY_ORDERS) {
+		VulkanMemoryBlock *block = nullptr;
+		allocation->size = requirements->size;
+		Error e = vulkanBlockCreate(memoryType, kind,
+					    requirements->size, true, &block);
+		if (e != ERR_OK) {
+			free(allocation);
+			return e;
+		}
+		block->used = block->size;
+		vulkanBlockAttach(block, allocation);
+		*allocationOut = allocation;
+		return ERR_OK;
+	}
+
+	VulkanMemoryBlock **blocks = vulkanMemory.blocks[memoryType];
+	for (ptrdiff_t i = 0; i < arrlen(blocks); i++) {
+		if (blocks[i]->dedicated || blocks[i]->kind != kind
+		    || !vulkanBlockTake(blocks[i], order,
+					&allocation->offset)) {
+			continue;
+		}
+		vulkanBlockAttach(blocks[i], allocation);
+		*allocationOut = allocation;
+		return ERR_OK;
+	}
+
+	/* Halve new blocks until they fit in the budget. */
+	Error e = ERR_OUT_OF_MEMORY;
+	VulkanMemoryBlock *block = nullptr;
+	for (VkDeviceSize size = VULKAN_BLOCK_SIZE;
+	     size >= allocation->size && e != ERR_OK; size /= 2) {
+		e = vulkanBlockCreate(memoryType, kind, size, false, &block);
+	}
+	if (e != ERR_OK) {
+		free(allocation);
+		return e;
+	}
+
+	(void)vulkanBlockTake(block, order, &allocation->offset);
+	vulkanBlockAttach(block, allocation);
+	*allocationOut = allocation;
+	return ERR_OK;
+}
+
+/* Allocate memory with `properties` for a resource, trying every type that
+ * has them in order. */
+Error vulkanMemoryAllocate(const VkMemoryRequirements *requirements,
+			   VkMemoryPropertyFlags properties,
+			   VulkanResourceKind kind,
+			   VulkanAllocation **allocationOut)
+{
+	Error e = ERR_OUT_OF_MEMORY;
+	uint32_t typeFilter = requirements->memoryTypeBits;
+	while (e != ERR_OK) {
+		uint32_t memoryType = vulkanMemoryFindType(typeFilter,
+							   properties);
+		if (memoryType == (uint32_t)-1) {
+			return ERR_OUT_OF_MEMORY;
+		}
+		e = vulkanMemoryAllocateType(requirements, memoryType, kind,
+					     allocationOut);
+		typeFilter &= ~(1u << memoryType);
+	}
+	return ERR_OK;
+}
+
+void vulkanMemoryDeallocate(VulkanAllocation *allocation)
+{
+	if (allocation == nullptr) {
+		return;
+	}
+
+	VulkanMemoryBlock *block = allocation->block;
+	vulkanBlockDetach(block, allocation);
+	if (block->dedicated) {
+		block->used = 0;
+	} else {
+		vulkanBlockGive(block, allocation->offset, allocation->order);
+	}
+	vulkanBlockRelease(block);
+	free(allocation);
+}
+
+/* Reserve room for up to `maxMoves` allocations of the emptiest block of a
+ * memory type in its other blocks, fullest first. Returns the number of
+ * moves. Every move has to be copied, then ended before the next begins. */
+uint32_t vulkanMemoryDefragmentBegin(VulkanMove *moves, uint32_t maxMoves)
+{
+	for (uint32_t type = 0; type < VK_MAX_MEMORY_TYPES; type++) {
+		VkMemoryPropertyFlags flags =
+			vulkanMemory.properties.memoryTypes[type].propertyFlags;
+		VulkanMemoryBlock **blocks = vulkanMemory.blocks[type];
+		if (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+		    || arrlen(blocks) < 2) {
+			continue;
+		}
+
+		/* The spare empty block has nothing to move. */
+		VulkanMemoryBlock *source = nullptr;
+		for (ptrdiff_t i = 0; i < arrlen(blocks); i++) {
+			if (!blocks[i]->dedicated && blocks[i]->used > 0
+			    && (source == nullptr
+				|| blocks[i]->used < source->used)) {
+				source = blocks[i];
+			}
+		}
+
+		if (source == nullptr) {
+			continue;
+		}
+
+		uint32_t moveCount = 0;
+		for (ptrdiff_t i = 0; i < arrlen(source->allocations)
+		     && moveCount < maxMoves; i++) {
+			VulkanAllocation *allocation = source->allocations[i];
+			if (!allocation->movable) {
+				continue;
+			}
+
+			/* Fullest block with room. */
+			VulkanMemoryBlock *target = nullptr;
+			VkDeviceSize offset = 0;
+			for (ptrdiff_t j = 0; j < arrlen(blocks); j++) {
+				VulkanMemoryBlock *block = blocks[j];
+				if (block == source || block->dedicated
+				    || block->kind != source->kind
+				    || block->used < source->used
+				    || (target != nullptr
+					&& block->used <= target->used)) {
+					continue;
+				}
+				VkDeviceSize taken = 0;
+				if (!vulkanBlockTake(block, allocation->order,
+						     &taken)) {
+					continue;
+				}
+				if (target != nullptr) {
+					vulkanBlockGive(target, offset,
+							allocation->order);
+				}
+				target = block;
+				offset = taken;
+			}
+
+			if (target != nullptr) {
+				moves[moveCount++] = (VulkanMove){
+					allocation, target, offset,
+				};
+			}
+		}
+
+		if (moveCount > 0) {
+			return moveCount;
+		}
+	}
+
+	return 0;
+}
+
+/* Give back the range reserved by a move that will not be made. */
+void vulkanMemoryDefragmentCancel(VulkanMove *move)
+{
+	vulkanBlockGive(move->block, move->offset, move->allocation->order);
+	vulkanBlockRelease(move->block);
+	move->allocation = nullptr;
+}
+
+/* Move allocations to their reserved ranges, once the copies are done and
+ * nothing uses the old ranges anymore. */
+void vulkanMemoryDefragmentEnd(const VulkanMove *moves, uint32_t moveCount)
+{
+	for (uint32_t i = 0; i < moveCount; i++) {
+		VulkanAllocation *allocation = moves[i].allocation;
+		if (allocation == nullptr) {
+			continue;
+		}
+		VulkanMemoryBlock *source = allocation->block;
+
+		vulkanBlockDetach(source, allocation);
+		vulkanBlockGive(source, allocation->offset, allocation->order);
+		allocation->offset = moves[i].offset;
+		vulkanBlockAttach(moves[i].block, allocation);
+		vulkanBlockRelease(source);
+	}
+}
+
+void vulkanMemoryReport(void)
+{
+	vulkanMemoryUpdateBudget();
+
+	const VkPhysicalDeviceMemoryProperties *properties =
+		&vulkanMemory.properties;
+	for (uint32_t heap = 0; heap < properties->memoryHeapCount; heap++) {
+		uint32_t blockCount = 0;
+		uint32_t allocationCount = 0;
+		VkDeviceSize used = 0;
+		for (uint32_t type = 0; type < properties->memoryTypeCount;
+		     type++) {
+			if (properties->memoryTypes[type].heapIndex != heap) {
+				continue;
+			}
+			VulkanMemoryBlock **blocks = vulkanMemory.blocks[type];
+			for (ptrdiff_t i = 0; i < arrlen(blocks); i++) {
+				blockCount++;
+				allocationCount +=
+					(uint32_t)arrlen(blocks[i]->allocations);
+				used += blocks[i]->used;
+			}
+		}
+
+		bool deviceLocal = properties->memoryHeaps[heap].flags
+			& VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+		printf("Heap %u%s: %u allocations, %.1f/%.1f MiB in %u blocks, "
+		       "process usage %.1f MiB, budget %.1f MiB\n",
+		       heap, deviceLocal ? " (device local)" : "",
+		       allocationCount, (double)used / (1 << 20),
+		       (double)vulkanMemory.heapBlockBytes[heap] / (1 << 20),
+		       blockCount,
+		       (double)vulkanMemory.heapUsage[heap] / (1 << 20),
+		       (double)vulkanMemory.heapBudget[heap] / (1 << 20));
+	}
+}
+
+/* Exclusive to one queue family at a time. Buffers that are not host-visible
+ * and have both VK_BUFFER_USAGE_TRANSFER_SRC_BIT and
+ * VK_BUFFER_USAGE_TRANSFER_DST_BIT may be moved by defragmentation. */
+Error vulkanCreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+			 VkMemoryPropertyFlags properties,
+			 VulkanBuffer *bufferOut)
+{
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VulkanBuffer buffer = {.size = size, .usage = usage};
+	if (vkCreateBuffer(vulkanMemory.device, &bufferInfo, nullptr,
+			   &buffer.buffer)
+	    != VK_SUCCESS) {
+		return ERR_BUFFER_CREATION_FAILED;
+	}
+
+	VkMemoryRequirements memRequirements = {};
+	vkGetBufferMemoryRequirements(vulkanMemory.device, buffer.buffer,
+				      &memRequirements);
+
+	if (vulkanMemoryAllocate(&memRequirements, properties,
+				 VULKAN_RESOURCE_LINEAR, &buffer.allocation)
+	    != ERR_OK) {
+		vkDestroyBuffer(vulkanMemory.device, buffer.buffer, nullptr);
+		return ERR_BUFFER_CREATION_FAILED;
+	}
+
+	if (vkBindBufferMemory(vulkanMemory.device, buffer.buffer,
+			       buffer.allocation->block->memory,
+			       buffer.allocation->offset)
+	    != VK_SUCCESS) {
+		vkDestroyBuffer(vulkanMemory.device, buffer.buffer, nullptr);
+		vulkanMemoryDeallocate(buffer.allocation);
+		return ERR_BUFFER_CREATION_FAILED;
+	}
+
+	VkBufferUsageFlags transfer = VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+		| VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	buffer.allocation->movable = buffer.allocation->mapped == nullptr
+		&& (usage & transfer) == transfer;
+
+	*bufferOut = buffer;
+	bufferOut->allocation->user = bufferOut;
+	return ERR_OK;
+}
+
+void vulkanDestroyBuffer(VulkanBuffer *buffer)
+{
+	vkDestroyBuffer(vulkanMemory.device, buffer->buffer, nullptr);
+	vulkanMemoryDeallocate(buffer->allocation);
+	*buffer = (VulkanBuffer){};
+}
+
+/* Never moved by defragmentation. */
+Error vulkanCreateImage(const VkImageCreateInfo *imageInfo,
+			VkMemoryPropertyFlags properties,
+			VulkanImage *imageOut)
+{
+	VulkanImage image = {};
+	if (vkCreateImage(vulkanMemory.device, imageInfo, nullptr,
+			  &image.image)
+	    != VK_SUCCESS) {
+		return ERR_IMAGE_CREATION_FAILED;
+	}
+
+	VkMemoryRequirements memRequirements = {};
+	vkGetImageMemoryRequirements(vulkanMemory.device, image.image,
+				     &memRequirements);
+
+	VulkanResourceKind kind = imageInfo->tiling == VK_IMAGE_TILING_OPTIMAL
+		? VULKAN_RESOURCE_OPTIMAL : VULKAN_RESOURCE_LINEAR;
+	if (vulkanMemoryAllocate(&memRequirements, properties, kind,
+				 &image.allocation)
+	    != ERR_OK) {
+		vkDestroyImage(vulkanMemory.device, image.image, nullptr);
+		return ERR_IMAGE_CREATION_FAILED;
+	}
+
+	if (vkBindImageMemory(vulkanMemory.device, image.image,
+			      image.allocation->block->memory,
+			      image.allocation->offset)
+	    != VK_SUCCESS) {
+		vkDestroyImage(vulkanMemory.device, image.image, nullptr);
+		vulkanMemoryDeallocate(image.allocation);
+		return ERR_IMAGE_CREATION_FAILED;
+	}
+
+	*imageOut = image;
+	return ERR_OK;
+}
+
+void vulkanDestroyImage(VulkanImage *image)
+{
+	vkDestroyImage(vulkanMemory.device, image->image, nullptr);
+	vulkanMemoryDeallocate(image->allocation);
+	*image = (VulkanImage){};
+}
+
+/* Blocks left are leaks, freed all the same. */
+void vulkanMemoryFree(void)
+{
+	for (uint32_t type = 0; type < VK_MAX_MEMORY_TYPES; type++) {
+		while (arrlen(vulkanMemory.blocks[type]) > 0) {
+			VulkanMemoryBlock *block = vulkanMemory.blocks[type][0];
+			for (ptrdiff_t i = 0; i < arrlen(block->allocations);
+			     i++) {
+				free(block->allocations[i]);
+			}
+			vulkanBlockDestroy(block);
+		}
+		arrfree(vulkanMemory.blocks[type]);
+	}
+	vulkanMemory = (struct VulkanMemory){};
+}
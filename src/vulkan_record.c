@@ -0,0 +1,326 @@
+/* Vulkan recording - Record draw lists into secondary command buffers in
+ * parallel
+ *
+ * OVERVIEW: - A pass's draw list is split into slices of at least
+ *   VULKAN_RECORD_MIN_DRAWS draws, one per job system thread at most. Each
+ *   slice is recorded into a secondary command buffer on the job system, and
+ *   the primary command buffer executes them within the render pass.
+ *
+ * - Every slice has its own command pools per frame in flight, so threads
+ *   record without locking. Transient pools are reset whole by
+ *   `vulkanRecordBeginFrame()`, once the frame's fence was waited on.
+ *
+ * - Reusable passes keep their secondary command buffers per frame in flight,
+ *   and only re-record them after `vulkanRecordInvalidate()`, to be called
+ *   whenever anything they reference changes: buffers, pipelines or the
+ *   swapchain extent.
+ *
+ * - Secondary command buffers inherit no state, so the record function binds
+ *   everything its draws need. It runs on any job system thread.
+ *
+ * USAGE:
+ * - VulkanRecorder recorder;
+ * - vulkanRecordInit(&recorder, device, graphicsFamily, MAX_FRAMES_IN_FLIGHT);
+ * - VulkanRecordPass pass = {renderPass, 0, drawCount, recordDraws, nullptr,
+ * -	true};
+ * - vulkanRecordBeginFrame(&recorder, currentFrame);
+ * - vkCmdBeginRenderPass(primary, &renderPassInfo,
+ * -	VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+ * - vulkanRecordExecute(&recorder, primary, &pass);
+ * - vkCmdEndRenderPass(primary);
+ * - vulkanRecordPassFree(&pass);
+ * - vulkanRecordFree(&recorder);
+ */
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#define GLFW_INCLUDE_VULKAN
+#include "GLFW/glfw3.h"
+#include "common.h"
+#include "jobs.c"
+#include "stb_ds.h"
+
+enum : uint32_t {
+	VULKAN_RECORD_MAX_SLICES = JOBS_MAX_WORKERS + 1,
+	/* Fewer draws take longer to hand out than to record. */
+	VULKAN_RECORD_MIN_DRAWS = 64,
+};
+
+/* Record draws [first, first + count) of a pass. */
+typedef void (*VulkanRecordFn)(VkCommandBuffer commands, uint32_t first,
+			       uint32_t count, void *user);
+
+typedef struct VulkanRecordPool {
+	VkCommandPool pool;
+	VkCommandBuffer *buffers;	/* stb_ds.h array */
+	uint32_t used;			/* This frame */
+} VulkanRecordPool;
+
+typedef struct VulkanRecordPass {
+	VkRenderPass renderPass;
+	uint32_t subpass;
+	uint32_t drawCount;
+	VulkanRecordFn record;
+	void *user;
+	bool reusable;
+	/* Reusable recordings, per frame in flight, then per slice */
+	VkCommandBuffer *recorded;	/* stb_ds.h array */
+	uint64_t *generations;		/* stb_ds.h array, 0 if not recorded */
+	uint32_t *sliceCounts;		/* stb_ds.h array */
+} VulkanRecordPass;
+
+typedef struct VulkanRecorder {
+	VkDevice device;
+	uint32_t frameCount;
+	uint32_t sliceCount;
+	uint32_t frame;
+	uint64_t generation;
+	/* Per frame in flight, then per slice */
+	VulkanRecordPool *transientPools;	/* stb_ds.h array */
+	VkCommandPool *reusablePools;		/* stb_ds.h array */
+} VulkanRecorder;
+
+typedef struct VulkanRecordJob {
+	const VulkanRecordPass *pass;
+	const VkCommandBuffer *commands;
+	uint32_t sliceCount;
+	atomic_bool failed;
+} VulkanRecordJob;
+
+Error vulkanRecordInit(VulkanRecorder *recorder, VkDevice device,
+		       uint32_t queueFamily, uint32_t frameCount)
+{
+	uint32_t sliceCount = (uint32_t)jobsWorkerCount() + 1;
+	*recorder = (VulkanRecorder){
+		.device = device,
+		.frameCount = frameCount,
+		.sliceCount = sliceCount < VULKAN_RECORD_MAX_SLICES
+			? sliceCount
+			: VULKAN_RECORD_MAX_SLICES,
+		.generation = 1,
+	};
+
+	uint32_t poolCount = recorder->frameCount * recorder->sliceCount;
+	arrsetlen(recorder->transientPools, poolCount);
+	arrsetlen(recorder->reusablePools, poolCount);
+	memset(recorder->transientPools, 0,
+	       poolCount * sizeof(*recorder->transientPools));
+	memset(recorder->reusablePools, 0,
+	       poolCount * sizeof(*recorder->reusablePools));
+
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = queueFamily;
+	for (uint32_t i = 0; i < poolCount; i++) {
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		if (vkCreateCommandPool(device, &poolInfo, nullptr,
+					&recorder->transientPools[i].pool)
+		    != VK_SUCCESS) {
+			return ERR_COMMAND_POOL_CREATION_FAILED;
+		}
+
+		poolInfo.flags =
+			VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		if (vkCreateCommandPool(device, &poolInfo, nullptr,
+					&recorder->reusablePools[i])
+		    != VK_SUCCESS) {
+			return ERR_COMMAND_POOL_CREATION_FAILED;
+		}
+	}
+
+	return ERR_OK;
+}
+
+/* Reclaim the transient command buffers of `frame`, which the GPU must be
+ * done with. */
+void vulkanRecordBeginFrame(VulkanRecorder *recorder, uint32_t frame)
+{
+	recorder->frame = frame;
+	for (uint32_t slice = 0; slice < recorder->sliceCount; slice++) {
+		VulkanRecordPool *pool = &recorder->transientPools
+			[frame * recorder->sliceCount + slice];
+		if (pool->used > 0) {
+			vkResetCommandPool(recorder->device, pool->pool, 0);
+			pool->used = 0;
+		}
+	}
+}
+
+/* Re-record every reusable pass on its next use. */
+void vulkanRecordInvalidate(VulkanRecorder *recorder)
+{
+	recorder->generation++;
+}
+
+Error vulkanRecordAllocate(VkDevice device, VkCommandPool pool,
+			   VkCommandBuffer *commands)
+{
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = pool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+	allocInfo.commandBufferCount = 1;
+
+	if (vkAllocateCommandBuffers(device, &allocInfo, commands)
+	    != VK_SUCCESS) {
+		return ERR_COMMAND_BUFFER_ALLOCATION_FAILED;
+	}
+
+	return ERR_OK;
+}
+
+void vulkanRecordSlice(int index, void *user)
+{
+	VulkanRecordJob *job = user;
+	const VulkanRecordPass *pass = job->pass;
+	uint32_t slice = (uint32_t)index;
+	uint32_t first = (uint32_t)((uint64_t)pass->drawCount * slice
+				    / job->sliceCount);
+	uint32_t end = (uint32_t)((uint64_t)pass->drawCount * (slice + 1)
+				  / job->sliceCount);
+
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType =
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = pass->renderPass;
+	inheritanceInfo.subpass = pass->subpass;
+	/* Any framebuffer, so reusable recordings survive image changes. */
+	inheritanceInfo.framebuffer = VK_NULL_HANDLE;
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	if (!pass->reusable) {
+		beginInfo.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	}
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	VkCommandBuffer commands = job->commands[slice];
+	if (vkBeginCommandBuffer(commands, &beginInfo) != VK_SUCCESS) {
+		atomic_store(&job->failed, true);
+		return;
+	}
+	pass->record(commands, first, end - first, pass->user);
+	if (vkEndCommandBuffer(commands) != VK_SUCCESS) {
+		atomic_store(&job->failed, true);
+	}
+}
+
+/* Record `pass` unless reusable and still valid, and execute it into
+ * `primary`, within its render pass begun with
+ * VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. */
+Error vulkanRecordExecute(VulkanRecorder *recorder, VkCommandBuffer primary,
+			  VulkanRecordPass *pass)
+{
+	if (pass->drawCount == 0) {
+		return ERR_OK;
+	}
+
+	uint32_t sliceCount = (pass->drawCount + VULKAN_RECORD_MIN_DRAWS - 1)
+		/ VULKAN_RECORD_MIN_DRAWS;
+	if (sliceCount > recorder->sliceCount) {
+		sliceCount = recorder->sliceCount;
+	}
+
+	uint32_t frame = recorder->frame;
+	uint32_t poolIndex = frame * recorder->sliceCount;
+	VkCommandBuffer commands[VULKAN_RECORD_MAX_SLICES] = {};
+
+	if (pass->reusable) {
+		if (arrlen(pass->generations) == 0) {
+			arrsetlen(pass->recorded, recorder->frameCount
+				  * VULKAN_RECORD_MAX_SLICES);
+			arrsetlen(pass->generations, recorder->frameCount);
+			arrsetlen(pass->sliceCounts, recorder->frameCount);
+			memset(pass->recorded, 0, arrlen(pass->recorded)
+			       * sizeof(*pass->recorded));
+			memset(pass->generations, 0, arrlen(pass->generations)
+			       * sizeof(*pass->generations));
+		}
+
+		VkCommandBuffer *recorded =
+			&pass->recorded[frame * VULKAN_RECORD_MAX_SLICES];
+		if (pass->generations[frame] == recorder->generation
+		    && pass->sliceCounts[frame] == sliceCount) {
+			vkCmdExecuteCommands(primary, sliceCount, recorded);
+			return ERR_OK;
+		}
+
+		for (uint32_t slice = 0; slice < sliceCount; slice++) {
+			if (recorded[slice] == VK_NULL_HANDLE) {
+				Error e = vulkanRecordAllocate(
+					recorder->device,
+					recorder->reusablePools[poolIndex
+								+ slice],
+					&recorded[slice]);
+				if (e != ERR_OK) {
+					return e;
+				}
+			}
+			commands[slice] = recorded[slice];
+		}
+	} else {
+		for (uint32_t slice = 0; slice < sliceCount; slice++) {
+			VulkanRecordPool *pool =
+				&recorder->transientPools[poolIndex + slice];
+			if (pool->used == arrlen(pool->buffers)) {
+				VkCommandBuffer buffer = VK_NULL_HANDLE;
+				Error e = vulkanRecordAllocate(recorder->device,
+							       pool->pool,
+							       &buffer);
+				if (e != ERR_OK) {
+					return e;
+				}
+				arrput(pool->buffers, buffer);
+			}
+			commands[slice] = pool->buffers[pool->used++];
+		}
+	}
+
+	VulkanRecordJob job = {
+		.pass = pass,
+		.commands = commands,
+		.sliceCount = sliceCount,
+	};
+	jobsParallelFor((int)sliceCount, vulkanRecordSlice, &job);
+
+	if (pass->reusable) {
+		pass->generations[frame] = atomic_load(&job.failed)
+			? 0
+			: recorder->generation;
+		pass->sliceCounts[frame] = sliceCount;
+	}
+	if (atomic_load(&job.failed)) {
+		return ERR_COMMAND_BUFFER_RECORDING_FAILED;
+	}
+
+	vkCmdExecuteCommands(primary, sliceCount, commands);
+	return ERR_OK;
+}
+
+/* Its command buffers are freed with the recorder's pools. */
+void vulkanRecordPassFree(VulkanRecordPass *pass)
+{
+	arrfree(pass->recorded);
+	arrfree(pass->generations);
+	arrfree(pass->sliceCounts);
+}
+
+void vulkanRecordFree(VulkanRecorder *recorder)
+{
+	for (ptrdiff_t i = 0; i < arrlen(recorder->transientPools); i++) {
+		vkDestroyCommandPool(recorder->device,
+				     recorder->transientPools[i].pool, nullptr);
+		arrfree(recorder->transientPools[i].buffers);
+	}
+	for (ptrdiff_t i = 0; i < arrlen(recorder->reusablePools); i++) {
+		vkDestroyCommandPool(recorder->device,
+				     recorder->reusablePools[i], nullptr);
+	}
+	arrfree(recorder->transientPools);
+	arrfree(recorder->reusablePools);
+	*recorder = (VulkanRecorder){};
+}
@@ -0,0 +1,424 @@
+/* Vulkan staging - Fill device-local buffers through a staging ring
+ *
+ * OVERVIEW: - Data is copied into a host-visible ring buffer, then into its
+ *   destination by copy commands. Copies are recorded into the current batch,
+ *   one command buffer, until `vulkanStagingFlush()` submits it. Ring space is
+ *   reclaimed as batches complete, only waiting on the oldest one when the
+ *   ring or the VULKAN_STAGING_BATCHES batches run out. Uploads larger than
+ *   the ring go through it in several batches.
+ *
+ * - With a dedicated transfer queue family, batches are submitted to the
+ *   transfer queue, which releases the written ranges to the graphics queue
+ *   family. A command buffer acquiring them is then submitted to the graphics
+ *   queue, waiting for the copies with a semaphore. Otherwise copies are
+ *   submitted to the graphics queue, followed by a barrier. Either way,
+ *   graphics queue copies read the written ranges safely, defragmentation
+ *   moving the buffers being one.
+ *
+ * - Destination buffers need VK_BUFFER_USAGE_TRANSFER_DST_BIT and the
+ *   exclusive sharing mode, and the ranges written must not be in use by the
+ *   GPU. Graphics submissions made after the flush see the data.
+ *
+ * USAGE:
+ * - VulkanStaging staging;
+ * - vulkanStagingInit(&staging, &desc);
+ * - vulkanStagingUpload(&staging, buffer, 0, vertices, sizeof(vertices),
+ * -	VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+ * -	VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+ * - vulkanStagingFlush(&staging);
+ * - vulkanStagingFree(&staging);
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define GLFW_INCLUDE_VULKAN
+#include "GLFW/glfw3.h"
+#include "common.h"
+#include "stb_ds.h"
+#include "vulkan_memory.c"
+
+enum : uint32_t {
+	VULKAN_STAGING_BATCHES = 4,
+	VULKAN_STAGING_ALIGNMENT = 16,
+};
+
+/* Default ring size. */
+enum : VkDeviceSize {
+	VULKAN_STAGING_SIZE = 8 << 20,
+};
+
+typedef struct VulkanStagingDesc {
+	VkDevice device;
+	VkQueue graphicsQueue;
+	uint32_t graphicsFamily;
+	/* The graphics queue and family without a dedicated transfer queue */
+	VkQueue transferQueue;
+	uint32_t transferFamily;
+	VkDeviceSize size;
+} VulkanStagingDesc;
+
+typedef struct VulkanStagingBatch {
+	VkCommandBuffer commands;	/* Transfer queue family */
+	VkCommandBuffer acquire;	/* Graphics family, if different */
+	VkSemaphore copied;		/* From `commands` to `acquire` */
+	VkFence fence;
+	VkBufferMemoryBarrier *barriers;	/* stb_ds.h array */
+	VkPipelineStageFlags stages;	/* Reading the written ranges */
+	VkDeviceSize bytes;		/* Ring space used, padding included */
+	VkDeviceSize end;		/* Ring offset past the batch's data */
+	bool recording;
+	bool pending;
+} VulkanStagingBatch;
+
+typedef struct VulkanStaging {
+	VulkanStagingDesc desc;
+	VulkanBuffer buffer;
+	uint8_t *mapped;		/* Persistently */
+	VkDeviceSize head;		/* Next byte to write */
+	VkDeviceSize tail;		/* First byte in use */
+	VkDeviceSize used;		/* Bytes in use */
+	VkCommandPool transferPool;
+	VkCommandPool graphicsPool;	/* With a dedicated transfer queue */
+	VulkanStagingBatch batches[VULKAN_STAGING_BATCHES];
+	uint32_t current;		/* Recording, or to record next */
+	uint32_t oldest;		/* Pending, or `current` if none is */
+} VulkanStaging;
+
+bool vulkanStagingDedicated(const VulkanStaging *staging)
+{
+	return staging->desc.transferFamily != staging->desc.graphicsFamily;
+}
+
+Error vulkanStagingInit(VulkanStaging *staging, const VulkanStagingDesc *desc)
+{
+	*staging = (VulkanStaging){.desc = *desc};
+	staging->desc.size = desc->size / VULKAN_STAGING_ALIGNMENT
+		* VULKAN_STAGING_ALIGNMENT;
+	VkDevice device = desc->device;
+
+	Error e = vulkanCreateBuffer(staging->desc.size,
+				     VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+				     | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				     &staging->buffer);
+	if (e != ERR_OK) {
+		return e;
+	}
+	staging->mapped = staging->buffer.allocation->mapped;
+
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT
+		| VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = desc->transferFamily;
+	if (vkCreateCommandPool(device, &poolInfo, nullptr,
+				&staging->transferPool)
+	    != VK_SUCCESS) {
+		return ERR_COMMAND_POOL_CREATION_FAILED;
+	}
+
+	VkCommandBuffer commands[VULKAN_STAGING_BATCHES] = {};
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = staging->transferPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = VULKAN_STAGING_BATCHES;
+	if (vkAllocateCommandBuffers(device, &allocInfo, commands)
+	    != VK_SUCCESS) {
+		return ERR_COMMAND_BUFFER_ALLOCATION_FAILED;
+	}
+
+	VkCommandBuffer acquires[VULKAN_STAGING_BATCHES] = {};
+	if (vulkanStagingDedicated(staging)) {
+		poolInfo.queueFamilyIndex = desc->graphicsFamily;
+		if (vkCreateCommandPool(device, &poolInfo, nullptr,
+					&staging->graphicsPool)
+		    != VK_SUCCESS) {
+			return ERR_COMMAND_POOL_CREATION_FAILED;
+		}
+
+		allocInfo.commandPool = staging->graphicsPool;
+		if (vkAllocateCommandBuffers(device, &allocInfo, acquires)
+		    != VK_SUCCESS) {
+			return ERR_COMMAND_BUFFER_ALLOCATION_FAILED;
+		}
+	}
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	for (uint32_t i = 0; i < VULKAN_STAGING_BATCHES; i++) {
+		VulkanStagingBatch *batch = &staging->batches[i];
+		batch->commands = commands[i];
+		batch->acquire = acquires[i];
+		if (vkCreateFence(device, &fenceInfo, nullptr, &batch->fence)
+		    != VK_SUCCESS) {
+			return ERR_SEMAPHORE_CREATION_FAILED;
+		}
+		if (vulkanStagingDedicated(staging)
+		    && vkCreateSemaphore(device, &semaphoreInfo, nullptr,
+					 &batch->copied)
+		    != VK_SUCCESS) {
+			return ERR_SEMAPHORE_CREATION_FAILED;
+		}
+	}
+
+	return ERR_OK;
+}
+
+/* Wait for the oldest pending batch, and reclaim its ring space. */
+void vulkanStagingRetire(VulkanStaging *staging)
+{
+	VkDevice device = staging->desc.device;
+	VulkanStagingBatch *batch = &staging->batches[staging->oldest];
+
+	vkWaitForFences(device, 1, &batch->fence, VK_TRUE, UINT64_MAX);
+	vkResetFences(device, 1, &batch->fence);
+
+	staging->used -= batch->bytes;
+	staging->tail = batch->end;
+	batch->bytes = 0;
+	batch->stages = 0;
+	arrsetlen(batch->barriers, 0);
+	batch->pending = false;
+	staging->oldest = (staging->oldest + 1) % VULKAN_STAGING_BATCHES;
+}
+
+/* Make sure the current batch is recording. */
+Error vulkanStagingBegin(VulkanStaging *staging)
+{
+	VulkanStagingBatch *batch = &staging->batches[staging->current];
+	if (batch->recording) {
+		return ERR_OK;
+	}
+
+	/* Every batch is pending, the current one being the oldest. */
+	if (batch->pending) {
+		vulkanStagingRetire(staging);
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	if (vkBeginCommandBuffer(batch->commands, &beginInfo) != VK_SUCCESS) {
+		return ERR_COMMAND_BUFFER_RECORDING_FAILED;
+	}
+
+	batch->recording = true;
+	batch->end = staging->head;
+	return ERR_OK;
+}
+
+/* Submit the copies recorded so far. */
+Error vulkanStagingFlush(VulkanStaging *staging)
+{
+	VulkanStagingBatch *batch = &staging->batches[staging->current];
+	if (!batch->recording) {
+		return ERR_OK;
+	}
+
+	/* Copies are made visible to their readers, or released to the
+	 * graphics queue family. Releases ignore the destination access, and
+	 * acquires the source access, so the barriers serve both. */
+	bool dedicated = vulkanStagingDedicated(staging);
+	uint32_t barrierCount = (uint32_t)arrlen(batch->barriers);
+	for (uint32_t i = 0; i < barrierCount && dedicated; i++) {
+		batch->barriers[i].srcQueueFamilyIndex =
+			staging->desc.transferFamily;
+		batch->barriers[i].dstQueueFamilyIndex =
+			staging->desc.graphicsFamily;
+	}
+	vkCmdPipelineBarrier(batch->commands, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			     dedicated ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT
+				       : batch->stages,
+			     0, 0, nullptr, barrierCount, batch->barriers, 0,
+			     nullptr);
+	batch->recording = false;
+	if (vkEndCommandBuffer(batch->commands) != VK_SUCCESS) {
+		return ERR_COMMAND_BUFFER_RECORDING_FAILED;
+	}
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch->commands;
+	if (dedicated) {
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &batch->copied;
+	}
+	if (vkQueueSubmit(staging->desc.transferQueue, 1, &submitInfo,
+			  dedicated ? VK_NULL_HANDLE : batch->fence)
+	    != VK_SUCCESS) {
+		return ERR_BUFFER_UPLOAD_FAILED;
+	}
+
+	if (dedicated) {
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if (vkBeginCommandBuffer(batch->acquire, &beginInfo)
+		    != VK_SUCCESS) {
+			return ERR_COMMAND_BUFFER_RECORDING_FAILED;
+		}
+		vkCmdPipelineBarrier(batch->acquire,
+				     VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				     batch->stages, 0, 0, nullptr, barrierCount,
+				     batch->barriers, 0, nullptr);
+		if (vkEndCommandBuffer(batch->acquire) != VK_SUCCESS) {
+			return ERR_COMMAND_BUFFER_RECORDING_FAILED;
+		}
+
+		VkPipelineStageFlags waitStage = batch->stages;
+		VkSubmitInfo acquireInfo = {};
+		acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		acquireInfo.waitSemaphoreCount = 1;
+		acquireInfo.pWaitSemaphores = &batch->copied;
+		acquireInfo.pWaitDstStageMask = &waitStage;
+		acquireInfo.commandBufferCount = 1;
+		acquireInfo.pCommandBuffers = &batch->acquire;
+		if (vkQueueSubmit(staging->desc.graphicsQueue, 1, &acquireInfo,
+				  batch->fence)
+		    != VK_SUCCESS) {
+			return ERR_BUFFER_UPLOAD_FAILED;
+		}
+	}
+
+	batch->pending = true;
+	staging->current = (staging->current + 1) % VULKAN_STAGING_BATCHES;
+	return ERR_OK;
+}
+
+/* Reserve `size` contiguous ring bytes for the current batch, which is
+ * recording on return. */
+Error vulkanStagingReserve(VulkanStaging *staging, VkDeviceSize size,
+			   VkDeviceSize *offsetOut)
+{
+	VkDeviceSize ringSize = staging->desc.size;
+	size = (size + VULKAN_STAGING_ALIGNMENT - 1) / VULKAN_STAGING_ALIGNMENT
+		* VULKAN_STAGING_ALIGNMENT;
+
+	for (;;) {
+		Error e = vulkanStagingBegin(staging);
+		if (e != ERR_OK) {
+			return e;
+		}
+		VulkanStagingBatch *batch = &staging->batches[staging->current];
+
+		if (staging->used == 0) {
+			staging->head = 0;
+			staging->tail = 0;
+			batch->end = 0;
+		}
+
+		/* Free space runs from the head to the end of the ring then
+		 * from its start to the tail, or from the head to the tail. */
+		bool full = staging->used == ringSize;
+		bool wrapped = staging->head < staging->tail;
+		if (!full && !wrapped && ringSize - staging->head < size
+		    && staging->tail >= size) {
+			/* Skip the end of the ring. */
+			VkDeviceSize padding = ringSize - staging->head;
+			staging->used += padding;
+			batch->bytes += padding;
+			staging->head = 0;
+			wrapped = true;
+		}
+		VkDeviceSize available = 0;
+		if (!full) {
+			available = wrapped ? staging->tail - staging->head
+					    : ringSize - staging->head;
+		}
+
+		if (available >= size) {
+			*offsetOut = staging->head;
+			staging->head += size;
+			staging->used += size;
+			batch->bytes += size;
+			batch->end = staging->head;
+			return ERR_OK;
+		}
+
+		/* The current batch holds the rest of the ring. */
+		if (!staging->batches[staging->oldest].pending) {
+			e = vulkanStagingFlush(staging);
+			if (e != ERR_OK) {
+				return e;
+			}
+		}
+		vulkanStagingRetire(staging);
+	}
+}
+
+/* Copy `size` bytes of `data` to `buffer` at `offset`, once flushed. `access`
+ * and `stage` are how graphics commands read them. */
+Error vulkanStagingUpload(VulkanStaging *staging, VkBuffer buffer,
+			  VkDeviceSize offset, const void *data,
+			  VkDeviceSize size, VkAccessFlags access,
+			  VkPipelineStageFlags stage)
+{
+	const uint8_t *bytes = data;
+
+	while (size > 0) {
+		VkDeviceSize chunk =
+			size < staging->desc.size ? size : staging->desc.size;
+		VkDeviceSize source = 0;
+		Error e = vulkanStagingReserve(staging, chunk, &source);
+		if (e != ERR_OK) {
+			return e;
+		}
+		memcpy(staging->mapped + source, bytes, (size_t)chunk);
+
+		VulkanStagingBatch *batch = &staging->batches[staging->current];
+		VkBufferCopy region = {};
+		region.srcOffset = source;
+		region.dstOffset = offset;
+		region.size = chunk;
+		vkCmdCopyBuffer(batch->commands, staging->buffer.buffer, buffer, 1,
+				&region);
+
+		VkBufferMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = access | VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = buffer;
+		barrier.offset = offset;
+		barrier.size = chunk;
+		arrput(batch->barriers, barrier);
+		batch->stages |= stage | VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+		bytes += chunk;
+		offset += chunk;
+		size -= chunk;
+	}
+
+	return ERR_OK;
+}
+
+/* Wait for every batch submitted. The current one is dropped. */
+void vulkanStagingFree(VulkanStaging *staging)
+{
+	VkDevice device = staging->desc.device;
+	while (staging->batches[staging->oldest].pending) {
+		vulkanStagingRetire(staging);
+	}
+
+	for (uint32_t i = 0; i < VULKAN_STAGING_BATCHES; i++) {
+		VulkanStagingBatch *batch = &staging->batches[i];
+		vkDestroyFence(device, batch->fence, nullptr);
+		vkDestroySemaphore(device, batch->copied, nullptr);
+		arrfree(batch->barriers);
+	}
+	vkDestroyCommandPool(device, staging->transferPool, nullptr);
+	vkDestroyCommandPool(device, staging->graphicsPool, nullptr);
+	if (staging->buffer.buffer != VK_NULL_HANDLE) {
+		vulkanDestroyBuffer(&staging->buffer);
+	}
+	*staging = (VulkanStaging){};
+}